@@ -508,11 +508,6 @@ static void gfs_adapt_gradient_read (GtsObject ** o, GtsFile * fp)
     a->v = gfs_temporary_variable (GFS_DOMAIN (gfs_object_simulation (a)));
 }
 
-static void update_f (FttCell * cell, GfsAdaptFunction * a)
-{
-  GFS_VALUE (cell, GFS_ADAPT_GRADIENT (a)->v) = gfs_function_value (a->f, cell);
-}
-
 static gboolean gfs_adapt_gradient_event (GfsEvent * event, 
 					  GfsSimulation * sim)
 {
@@ -522,8 +517,7 @@ static gboolean gfs_adapt_gradient_event (GfsEvent * event,
     a->dimension = pow (sim->physical_params.L, a->v->units);
     if (!gfs_function_get_variable (GFS_ADAPT_FUNCTION (event)->f)) {
       gfs_catch_floating_point_exceptions ();
-      gfs_domain_cell_traverse (GFS_DOMAIN (sim), FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
-				(FttCellTraverseFunc) update_f, event);
+      gfs_function_fill (GFS_ADAPT_FUNCTION (event)->f, a->v, FTT_TRAVERSE_LEAFS, -1);
       gfs_restore_fpe_for_function (GFS_ADAPT_FUNCTION (event)->f);
       gfs_domain_cell_traverse (GFS_DOMAIN (sim),
 				FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
@@ -1306,7 +1300,7 @@ gboolean gfs_simulation_adapt (GfsSimulation * simulation)
 
   domain = GFS_DOMAIN (simulation);
 
-  gfs_domain_timer_start (domain, "adapt");
+  gfs_domain_timer_start_id (domain, GFS_TIMER_ADAPT);
 
   GSList * i = simulation->adapts->items;
   while (i) {
@@ -1348,7 +1342,7 @@ gboolean gfs_simulation_adapt (GfsSimulation * simulation)
     }
   }
 
-  gfs_domain_timer_stop (domain, "adapt");
+  gfs_domain_timer_stop_id (domain, GFS_TIMER_ADAPT);
 
   return changed;
 }
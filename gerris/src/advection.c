@@ -46,6 +46,52 @@ static gdouble transverse_term (FttCell * cell,
   return par->dt*vtan*g/(2.*msize[c]);
 }
 
+static void cell_metric_size (FttCell * cell,
+			      const GfsAdvectionParams * par,
+			      gdouble msize[FTT_DIMENSION])
+{
+  gdouble size = ftt_cell_size (cell);
+  FttComponent c;
+
+  if (par->v->domain->scale_metric)
+    for (c = 0; c < FTT_DIMENSION; c++)
+      msize[c] = size*(* par->v->domain->scale_metric) (par->v->domain, cell, c);
+  else
+    for (c = 0; c < FTT_DIMENSION; c++)
+      msize[c] = size;
+}
+
+static void advected_face_values (FttCell * cell,
+				  FttComponent c,
+				  gdouble * msize,
+				  const GfsAdvectionParams * par,
+				  gdouble * left, gdouble * right)
+{
+  GfsStateVector * s = GFS_STATE (cell);
+  gdouble unorm = par->use_centered_velocity ?
+    par->dt*GFS_VALUE (cell, par->u[c])/msize[c] :
+    par->dt*(s->f[2*c].un + s->f[2*c + 1].un)/(2.*msize[c]);
+  gdouble g = (* par->gradient) (cell, c, par->v->i);
+  gdouble vl = GFS_VALUE (cell, par->v) + MIN ((1. - unorm)/2., 0.5)*g;
+  gdouble vr = GFS_VALUE (cell, par->v) + MAX ((- 1. - unorm)/2., -0.5)*g;
+  gdouble src = par->dt*gfs_variable_mac_source (par->v, cell)/2.;
+  gdouble dv;
+
+#if FTT_2D
+  dv = transverse_term (cell, msize, FTT_ORTHOGONAL_COMPONENT (c), par);
+#else  /* FTT_3D */
+  static FttComponent orthogonal[FTT_DIMENSION][2] = {
+    {FTT_Y, FTT_Z}, {FTT_X, FTT_Z}, {FTT_X, FTT_Y}
+  };
+
+  dv =  transverse_term (cell, msize, orthogonal[c][0], par);
+  dv += transverse_term (cell, msize, orthogonal[c][1], par);
+#endif /* FTT_3D */
+
+  *left  = vl + src - dv;
+  *right = vr + src - dv;
+}
+
 /**
  * gfs_cell_advected_face_values:
  * @cell: a #FttCell.
@@ -62,40 +108,37 @@ void gfs_cell_advected_face_values (FttCell * cell,
   g_return_if_fail (par != NULL);
 
   GfsStateVector * s = GFS_STATE (cell);
-  gdouble size = ftt_cell_size (cell), msize[FTT_DIMENSION];
-
+  gdouble msize[FTT_DIMENSION];
   FttComponent c;
-  if (par->v->domain->scale_metric)
-    for (c = 0; c < FTT_DIMENSION; c++)
-      msize[c] = size*(* par->v->domain->scale_metric) (par->v->domain, cell, c);
-  else
-    for (c = 0; c < FTT_DIMENSION; c++)
-      msize[c] = size;
 
-  for (c = 0; c < FTT_DIMENSION; c++) {
-    gdouble unorm = par->use_centered_velocity ?
-      par->dt*GFS_VALUE (cell, par->u[c])/msize[c] :
-      par->dt*(s->f[2*c].un + s->f[2*c + 1].un)/(2.*msize[c]);
-    gdouble g = (* par->gradient) (cell, c, par->v->i);
-    gdouble vl = GFS_VALUE (cell, par->v) + MIN ((1. - unorm)/2., 0.5)*g;
-    gdouble vr = GFS_VALUE (cell, par->v) + MAX ((- 1. - unorm)/2., -0.5)*g;
-    gdouble src = par->dt*gfs_variable_mac_source (par->v, cell)/2.;
-    gdouble dv;
+  cell_metric_size (cell, par, msize);
+  for (c = 0; c < FTT_DIMENSION; c++)
+    advected_face_values (cell, c, msize, par, &s->f[2*c].v, &s->f[2*c + 1].v);
+}
 
-#if FTT_2D
-    dv = transverse_term (cell, msize, FTT_ORTHOGONAL_COMPONENT (c), par);
-#else  /* FTT_3D */
-    static FttComponent orthogonal[FTT_DIMENSION][2] = {
-      {FTT_Y, FTT_Z}, {FTT_X, FTT_Z}, {FTT_X, FTT_Y}
-    };
+/**
+ * gfs_cell_advected_face_value:
+ * @cell: a #FttCell.
+ * @d: a direction.
+ * @par: the advection parameters.
+ *
+ * Returns: the advected value of variable @par->v at time t + dt/2 on
+ * the face of @cell in direction @d, i.e. the value which
+ * gfs_cell_advected_face_values() stores in the face state vector.
+ */
+gdouble gfs_cell_advected_face_value (FttCell * cell,
+				      FttDirection d,
+				      const GfsAdvectionParams * par)
+{
+  g_return_val_if_fail (cell != NULL, 0.);
+  g_return_val_if_fail (d < FTT_NEIGHBORS, 0.);
+  g_return_val_if_fail (par != NULL, 0.);
 
-    dv =  transverse_term (cell, msize, orthogonal[c][0], par);
-    dv += transverse_term (cell, msize, orthogonal[c][1], par);
-#endif /* FTT_3D */
+  gdouble msize[FTT_DIMENSION], v[2];
 
-    s->f[2*c].v     = vl + src - dv;
-    s->f[2*c + 1].v = vr + src - dv;
-  }
+  cell_metric_size (cell, par, msize);
+  advected_face_values (cell, d/2, msize, par, &v[0], &v[1]);
+  return v[d % 2];
 }
 
 /**
@@ -128,12 +171,26 @@ void gfs_cell_non_advected_face_values (FttCell * cell,
   }
 }
 
+/* face value of tracer @i returned by @func */
+typedef struct {
+  GfsFaceValueFunc func;
+  gpointer data;
+  guint i;
+} FaceValues;
+
+/* face value either stored in the face state vector (@fv == NULL)
+   or returned by @fv */
+#define FACE_VALUE(cell, d, fv) ((fv) ?					\
+				 (* (fv)->func) ((FttCell *) (cell), d, (fv)->i, (fv)->data) : \
+				 GFS_STATE (cell)->f[d].v)
+
 #if FTT_2D
 
 static gdouble interpolate_1D1 (const FttCell * cell,
 				FttDirection dright,
 				FttDirection dup,
-				gdouble x)
+				gdouble x,
+				const FaceValues * fv)
 {
   FttCell * n;
   FttDirection dleft;
@@ -146,14 +203,14 @@ static gdouble interpolate_1D1 (const FttCell * cell,
   s = GFS_STATE (cell);
   if (n && !GFS_CELL_IS_BOUNDARY (n)) {
     gdouble s1 = s->solid ? s->solid->s[dleft] : 1., s2;
-    gdouble v1 = s->f[dleft].v, v2;
+    gdouble v1 = FACE_VALUE (cell, dleft, fv), v2;
 
     g_assert (s1 > 0.);
     /* check for corner refinement violation (topology.fig) */
     g_assert (ftt_cell_level (n) == ftt_cell_level (cell));
 
     if (FTT_CELL_IS_LEAF (n)) {
-      v2 = GFS_STATE (n)->f[dleft].v;
+      v2 = FACE_VALUE (n, dleft, fv);
       s2 = GFS_IS_MIXED (n) ? GFS_STATE (n)->solid->s[dleft] : 1.;
     }
     else {
@@ -163,7 +220,7 @@ static gdouble interpolate_1D1 (const FttCell * cell,
       d[1] = FTT_OPPOSITE_DIRECTION (dup);
       n = ftt_cell_child_corner (n, d);
       if (n) {
-	v2 = GFS_STATE (n)->f[dleft].v;
+	v2 = FACE_VALUE (n, dleft, fv);
 	s2 = GFS_IS_MIXED (n) ? GFS_STATE (n)->solid->s[dleft]/2. : 0.5;
       }
       else
@@ -171,7 +228,7 @@ static gdouble interpolate_1D1 (const FttCell * cell,
     }
     return s2 > 0. ? (v2*(s1 - 1. + 2.*x) + v1*(s2 + 1. - 2.*x))/(s1 + s2) : v1;
   }
-  return s->f[dleft].v;
+  return FACE_VALUE (cell, dleft, fv);
 }
 
 #else /* FTT_3D */
@@ -179,7 +236,8 @@ static gdouble interpolate_1D1 (const FttCell * cell,
 static gdouble interpolate_2D1 (const FttCell * cell,
 				FttDirection dright,
 				FttDirection d1, FttDirection d2,
-				gdouble x, gdouble y)
+				gdouble x, gdouble y,
+				const FaceValues * fv)
 {
   FttCell * n1, * n2;
   gdouble x1 = 0., y1 = 1.;
@@ -192,7 +250,7 @@ static gdouble interpolate_2D1 (const FttCell * cell,
      fractions (in contrast to interpolate_1D1 above) */
 
   dleft = FTT_OPPOSITE_DIRECTION (dright);
-  v0 = GFS_STATE (cell)->f[dleft].v;
+  v0 = FACE_VALUE (cell, dleft, fv);
 
   n1 = ftt_cell_neighbor (cell, d1);
   if (n1 && !GFS_CELL_IS_BOUNDARY (n1)) {
@@ -206,7 +264,7 @@ static gdouble interpolate_2D1 (const FttCell * cell,
       d[1] = FTT_OPPOSITE_DIRECTION (d1);
       d[2] = d2;
       if ((n1 = ftt_cell_child_corner (n1, d))) {
-	v1 = GFS_STATE (n1)->f[dleft].v;
+	v1 = FACE_VALUE (n1, dleft, fv);
 	x1 = 1./4.;
 	y1 = 3./4.;
       }
@@ -214,7 +272,7 @@ static gdouble interpolate_2D1 (const FttCell * cell,
 	v1 = v0;
     }
     else
-      v1 = GFS_STATE (n1)->f[dleft].v;
+      v1 = FACE_VALUE (n1, dleft, fv);
   }
   else
     v1 = v0;
@@ -231,7 +289,7 @@ static gdouble interpolate_2D1 (const FttCell * cell,
       d[1] = FTT_OPPOSITE_DIRECTION (d2);
       d[2] = d1;
       if ((n2 = ftt_cell_child_corner (n2, d))) {
-	v2 = GFS_STATE (n2)->f[dleft].v;
+	v2 = FACE_VALUE (n2, dleft, fv);
 	x2 = 3./4.;
 	y2 = 1./4.;
       }
@@ -239,7 +297,7 @@ static gdouble interpolate_2D1 (const FttCell * cell,
 	v2 = v0;
     }
     else
-      v2 = GFS_STATE (n2)->f[dleft].v;
+      v2 = FACE_VALUE (n2, dleft, fv);
   }
   else
     v2 = v0;
@@ -250,54 +308,21 @@ static gdouble interpolate_2D1 (const FttCell * cell,
 
 #endif /* FTT_3D */
 
-/**
- * gfs_face_upwinded_value:
- * @face: a #FttCellFace.
- * @upwinding: type of upwinding.
- * @u: the cell-centered velocity.
- *
- * This function assumes that the face variable has been previously
- * defined using gfs_cell_advected_face_values().
- *
- * Returns: the upwinded value of the face variable.  
- */
-gdouble gfs_face_upwinded_value (const FttCellFace * face,
-				 GfsUpwinding upwinding,
-				 GfsVariable ** u)
+static gdouble upwinded_value (const FttCellFace * face,
+			       FttFaceType type,
+			       gdouble un,
+			       const FaceValues * fv)
 {
-  gdouble un = 0.;
-
-  g_return_val_if_fail (face != NULL, 0.);
-
-  if (GFS_FACE_FRACTION (face) == 0.)
-    return 0.;
-
-  switch (upwinding) {
-  case GFS_CENTERED_UPWINDING:
-    g_return_val_if_fail (u != NULL, 0.);
-    un = gfs_face_interpolated_value (face, u[face->d/2]->i); 
-    break;
-  case GFS_FACE_UPWINDING:
-    un = GFS_FACE_NORMAL_VELOCITY (face); 
-    break;
-  case GFS_NO_UPWINDING:
-    break;
-  default:
-    g_assert_not_reached ();
-  }
-  if (!FTT_FACE_DIRECT (face))
-    un = - un;
-
-  switch (ftt_face_type (face)) {
+  switch (type) {
   case FTT_FINE_FINE:
     return 
-      un > 0. ? GFS_STATE (face->cell)->f[face->d].v :
-      un < 0. ? GFS_STATE (face->neighbor)->f[FTT_OPPOSITE_DIRECTION (face->d)].v :
-      (GFS_STATE (face->cell)->f[face->d].v +
-       GFS_STATE (face->neighbor)->f[FTT_OPPOSITE_DIRECTION (face->d)].v)/2.;
+      un > 0. ? FACE_VALUE (face->cell, face->d, fv) :
+      un < 0. ? FACE_VALUE (face->neighbor, FTT_OPPOSITE_DIRECTION (face->d), fv) :
+      (FACE_VALUE (face->cell, face->d, fv) +
+       FACE_VALUE (face->neighbor, FTT_OPPOSITE_DIRECTION (face->d), fv))/2.;
   case FTT_FINE_COARSE:
     if (un > 0.)
-      return GFS_STATE (face->cell)->f[face->d].v;
+      return FACE_VALUE (face->cell, face->d, fv);
     else {
       gdouble vcoarse;
 #if FTT_2D
@@ -321,15 +346,15 @@ gdouble gfs_face_upwinded_value (const FttCellFace * face,
       dp = perpendicular[face->d][FTT_CELL_ID (face->cell)];
 #if FTT_2D
       g_assert (dp >= 0);
-      vcoarse = interpolate_1D1 (face->neighbor, face->d, dp, 1./4.);
+      vcoarse = interpolate_1D1 (face->neighbor, face->d, dp, 1./4., fv);
 #else  /* FTT_3D */
       g_assert (dp[0] >= 0 && dp[1] >= 0);
       vcoarse = interpolate_2D1 (face->neighbor, face->d,
 				 dp[0], dp[1], 
-				 1./4., 1./4.);
+				 1./4., 1./4., fv);
 #endif /* FTT_3D */
       if (un == 0.)
-	return (GFS_STATE (face->cell)->f[face->d].v + vcoarse)/2.;
+	return (FACE_VALUE (face->cell, face->d, fv) + vcoarse)/2.;
       else
 	return vcoarse;
     }
@@ -339,6 +364,47 @@ gdouble gfs_face_upwinded_value (const FttCellFace * face,
   return 0.;
 }
 
+/**
+ * gfs_face_upwinded_value:
+ * @face: a #FttCellFace.
+ * @upwinding: type of upwinding.
+ * @u: the cell-centered velocity.
+ *
+ * This function assumes that the face variable has been previously
+ * defined using gfs_cell_advected_face_values().
+ *
+ * Returns: the upwinded value of the face variable.  
+ */
+gdouble gfs_face_upwinded_value (const FttCellFace * face,
+				 GfsUpwinding upwinding,
+				 GfsVariable ** u)
+{
+  gdouble un = 0.;
+
+  g_return_val_if_fail (face != NULL, 0.);
+
+  if (GFS_FACE_FRACTION (face) == 0.)
+    return 0.;
+
+  switch (upwinding) {
+  case GFS_CENTERED_UPWINDING:
+    g_return_val_if_fail (u != NULL, 0.);
+    un = gfs_face_interpolated_value (face, u[face->d/2]->i); 
+    break;
+  case GFS_FACE_UPWINDING:
+    un = GFS_FACE_NORMAL_VELOCITY (face); 
+    break;
+  case GFS_NO_UPWINDING:
+    break;
+  default:
+    g_assert_not_reached ();
+  }
+  if (!FTT_FACE_DIRECT (face))
+    un = - un;
+
+  return upwinded_value (face, ftt_face_type (face), un, NULL);
+}
+
 /**
  * gfs_face_advection_flux:
  * @face: a #FttCellFace.
@@ -377,6 +443,64 @@ void gfs_face_advection_flux (const FttCellFace * face,
   }
 }
 
+/**
+ * gfs_face_advection_flux_batch:
+ * @face: a #FttCellFace.
+ * @par: an array of @n advection parameters.
+ * @n: the number of advected variables.
+ * @value: a #GfsFaceValueFunc.
+ * @data: user data to pass to @value.
+ *
+ * Adds to each variable @par[i]->fv, the value of the (conservative)
+ * advection flux through @face of the face values of variable
+ * @par[i]->v returned by @value.
+ *
+ * This is equivalent to calling gfs_face_advection_flux() for each
+ * variable but the geometry of @face is only computed once.
+ */
+void gfs_face_advection_flux_batch (const FttCellFace * face,
+				    GfsAdvectionParams ** par,
+				    guint n,
+				    GfsFaceValueFunc value,
+				    gpointer data)
+{
+  g_return_if_fail (face != NULL);
+  g_return_if_fail (par != NULL);
+  g_return_if_fail (value != NULL);
+
+  if (n == 0)
+    return;
+
+  gdouble un = GFS_FACE_NORMAL_VELOCITY (face);
+  gdouble f = gfs_domain_face_fraction (par[0]->v->domain, face)*un;
+  gdouble size = ftt_cell_size (face->cell);
+  gboolean empty = (GFS_FACE_FRACTION (face) == 0.);
+  FttFaceType type = ftt_face_type (face);
+  FaceValues fv = { value, data, 0 };
+
+  if (!FTT_FACE_DIRECT (face))
+    un = - un;
+  for (fv.i = 0; fv.i < n; fv.i++) {
+    guint i = fv.i;
+    gdouble flux = f*par[i]->dt*(empty ? 0. : upwinded_value (face, type, un, &fv))/size;
+
+    if (!FTT_FACE_DIRECT (face))
+      flux = - flux;
+    GFS_VALUE (face->cell, par[i]->fv) -= flux;
+
+    switch (type) {
+    case FTT_FINE_FINE:
+      GFS_VALUE (face->neighbor, par[i]->fv) += flux;
+      break;
+    case FTT_FINE_COARSE:
+      GFS_VALUE (face->neighbor, par[i]->fv) += flux/FTT_CELLS;
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+  }
+}
+
 /**
  * gfs_face_velocity_advection_flux:
  * @face: a #FttCellFace.
@@ -677,6 +801,7 @@ void gfs_set_merged (GfsDomain * domain)
 
   gfs_domain_traverse_mixed (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS,
 			     (FttCellTraverseFunc) set_merged, NULL);
+  gfs_domain_reset_merged (domain);
 }
 
 static void add_merged (GSList ** merged, FttCell * cell)
@@ -712,16 +837,13 @@ static void add_merged (GSList ** merged, FttCell * cell)
   }
 }
 
-static void traverse_merged (FttCell * cell, gpointer * datum)
+static void build_merged (FttCell * cell, GPtrArray * merged)
 {
   if ((cell->flags & GFS_FLAG_USED) == 0) {
-    GfsMergedTraverseFunc func = (GfsMergedTraverseFunc) datum[0];
-    gpointer data = datum[1];
-    GSList * merged = NULL;
+    GSList * list = NULL;
 
-    add_merged (&merged, cell);
-    (* func) (merged, data);
-    g_slist_free (merged);
+    add_merged (&list, cell);
+    g_ptr_array_add (merged, list);
   }
 }
 
@@ -739,6 +861,39 @@ static void traverse_non_merged (FttCell * cell, gpointer * datum)
   }
 }
 
+/**
+ * gfs_domain_merged:
+ * @domain: a #GfsDomain.
+ *
+ * The lists of merged cells only depend on the mesh and on the solid
+ * boundaries. They are built on the first call and reused until
+ * gfs_domain_reset_merged() is called (this is done by
+ * gfs_set_merged() and gfs_domain_match()).
+ *
+ * Returns: an array of the lists of merged leaf cells containing
+ * the mixed cells of @domain. Leaf cells which do not belong to any
+ * of these lists are not merged.
+ */
+GPtrArray * gfs_domain_merged (GfsDomain * domain)
+{
+  g_return_val_if_fail (domain != NULL, NULL);
+
+  if (domain->merged == NULL) {
+    guint n;
+    domain->merged = g_ptr_array_new ();
+    gfs_domain_traverse_mixed (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS,
+			       (FttCellTraverseFunc) build_merged, domain->merged);
+    for (n = 0; n < domain->merged->len; n++) {
+      GSList * i = domain->merged->pdata[n];
+      while (i) {
+	((FttCell *) i->data)->flags &= ~GFS_FLAG_USED;
+	i = i->next;
+      }
+    }
+  }
+  return domain->merged;
+}
+
 /**
  * gfs_domain_traverse_merged:
  * @domain: the domain to traverse.
@@ -748,24 +903,62 @@ static void traverse_non_merged (FttCell * cell, gpointer * datum)
  * Traverses the merged leaf cells of the domain defined by @domain. A
  * list of merged cells is passed to @func. No cell belongs to more
  * than one merged list.  
+ *
+ * The lists of merged cells are cached (see gfs_domain_merged()).
  */
 void gfs_domain_traverse_merged (GfsDomain * domain,
 				GfsMergedTraverseFunc func,
 				gpointer data)
 {
   gpointer datum[2];
+  guint n;
   
   g_return_if_fail (domain != NULL);
   g_return_if_fail (func != NULL);
 
+  GPtrArray * merged = gfs_domain_merged (domain);
+  for (n = 0; n < merged->len; n++) {
+    GSList * i = merged->pdata[n];
+    while (i) {
+      ((FttCell *) i->data)->flags |= GFS_FLAG_USED;
+      i = i->next;
+    }
+  }
+
+  for (n = 0; n < merged->len; n++)
+    (* func) (merged->pdata[n], data);
+
   datum[0] = func;
   datum[1] = data;
-  gfs_domain_traverse_mixed (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS,
-			    (FttCellTraverseFunc) traverse_merged, datum);
   gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
 			   (FttCellTraverseFunc) traverse_non_merged, datum);
 }
 
+/**
+ * gfs_domain_reset_merged:
+ * @domain: a #GfsDomain.
+ *
+ * Frees the lists of merged cells cached by gfs_domain_merged(). This
+ * must be called whenever the mesh or the solid boundaries of @domain change.
+ *
+ * The @mesh_changes field of @domain is also incremented, so that
+ * other caches of cell pointers can check whether they are still
+ * valid.
+ */
+void gfs_domain_reset_merged (GfsDomain * domain)
+{
+  g_return_if_fail (domain != NULL);
+
+  domain->mesh_changes++;
+  if (domain->merged) {
+    guint n;
+    for (n = 0; n < domain->merged->len; n++)
+      g_slist_free (domain->merged->pdata[n]);
+    g_ptr_array_free (domain->merged, TRUE);
+    domain->merged = NULL;
+  }
+}
+
 /**
  * gfs_advection_update:
  * @merged: a list of merged #FttCell.
@@ -928,6 +1121,8 @@ void gfs_advection_params_write (GfsAdvectionParams * par, FILE * fp)
 #endif
   if (par->linear)
     fputs ("  linear = 1\n", fp);
+  if (par->subcycle)
+    fputs ("  subcycle = 1\n", fp);
   fputc ('}', fp);
 }
 
@@ -949,6 +1144,7 @@ void gfs_advection_params_init (GfsAdvectionParams * par)
   par->update = (GfsMergedTraverseFunc) gfs_advection_update;
   par->moving_order = 1;
   par->linear = FALSE;
+  par->subcycle = FALSE;
   par->diffusion_solve = gfs_diffusion;
 }
 
@@ -988,6 +1184,7 @@ void gfs_advection_params_read (GfsAdvectionParams * par, GtsFile * fp)
     {GTS_OBJ,    "vz",           TRUE, &par->sink[2]},
 #endif /* 3D */
     {GTS_INT,    "linear",       TRUE, &par->linear},
+    {GTS_INT,    "subcycle",     TRUE, &par->subcycle},
     {GTS_NONE}
   };
 
@@ -59,7 +59,7 @@ struct _GfsAdvectionParams {
   GfsMergedTraverseFunc update;
   guint moving_order;
   GfsFunction * sink[FTT_DIMENSION];
-  gboolean linear;
+  gboolean linear, subcycle;
   void (* diffusion_solve) (GfsDomain * domain,
 			    GfsMultilevelParams * par,
 			    GfsVariable * v,
@@ -75,6 +75,9 @@ void         gfs_advection_params_read        (GfsAdvectionParams * par,
 					       GtsFile * fp);
 void         gfs_cell_advected_face_values    (FttCell * cell,
 					       const GfsAdvectionParams * par);
+gdouble      gfs_cell_advected_face_value     (FttCell * cell,
+					       FttDirection d,
+					       const GfsAdvectionParams * par);
 void         gfs_cell_non_advected_face_values (FttCell * cell,
 						const GfsAdvectionParams * par);
 gdouble      gfs_face_upwinded_value          (const FttCellFace * face,
@@ -82,6 +85,15 @@ gdouble      gfs_face_upwinded_value          (const FttCellFace * face,
 					       GfsVariable ** u);
 void         gfs_face_advection_flux          (const FttCellFace * face,
 					       const GfsAdvectionParams * par);
+typedef gdouble (* GfsFaceValueFunc)           (FttCell * cell,
+					       FttDirection d,
+					       guint i,
+					       gpointer data);
+void         gfs_face_advection_flux_batch    (const FttCellFace * face,
+					       GfsAdvectionParams ** par,
+					       guint n,
+					       GfsFaceValueFunc value,
+					       gpointer data);
 void         gfs_face_velocity_advection_flux (const FttCellFace * face,
 					       const GfsAdvectionParams * par);
 void         gfs_face_velocity_convective_flux (const FttCellFace * face,
@@ -96,6 +108,8 @@ void         gfs_set_merged                        (GfsDomain * domain);
 void         gfs_domain_traverse_merged            (GfsDomain * domain,
 						    GfsMergedTraverseFunc func,
 						    gpointer data);
+GPtrArray *  gfs_domain_merged                     (GfsDomain * domain);
+void         gfs_domain_reset_merged               (GfsDomain * domain);
 void         gfs_advection_update                  (GSList * merged, 
 					            const GfsAdvectionParams * par);
 
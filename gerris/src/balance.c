@@ -20,6 +20,10 @@
  * \brief Parallel load-balancing.
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
 #include "balance.h"
 #include "mpi_boundary.h"
 #include "adaptive.h"
@@ -55,9 +59,110 @@ static GArray * neighboring_processors (GfsDomain * domain)
   return pe;
 }
 
-static void count (FttCell * cell, int * n)
+static void cell_work (FttCell * cell, gpointer * data)
+{
+  gdouble * work = data[0];
+  GfsFunction * weight = data[1];
+  *work += weight ? gfs_function_value (weight, cell) : 1.;
+}
+
+/* Sets box->size to the work of @box, i.e. the sum of the weights
+   of its leaf cells */
+static void box_size (GfsBox * box, GfsEventBalance * s)
+{
+  gdouble work = 0.;
+  gpointer data[2];
+  data[0] = &work;
+  data[1] = s->weight;
+  ftt_cell_traverse (box->root, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+		     (FttCellTraverseFunc) cell_work, data);
+  box->size = floor (work + 0.5);
+}
+
+static void box_size_scale (GfsBox * box, gdouble * factor)
+{
+  box->size = floor (box->size*(*factor) + 0.5);
+}
+
+static void box_size_add (GfsBox * box, gdouble * work)
+{
+  *work += box->size;
+}
+
+/* Returns the total time spent in the (outermost) MPI wait timers of
+   the tree rooted in @t, i.e. in blocking communications and
+   reductions */
+static gdouble mpi_wait_time (GfsTimer * t, GfsDomain * domain)
+{
+  if (t->id == GFS_TIMER_MPI_WAIT)
+    return gfs_timer_total (t, domain);
+  gdouble wait = 0.;
+  guint i;
+  for (i = 0; i < t->children->len; i++)
+    wait += mpi_wait_time (t->children->pdata[i], domain);
+  return wait;
+}
+
+/* Starts the measurement of the compute time of this process */
+static void measure_start (GfsDomain * domain, GfsEventBalance * s)
 {
-  (*n)++;
+  s->start = g_timer_elapsed (domain->clock, NULL);
+  s->wait = mpi_wait_time (domain->timers, domain);
+}
+
+/*
+ * Sets the size of each box of @domain to its work and returns the
+ * total work of this process.
+ *
+ * If the cost of each process is measured, the work is multiplied by
+ * the ratio of the cost per unit of work of this process (measured
+ * using the wall-clock time spent outside MPI waits and reductions
+ * since the end of the last balancing) to the average cost per unit
+ * of work. The work is thus always expressed in "average cells".
+ */
+static gdouble domain_work (GfsDomain * domain, GfsEventBalance * s)
+{
+  gdouble work = 0.;
+
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_size, s);
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_size_add, &work);
+
+  if (s->measured) {
+    gdouble now = g_timer_elapsed (domain->clock, NULL);
+    gdouble time = now - s->start - (mpi_wait_time (domain->timers, domain) - s->wait);
+    int valid = (s->start >= 0. && now >= s->start && time > 0. && work > 0.);
+    gfs_all_reduce (domain, valid, MPI_INT, MPI_MIN);
+    if (valid) {
+      gdouble total_work = work, total_time = time;
+      gfs_all_reduce (domain, total_work, MPI_DOUBLE, MPI_SUM);
+      gfs_all_reduce (domain, total_time, MPI_DOUBLE, MPI_SUM);
+      gdouble factor = time/work*total_work/total_time;
+      gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_size_scale, &factor);
+      work = 0.;
+      gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_size_add, &work);
+    }
+  }
+  return work;
+}
+
+/* Fills @size with the statistics of @work over all the processes */
+static void work_stats (GfsDomain * domain, gdouble work, GtsRange * size)
+{
+  int npe;
+  gdouble min = work, max = work, sum = work, sum2 = work*work;
+
+  MPI_Comm_size (MPI_COMM_WORLD, &npe);
+  gfs_all_reduce (domain, min, MPI_DOUBLE, MPI_MIN);
+  gfs_all_reduce (domain, max, MPI_DOUBLE, MPI_MAX);
+  gfs_all_reduce (domain, sum, MPI_DOUBLE, MPI_SUM);
+  gfs_all_reduce (domain, sum2, MPI_DOUBLE, MPI_SUM);
+  gts_range_init (size);
+  size->min = min;
+  size->max = max;
+  size->sum = sum;
+  size->sum2 = sum2;
+  size->n = npe;
+  gts_range_update (size);
 }
 
 #define NITERMAX 100
@@ -71,10 +176,11 @@ typedef struct {
 
 /*
  * Computes the "balancing flow" necessary to balance the domain
- * sizes on all the processes. @average is the average domain size
- * (i.e. the target domain size).
+ * sizes on all the processes. @size is the size of the domain on this
+ * process and @average is the average domain size (i.e. the target
+ * domain size).
  */
-static BalancingFlow * balancing_flow_new (GfsDomain * domain, int average)
+static BalancingFlow * balancing_flow_new (GfsDomain * domain, gdouble size, gdouble average)
 {
   BalancingFlow * b;
 
@@ -84,8 +190,7 @@ static BalancingFlow * balancing_flow_new (GfsDomain * domain, int average)
     g_array_free (pe, TRUE);
     return b;
   }
-  int size = 0, i;
-  gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) count, &size);
+  int i;
   gdouble rsize = size - average;
   gdouble * lambda = g_malloc (sizeof (gdouble)*(pe->len + 1)), lambda1, eps = G_MAXDOUBLE;
   MPI_Request * request = g_malloc (sizeof (MPI_Request)*pe->len);
@@ -143,19 +248,16 @@ static void balancing_flow_destroy (BalancingFlow * b)
   g_free (b);
 }
 
-static void reset_box_size (GfsBox * box)
-{
-  box->size = 0;
-}
-
 typedef struct {
   GfsBox * box;
   gint dest, flow, min, neighboring;
+  gboolean fit;      /* whether to only select boxes which fit in the flow */
+  gboolean smallest; /* whether to select the smallest box */
 } BoxData;
 
 static void select_neighbouring_box (GfsBox * box, BoxData * b)
 {
-  if (box->pid != b->dest) {
+  if (box->pid != b->dest && (!b->fit || box->size <= 2*b->flow)) {
     gint neighboring = 0;
     FttDirection d;
     
@@ -166,22 +268,20 @@ static void select_neighbouring_box (GfsBox * box, BoxData * b)
 	   GFS_BOX (box->neighbor[d])->pid == b->dest))
 	neighboring++;
 
-    if (neighboring && neighboring >= b->neighboring) {
-      if (box->size == 0)
-	ftt_cell_traverse (box->root, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
-			   (FttCellTraverseFunc) count, &box->size);
-      if (neighboring > b->neighboring ||
-	  fabs (box->size - b->flow) < fabs (b->box->size - b->flow)) {
-	b->box = box;
-	b->neighboring = neighboring;
-      }
+    if (neighboring && (b->smallest ?
+			(b->box == NULL || box->size < b->box->size) :
+			(neighboring > b->neighboring ||
+			 (neighboring == b->neighboring &&
+			  fabs (box->size - b->flow) < fabs (b->box->size - b->flow))))) {
+      b->box = box;
+      b->neighboring = neighboring;
     }
   }
 }
 
 static void get_pid (GfsBox * box, GArray * pid)
 {
-  g_assert (box->id > 0 && box->id <= pid->len);
+  g_assert (box->id > 0 && box->id <= pid->len/2);
   g_array_index (pid, guint, box->id - 1) = gfs_box_domain (box)->pid;
 }
 
@@ -191,13 +291,222 @@ static void update_box_pid (GfsBox * box, GArray * pid)
   for (d = 0; d < FTT_NEIGHBORS; d++)
     if (GFS_IS_BOUNDARY_MPI (box->neighbor[d])) {
       guint id = GFS_BOUNDARY_MPI (box->neighbor[d])->id;
-      g_assert (id > 0 && id <= pid->len);
+      g_assert (id > 0 && id <= pid->len/2);
       GFS_BOUNDARY_MPI (box->neighbor[d])->process = g_array_index (pid, guint, id - 1);
     }
 }
 
+/*
+ * Migrates boxes to the neighbouring processes following the
+ * balancing flow. The requests of the sends are added to @request
+ * and the ids of the boxes sent to @sent. Returns %TRUE if boxes have
+ * been sent.
+ */
+static gboolean flow_migrate (GfsDomain * domain, GfsEventBalance * s, gdouble work,
+			      GtsRange * size, GPtrArray * request, GArray * sent)
+{
+  BalancingFlow * balance = balancing_flow_new (domain, work, size->mean);
+  gboolean modified = FALSE;
+  int i;
+  /* Send boxes */
+  guint nb = gts_container_size (GTS_CONTAINER (domain));
+  for (i = 0; i < balance->n; i++)
+    if (balance->flow[i] > 0.) { /* largest subdomain */
+      /* we need to find the list of boxes which minimizes 
+	 |\sum n_i - n| where n_i is the size of box i. This is known in
+	 combinatorial optimisation as a "knapsack problem". */
+      GSList * l = NULL;
+      BoxData b;
+      b.flow = balance->flow[i];
+      b.fit = b.smallest = FALSE;
+      if (s->incremental > 0.) {
+	/* bounds the work migrated per step */
+	b.flow = MIN (b.flow, s->incremental*size->mean);
+	b.fit = TRUE;
+      }
+      b.dest = balance->pid[i];
+      while (b.flow > 0 && nb > 1) {
+	b.box = NULL; b.neighboring = 0;
+	gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) select_neighbouring_box, &b);
+	if (b.box && b.box->size <= 2*b.flow) {
+	  l = g_slist_prepend (l, b.box);
+	  g_array_append_val (sent, b.box->id);
+	  b.box->pid = b.dest;
+	  b.flow -= b.box->size;
+	  nb--;
+	  modified = TRUE;
+	}
+	else
+	  b.flow = 0;
+      }
+      if (l == NULL && b.fit && nb > 1) {
+	/* no box fits in the incremental bound: migrates the smallest
+	   neighbouring box if this reduces the imbalance, so that
+	   balancing does not stall */
+	b.box = NULL; b.neighboring = 0;
+	b.fit = FALSE;
+	b.smallest = TRUE;
+	gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) select_neighbouring_box, &b);
+	if (b.box && b.box->size < 2*balance->flow[i]) {
+	  l = g_slist_prepend (l, b.box);
+	  g_array_append_val (sent, b.box->id);
+	  b.box->pid = b.dest;
+	  nb--;
+	  modified = TRUE;
+	}
+      }
+      g_ptr_array_add (request, gfs_send_boxes (domain, l, balance->pid[i]));
+      g_slist_free (l);
+    }
+  /* Receive boxes */
+  for (i = 0; i < balance->n; i++)
+    if (balance->flow[i] < 0.) { /* smallest subdomain */
+      GSList * l = gfs_receive_boxes (domain, balance->pid[i]);
+      g_slist_free (l);
+    }
+  balancing_flow_destroy (balance);
+  return modified;
+}
+
+static void box_move (GfsBox * box, GArray * move)
+{
+  guint nb = move->len/2, pid = gfs_box_domain (box)->pid;
+  g_assert (box->id > 0 && box->id <= nb);
+  if (box->pid != pid) {
+    g_array_index (move, guint, box->id - 1) = box->pid + 1;
+    g_array_index (move, guint, nb + box->id - 1) = pid + 1;
+  }
+}
+
+static void box_list (GfsBox * box, gpointer * data)
+{
+  GSList ** l = data[0];
+  GArray * sent = data[1];
+  if (box->pid != gfs_box_domain (box)->pid) {
+    l[box->pid] = g_slist_prepend (l[box->pid], box);
+    g_array_append_val (sent, box->id);
+  }
+}
+
+/*
+ * Migrates the boxes to the processes given by the partition of the
+ * work of all the boxes along a space-filling curve (see
+ * gfs_domain_sfc_partition()). Arguments and return value are as for
+ * flow_migrate().
+ */
+static gboolean curve_migrate (GfsDomain * domain, GPtrArray * request, GArray * sent)
+{
+  int npe, i;
+  MPI_Comm_size (MPI_COMM_WORLD, &npe);
+  guint nb = gts_container_size (GTS_CONTAINER (domain));
+  gfs_all_reduce (domain, nb, MPI_UNSIGNED, MPI_SUM);
+  if (nb < npe)
+    return FALSE;
+  gfs_domain_sfc_partition (domain, npe);
+
+  /* the first half of move contains the destination (plus one) of
+     each migrated box, the second half its source (plus one) */
+  GArray * move = g_array_new (FALSE, TRUE, sizeof (guint));
+  g_array_set_size (move, 2*nb);
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_move, move);
+#if MPI_VERSION == 2
+  MPI_Allreduce (MPI_IN_PLACE, move->data, 2*nb, MPI_UNSIGNED, MPI_MAX, MPI_COMM_WORLD);
+#else /* MPI-1 does not have the MPI_IN_PLACE option */ 
+  GArray * recv = g_array_new (FALSE, TRUE, sizeof (guint));
+  g_array_set_size (recv, 2*nb);
+  MPI_Allreduce (move->data, recv->data, 2*nb, MPI_UNSIGNED, MPI_MAX, MPI_COMM_WORLD);
+  g_array_free (move, TRUE);
+  move = recv;
+#endif /* MPI-1 */
+
+  /* Send boxes */
+  GSList ** l = g_malloc0 (npe*sizeof (GSList *));
+  gpointer data[2];
+  data[0] = l;
+  data[1] = sent;
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_list, data);
+  gboolean modified = FALSE;
+  for (i = 0; i < npe; i++)
+    if (l[i]) {
+      g_ptr_array_add (request, gfs_send_boxes (domain, l[i], i));
+      g_slist_free (l[i]);
+      modified = TRUE;
+    }
+  g_free (l);
+  /* Receive boxes */
+  gboolean * src = g_malloc0 (npe*sizeof (gboolean));
+  for (i = 0; i < nb; i++)
+    if (g_array_index (move, guint, i) == domain->pid + 1)
+      src[g_array_index (move, guint, nb + i) - 1] = TRUE;
+  for (i = 0; i < npe; i++)
+    if (src[i])
+      g_slist_free (gfs_receive_boxes (domain, i));
+  g_free (src);
+  g_array_free (move, TRUE);
+  return modified;
+}
+
+/* A boundary is "touched" if either its box or, for parallel
+   boundaries, the box on the other side has been migrated. Both sides
+   of a parallel boundary thus agree on whether it is touched. */
+static void touched_boundaries (GfsBox * box, gpointer * data)
+{
+  GPtrArray * touched = data[0];
+  GArray * pid = data[1];
+  guint nb = pid->len/2;
+  gboolean moved = g_array_index (pid, guint, nb + box->id - 1);
+  FttDirection d;
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (GFS_IS_BOUNDARY (box->neighbor[d]) &&
+	(moved || (GFS_IS_BOUNDARY_MPI (box->neighbor[d]) &&
+		   g_array_index (pid, guint, nb + GFS_BOUNDARY_MPI (box->neighbor[d])->id - 1))))
+      g_ptr_array_add (touched, box->neighbor[d]);
+}
+
+/*
+ * Reshapes @domain after box migration, re-matching and applying the
+ * boundary conditions only on the boundaries touched by the migrated
+ * boxes. This relies on the mesh itself being unchanged by migration
+ * so that all the other boundaries are still valid. If cells need to
+ * be refined to keep the mesh graded (across boxes which have become
+ * neighbours on the same process), returns %FALSE and the domain
+ * must be reshaped completely.
+ */
+static gboolean reshape_touched (GfsDomain * domain, GArray * pid)
+{
+  GPtrArray * touched = g_ptr_array_new ();
+  gpointer data[2];
+  data[0] = touched;
+  data[1] = pid;
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) touched_boundaries, data);
+  if (gfs_domain_match_boundaries (domain, touched)) {
+    g_ptr_array_free (touched, TRUE);
+    return FALSE;
+  }
+  gfs_set_merged (domain);
+  /* BCs are applied twice in case a BC on one variable depends on another variable */
+  guint pass;
+  for (pass = 0; pass < 2; pass++) {
+    GSList * i = domain->variables;
+    while (i) {
+      gfs_domain_boundaries_bc (domain, touched, FTT_TRAVERSE_LEAFS, -1, i->data);
+      i = i->next;
+    }
+  }
+  g_ptr_array_free (touched, TRUE);
+  return TRUE;
+}
+
 #endif /* HAVE_MPI */
 
+static void gfs_event_balance_destroy (GtsObject * o)
+{
+  if (GFS_EVENT_BALANCE (o)->weight)
+    gts_object_destroy (GTS_OBJECT (GFS_EVENT_BALANCE (o)->weight));
+
+  (* GTS_OBJECT_CLASS (gfs_event_balance_class ())->parent_class->destroy) (o);
+}
+
 static void gfs_event_balance_write (GtsObject * o, FILE * fp)
 {
   GfsEventBalance * s = GFS_EVENT_BALANCE (o);
@@ -207,6 +516,20 @@ static void gfs_event_balance_write (GtsObject * o, FILE * fp)
       (o, fp);
 
   fprintf (fp, " %g", s->max);
+  if (s->weight || s->measured || s->incremental > 0. || s->curve) {
+    fputs (" {", fp);
+    if (s->weight) {
+      fputs (" weight =", fp);
+      gfs_function_write (s->weight, fp);
+    }
+    if (s->measured)
+      fputs (" measured = 1", fp);
+    if (s->incremental > 0.)
+      fprintf (fp, " incremental = %g", s->incremental);
+    if (s->curve)
+      fputs (" curve = 1", fp);
+    fputs (" }", fp);
+  }
 }
 
 static void gfs_event_balance_read (GtsObject ** o, GtsFile * fp)
@@ -221,6 +544,89 @@ static void gfs_event_balance_read (GtsObject ** o, GtsFile * fp)
     return;
   
   s->max = gfs_read_constant (fp, domain);
+  if (fp->type == GTS_ERROR)
+    return;
+
+  if (fp->type == '{') {
+    fp->scope_max++;
+    gts_file_next_token (fp);
+    while (fp->type != GTS_ERROR && fp->type != '}') {
+      if (fp->type == '\n') {
+	gts_file_next_token (fp);
+	continue;
+      }
+      if (fp->type != GTS_STRING) {
+	gts_file_error (fp, "expecting a keyword");
+	return;
+      }
+      else if (!strcmp (fp->token->str, "weight")) {
+	gts_file_next_token (fp);
+	if (fp->type != '=') {
+	  gts_file_error (fp, "expecting '='");
+	  return;
+	}
+	gts_file_next_token (fp);
+	if (!s->weight)
+	  s->weight = gfs_function_new (gfs_function_class (), 1.);
+	gfs_function_read (s->weight, domain, fp);
+      }
+      else if (!strcmp (fp->token->str, "measured")) {
+	gts_file_next_token (fp);
+	if (fp->type != '=') {
+	  gts_file_error (fp, "expecting '='");
+	  return;
+	}
+	gts_file_next_token (fp);
+	if (fp->type != GTS_INT) {
+	  gts_file_error (fp, "expecting an integer (measured)");
+	  return;
+	}
+	s->measured = atoi (fp->token->str);
+	gts_file_next_token (fp);
+      }
+      else if (!strcmp (fp->token->str, "curve")) {
+	gts_file_next_token (fp);
+	if (fp->type != '=') {
+	  gts_file_error (fp, "expecting '='");
+	  return;
+	}
+	gts_file_next_token (fp);
+	if (fp->type != GTS_INT) {
+	  gts_file_error (fp, "expecting an integer (curve)");
+	  return;
+	}
+	s->curve = atoi (fp->token->str);
+	gts_file_next_token (fp);
+      }
+      else if (!strcmp (fp->token->str, "incremental")) {
+	gts_file_next_token (fp);
+	if (fp->type != '=') {
+	  gts_file_error (fp, "expecting '='");
+	  return;
+	}
+	gts_file_next_token (fp);
+	s->incremental = gfs_read_constant (fp, domain);
+	if (fp->type == GTS_ERROR)
+	  return;
+	if (s->incremental < 0.) {
+	  gts_file_error (fp, "incremental must be positive");
+	  return;
+	}
+      }
+      else {
+	gts_file_error (fp, "unknown keyword `%s'", fp->token->str);
+	return;
+      }
+    }
+    if (fp->type == GTS_ERROR)
+      return;
+    if (fp->type != '}') {
+      gts_file_error (fp, "expecting a closing brace");
+      return;
+    }
+    fp->scope_max--;
+    gts_file_next_token (fp);
+  }
 }
 
 static gboolean gfs_event_balance_event (GfsEvent * event, GfsSimulation * sim)
@@ -230,86 +636,78 @@ static gboolean gfs_event_balance_event (GfsEvent * event, GfsSimulation * sim)
     GfsDomain * domain = GFS_DOMAIN (sim);
     GfsEventBalance * s = GFS_EVENT_BALANCE (event);
     GtsRange size, boundary, mpiwait;
+#ifdef HAVE_MPI
+    gdouble work = 0.;
+#endif /* HAVE_MPI */
 
     gfs_domain_stats_balance (domain, &size, &boundary, &mpiwait);
+#ifdef HAVE_MPI
+    if (domain->pid >= 0) {
+      /* balance the work rather than the number of cells */
+      work = domain_work (domain, s);
+      work_stats (domain, work, &size);
+    }
+#endif /* HAVE_MPI */
     if (size.max/size.min > 1. + s->max) {
 #ifdef HAVE_MPI
-      BalancingFlow * balance = balancing_flow_new (domain, size.mean);
       GPtrArray * request = g_ptr_array_new ();
-      int modified = FALSE;
+      GArray * sent = g_array_new (FALSE, FALSE, sizeof (guint));
+      int modified = s->curve ?
+	curve_migrate (domain, request, sent) :
+	flow_migrate (domain, s, work, &size, request, sent);
       int i;
-      /* Send boxes */
-      gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) reset_box_size, NULL);
-      guint nb = gts_container_size (GTS_CONTAINER (domain));
-      for (i = 0; i < balance->n; i++)
-	if (balance->flow[i] > 0.) { /* largest subdomain */
-	  /* we need to find the list of boxes which minimizes 
-	     |\sum n_i - n| where n_i is the size of box i. This is known in
-	     combinatorial optimisation as a "knapsack problem". */
-	  GSList * l = NULL;
-	  BoxData b;
-	  b.flow = balance->flow[i];
-	  b.dest = balance->pid[i];
-	  while (b.flow > 0 && nb > 1) {
-	    b.box = NULL; b.neighboring = 0;
-	    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) select_neighbouring_box, &b);
-	    if (b.box && b.box->size <= 2*b.flow) {
-	      l = g_slist_prepend (l, b.box);
-	      b.box->pid = b.dest;
-	      b.flow -= b.box->size;
-	      nb--;
-	      modified = TRUE;
-	    }
-	    else
-	      b.flow = 0;
-	  }
-	  g_ptr_array_add (request, gfs_send_boxes (domain, l, balance->pid[i]));
-	  g_slist_free (l);
-	}
-      /* Receive boxes */
-      for (i = 0; i < balance->n; i++)
-	if (balance->flow[i] < 0.) { /* smallest subdomain */
-	  GSList * l = gfs_receive_boxes (domain, balance->pid[i]);
-	  g_slist_free (l);
-	}
-      /* Synchronize */
-      for (i = 0; i < request->len; i++)
-	gfs_wait (g_ptr_array_index (request, i));
-      g_ptr_array_free (request, TRUE);
-      balancing_flow_destroy (balance);
       /* Reshape */
       gfs_all_reduce (domain, modified, MPI_INT, MPI_MAX);
       if (modified) {
 	/* Updates the pid associated with each box */
 	guint nb = gts_container_size (GTS_CONTAINER (domain));
 	gfs_all_reduce (domain, nb, MPI_UNSIGNED, MPI_SUM);
+	/* the first half of pid contains the pids, the second half
+	   whether each box has been migrated */
 	GArray * pid = g_array_new (FALSE, TRUE, sizeof (guint));
-	g_array_set_size (pid, nb);
+	g_array_set_size (pid, 2*nb);
 	gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) get_pid, pid);
+	for (i = 0; i < sent->len; i++) {
+	  guint id = g_array_index (sent, guint, i);
+	  g_assert (id > 0 && id <= nb);
+	  g_array_index (pid, guint, nb + id - 1) = TRUE;
+	}
 #if MPI_VERSION == 2
-	MPI_Allreduce (MPI_IN_PLACE, pid->data, nb, MPI_UNSIGNED, MPI_MAX, MPI_COMM_WORLD);
+	MPI_Allreduce (MPI_IN_PLACE, pid->data, 2*nb, MPI_UNSIGNED, MPI_MAX, MPI_COMM_WORLD);
 #else /* MPI-1 does not have the MPI_IN_PLACE option */ 
 	GArray * recv = g_array_new (FALSE, TRUE, sizeof (guint));
-	g_array_set_size (recv, nb);
-	MPI_Allreduce (pid->data, recv->data, nb, MPI_UNSIGNED, MPI_MAX, MPI_COMM_WORLD);
+	g_array_set_size (recv, 2*nb);
+	MPI_Allreduce (pid->data, recv->data, 2*nb, MPI_UNSIGNED, MPI_MAX, MPI_COMM_WORLD);
 	g_array_free (pid, TRUE);
 	pid = recv;
 #endif /* MPI-1 */
 	/* pid[id] now contains the current pid of box with index id */
 	gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) update_box_pid, pid);
-	g_array_free (pid, TRUE);
-	gfs_domain_reshape (domain, gfs_domain_depth (domain));
-	/* applies BCs again in case a BC on one variable depends on another variable */
-	GSList * i = domain->variables;
-	while (i) {
-	  gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, i->data);
-	  i = i->next;
+	if (s->incremental <= 0. || domain->projections || !reshape_touched (domain, pid)) {
+	  gfs_domain_reshape (domain, gfs_domain_depth (domain));
+	  /* applies BCs again in case a BC on one variable depends on another variable */
+	  GSList * i = domain->variables;
+	  while (i) {
+	    gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, i->data);
+	    i = i->next;
+	  }
 	}
+	g_array_free (pid, TRUE);
       }
+      /* Synchronize: the sends complete while the domain is reshaped */
+      for (i = 0; i < request->len; i++)
+	gfs_wait (g_ptr_array_index (request, i));
+      g_ptr_array_free (request, TRUE);
+      g_array_free (sent, TRUE);
 #else /* not HAVE_MPI */
       g_assert_not_reached ();
 #endif /* not HAVE_MPI */
     }
+#ifdef HAVE_MPI
+    /* the time spent balancing is not part of the measured cost */
+    if (s->measured && domain->pid >= 0)
+      measure_start (domain, s);
+#endif /* HAVE_MPI */
     return TRUE;
   }
   return FALSE;
@@ -317,11 +715,17 @@ static gboolean gfs_event_balance_event (GfsEvent * event, GfsSimulation * sim)
 
 static void gfs_event_balance_class_init (GfsEventClass * klass)
 {
+  GTS_OBJECT_CLASS (klass)->destroy = gfs_event_balance_destroy;
   GTS_OBJECT_CLASS (klass)->read = gfs_event_balance_read;
   GTS_OBJECT_CLASS (klass)->write = gfs_event_balance_write;
   GFS_EVENT_CLASS (klass)->event = gfs_event_balance_event;
 }
 
+static void gfs_event_balance_init (GfsEventBalance * s)
+{
+  s->start = -1.;
+}
+
 GfsEventClass * gfs_event_balance_class (void)
 {
   static GfsEventClass * klass = NULL;
@@ -332,7 +736,7 @@ GfsEventClass * gfs_event_balance_class (void)
       sizeof (GfsEventBalance),
       sizeof (GfsEventClass),
       (GtsObjectClassInitFunc) gfs_event_balance_class_init,
-      (GtsObjectInitFunc) NULL,
+      (GtsObjectInitFunc) gfs_event_balance_init,
       (GtsArgSetFunc) NULL,
       (GtsArgGetFunc) NULL
     };
@@ -31,9 +31,16 @@ extern "C" {
 typedef struct _GfsEventBalance         GfsEventBalance;
 
 struct _GfsEventBalance {
+  /*< private >*/
   GfsEvent parent;
+  gdouble start, wait; /* wall-clock and MPI wait times at the end of the last balancing */
 
+  /*< public >*/
   gdouble max;
+  GfsFunction * weight; /* work of a leaf cell (one cell if NULL) */
+  gboolean measured;    /* whether to use the measured cost of each process */
+  gdouble incremental;  /* maximum fraction of the average work migrated per step */
+  gboolean curve;       /* whether to repartition along a space-filling curve */
 };
 
 #define GFS_EVENT_BALANCE(obj)            GTS_OBJECT_CAST (obj,\
@@ -1816,6 +1816,180 @@ static void box_size (FttCell * cell, guint * size)
   (*size)++;
 }
 
+/* Boxes whose binary representation is (estimated to be) larger than
+   this are written directly to the file rather than staged in memory */
+#define BOX_BUFFER_MAX (64*1024*1024)
+
+/* Compressed cell data: the cell tree (flags and solid data) and
+   each variable are stored as separate (compressed) blocks */
+
+typedef struct {
+  GfsDomain * domain;
+  GArray ** columns;
+  guint n, ncells;
+} BoxColumns;
+
+static void cell_write_columns (const FttCell * cell, GArray * tree, BoxColumns * c)
+{
+  gfs_cell_write_binary_buffer (cell, tree, NULL);
+  GSList * i = c->domain->variables_io;
+  guint j = 0;
+  while (i) {
+    gdouble a = GFS_VALUE (cell, GFS_VARIABLE (i->data));
+    g_array_append_val (c->columns[j++], a);
+    i = i->next;
+  }
+  c->ncells++;
+}
+
+/* Each block (the cell tree and each column) is compressed in memory
+   and written as soon as it is ready. A block must be smaller than
+   4 GB (the maximum size of a GArray). */
+static void box_write_compressed (GfsBox * box, GfsDomain * domain, guint size, FILE * fp)
+{
+  BoxColumns c = { domain, NULL, g_slist_length (domain->variables_io), 0 };
+  gsize hint = MIN ((gsize) size + size/2, BOX_BUFFER_MAX/sizeof (gdouble));
+  guint j;
+
+  c.columns = g_malloc (c.n*sizeof (GArray *));
+  for (j = 0; j < c.n; j++)
+    c.columns[j] = g_array_sized_new (FALSE, FALSE, sizeof (gdouble), hint);
+  GArray * tree = g_array_sized_new (FALSE, FALSE, 1, hint*(sizeof (guint) + sizeof (gdouble)));
+  ftt_cell_write_binary_buffer (box->root, domain->max_depth_write, tree,
+				(FttCellWriteBufferFunc) cell_write_columns, &c);
+
+  GArray * buf = g_array_sized_new (FALSE, FALSE, 1, tree->len);
+  guint64 len = tree->len, clen = 0;
+  g_array_append_vals (buf, &c.ncells, sizeof (guint));
+  g_array_append_vals (buf, &len, sizeof (guint64));
+  g_array_append_vals (buf, &clen, sizeof (guint64));
+  gfs_compress_bytes (tree->data, tree->len, buf);
+  clen = buf->len - sizeof (guint) - 2*sizeof (guint64);
+  memcpy (&buf->data[sizeof (guint) + sizeof (guint64)], &clen, sizeof (guint64));
+  g_array_free (tree, TRUE);
+  fwrite (buf->data, 1, buf->len, fp);
+
+  GSList * i = domain->variables_io;
+  for (j = 0; j < c.n; j++, i = i->next) {
+    gdouble * tolerance = domain->tolerance_io ? 
+      g_hash_table_lookup (domain->tolerance_io, i->data) : NULL;
+    g_array_set_size (buf, 0);
+    gfs_compress_column ((gdouble *) c.columns[j]->data, c.ncells, tolerance ? *tolerance : -1., 
+			 buf);
+    g_array_free (c.columns[j], TRUE);
+    fwrite (buf->data, 1, buf->len, fp);
+  }
+  g_free (c.columns);
+  g_array_free (buf, TRUE);
+}
+
+static gboolean cell_read_columns (FttCell * cell, const gchar ** buf, const gchar * end,
+				   BoxColumns * c)
+{
+  if (c->n >= c->ncells || 
+      !gfs_cell_read_binary_buffer (cell, buf, end, c->domain, NULL))
+    return FALSE;
+  GSList * i = c->domain->variables_io;
+  guint j = 0;
+  while (i) {
+    if (c->columns[j])
+      GFS_VALUE (cell, GFS_VARIABLE (i->data)) = g_array_index (c->columns[j], gdouble, c->n);
+    j++;
+    i = i->next;
+  }
+  c->n++;
+  return TRUE;
+}
+
+static FttCell * box_read_compressed (GtsFile * fp, GfsDomain * domain)
+{
+  BoxColumns c = { domain, NULL, 0, 0 };
+  guint64 len, clen;
+
+  if (gts_file_read (fp, &c.ncells, sizeof (guint), 1) != 1 ||
+      gts_file_read (fp, &len, sizeof (guint64), 1) != 1 ||
+      gts_file_read (fp, &clen, sizeof (guint64), 1) != 1) {
+    gts_file_error (fp, "expecting compressed cell tree header");
+    return NULL;
+  }
+  gchar * compressed = g_malloc (clen), * tree = g_malloc (len);
+  if (gts_file_read (fp, compressed, 1, clen) != clen ||
+      !gfs_uncompress_bytes (compressed, clen, tree, len)) {
+    gts_file_error (fp, "corrupted compressed cell tree");
+    g_free (compressed);
+    g_free (tree);
+    return NULL;
+  }
+  g_free (compressed);
+
+  guint nv = g_slist_length (domain->variables_io), j;
+  GSList * i = domain->variables_io;
+  GSList * selected = domain->selection ? domain->selection->read : NULL;
+  c.columns = g_malloc0 (nv*sizeof (GArray *));
+  for (j = 0; j < nv && fp->type != GTS_ERROR; j++, i = i->next) {
+    guint8 header[1 + sizeof (guint64)];
+    guint64 size;
+    if (gts_file_read (fp, header, 1, sizeof (header)) != sizeof (header)) {
+      gts_file_error (fp, "expecting compressed column header");
+      break;
+    }
+    memcpy (&size, &header[1], sizeof (guint64));
+    if (selected && !g_slist_find (selected, i->data) && fp->fp &&
+	!fseeko (fp->fp, size, SEEK_CUR))
+      /* columns are self-delimiting: unselected variables are skipped */
+      continue;
+    gchar * column = g_malloc (sizeof (header) + size);
+    const gchar * start = column;
+    memcpy (column, header, sizeof (header));
+    c.columns[j] = g_array_sized_new (FALSE, FALSE, sizeof (gdouble), c.ncells);
+    g_array_set_size (c.columns[j], c.ncells);
+    if (gts_file_read (fp, column + sizeof (header), 1, size) != size ||
+	!gfs_uncompress_column (&start, column + sizeof (header) + size,
+				(gdouble *) c.columns[j]->data, c.ncells))
+      gts_file_error (fp, "corrupted compressed column");
+    g_free (column);
+  }
+
+  FttCell * root = NULL;
+  if (fp->type != GTS_ERROR) {
+    const gchar * p = tree;
+    root = ftt_cell_read_binary_buffer (&p, tree + len, 
+					(FttCellReadBufferFunc) cell_read_columns, &c);
+    if (p != tree + len || c.n != c.ncells)
+      gts_file_error (fp, "corrupted compressed cell tree");
+  }
+
+  for (j = 0; j < nv; j++)
+    if (c.columns[j])
+      g_array_free (c.columns[j], TRUE);
+  g_free (c.columns);
+  g_free (tree);
+  return root;
+}
+
+static gboolean cell_read_binary_buffer (FttCell * cell, const gchar ** buf, const gchar * end,
+					 GfsDomain * domain)
+{
+  return gfs_cell_read_binary_buffer (cell, buf, end, domain, domain->variables_io);
+}
+
+/* Reads the cell data of a GtsFile reading from memory (see
+   gfs_file_new_mapped()) directly from its buffer */
+static FttCell * box_read_binary_buffer (GtsFile * fp, GfsDomain * domain)
+{
+  const gchar * p = fp->buf;
+  FttCell * root = ftt_cell_read_binary_buffer (&p, fp->buf + fp->len,
+						(FttCellReadBufferFunc) cell_read_binary_buffer,
+						domain);
+  if (p == NULL) {
+    gts_file_error (fp, "corrupted binary cell data");
+    return root;
+  }
+  fp->len -= p - fp->buf;
+  fp->buf = (gchar *) p;
+  return root;
+}
+
 static void gfs_box_write (GtsObject * object, FILE * fp)
 {
   GfsBox * box = GFS_BOX (object);
@@ -1840,9 +2014,25 @@ static void gfs_box_write (GtsObject * object, FILE * fp)
   fputs (" }", fp);
   if (domain != NULL && domain->max_depth_write > -2) {
     fputs (" {\n", fp);
-    if (domain->binary)
-      ftt_cell_write_binary (box->root, domain->max_depth_write, fp, 
-			     (FttCellWriteFunc) gfs_cell_write_binary, domain->variables_io);
+    if (domain->binary && domain->compress)
+      box_write_compressed (box, domain, size, fp);
+    else if (domain->binary) {
+      gsize cell_size = sizeof (guint) + 
+	(g_slist_length (domain->variables_io) + 1)*sizeof (gdouble);
+      gsize hint = ((gsize) size + size/2)*cell_size;
+      if (hint > BOX_BUFFER_MAX)
+	ftt_cell_write_binary (box->root, domain->max_depth_write, fp, 
+			       (FttCellWriteFunc) gfs_cell_write_binary, domain->variables_io);
+      else {
+	/* the tree is serialised in memory and written in one block */
+	GArray * buf = g_array_sized_new (FALSE, FALSE, 1, hint);
+	ftt_cell_write_binary_buffer (box->root, domain->max_depth_write, buf,
+				      (FttCellWriteBufferFunc) gfs_cell_write_binary_buffer, 
+				      domain->variables_io);
+	fwrite (buf->data, 1, buf->len, fp);
+	g_array_free (buf, TRUE);
+      }
+    }
     else
       ftt_cell_write (box->root, domain->max_depth_write, fp, 
 		      (FttCellWriteFunc) gfs_cell_write, domain->variables_io);
@@ -1850,6 +2040,53 @@ static void gfs_box_write (GtsObject * object, FILE * fp)
   }
 }
 
+/* Returns: %TRUE if the box centered on @pos intersects the region
+   of @selection */
+static gboolean box_is_selected (FttVector * pos, GfsDomain * domain,
+				 GfsReadSelection * selection)
+{
+  if (!selection->region)
+    return TRUE;
+
+  FttVector min = selection->min, max = selection->max;
+  if (GFS_IS_SIMULATION (domain)) {
+    gfs_simulation_map (GFS_SIMULATION (domain), &min);
+    gfs_simulation_map (GFS_SIMULATION (domain), &max);
+  }
+  gdouble h = ftt_level_size (domain->rootlevel)/2.;
+  FttComponent c;
+  for (c = 0; c < FTT_DIMENSION; c++) {
+    gdouble a = MIN ((&min.x)[c], (&max.x)[c]), b = MAX ((&min.x)[c], (&max.x)[c]);
+    if ((&pos->x)[c] + h < a || (&pos->x)[c] - h > b)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/* Uses the index of @selection to move @fp to the closing brace of
+   the cell data of @b. Returns %FALSE if the index is not valid for
+   @fp, in which case @fp is left unchanged. */
+static gboolean box_skip (GfsBox * b, GtsFile * fp, GfsReadSelection * selection)
+{
+  gint64 * offset;
+  off_t pos;
+
+  if (fp->fp == NULL || selection->index == NULL ||
+      !(offset = g_hash_table_lookup (selection->index, GUINT_TO_POINTER (b->id))) ||
+      (pos = ftello (fp->fp)) <= offset[0] || pos >= offset[1])
+    return FALSE;
+  if (!fseeko (fp->fp, offset[1], SEEK_SET) && fgetc (fp->fp) == '}' &&
+      !fseeko (fp->fp, offset[1], SEEK_SET))
+    return TRUE;
+  fseeko (fp->fp, pos, SEEK_SET);
+  return FALSE;
+}
+
+static gboolean coarsen_depth (FttCell * cell, gint * depth)
+{
+  return ftt_cell_level (cell) >= *depth;
+}
+
 static void gfs_box_read (GtsObject ** o, GtsFile * fp)
 {
   GfsBox * b = GFS_BOX (*o);
@@ -1885,6 +2122,10 @@ static void gfs_box_read (GtsObject ** o, GtsFile * fp)
   else
     gts_container_add (GTS_CONTAINER (domain), GTS_CONTAINEE (b));
 
+  GfsReadSelection * selection = domain->pid < 0 ? domain->selection : NULL;
+  /* number of the box in file order */
+  guint n = selection ? selection->nboxes++ : 0;
+
   if (fp->type != GTS_STRING) {
     gts_file_error (fp, "expecting a string (GfsBoxClass)");
     return;
@@ -1937,6 +2178,10 @@ static void gfs_box_read (GtsObject ** o, GtsFile * fp)
   
   if (fp->type == '{') {
     FttCell * root;
+    gboolean skip = selection &&
+      ((selection->single_box && n != selection->box) ||
+       ((var[3].set || var[4].set || var[5].set) &&
+	!box_is_selected (&pos, domain, selection)));
 
     fp->scope_max++;
     if (domain->binary) {
@@ -1944,7 +2189,14 @@ static void gfs_box_read (GtsObject ** o, GtsFile * fp)
       	gts_file_error (fp, "expecting a newline");
       	return;
       }
-      root = ftt_cell_read_binary (fp, (FttCellReadFunc) gfs_cell_read_binary, domain);
+      if (skip && box_skip (b, fp, selection))
+	root = NULL;
+      else if (domain->compress)
+	root = box_read_compressed (fp, domain);
+      else if (fp->fp == NULL && fp->buf != NULL && domain->version >= 90628)
+	root = box_read_binary_buffer (fp, domain);
+      else
+	root = ftt_cell_read_binary (fp, (FttCellReadFunc) gfs_cell_read_binary, domain);
       if (fp->type == GTS_ERROR)
 	return;
       gts_file_next_token (fp);
@@ -1955,10 +2207,21 @@ static void gfs_box_read (GtsObject ** o, GtsFile * fp)
     }
     fp->scope_max--;
 
-    if (domain->pid >= 0 && b->pid != domain->pid)
+    if (skip) {
+      /* the box is destroyed by domain_post_read() */
+      if (root)
+	ftt_cell_destroy (root, (FttCellCleanupFunc) gfs_cell_cleanup, domain);
+      selection->skipped = g_slist_prepend (selection->skipped, b);
+    }
+    else if (domain->pid >= 0 && b->pid != domain->pid)
       /* ignore data of boxes belonging to other PEs */
       ftt_cell_destroy (root, (FttCellCleanupFunc) gfs_cell_cleanup, domain);
     else {
+      if (selection && selection->max_depth >= 0 && root) {
+	gint depth = MAX (selection->max_depth - (gint) domain->rootlevel, 0);
+	ftt_cell_coarsen (root, (FttCellCoarsenFunc) coarsen_depth, &depth,
+			  (FttCellCleanupFunc) gfs_cell_cleanup, domain);
+      }
       ftt_cell_destroy (b->root, (FttCellCleanupFunc) gfs_cell_cleanup, domain);
       b->root = root;
       FttDirection d;
@@ -2040,9 +2303,10 @@ static void gfs_box_class_init (GfsBoxClass * klass)
 
 static void gfs_box_init (GfsBox * box)
 {
-  static guint id = 1;
+  static gint id = 1;
 
-  box->id = id++;
+  /* boxes may be created concurrently when reading files from several threads */
+  box->id = g_atomic_int_add (&id, 1);
   box->pid = -1;
   box->size = -1;
 }
@@ -203,11 +203,18 @@ static void domain_write (GtsObject * o, FILE * fp)
       fputc (' ', fp);
     }
   }
-  if (domain->binary != FALSE)
+  if (domain->binary != FALSE) {
     fprintf (fp, "binary = 1 ");
+    if (domain->compress)
+      fprintf (fp, "compress = 1 ");
+  }
   fputc ('}', fp);
 }
 
+/* the selection used by gfs_domain_read_selection() (files may be
+   read concurrently by several threads) */
+static GPrivate read_selection = G_PRIVATE_INIT (NULL);
+
 static void domain_read (GtsObject ** o, GtsFile * fp)
 {
   GfsDomain * domain = GFS_DOMAIN (*o);
@@ -223,6 +230,7 @@ static void domain_read (GtsObject ** o, GtsFile * fp)
     {GTS_INT,    "binary",    TRUE},
     {GTS_INT,    "version",   TRUE},
     {GTS_INT,    "overlap",   TRUE},
+    {GTS_INT,    "compress",  TRUE},
     {GTS_NONE}
   };
   gchar * variables = NULL;
@@ -232,6 +240,8 @@ static void domain_read (GtsObject ** o, GtsFile * fp)
   if (fp->type == GTS_ERROR)
     return;
 
+  domain->selection = g_private_get (&read_selection);
+
   domain->version = -1;
   var[0].data = &domain->rootlevel;
   var[1].data = &domain->refpos.x;
@@ -244,6 +254,7 @@ static void domain_read (GtsObject ** o, GtsFile * fp)
   var[8].data = &domain->binary;
   var[9].data = &domain->version;
   var[10].data = &domain->overlap;
+  var[11].data = &domain->compress;
   gts_file_assign_variables (fp, var);
   if (fp->type == GTS_ERROR) {
     g_free (variables);
@@ -290,6 +301,15 @@ static void domain_read (GtsObject ** o, GtsFile * fp)
     domain->variables_io = gfs_variables_from_list (domain->variables, variables, &s);
     g_free (variables);
   } 
+
+  if (domain->selection && domain->selection->variables) {
+    gchar * error;
+    /* if one of the selected variables is not stored in the file,
+       all the variables are read */
+    domain->selection->read = gfs_variables_from_list (domain->variables_io, 
+						       domain->selection->variables,
+						       &error);
+  }
 }
 
 static void box_set_pos (GfsBox * box, FttVector * pos, 
@@ -403,6 +423,20 @@ static void mpi_links (GfsBox * box, GfsDomain * domain)
 			    pid, id);
 }
 
+static void selection_boundaries (GfsBox * box)
+{
+  FttDirection d;
+
+  /* the links with the boxes which have not been read are replaced
+     with default boundaries */
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (box->neighbor[d] == NULL || GFS_IS_BOUNDARY_MPI (box->neighbor[d])) {
+      if (box->neighbor[d])
+	gts_object_destroy (box->neighbor[d]);
+      gfs_boundary_new (gfs_boundary_class (), box, d);
+    }
+}
+
 static void add_id (GfsBox * box, GPtrArray * ids)
 {
   if (box->id > ids->len)
@@ -465,6 +499,14 @@ static void convert_boundary_mpi_into_edges (GfsBox * box, GPtrArray * ids)
 
 static void domain_post_read (GfsDomain * domain, GtsFile * fp)
 {
+  if (domain->selection) {
+    /* Remove the boxes which are not part of the selection */
+    g_slist_foreach (domain->selection->skipped, (GFunc) gts_object_destroy, NULL);
+    if (gts_container_size (GTS_CONTAINER (domain)) == 0) {
+      gts_file_error (fp, "no box is selected");
+      return;
+    }
+  }
   gts_graph_foreach_edge (GTS_GRAPH (domain), (GtsFunc) gfs_gedge_link_boxes, NULL);
 
   domain->np = 0;
@@ -506,6 +548,9 @@ static void domain_post_read (GfsDomain * domain, GtsFile * fp)
 
     g_ptr_array_free (ids, TRUE);
 
+    if (domain->selection)
+      gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) selection_boundaries, NULL);
+
     gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) set_ref_pos, &domain->refpos);
   }
 
@@ -517,10 +562,30 @@ static void domain_post_read (GfsDomain * domain, GtsFile * fp)
   domain->version = atoi (GFS_BUILD_VERSION);
 }
 
-static void free_pair (gpointer key, gpointer value)
+static GfsTimer * timer_new (guint id, GfsTimer * parent)
+{
+  GfsTimer * t = g_malloc (sizeof (GfsTimer));
+
+  gts_range_init (&t->r);
+  gts_range_init (&t->ranks);
+  t->start = -1.;
+  memset (t->counters, 0, sizeof (t->counters));
+  t->id = id;
+  t->parent = parent;
+  t->children = g_ptr_array_new ();
+  if (parent)
+    g_ptr_array_add (parent->children, t);
+  return t;
+}
+
+static void timer_destroy (GfsTimer * t)
 {
-  g_free (key);
-  g_free (value);
+  guint i;
+
+  for (i = 0; i < t->children->len; i++)
+    timer_destroy (t->children->pdata[i]);
+  g_ptr_array_free (t->children, TRUE);
+  g_free (t);
 }
 
 static void cleanup_each_box (GfsBox * box, GfsDomain * domain)
@@ -562,8 +627,11 @@ static void domain_destroy (GtsObject * o)
 
   g_array_free (domain->allocated, TRUE);
 
-  g_hash_table_foreach (domain->timers, (GHFunc) free_pair, NULL);
-  g_hash_table_destroy (domain->timers);
+  timer_destroy (domain->timers);
+  if (domain->timer_calls)
+    g_array_free (domain->timer_calls, TRUE);
+  if (domain->counters)
+    gfs_counters_destroy (domain->counters);
 
   g_slist_free (domain->variables_io);
 
@@ -575,6 +643,8 @@ static void domain_destroy (GtsObject * o)
   g_ptr_array_free (domain->sorted, TRUE);
   domain->sorted = NULL;
 
+  gfs_domain_reset_merged (domain);
+
   (* GTS_OBJECT_CLASS (gfs_domain_class ())->parent_class->destroy) (o);
 }
 
@@ -620,12 +690,14 @@ static void domain_add (GtsContainer * c, GtsContainee * i)
 {
   (* GTS_CONTAINER_CLASS (GTS_OBJECT_CLASS (gfs_domain_class ())->parent_class)->add) (c, i);
   GFS_DOMAIN (c)->dirty = TRUE;
+  gfs_domain_reset_merged (GFS_DOMAIN (c));
 }
 
 static void domain_remove (GtsContainer * c, GtsContainee * i)
 {
   (* GTS_CONTAINER_CLASS (GTS_OBJECT_CLASS (gfs_domain_class ())->parent_class)->remove) (c, i);
   GFS_DOMAIN (c)->dirty = TRUE;
+  gfs_domain_reset_merged (GFS_DOMAIN (c));
 }
 
 static void domain_class_init (GfsDomainClass * klass)
@@ -655,7 +727,9 @@ static void domain_init (GfsDomain * domain)
 
   domain->clock = g_timer_new ();
   domain->timer = gfs_clock_new ();
-  domain->timers = g_hash_table_new (g_str_hash, g_str_equal);
+  domain->current_timer = domain->timers = timer_new (G_MAXUINT, NULL);
+  domain->timer_calls = NULL;
+  domain->counters = NULL;
 
   gts_range_init (&domain->size);
 
@@ -672,6 +746,10 @@ static void domain_init (GfsDomain * domain)
   domain->variables = NULL;
 
   domain->variables_io = NULL;
+  domain->compress = FALSE;
+  domain->tolerance_io = NULL;
+  domain->offset_io = 0;
+  domain->selection = NULL;
   domain->max_depth_write = -1;
 
   domain->cell_init = (FttCellInitFunc) gfs_cell_fine_init;
@@ -687,6 +765,8 @@ static void domain_init (GfsDomain * domain)
 
   domain->sorted = g_ptr_array_new ();
   domain->dirty = TRUE;
+  domain->merged = NULL;
+  domain->cfl = -1.;
   
   domain->projections = NULL;
 }
@@ -856,14 +936,14 @@ void gfs_domain_copy_bc (GfsDomain * domain,
   g_return_if_fail (v1 != NULL);
 
   if (domain->profile_bc)
-    gfs_domain_timer_start (domain, "bc");
+    gfs_domain_timer_start_id (domain, GFS_TIMER_BC);
 
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_bc, &b);
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_receive_bc, &b);
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_synchronize, &b.c);
 
   if (domain->profile_bc)
-    gfs_domain_timer_stop (domain, "bc");
+    gfs_domain_timer_stop_id (domain, GFS_TIMER_BC);
 }
 
 /**
@@ -955,14 +1035,14 @@ void gfs_domain_homogeneous_bc (GfsDomain * domain,
   g_return_if_fail (v != NULL);
 
   if (domain->profile_bc)
-    gfs_domain_timer_start (domain, "bc");
+    gfs_domain_timer_start_id (domain, GFS_TIMER_BC);
 
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_homogeneous_bc, &b);
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_receive_bc, &b);
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_synchronize, &b.c);
 
   if (domain->profile_bc)
-    gfs_domain_timer_stop (domain, "bc");
+    gfs_domain_timer_stop_id (domain, GFS_TIMER_BC);
 }
 
 /**
@@ -1221,14 +1301,14 @@ void gfs_domain_face_bc (GfsDomain * domain,
   g_return_if_fail (v != NULL);
 
   if (domain->profile_bc)
-    gfs_domain_timer_start (domain, "face_bc");
+    gfs_domain_timer_start_id (domain, GFS_TIMER_FACE_BC);
 
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_face_bc, &b);
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_receive_bc, &b);
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_synchronize, &b.c);
 
   if (domain->profile_bc)
-    gfs_domain_timer_stop (domain, "face_bc");
+    gfs_domain_timer_stop_id (domain, GFS_TIMER_FACE_BC);
 }
 
 static void box_changed (GfsBox * box, gboolean * changed)
@@ -1286,12 +1366,156 @@ void gfs_domain_match (GfsDomain * domain)
   g_return_if_fail (domain != NULL);
 
   if (domain->profile_bc)
-    gfs_domain_timer_start (domain, "match");
+    gfs_domain_timer_start_id (domain, GFS_TIMER_MATCH);
 
   while (domain_match (domain));
+  gfs_domain_reset_merged (domain);
 
   if (domain->profile_bc)
-    gfs_domain_timer_stop (domain, "match");
+    gfs_domain_timer_stop_id (domain, GFS_TIMER_MATCH);
+}
+
+static void refine_cell_corner_count (FttCell * cell, gpointer * data)
+{
+  GfsDomain * domain = data[0];
+  if (FTT_CELL_IS_LEAF (cell) && ftt_refine_corner (cell)) {
+    ftt_cell_refine_single (cell, domain->cell_init, domain->cell_init_data);
+    (* (guint *) data[1])++;
+  }
+}
+
+static gboolean boundaries_match (GfsDomain * domain, GPtrArray * boundaries, guint * refined)
+{
+  gboolean changed = FALSE;
+  guint i;
+
+  for (i = 0; i < boundaries->len; i++) {
+    GfsBoundary * boundary = g_ptr_array_index (boundaries, i);
+
+    g_assert (GFS_BOUNDARY_CLASS (GTS_OBJECT (boundary)->klass)->match);
+    boundary->type = GFS_BOUNDARY_MATCH_VARIABLE;
+    (* GFS_BOUNDARY_CLASS (GTS_OBJECT (boundary)->klass)->match) (boundary);
+    if (!boundary->root) {
+      gts_object_destroy (GTS_OBJECT (boundary));
+      g_ptr_array_remove_index_fast (boundaries, i--);
+    }
+    else
+      gfs_boundary_send (boundary);
+  }
+  for (i = 0; i < boundaries->len; i++)
+    gfs_boundary_receive (g_ptr_array_index (boundaries, i), FTT_TRAVERSE_LEAFS, -1);
+  for (i = 0; i < boundaries->len; i++) {
+    GfsBoundary * boundary = g_ptr_array_index (boundaries, i);
+    gfs_boundary_synchronize (boundary);
+    changed |= boundary->changed;
+  }
+  if (changed) {
+    gint l;
+    guint depth = 0;
+    gpointer data[2];
+    data[0] = domain;
+    data[1] = refined;
+    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_depth, &depth);
+    for (l = depth - 2; l >= 0; l--)
+      gfs_domain_cell_traverse (domain,
+				FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL, l,
+				(FttCellTraverseFunc) refine_cell_corner_count, data);
+  }
+  gfs_all_reduce (domain, changed, MPI_INT, MPI_MAX);
+  return changed;
+}
+
+/**
+ * gfs_domain_match_boundaries:
+ * @domain: a #GfsDomain.
+ * @boundaries: an array of #GfsBoundary of @domain.
+ *
+ * Match only the boundaries of @domain contained in @boundaries. In
+ * a parallel simulation, the arrays of all the processes must
+ * contain both sides of each parallel boundary they list.
+ *
+ * Boundaries which become empty are destroyed and removed from
+ * @boundaries.
+ *
+ * This is only valid if the other boundaries are not affected,
+ * i.e. if the cells of @domain do not need to be refined to keep
+ * the mesh graded. If they do, the cells are refined but the
+ * boundaries must then all be matched again using
+ * gfs_domain_match().
+ *
+ * This is a collective operation for parallel simulations.
+ *
+ * Returns: %TRUE if cells have been refined (on any process),
+ * %FALSE otherwise.
+ */
+gboolean gfs_domain_match_boundaries (GfsDomain * domain, GPtrArray * boundaries)
+{
+  guint refined = 0;
+
+  g_return_val_if_fail (domain != NULL, FALSE);
+  g_return_val_if_fail (boundaries != NULL, FALSE);
+
+  if (domain->profile_bc)
+    gfs_domain_timer_start_id (domain, GFS_TIMER_MATCH);
+
+  while (boundaries_match (domain, boundaries, &refined));
+  gfs_all_reduce (domain, refined, MPI_UNSIGNED, MPI_MAX);
+  gfs_domain_reset_merged (domain);
+
+  if (domain->profile_bc)
+    gfs_domain_timer_stop_id (domain, GFS_TIMER_MATCH);
+
+  return (refined > 0);
+}
+
+/**
+ * gfs_domain_boundaries_bc:
+ * @domain: a #GfsDomain.
+ * @boundaries: an array of #GfsBoundary of @domain.
+ * @flags: the traversal flags.
+ * @max_depth: the maximum depth of the traversal.
+ * @v: a #GfsVariable.
+ *
+ * Apply the boundary conditions for variable @v only on the
+ * boundaries contained in @boundaries (see also
+ * gfs_domain_match_boundaries()).
+ */
+void gfs_domain_boundaries_bc (GfsDomain * domain,
+			       GPtrArray * boundaries,
+			       FttTraverseFlags flags,
+			       gint max_depth,
+			       GfsVariable * v)
+{
+  guint i;
+
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (boundaries != NULL);
+  g_return_if_fail (v != NULL);
+
+  if (domain->profile_bc)
+    gfs_domain_timer_start_id (domain, GFS_TIMER_BC);
+
+  for (i = 0; i < boundaries->len; i++) {
+    GfsBoundary * b = g_ptr_array_index (boundaries, i);
+    GfsBc * bc = gfs_boundary_lookup_bc (b, v);
+
+    if (bc) {
+      b->v = v;
+      b->type = GFS_BOUNDARY_CENTER_VARIABLE;
+      gfs_boundary_update (b);
+      ftt_face_traverse_boundary (b->root, b->d,
+				  FTT_PRE_ORDER, flags, max_depth,
+				  bc->bc, bc);
+      gfs_boundary_send (b);
+    }
+  }
+  for (i = 0; i < boundaries->len; i++)
+    gfs_boundary_receive (g_ptr_array_index (boundaries, i), flags, max_depth);
+  for (i = 0; i < boundaries->len; i++)
+    gfs_boundary_synchronize (g_ptr_array_index (boundaries, i));
+
+  if (domain->profile_bc)
+    gfs_domain_timer_stop_id (domain, GFS_TIMER_BC);
 }
 
 /**
@@ -2360,19 +2584,65 @@ GfsNorm gfs_domain_norm_velocity (GfsDomain * domain,
  * the corresponding @fp fields (@pos and @error) are set.
  */
 GfsDomain * gfs_domain_read (GtsFile * fp)
+{
+  g_return_val_if_fail (fp != NULL, NULL);
+
+  return gfs_domain_read_selection (fp, NULL);
+}
+
+/**
+ * gfs_domain_read_selection:
+ * @fp: a #GtsFile.
+ * @selection: a #GfsReadSelection or %NULL.
+ *
+ * Identical to gfs_domain_read() but only reads the subset of @fp
+ * defined by @selection.
+ *
+ * Boxes which do not intersect the region of @selection are
+ * discarded (and skipped without being parsed if @selection contains
+ * a valid index of @fp). The cell trees of the other boxes are
+ * coarsened to the maximum depth of @selection. For compressed
+ * binary files, only the variables listed in @selection are
+ * uncompressed, the other variables are set to zero.
+ *
+ * If the @single_box field of @selection is set, only box number
+ * @box (counting from zero, in file order) is read. In all cases, the
+ * @nboxes field of @selection is set to the number of boxes in @fp.
+ *
+ * Selections are ignored for parallel simulations.
+ *
+ * Different files can be read concurrently by different threads.
+ *
+ * Returns: the #GfsDomain or %NULL if an error occured, in which case
+ * the corresponding @fp fields (@pos and @error) are set.
+ */
+GfsDomain * gfs_domain_read_selection (GtsFile * fp, GfsReadSelection * selection)
 {
   GfsDomain * domain;
 
   g_return_val_if_fail (fp != NULL, NULL);
-						 
-  if (!(domain = GFS_DOMAIN (gts_graph_read (fp))))
+
+  if (selection)
+    selection->nboxes = 0;
+  g_private_set (&read_selection, selection);
+  domain = GFS_DOMAIN (gts_graph_read (fp));
+  g_private_set (&read_selection, NULL);
+  if (domain == NULL)
     return NULL;
 
   (* GFS_DOMAIN_CLASS (GTS_OBJECT (domain)->klass)->post_read) (domain, fp);
+  if (selection) {
+    g_slist_free (selection->read);
+    g_slist_free (selection->skipped);
+    selection->read = selection->skipped = NULL;
+    domain->selection = NULL;
+  }
   if (fp->type == GTS_ERROR) {
     gts_object_destroy (GTS_OBJECT (domain));
     return NULL;
   }
+  /* compression only applies to the file which has just been read */
+  domain->compress = FALSE;
 
   return domain;
 }
@@ -2598,6 +2868,235 @@ void gfs_domain_split (GfsDomain * domain, gboolean one_box_per_pe)
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) get_ref_pos, &domain->refpos);
 }
 
+/* Returns the index of the point of integer coordinates @x (of
+   @bits bits) along the Hilbert curve (Skilling, 2004, "Programming
+   the Hilbert curve", AIP Conf. Proc. 707) */
+static guint64 hilbert_index (guint x[FTT_DIMENSION], guint bits)
+{
+  guint M = 1 << (bits - 1), P, Q, t;
+  guint64 index = 0;
+  gint i, b;
+
+  /* inverse undo */
+  for (Q = M; Q > 1; Q >>= 1) {
+    P = Q - 1;
+    for (i = 0; i < FTT_DIMENSION; i++)
+      if (x[i] & Q)
+	x[0] ^= P;
+      else {
+	t = (x[0] ^ x[i]) & P;
+	x[0] ^= t;
+	x[i] ^= t;
+      }
+  }
+  /* Gray encode */
+  for (i = 1; i < FTT_DIMENSION; i++)
+    x[i] ^= x[i - 1];
+  t = 0;
+  for (Q = M; Q > 1; Q >>= 1)
+    if (x[FTT_DIMENSION - 1] & Q)
+      t ^= Q - 1;
+  for (i = 0; i < FTT_DIMENSION; i++)
+    x[i] ^= t;
+  /* interleave the transposed bits */
+  for (b = bits - 1; b >= 0; b--)
+    for (i = 0; i < FTT_DIMENSION; i++)
+      index = (index << 1) | ((x[i] >> b) & 1);
+  return index;
+}
+
+typedef struct {
+  GfsBox * box; /* NULL for the boxes of other processes */
+  FttVector p;
+  gdouble size;
+  guint64 index;
+} SfcBox;
+
+static void sfc_box (GfsBox * box, GArray * boxes)
+{
+  SfcBox b;
+  b.box = box;
+  ftt_cell_pos (box->root, &b.p);
+  b.size = gts_gnode_weight (GTS_GNODE (box));
+  b.index = 0;
+  g_array_append_val (boxes, b);
+}
+
+static int compare_sfc_box (const void * a, const void * b)
+{
+  guint64 i1 = ((SfcBox *) a)->index, i2 = ((SfcBox *) b)->index;
+  return i1 < i2 ? -1 : i1 > i2 ? 1 : 0;
+}
+
+#ifdef HAVE_MPI
+/* Replaces the (local) boxes in @boxes with the boxes of all the
+   processes */
+static GArray * sfc_boxes_gather (GArray * boxes)
+{
+  int size, rank, n = boxes->len, ntotal = 0, i, j;
+  MPI_Comm_size (MPI_COMM_WORLD, &size);
+  MPI_Comm_rank (MPI_COMM_WORLD, &rank);
+  int * counts = g_malloc (size*sizeof (int)), * displs = g_malloc (size*sizeof (int));
+  MPI_Allgather (&n, 1, MPI_INT, counts, 1, MPI_INT, MPI_COMM_WORLD);
+  for (i = 0; i < size; i++) {
+    counts[i] *= 4;
+    displs[i] = ntotal;
+    ntotal += counts[i];
+  }
+  gdouble * local = g_malloc (MAX (4*n, 1)*sizeof (gdouble));
+  gdouble * all = g_malloc (MAX (ntotal, 1)*sizeof (gdouble));
+  SfcBox * b = (SfcBox *) boxes->data;
+  for (i = 0; i < n; i++) {
+    local[4*i] = b[i].p.x; local[4*i + 1] = b[i].p.y; local[4*i + 2] = b[i].p.z;
+    local[4*i + 3] = b[i].size;
+  }
+  MPI_Allgatherv (local, 4*n, MPI_DOUBLE, all, counts, displs, MPI_DOUBLE, MPI_COMM_WORLD);
+
+  GArray * allboxes = g_array_sized_new (FALSE, FALSE, sizeof (SfcBox), ntotal/4);
+  for (i = 0; i < ntotal/4; i++) {
+    SfcBox c;
+    j = i - displs[rank]/4;
+    c.box = j >= 0 && j < n ? b[j].box : NULL;
+    c.p.x = all[4*i]; c.p.y = all[4*i + 1]; c.p.z = all[4*i + 2];
+    c.size = all[4*i + 3];
+    c.index = 0;
+    g_array_append_val (allboxes, c);
+  }
+  g_free (local);
+  g_free (all);
+  g_free (counts);
+  g_free (displs);
+  g_array_free (boxes, TRUE);
+  return allboxes;
+}
+#endif /* HAVE_MPI */
+
+/* Returns the number of pieces obtained by cutting @b greedily into
+   pieces of size at most @max */
+static guint sfc_pieces (SfcBox * b, guint n, gdouble max)
+{
+  guint i, pieces = 1, count = 0;
+  gdouble size = 0.;
+  for (i = 0; i < n; i++) {
+    if (count > 0 && size + b[i].size > max) {
+      pieces++;
+      size = 0.;
+      count = 0;
+    }
+    size += b[i].size;
+    count++;
+  }
+  return pieces;
+}
+
+/**
+ * gfs_domain_sfc_partition:
+ * @domain: a #GfsDomain.
+ * @np: the number of partitions.
+ *
+ * Sets the pid of each box of @domain by cutting the list of boxes,
+ * ordered along a Hilbert space-filling curve, into @np contiguous
+ * pieces. The pieces minimize the maximum size of a partition, the
+ * size of a box being its weight (i.e. its number of leaf cells if
+ * box->size is not set). If there are at least @np boxes, each
+ * partition contains at least one box.
+ *
+ * The balance is limited by the size of the boxes: if it is not good
+ * enough, the boxes can be split using gfs_domain_split() and the
+ * domain partitioned again.
+ *
+ * For a parallel @domain, this is a collective operation: the
+ * partition is computed using the boxes of all the processes and
+ * only the pids of the local boxes are set.
+ *
+ * Returns: the imbalance of the partition, i.e. the ratio of the
+ * maximum to the average size of a partition.
+ */
+gdouble gfs_domain_sfc_partition (GfsDomain * domain, guint np)
+{
+  g_return_val_if_fail (domain != NULL, 0.);
+  g_return_val_if_fail (np > 0, 0.);
+
+  GArray * boxes = g_array_new (FALSE, FALSE, sizeof (SfcBox));
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) sfc_box, boxes);
+#ifdef HAVE_MPI
+  if (domain->pid >= 0)
+    boxes = sfc_boxes_gather (boxes);
+#endif /* HAVE_MPI */
+  if (boxes->len == 0) {
+    g_array_free (boxes, TRUE);
+    return 0.;
+  }
+
+  /* integer coordinates of the boxes */
+  SfcBox * b = (SfcBox *) boxes->data;
+  guint n = boxes->len;
+  gdouble h = ftt_level_size (domain->rootlevel);
+  FttVector min = { G_MAXDOUBLE, G_MAXDOUBLE, G_MAXDOUBLE };
+  guint i, j, x[FTT_DIMENSION], max = 0, bits = 1;
+  for (i = 0; i < n; i++)
+    for (j = 0; j < FTT_DIMENSION; j++)
+      if ((&b[i].p.x)[j] < (&min.x)[j])
+	(&min.x)[j] = (&b[i].p.x)[j];
+  for (i = 0; i < n; i++)
+    for (j = 0; j < FTT_DIMENSION; j++) {
+      guint c = floor (((&b[i].p.x)[j] - (&min.x)[j])/h + 0.5);
+      if (c > max)
+	max = c;
+    }
+  while ((1 << bits) <= max)
+    bits++;
+  gdouble total = 0., maxsize = 0.;
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < FTT_DIMENSION; j++)
+      x[j] = floor (((&b[i].p.x)[j] - (&min.x)[j])/h + 0.5);
+    b[i].index = hilbert_index (x, bits);
+    total += b[i].size;
+    if (b[i].size > maxsize)
+      maxsize = b[i].size;
+  }
+  qsort (b, n, sizeof (SfcBox), compare_sfc_box);
+
+  /* smallest maximum size of the pieces (bisection between a lower
+     bound and an upper bound for which greedy cutting gives at most
+     np pieces) */
+  gdouble lo = MAX (maxsize, total/np), hi = total/np + maxsize;
+  if (sfc_pieces (b, n, lo) <= np)
+    hi = lo;
+  else
+    for (i = 0; i < 64 && hi - lo > 1e-6*hi; i++) {
+      gdouble mid = (lo + hi)/2.;
+      if (sfc_pieces (b, n, mid) <= np)
+	hi = mid;
+      else
+	lo = mid;
+    }
+
+  /* cut the curve into np pieces of size at most hi, starting a new
+     piece for each box when there are just enough boxes left for the
+     remaining pieces */
+  gdouble * size = g_malloc0 (np*sizeof (gdouble)), imbalance = 0.;
+  guint pid = 0, count = 0;
+  for (i = 0; i < n; i++) {
+    if (count > 0 && pid < np - 1 &&
+	(size[pid] + b[i].size > hi || n - i <= np - 1 - pid)) {
+      pid++;
+      count = 0;
+    }
+    if (b[i].box)
+      b[i].box->pid = pid;
+    size[pid] += b[i].size;
+    count++;
+  }
+  for (i = 0; i < np; i++)
+    if (size[i] > imbalance)
+      imbalance = size[i];
+  g_free (size);
+  g_array_free (boxes, TRUE);
+
+  return total > 0. ? imbalance*np/total : 1.;
+}
+
 /**
  * gfs_domain_locate:
  * @domain: a #GfsDomain.
@@ -2815,81 +3314,191 @@ guint gfs_domain_size (GfsDomain * domain,
   return n;
 }
 
-typedef struct {
-  gdouble cfl;
-  GfsVariable ** v;
-  GfsDomain * domain;
-} CflData;
-
-static void minimum_mac_cfl (FttCellFace * face, CflData * p)
+/**
+ * gfs_face_cfl:
+ * @face: a #FttCellFace.
+ * @v: the velocity.
+ * @cfl: the square of a timestep.
+ *
+ * Sets @cfl to the minimum of @cfl and of the square of the time
+ * scale defined by the size of the cell of @face and the normal
+ * velocity on @face.
+ */
+void gfs_face_cfl (FttCellFace * face, GfsVariable ** v, gdouble * cfl)
 {
+  g_return_if_fail (face != NULL);
+  g_return_if_fail (v != NULL);
+  g_return_if_fail (cfl != NULL);
+
   gdouble un = GFS_STATE (face->cell)->f[face->d].un;
-  gdouble length = ftt_cell_size (face->cell);
-  if (p->domain->cell_metric) {
-    gdouble fm = (* p->domain->face_metric) (p->domain, face);
-    if (fm <= 0.) /* e.g. Axi metric on the axis */
-      return;
-    length *= (* p->domain->cell_metric) (p->domain, face->cell)/fm;
-  }
   if (un != 0.) {
+    GfsDomain * domain = v[0]->domain;
+    gdouble length = ftt_cell_size (face->cell);
+    if (domain->cell_metric) {
+      gdouble fm = (* domain->face_metric) (domain, face);
+      if (fm <= 0.) /* e.g. Axi metric on the axis */
+	return;
+      length *= (* domain->cell_metric) (domain, face->cell)/fm;
+    }
     gdouble cflu = length/fabs (un);
-    if (cflu*cflu < p->cfl)
-      p->cfl = cflu*cflu;
+    if (cflu*cflu < *cfl)
+      *cfl = cflu*cflu;
   }
+}
+
+static void face_source_cfl (FttCellFace * face, GfsVariable ** v, gdouble * cfl)
+{
   FttComponent c = face->d/2;
-  if (p->v[c]->sources) {
+  if (v[c]->sources) {
+    GfsDomain * domain = v[0]->domain;
+    gdouble length = ftt_cell_size (face->cell);
+    if (domain->cell_metric) {
+      gdouble fm = (* domain->face_metric) (domain, face);
+      if (fm <= 0.) /* e.g. Axi metric on the axis */
+	return;
+      length *= (* domain->cell_metric) (domain, face->cell)/fm;
+    }
     gdouble g = 0.;
-    GSList * i = GTS_SLIST_CONTAINER (p->v[c]->sources)->items;
+    GSList * i = GTS_SLIST_CONTAINER (v[c]->sources)->items;
     while (i) {
       GfsSourceGeneric * s = i->data;
       if (s->face_value)
-	g += (* s->face_value) (s, face, p->v[c]);
+	g += (* s->face_value) (s, face, v[c]);
       i = i->next;
     }
     if (g != 0.) {
       gdouble cflg = 2.*length/fabs (g);
-      if (cflg < p->cfl)
-	p->cfl = cflg;
+      if (cflg < *cfl)
+	*cfl = cflg;
     }
   }
 }
 
-static void minimum_cfl (FttCell * cell, CflData * p)
+static gdouble cell_length (FttCell * cell, GfsDomain * domain, FttComponent c, gdouble * fm)
 {
   gdouble length = ftt_cell_size (cell);
-  if (p->domain->cell_metric)
-    length *= (* p->domain->cell_metric) (p->domain, cell);
+  if (domain->cell_metric)
+    length *= (* domain->cell_metric) (domain, cell);
+  if (domain->face_metric) {
+    FttCellFace f;
+    f.cell = cell; f.d = 2*c;
+    gdouble fm1 = (* domain->face_metric) (domain, &f);
+    f.d = 2*c + 1;
+    gdouble fm2 = (* domain->face_metric) (domain, &f);
+    *fm = MAX (fm1, fm2);
+  }
+  else
+    *fm = 1.;
+  return length;
+}
 
+/**
+ * gfs_cell_cfl:
+ * @cell: a #FttCell.
+ * @v: the velocity.
+ * @cfl: the square of a timestep.
+ *
+ * Sets @cfl to the minimum of @cfl and of the square of the time
+ * scale defined by the size of @cell and the centered velocity in
+ * @cell.
+ */
+void gfs_cell_cfl (FttCell * cell, GfsVariable ** v, gdouble * cfl)
+{
   FttComponent c;
-  for (c = 0; c < FTT_DIMENSION; c++) {
-    gdouble fm;
-    if (p->domain->face_metric) {
-      FttCellFace f;
-      f.cell = cell; f.d = 2*c;
-      gdouble fm1 = (* p->domain->face_metric) (p->domain, &f);
-      f.d = 2*c + 1;
-      gdouble fm2 = (* p->domain->face_metric) (p->domain, &f);
-      fm = MAX (fm1, fm2);
-    }
-    else
-      fm = 1.;
-    if (GFS_VALUE (cell, p->v[c]) != 0.) {
-      gdouble cflu = length/fabs (fm*GFS_VALUE (cell, p->v[c]));
 
-      if (cflu*cflu < p->cfl)
-	p->cfl = cflu*cflu;
+  g_return_if_fail (cell != NULL);
+  g_return_if_fail (v != NULL);
+  g_return_if_fail (cfl != NULL);
+
+  for (c = 0; c < FTT_DIMENSION; c++)
+    if (GFS_VALUE (cell, v[c]) != 0.) {
+      gdouble fm, length = cell_length (cell, v[c]->domain, c, &fm);
+      gdouble cflu = length/fabs (fm*GFS_VALUE (cell, v[c]));
+
+      if (cflu*cflu < *cfl)
+	*cfl = cflu*cflu;
     }
-    if (p->v[c]->sources) {
-      gdouble g = gfs_variable_mac_source (p->v[c], cell);
+}
+
+static void cell_source_cfl (FttCell * cell, GfsVariable ** v, gdouble * cfl)
+{
+  FttComponent c;
+
+  for (c = 0; c < FTT_DIMENSION; c++)
+    if (v[c]->sources) {
+      gdouble g = gfs_variable_mac_source (v[c], cell);
 
       if (g != 0.) {
+	gdouble fm, length = cell_length (cell, v[c]->domain, c, &fm);
 	gdouble cflg = 2.*length/fabs (fm*g);
 
-	if (cflg < p->cfl)
-	  p->cfl = cflg;
+	if (cflg < *cfl)
+	  *cfl = cflg;
       }
     }
-  }
+}
+
+typedef struct {
+  gdouble cfl, * level;
+  GfsVariable ** v;
+} CflData;
+
+static void minimum_mac_cfl (FttCellFace * face, CflData * p)
+{
+  gdouble * cfl = p->level ? &p->level[ftt_cell_level (face->cell)] : &p->cfl;
+  gfs_face_cfl (face, p->v, cfl);
+  face_source_cfl (face, p->v, cfl);
+}
+
+static void minimum_cfl (FttCell * cell, CflData * p)
+{
+  gdouble * cfl = p->level ? &p->level[ftt_cell_level (cell)] : &p->cfl;
+  gfs_cell_cfl (cell, p->v, cfl);
+  cell_source_cfl (cell, p->v, cfl);
+}
+
+static void minimum_source_mac_cfl (FttCellFace * face, CflData * p)
+{
+  face_source_cfl (face, p->v, &p->cfl);
+}
+
+static void minimum_source_cfl (FttCell * cell, CflData * p)
+{
+  cell_source_cfl (cell, p->v, &p->cfl);
+}
+
+/**
+ * gfs_domain_sources_cfl:
+ * @domain: a #GfsDomain.
+ * @cfl: the square of a timestep.
+ *
+ * Sets @cfl to the minimum of @cfl and of the square of the time
+ * scale defined by the size of the leaf cells of @domain and the
+ * velocity source terms. Contrary to gfs_domain_cfl(), the minimum is
+ * local to this process.
+ */
+void gfs_domain_sources_cfl (GfsDomain * domain, gdouble * cfl)
+{
+  GfsVariable ** v;
+  FttComponent c;
+
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (cfl != NULL);
+
+  v = gfs_domain_velocity (domain);
+  for (c = 0; c < FTT_DIMENSION; c++)
+    if (v[c]->sources && GTS_SLIST_CONTAINER (v[c]->sources)->items) {
+      CflData p;
+      p.cfl = *cfl;
+      p.level = NULL;
+      p.v = v;
+      gfs_domain_face_traverse (domain, FTT_XYZ, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1, 
+				(FttFaceTraverseFunc) minimum_source_mac_cfl, &p);
+      gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1, 
+				(FttCellTraverseFunc) minimum_source_cfl, &p);
+      *cfl = p.cfl;
+      return;
+    }
 }
 
 /**
@@ -2912,8 +3521,8 @@ gdouble gfs_domain_cfl (GfsDomain * domain,
   g_return_val_if_fail (domain != NULL, 0.);
 
   p.cfl = G_MAXDOUBLE;
+  p.level = NULL;
   p.v = gfs_domain_velocity (domain);
-  p.domain = domain;
   gfs_domain_face_traverse (domain, FTT_XYZ, FTT_PRE_ORDER, flags, max_depth, 
 			    (FttFaceTraverseFunc) minimum_mac_cfl, &p);
   gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, flags, max_depth, 
@@ -2922,6 +3531,42 @@ gdouble gfs_domain_cfl (GfsDomain * domain,
   return sqrt (p.cfl);
 }
 
+/**
+ * gfs_domain_levels_cfl:
+ * @domain: a #GfsDomain.
+ * @cfl: an array of size gfs_domain_depth (@domain) + 1.
+ *
+ * Fills @cfl[l] with the minimum value over the leaf cells of level l
+ * of the timestep defined by gfs_domain_cfl() (or %G_MAXDOUBLE if
+ * this level does not contain any leaf cell).
+ */
+void gfs_domain_levels_cfl (GfsDomain * domain, gdouble * cfl)
+{
+  CflData p;
+  guint l, depth;
+
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (cfl != NULL);
+
+  depth = gfs_domain_depth (domain);
+  for (l = 0; l <= depth; l++)
+    cfl[l] = G_MAXDOUBLE;
+  p.cfl = G_MAXDOUBLE;
+  p.level = cfl;
+  p.v = gfs_domain_velocity (domain);
+  gfs_domain_face_traverse (domain, FTT_XYZ, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1, 
+			    (FttFaceTraverseFunc) minimum_mac_cfl, &p);
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1, 
+			    (FttCellTraverseFunc) minimum_cfl, &p);
+#ifdef HAVE_MPI
+  if (domain->pid >= 0)
+    MPI_Allreduce (MPI_IN_PLACE, cfl, depth + 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+#endif /* HAVE_MPI */
+  for (l = 0; l <= depth; l++)
+    if (cfl[l] < G_MAXDOUBLE)
+      cfl[l] = sqrt (cfl[l]);
+}
+
 /**
  * gfs_cell_init:
  * @cell: a #FttCell.
@@ -3199,6 +3844,46 @@ void gfs_cell_write_binary (const FttCell * cell, FILE * fp,
   }
 }
 
+/**
+ * gfs_cell_write_binary_buffer:
+ * @cell: a #FttCell.
+ * @buf: a #GArray of bytes.
+ * @variables: the list of #GfsVariable to be written.
+ *
+ * Appends to @buf the same binary representation of the fluid data
+ * associated with @cell as written by gfs_cell_write_binary(). This
+ * function is generally used in association with
+ * ftt_cell_write_binary_buffer().
+ */
+void gfs_cell_write_binary_buffer (const FttCell * cell, GArray * buf,
+				   GSList * variables)
+{
+  g_return_if_fail (cell != NULL);
+  g_return_if_fail (buf != NULL);
+
+  if (GFS_IS_MIXED (cell)) {
+    GfsSolidVector * s = GFS_STATE (cell)->solid;
+
+    g_array_append_vals (buf, s->s, FTT_NEIGHBORS*sizeof (gdouble));
+    g_array_append_vals (buf, &s->a, sizeof (gdouble));
+    g_array_append_vals (buf, &s->cm.x, FTT_DIMENSION*sizeof (gdouble));
+    g_array_append_vals (buf, &s->ca.x, FTT_DIMENSION*sizeof (gdouble));
+  }
+  else {
+    gdouble a = -1.;
+    g_array_append_vals (buf, &a, sizeof (gdouble));
+  }
+
+  guint len = buf->len;
+  g_array_set_size (buf, len + g_slist_length (variables)*sizeof (gdouble));
+  while (variables) {
+    gdouble a = GFS_VALUE (cell, GFS_VARIABLE (variables->data));
+    memcpy (&buf->data[len], &a, sizeof (gdouble));
+    len += sizeof (gdouble);
+    variables = variables->next;
+  }
+}
+
 /**
  * gfs_cell_read_binary:
  * @cell: a #FttCell.
@@ -3268,6 +3953,70 @@ void gfs_cell_read_binary (FttCell * cell, GtsFile * fp, GfsDomain * domain)
   }
 }
 
+/**
+ * gfs_cell_read_binary_buffer:
+ * @cell: a #FttCell.
+ * @buf: a pointer to the buffer.
+ * @end: the end of the buffer.
+ * @domain: the #GfsDomain containing @cell.
+ * @variables: the list of #GfsVariable to be read.
+ *
+ * Reads from @buf the fluid data associated with @cell and described
+ * by @variables, as written by gfs_cell_write_binary_buffer(), and
+ * updates @buf to point to the end of the data read. This function
+ * is generally used in association with ftt_cell_read_binary_buffer().
+ *
+ * Returns: %FALSE if @buf is corrupted or truncated, %TRUE otherwise.
+ */
+gboolean gfs_cell_read_binary_buffer (FttCell * cell, 
+				      const gchar ** buf, const gchar * end,
+				      GfsDomain * domain,
+				      GSList * variables)
+{
+  gdouble s0;
+
+  g_return_val_if_fail (cell != NULL, FALSE);
+  g_return_val_if_fail (buf != NULL && *buf != NULL, FALSE);
+  g_return_val_if_fail (end != NULL, FALSE);
+  g_return_val_if_fail (domain != NULL, FALSE);
+
+  if (end - *buf < sizeof (gdouble))
+    return FALSE;
+  memcpy (&s0, *buf, sizeof (gdouble));
+  if (s0 < 0. && s0 != -1.)
+    return FALSE;
+  *buf += sizeof (gdouble);
+
+  gfs_cell_init (cell, domain);
+  if (s0 >= 0.) {
+    GfsSolidVector * s = GFS_STATE (cell)->solid = g_malloc0 (sizeof (GfsSolidVector));
+    guint n = FTT_NEIGHBORS - 1 + 1 + 2*FTT_DIMENSION;
+
+    if (end - *buf < n*sizeof (gdouble))
+      return FALSE;
+    s->s[0] = s0;
+    memcpy (&s->s[1], *buf, (FTT_NEIGHBORS - 1)*sizeof (gdouble));
+    *buf += (FTT_NEIGHBORS - 1)*sizeof (gdouble);
+    memcpy (&s->a, *buf, sizeof (gdouble));
+    *buf += sizeof (gdouble);
+    memcpy (&s->cm.x, *buf, FTT_DIMENSION*sizeof (gdouble));
+    *buf += FTT_DIMENSION*sizeof (gdouble);
+    memcpy (&s->ca.x, *buf, FTT_DIMENSION*sizeof (gdouble));
+    *buf += FTT_DIMENSION*sizeof (gdouble);
+  }
+
+  if (end - *buf < g_slist_length (variables)*sizeof (gdouble))
+    return FALSE;
+  while (variables) {
+    gdouble a;
+    memcpy (&a, *buf, sizeof (gdouble));
+    *buf += sizeof (gdouble);
+    GFS_VALUE (cell, GFS_VARIABLE (variables->data)) = a;
+    variables = variables->next;
+  }
+  return TRUE;
+}
+
 static void box_realloc (GfsBox * box, GfsDomain * domain)
 {
   FttDirection d;
@@ -4123,31 +4872,170 @@ void gfs_domain_remove_specks (GfsDomain * domain)
     
 }
 
+/* Registry of the timer names: the id of a timer is its index in
+   timer_names */
+static GPtrArray * timer_names = NULL;
+static GHashTable * timer_ids = NULL;
+G_LOCK_DEFINE_STATIC (timer_names);
+
+static const gchar * predefined_timers[GFS_TIMER_IDS] = {
+  "simulation_run",
+  "bc",
+  "face_bc",
+  "match",
+  "mpi_wait",
+  "poisson_solve",
+  "poisson_cycle",
+  "mac_projection",
+  "approximate_projection",
+  "adapt"
+};
+
+static guint timer_register (const gchar * name)
+{
+  gchar * s = g_strdup (name);
+  guint id = timer_names->len;
+
+  g_ptr_array_add (timer_names, s);
+  g_hash_table_insert (timer_ids, s, GUINT_TO_POINTER (id + 1));
+  return id;
+}
+
+static void timer_registry_init (void)
+{
+  if (timer_names == NULL) {
+    guint i;
+
+    timer_names = g_ptr_array_new ();
+    timer_ids = g_hash_table_new (g_str_hash, g_str_equal);
+    for (i = 0; i < GFS_TIMER_IDS; i++)
+      timer_register (predefined_timers[i]);
+  }
+}
+
+/**
+ * gfs_timer_id:
+ * @name: the name of a timer.
+ *
+ * The ids of the timers listed in #GfsTimerId are pre-registered.
+ *
+ * Returns: the id of the timer called @name, registering it first if
+ * necessary.
+ */
+guint gfs_timer_id (const gchar * name)
+{
+  guint id;
+
+  g_return_val_if_fail (name != NULL, 0);
+
+  G_LOCK (timer_names);
+  timer_registry_init ();
+  id = GPOINTER_TO_UINT (g_hash_table_lookup (timer_ids, name));
+  id = id > 0 ? id - 1 : timer_register (name);
+  G_UNLOCK (timer_names);
+  return id;
+}
+
+/**
+ * gfs_timer_name:
+ * @id: the id of a timer.
+ *
+ * Returns: the name of the timer with id @id.
+ */
+const gchar * gfs_timer_name (guint id)
+{
+  const gchar * name;
+
+  G_LOCK (timer_names);
+  timer_registry_init ();
+  name = id < timer_names->len ? timer_names->pdata[id] : "";
+  G_UNLOCK (timer_names);
+  return name;
+}
+
+/**
+ * gfs_domain_timer_start_id:
+ * @domain: a #GfsDomain.
+ * @id: the id of the timer.
+ *
+ * Starts timer @id of @domain, nested within the innermost running
+ * timer. Timers measure wall-clock time.
+ *
+ * If the timer calls of @domain are recorded (i.e. if
+ * @domain->timer_calls is not %NULL), a #GfsTimerCall is appended
+ * when the timer is stopped.
+ *
+ * If @domain->counters is not %NULL, the hardware performance
+ * counters are also accumulated (see gfs_timer_counters()).
+ */
+void gfs_domain_timer_start_id (GfsDomain * domain, guint id)
+{
+  GfsTimer * parent, * t = NULL;
+  guint i;
+
+  g_return_if_fail (domain != NULL);
+
+  parent = domain->current_timer;
+  for (i = 0; i < parent->children->len && !t; i++)
+    if (((GfsTimer *) parent->children->pdata[i])->id == id)
+      t = parent->children->pdata[i];
+  if (t == NULL)
+    t = timer_new (id, parent);
+  if (domain->counters)
+    gfs_counters_read (domain->counters, t->counters_start);
+  t->start = g_timer_elapsed (domain->clock, NULL);
+  domain->current_timer = t;
+}
+
+/**
+ * gfs_domain_timer_stop_id:
+ * @domain: a #GfsDomain.
+ * @id: the id of the timer.
+ *
+ * Stops timer @id of @domain. This function fails if @id is not the
+ * innermost running timer of @domain.
+ */
+void gfs_domain_timer_stop_id (GfsDomain * domain, guint id)
+{
+  GfsTimer * t;
+  gdouble end;
+
+  g_return_if_fail (domain != NULL);
+  end = g_timer_elapsed (domain->clock, NULL);
+  t = domain->current_timer;
+  g_return_if_fail (t->id == id && t->start >= 0.);
+
+  gts_range_add_value (&t->r, end - t->start);
+  if (domain->counters) {
+    gint64 c[GFS_COUNTERS];
+    if (gfs_counters_read (domain->counters, c)) {
+      guint i;
+      for (i = 0; i < GFS_COUNTERS; i++)
+	t->counters[i] += c[i] - t->counters_start[i];
+    }
+  }
+  if (domain->timer_calls) {
+    GfsTimerCall c = { t, t->start, end };
+    g_array_append_val (domain->timer_calls, c);
+  }
+  t->start = -1.;
+  domain->current_timer = t->parent;
+}
+
 /**
  * gfs_domain_timer_start:
  * @domain: a #GfsDomain.
  * @name: the name of the timer.
  *
- * Starts timer @name of @domain. If @name does not exist it is
- * created first.
+ * Starts timer @name of @domain (see gfs_domain_timer_start_id()).
  */
 void gfs_domain_timer_start (GfsDomain * domain, const gchar * name)
 {
-  GfsTimer * t;
-
   g_return_if_fail (domain != NULL);
   g_return_if_fail (name != NULL);
 
-  t = g_hash_table_lookup (domain->timers, name);
-  if (t == NULL) {
-    t = g_malloc (sizeof (GfsTimer));
-    gts_range_init (&t->r);
-    g_hash_table_insert (domain->timers, g_strdup (name), t);
-  }
-  else
-    g_return_if_fail (t->start < 0.);
-  t->start = gfs_clock_elapsed (domain->timer);
-  gfs_debug ("starting %s at %g", name, t->start);
+  gfs_domain_timer_start_id (domain, gfs_timer_id (name));
+  gfs_debug ("starting %s at %g", name, domain->current_timer->start);
 }
 
 /**
@@ -4155,26 +5043,147 @@ void gfs_domain_timer_start (GfsDomain * domain, const gchar * name)
  * @domain: a #GfsDomain.
  * @name: the name of the timer.
  *
- * Stops timer @name of @domain. This function fails if @name is not a
- * timer of @domain.
+ * Stops timer @name of @domain (see gfs_domain_timer_stop_id()).
  */
 void gfs_domain_timer_stop (GfsDomain * domain, const gchar * name)
 {
-  GfsTimer * t;
-  gdouble end;
-
   g_return_if_fail (domain != NULL);
-  end = gfs_clock_elapsed (domain->timer);
   g_return_if_fail (name != NULL);
 
-  t = g_hash_table_lookup (domain->timers, name);
+  gfs_domain_timer_stop_id (domain, gfs_timer_id (name));
+  gfs_debug ("stopping %s at %g", name, g_timer_elapsed (domain->clock, NULL));
+}
+
+/**
+ * gfs_timer_total:
+ * @t: a #GfsTimer.
+ * @domain: the #GfsDomain of @t.
+ *
+ * Returns: the total time spent in @t, including the current call
+ * (if @t is running).
+ */
+gdouble gfs_timer_total (GfsTimer * t, GfsDomain * domain)
+{
+  g_return_val_if_fail (t != NULL, 0.);
+  g_return_val_if_fail (domain != NULL, 0.);
+
+  return t->r.sum + (t->start >= 0. ? g_timer_elapsed (domain->clock, NULL) - t->start : 0.);
+}
+
+/**
+ * gfs_timer_counters:
+ * @t: a #GfsTimer.
+ * @domain: the #GfsDomain of @t.
+ * @values: an array of size %GFS_COUNTERS.
+ *
+ * Fills @values with the totals of the hardware performance counters
+ * (see gfs_counter_name()) of @t, including the current call (if @t
+ * is running). The values are zero if @domain->counters is %NULL.
+ */
+void gfs_timer_counters (GfsTimer * t, GfsDomain * domain, gint64 * values)
+{
+  gint64 c[GFS_COUNTERS];
+  guint i;
+
   g_return_if_fail (t != NULL);
-  g_return_if_fail (t->start >= 0.);
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (values != NULL);
 
-  gts_range_add_value (&t->r, end - t->start);
-  gts_range_update (&t->r);
-  gfs_debug ("stopping %s: elapsed: %g", name, end - t->start);
-  t->start = -1.;
+  for (i = 0; i < GFS_COUNTERS; i++)
+    values[i] = t->counters[i];
+  if (t->start >= 0. && domain->counters && gfs_counters_read (domain->counters, c))
+    for (i = 0; i < GFS_COUNTERS; i++)
+      values[i] += c[i] - t->counters_start[i];
+}
+
+/* Stores the timers of the tree rooted in @t in @timers, together
+   with keys identifying their paths in the tree */
+static void timers_collect (GfsTimer * t, guint key, GPtrArray * timers, GArray * keys)
+{
+  guint i;
+
+  for (i = 0; i < t->children->len; i++) {
+    GfsTimer * c = t->children->pdata[i];
+    guint k = 31*key + g_str_hash (gfs_timer_name (c->id));
+
+    g_ptr_array_add (timers, c);
+    g_array_append_val (keys, k);
+    timers_collect (c, k, timers, keys);
+  }
+}
+
+/**
+ * gfs_domain_timers_reduce:
+ * @domain: a #GfsDomain.
+ *
+ * Updates the statistics of the timers of @domain and sets their
+ * @ranks fields to the statistics of their total time over all the
+ * processes. Timers are matched across processes using their path in
+ * the tree.
+ *
+ * This function must be called by all the processes of a parallel
+ * simulation.
+ */
+void gfs_domain_timers_reduce (GfsDomain * domain)
+{
+  g_return_if_fail (domain != NULL);
+
+  GPtrArray * timers = g_ptr_array_new ();
+  GArray * keys = g_array_new (FALSE, FALSE, sizeof (guint));
+  gdouble * totals;
+  guint i;
+
+  timers_collect (domain->timers, 0, timers, keys);
+  totals = g_malloc (MAX (timers->len, 1)*sizeof (gdouble));
+  for (i = 0; i < timers->len; i++) {
+    GfsTimer * t = timers->pdata[i];
+    if (t->r.n > 0)
+      gts_range_update (&t->r);
+    gts_range_init (&t->ranks);
+    totals[i] = gfs_timer_total (t, domain);
+  }
+
+#ifdef HAVE_MPI
+  if (domain->pid >= 0) {
+    int size, n = timers->len, ntotal = 0;
+    MPI_Comm_size (MPI_COMM_WORLD, &size);
+    int * counts = g_malloc (size*sizeof (int)), * displs = g_malloc (size*sizeof (int));
+    MPI_Allgather (&n, 1, MPI_INT, counts, 1, MPI_INT, MPI_COMM_WORLD);
+    for (i = 0; i < size; i++) {
+      displs[i] = ntotal;
+      ntotal += counts[i];
+    }
+    guint * allkeys = g_malloc (MAX (ntotal, 1)*sizeof (guint));
+    gdouble * alltotals = g_malloc (MAX (ntotal, 1)*sizeof (gdouble));
+    MPI_Allgatherv (keys->data, n, MPI_UNSIGNED, allkeys, counts, displs, MPI_UNSIGNED,
+		    MPI_COMM_WORLD);
+    MPI_Allgatherv (totals, n, MPI_DOUBLE, alltotals, counts, displs, MPI_DOUBLE,
+		    MPI_COMM_WORLD);
+    GHashTable * local = g_hash_table_new (NULL, NULL);
+    for (i = 0; i < timers->len; i++)
+      g_hash_table_insert (local, GUINT_TO_POINTER (g_array_index (keys, guint, i)), 
+			   timers->pdata[i]);
+    for (i = 0; i < ntotal; i++) {
+      GfsTimer * t = g_hash_table_lookup (local, GUINT_TO_POINTER (allkeys[i]));
+      if (t)
+	gts_range_add_value (&t->ranks, alltotals[i]);
+    }
+    g_hash_table_destroy (local);
+    g_free (allkeys);
+    g_free (alltotals);
+    g_free (counts);
+    g_free (displs);
+  }
+  else
+#endif /* HAVE_MPI */
+    for (i = 0; i < timers->len; i++)
+      gts_range_add_value (&((GfsTimer *) timers->pdata[i])->ranks, totals[i]);
+
+  for (i = 0; i < timers->len; i++)
+    gts_range_update (&((GfsTimer *) timers->pdata[i])->ranks);
+  g_free (totals);
+  g_array_free (keys, TRUE);
+  g_ptr_array_free (timers, TRUE);
 }
 
 static void cell_combine_traverse (FttCell * cell,
@@ -4609,6 +5618,11 @@ static void setup_binary_IO (GfsDomain * domain)
  * Send boxes to @dest and removes them from @domain.
  * This is a non-blocking operation.
  *
+ * If all the boxes of @domain are sent (which can happen while
+ * boxes are migrated, before the boxes sent by other processes are
+ * received using gfs_receive_boxes()), the locate array of @domain
+ * is left undefined.
+ *
  * Returns: a #GfsRequest which must be cleared using gfs_wait().
  */
 GfsRequest * gfs_send_boxes (GfsDomain * domain, GSList * boxes, int dest)
@@ -4621,7 +5635,8 @@ GfsRequest * gfs_send_boxes (GfsDomain * domain, GSList * boxes, int dest)
   GfsRequest * r = gfs_send_objects (boxes, dest);
   g_slist_foreach (boxes, (GFunc) gts_object_destroy, NULL);
   gfs_locate_array_destroy (domain->array);
-  domain->array = gfs_locate_array_new (domain);
+  domain->array = gts_container_size (GTS_CONTAINER (domain)) > 0 ?
+    gfs_locate_array_new (domain) : NULL;
   return r;
 }
 
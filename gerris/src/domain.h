@@ -46,10 +46,53 @@ typedef struct _GfsDomainClass     GfsDomainClass;
 typedef struct _GfsDiffusion       GfsDiffusion;
 typedef struct _GfsSourceDiffusion GfsSourceDiffusion;
 typedef struct _GfsTimer           GfsTimer;
+typedef struct _GfsReadSelection   GfsReadSelection;
+
+/* Timers with pre-registered ids (see gfs_timer_id()) */
+typedef enum {
+  GFS_TIMER_SIMULATION_RUN,
+  GFS_TIMER_BC,
+  GFS_TIMER_FACE_BC,
+  GFS_TIMER_MATCH,
+  GFS_TIMER_MPI_WAIT,
+  GFS_TIMER_POISSON_SOLVE,
+  GFS_TIMER_POISSON_CYCLE,
+  GFS_TIMER_MAC_PROJECTION,
+  GFS_TIMER_APPROXIMATE_PROJECTION,
+  GFS_TIMER_ADAPT,
+  GFS_TIMER_IDS
+} GfsTimerId;
 
 struct _GfsTimer {
-  GtsRange r;
-  gdouble start;
+  GtsRange r;      /* durations of the calls (wall-clock seconds) */
+  gdouble start;   /* start of the current call or -1 */
+  guint id;
+  GfsTimer * parent;
+  GPtrArray * children;
+  GtsRange ranks;  /* total times over all processes (see gfs_domain_timers_reduce()) */
+  gint64 counters[GFS_COUNTERS];       /* hardware counter totals (see gfs_timer_counters()) */
+  gint64 counters_start[GFS_COUNTERS]; /* counter values at the start of the current call */
+};
+
+typedef struct {
+  GfsTimer * timer;
+  gdouble start, end;
+} GfsTimerCall;
+
+struct _GfsReadSelection {
+  gboolean region;    /* whether to read only the boxes intersecting [min,max] */
+  FttVector min, max; /* physical coordinates */
+  gchar * variables;  /* comma-separated list of variables to read or NULL */
+  gint max_depth;     /* maximum level of the cell trees read (-1 means no limit) */
+  gboolean single_box; /* whether to read only the box number box (in file order) */
+  guint box;
+  guint nboxes;       /* number of boxes in the file (set by the reader) */
+  gboolean indexed;   /* whether the file contains a box index (set by
+			 gfs_simulation_read_selection()) */
+
+  /*< private >*/
+  GHashTable * index; /* box id -> offsets of the box in the file */
+  GSList * read, * skipped;
 };
 
 struct _GfsDomain {
@@ -57,7 +100,10 @@ struct _GfsDomain {
 
   int pid;
   GfsClock * timer;
-  GHashTable * timers;
+  GfsTimer * timers;         /* root of the tree of timers */
+  GfsTimer * current_timer;  /* innermost running timer */
+  GArray * timer_calls;      /* GfsTimerCall records of the timers or NULL */
+  GfsCounters * counters;    /* hardware performance counters of the timers or NULL */
 
   GtsRange timestep;
   GtsRange size;
@@ -79,6 +125,10 @@ struct _GfsDomain {
 
   GSList * variables_io;
   gboolean binary;
+  gboolean compress; /* whether binary cell data is stored as compressed columns */
+  GHashTable * tolerance_io; /* compression tolerances of variables_io or NULL */
+  gint64 offset_io; /* offset in the output file of the stream being written or -1 if unknown */
+  GfsReadSelection * selection; /* subset of the file being read or NULL */
   gint max_depth_write;
 
   FttCellInitFunc cell_init;
@@ -120,6 +170,9 @@ struct _GfsDomain {
 
   GPtrArray * sorted; /**< array of sorted boxes */
   gboolean dirty;     /**< whether the sorted array needs updating */
+  GPtrArray * merged; /**< cached lists of merged cells (or %NULL) */
+  guint mesh_changes; /**< number of changes of the mesh (see gfs_domain_reset_merged()) */
+  gdouble cfl;        /**< square of the local velocity CFL timestep of the last projection (or < 0) */
 
   GSList * projections; /**< list of GfsDomainProjection associated with this domain */
 
@@ -249,6 +302,13 @@ void         gfs_domain_face_bc               (GfsDomain * domain,
 					       FttComponent c,
 					       GfsVariable * v);
 void         gfs_domain_match                 (GfsDomain * domain);
+gboolean     gfs_domain_match_boundaries      (GfsDomain * domain,
+					       GPtrArray * boundaries);
+void         gfs_domain_boundaries_bc         (GfsDomain * domain,
+					       GPtrArray * boundaries,
+					       FttTraverseFlags flags,
+					       gint max_depth,
+					       GfsVariable * v);
 void         gfs_domain_forget_boundary       (GfsDomain * domain, 
 					       GfsBoundary * boundary);
 void         gfs_domain_surface_bc            (GfsDomain * domain,
@@ -285,6 +345,10 @@ GfsNorm      gfs_domain_norm_velocity         (GfsDomain * domain,
 					       FttTraverseFlags flags,
 					       gint max_depth);
 GfsDomain *  gfs_domain_read                  (GtsFile * fp);
+GfsDomain *  gfs_domain_read_selection        (GtsFile * fp,
+					       GfsReadSelection * selection);
+gdouble      gfs_domain_sfc_partition         (GfsDomain * domain,
+					       guint np);
 void         gfs_domain_split                 (GfsDomain * domain,
 					       gboolean one_box_per_pe);
 FttCell *    gfs_domain_locate                (GfsDomain * domain,
@@ -311,6 +375,16 @@ guint        gfs_domain_size                  (GfsDomain * domain,
 gdouble      gfs_domain_cfl                   (GfsDomain * domain,
 					       FttTraverseFlags flags,
 					       gint max_depth);
+void         gfs_domain_levels_cfl            (GfsDomain * domain,
+					       gdouble * cfl);
+void         gfs_face_cfl                     (FttCellFace * face,
+					       GfsVariable ** v,
+					       gdouble * cfl);
+void         gfs_cell_cfl                     (FttCell * cell,
+					       GfsVariable ** v,
+					       gdouble * cfl);
+void         gfs_domain_sources_cfl           (GfsDomain * domain,
+					       gdouble * cfl);
 void         gfs_cell_init                    (FttCell * cell,
 					       GfsDomain * domain);
 void         gfs_cell_reinit                  (FttCell * cell, 
@@ -329,9 +403,17 @@ void         gfs_cell_write                   (const FttCell * cell,
 void         gfs_cell_read_binary             (FttCell * cell, 
 					       GtsFile * fp,
 					       GfsDomain * domain);
+gboolean     gfs_cell_read_binary_buffer      (FttCell * cell, 
+					       const gchar ** buf,
+					       const gchar * end,
+					       GfsDomain * domain,
+					       GSList * variables);
 void         gfs_cell_write_binary            (const FttCell * cell, 
 					       FILE * fp,
 					       GSList * variables);
+void         gfs_cell_write_binary_buffer     (const FttCell * cell, 
+					       GArray * buf,
+					       GSList * variables);
 guint        gfs_domain_alloc                 (GfsDomain * domain);
 void         gfs_domain_free                  (GfsDomain * domain, 
 					       guint i);
@@ -360,10 +442,22 @@ void         gfs_domain_remove_ponds          (GfsDomain * domain,
 					       FttCellCleanupFunc cleanup,
 					       gpointer data);
 void         gfs_domain_remove_specks         (GfsDomain * domain);
+guint        gfs_timer_id                     (const gchar * name);
+const gchar * gfs_timer_name                  (guint id);
+void         gfs_domain_timer_start_id        (GfsDomain * domain, 
+					       guint id);
+void         gfs_domain_timer_stop_id         (GfsDomain * domain, 
+					       guint id);
 void         gfs_domain_timer_start           (GfsDomain * domain, 
 					       const gchar * name);
 void         gfs_domain_timer_stop            (GfsDomain * domain, 
 					       const gchar * name);
+gdouble      gfs_timer_total                  (GfsTimer * t,
+					       GfsDomain * domain);
+void         gfs_timer_counters               (GfsTimer * t,
+					       GfsDomain * domain,
+					       gint64 * values);
+void         gfs_domain_timers_reduce         (GfsDomain * domain);
 typedef
 void      (* FttCellCombineTraverseFunc)      (FttCell * cell1, 
 					       FttCell * cell2, 
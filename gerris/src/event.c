@@ -320,6 +320,7 @@ static void gfs_event_destroy (GtsObject * o)
 static void gfs_event_class_init (GfsEventClass * klass)
 {
   klass->event = gfs_event_event;
+  klass->scheduled_event = gfs_event_event;
 
   GTS_OBJECT_CLASS (klass)->write   = gfs_event_write;
   GTS_OBJECT_CLASS (klass)->read    = gfs_event_read;
@@ -458,6 +459,61 @@ void gfs_event_do (GfsEvent * event, GfsSimulation * sim)
   gfs_domain_timer_stop (GFS_DOMAIN (sim), name);
 }
 
+/* Returns: %FALSE if gfs_event_event() would do nothing but reset
+   @event->realised */
+static gboolean event_is_due (GfsEvent * event, GfsSimulation * sim)
+{
+  if (event->redo)
+    return TRUE;
+  if (event->t >= event->end ||
+      event->i >= event->iend ||
+      sim->time.t > event->end || 
+      sim->time.i > event->iend)
+    return TRUE;
+  if (event->end_event)
+    return (event->n == 0 &&
+	    (sim->time.t >= sim->time.end ||
+	     sim->time.i >= sim->time.iend));
+  if (sim->time.t >= event->t && (event->istep == G_MAXINT || event->n == 0))
+    return TRUE;
+  if (sim->time.i >= event->i && (event->step == G_MAXDOUBLE || event->n == 0))
+    return TRUE;
+  return FALSE;
+}
+
+/**
+ * gfs_events_do:
+ * @sim: a #GfsSimulation.
+ *
+ * Realises the events of @sim which are active, in order (see
+ * gfs_event_do()).
+ *
+ * Events whose class declares (through its @scheduled_event method)
+ * that they do nothing unless their schedule is due are not
+ * dispatched at all when they are not due, which avoids the cost of
+ * the timers and of the event methods for events which are realised
+ * only every few timesteps.
+ */
+void gfs_events_do (GfsSimulation * sim)
+{
+  GSList * i;
+
+  g_return_if_fail (sim != NULL);
+
+  i = sim->events->items;
+  while (i) {
+    GSList * next = i->next;
+    GfsEvent * event = i->data;
+    GfsEventClass * klass = GFS_EVENT_CLASS (GTS_OBJECT (event)->klass);
+
+    if (klass->scheduled_event == klass->event && !event_is_due (event, sim))
+      event->realised = FALSE;
+    else
+      gfs_event_do (event, sim);
+    i = next;
+  }
+}
+
 /**
  * gfs_event_half_do:
  * @event: a #GfsEvent:
@@ -719,7 +775,11 @@ static gboolean gfs_init_event (GfsEvent * event, GfsSimulation * sim)
       VarFunc * vf = i->data;
       gfs_catch_floating_point_exceptions ();
       /* fixme: the check for "layered" variables is messy */
-      if (!gfs_char_in_string (vf->v[0]->name[strlen (vf->v[0]->name) - 1], "0123456789"))
+      gboolean layered = !gfs_char_in_string (vf->v[0]->name[strlen (vf->v[0]->name) - 1],
+					      "0123456789");
+      if (vf->n == 1 && !(layered && GFS_DOMAIN (sim)->traverse_layers))
+	gfs_function_fill (vf->f[0], vf->v[0], FTT_TRAVERSE_LEAFS, -1);
+      else if (layered)
 	gfs_domain_traverse_layers (GFS_DOMAIN (sim), (FttCellTraverseFunc) 
 				    (vf->n == 1 ? init_scalar : init_vector), vf);
       else
@@ -2129,11 +2189,6 @@ static void gfs_remove_droplets_destroy (GtsObject * object)
   (* GTS_OBJECT_CLASS (gfs_remove_droplets_class ())->parent_class->destroy) (object);
 }
 
-static void compute_v (FttCell * cell, GfsRemoveDroplets * d)
-{
-  GFS_VALUE (cell, d->v) = gfs_function_value (d->fc, cell);
-}
-
 static gboolean gfs_remove_droplets_event (GfsEvent * event, GfsSimulation * sim)
 {
   if ((* GFS_EVENT_CLASS (GTS_OBJECT_CLASS (gfs_remove_droplets_class ())->parent_class)->event) 
@@ -2146,8 +2201,7 @@ static gboolean gfs_remove_droplets_event (GfsEvent * event, GfsSimulation * sim
     else {
       d->v = gfs_temporary_variable (domain);
       gfs_catch_floating_point_exceptions ();
-      gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
-				(FttCellTraverseFunc) compute_v, d);
+      gfs_function_fill (d->fc, d->v, FTT_TRAVERSE_ALL, -1);
       gfs_restore_fpe_for_function (d->fc);
       gfs_domain_remove_droplets (domain, d->v, d->c, d->min, d->val);
       gts_object_destroy (GTS_OBJECT (d->v));
@@ -2539,6 +2593,7 @@ static void gfs_event_list_destroy (GtsObject * o)
 static void gfs_event_list_class_init (GfsEventClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_event_list_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_event_list_event;
   GTS_OBJECT_CLASS (klass)->read = gfs_event_list_read;
   GTS_OBJECT_CLASS (klass)->write = gfs_event_list_write;
   GTS_OBJECT_CLASS (klass)->destroy = gfs_event_list_destroy;
@@ -48,6 +48,9 @@ struct _GfsEventClass {
   gboolean (* event)      (GfsEvent * event, GfsSimulation * sim);
   void     (* post_event) (GfsEvent * event, GfsSimulation * sim);
   void     (* event_half) (GfsEvent * event, GfsSimulation * sim);
+  /* set to the event method if it does nothing when the schedule of
+     the event is not due (see gfs_events_do()) */
+  gboolean (* scheduled_event) (GfsEvent * event, GfsSimulation * sim);
 };
 
 #include "simulation.h"
@@ -80,6 +83,7 @@ gdouble         gfs_event_next        (GfsEvent * event,
 				       GfsSimulation * sim);
 void            gfs_event_half_do     (GfsEvent * event, 
 				       GfsSimulation * sim);
+void            gfs_events_do         (GfsSimulation * sim);
 #define         gfs_event_is_repetitive(e) ((e)->step < G_MAXDOUBLE || (e)->istep < G_MAXINT)
 
 /* GfsGenericInit: Header */
@@ -2694,6 +2694,63 @@ gdouble gfs_interpolate (FttCell * cell,
   return gfs_interpolate_from_corners (cell, p, f);
 }
 
+/**
+ * gfs_interpolate_variables:
+ * @cell: a #FttCell containing location @p.
+ * @p: the location at which to interpolate.
+ * @v: an array of #GfsVariable.
+ * @n: the number of variables in @v.
+ * @val: an array of size @n.
+ *
+ * Fills @val with the values of variables @v interpolated at location
+ * @p, as computed by gfs_interpolate(). The interpolators of the
+ * corners of @cell are computed only once for all the variables.
+ */
+void gfs_interpolate_variables (FttCell * cell,
+				FttVector p,
+				GfsVariable ** v,
+				guint n,
+				gdouble * val)
+{
+  GfsInterpolator inter[2][4*(FTT_DIMENSION - 1)];
+  gboolean computed[2] = { FALSE, FALSE };
+  guint i;
+
+  g_return_if_fail (cell != NULL);
+  g_return_if_fail (v != NULL);
+  g_return_if_fail (val != NULL);
+
+  for (i = 0; i < n; i++) {
+    gdouble v0 = GFS_VALUE (cell, v[i]);
+    if (v0 == GFS_NODATA)
+      val[i] = GFS_NODATA;
+    else {
+      guint c = v[i]->centered ? 1 : 0, j, k;
+      if (!computed[c]) {
+	for (j = 0; j < 4*(FTT_DIMENSION - 1); j++)
+	  gfs_cell_corner_interpolator (cell, corner[j], -1, c, &inter[c][j]);
+	computed[c] = TRUE;
+      }
+
+      gdouble f[4*(FTT_DIMENSION - 1) + 1];
+      for (j = 0; j < 4*(FTT_DIMENSION - 1); j++) {
+	GfsInterpolator * a = &inter[c][j];
+	f[j] = 0.;
+	for (k = 0; k < a->n; k++) {
+	  gdouble v1 = GFS_VALUE (a->c[k], v[i]);
+	  if (v1 == GFS_NODATA) {
+	    f[j] = v0;
+	    break;
+	  }
+	  f[j] += a->w[k]*v1;
+	}
+      }
+      f[4*(FTT_DIMENSION - 1)] = v0;
+      val[i] = gfs_interpolate_from_corners (cell, p, f);
+    }
+  }
+}
+
 /**
  * gfs_interpolate_stencil:
  * @cell: a #FttCell.
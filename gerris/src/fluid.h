@@ -244,6 +244,11 @@ gdouble               gfs_interpolate_from_corners  (FttCell * cell,
 gdouble               gfs_interpolate               (FttCell * cell,
 						     FttVector p,
 						     GfsVariable * v);
+void                  gfs_interpolate_variables     (FttCell * cell,
+						     FttVector p,
+						     GfsVariable ** v,
+						     guint n,
+						     gdouble * val);
 void                  gfs_interpolate_stencil       (FttCell * cell,
 						     GfsVariable * v);
 void                  ftt_cell_refine_corners       (FttCell * cell,
@@ -21,6 +21,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "ftt.h"
 
 #define  FTT_CELL_IS_DESTROYED(c) (((c)->flags & FTT_FLAG_DESTROYED) != 0)
@@ -1797,6 +1798,47 @@ void ftt_cell_write_binary (const FttCell * root,
   }
 }
 
+/**
+ * ftt_cell_write_binary_buffer:
+ * @root: a #FttCell.
+ * @max_depth: the maximum depth at which to stop writing (-1 means no limit).
+ * @buf: a #GArray of bytes.
+ * @write: a #FttCellWriteBufferFunc function or %NULL.
+ * @data: user data to pass to @write.
+ *
+ * Appends to @buf the same binary representation of the cell tree
+ * starting at @root as written by ftt_cell_write_binary(). The whole
+ * tree can then be written using a single call to fwrite().
+ */
+void ftt_cell_write_binary_buffer (const FttCell * root,
+				   gint max_depth,
+				   GArray * buf,
+				   FttCellWriteBufferFunc write,
+				   gpointer data)
+{
+  guint flags;
+
+  g_return_if_fail (root != NULL);
+  g_return_if_fail (buf != NULL);
+
+  flags = root->flags;
+  if (FTT_CELL_IS_LEAF (root) || ftt_cell_level (root) == max_depth)
+    flags |= FTT_FLAG_LEAF;
+
+  g_array_append_vals (buf, &flags, sizeof (guint));
+  if (write && !FTT_CELL_IS_DESTROYED (root))
+    (* write) (root, buf, data);
+
+  if ((flags & FTT_FLAG_LEAF) == 0) {
+    FttOct * oct;
+    guint i;
+
+    oct = root->children;
+    for (i = 0; i < FTT_CELLS; i++)
+      ftt_cell_write_binary_buffer (&(oct->cell[i]), max_depth, buf, write, data);
+  }
+}
+
 #define FTT_CELL_IS_FLAGGED_LEAF(cell) (((cell)->flags & FTT_FLAG_LEAF) != 0)
 
 static gboolean oct_read (FttCell * parent, 
@@ -2003,6 +2045,106 @@ FttCell * ftt_cell_read_binary (GtsFile * fp,
   return root;
 }
 
+static gboolean oct_read_binary_buffer (FttCell * parent, 
+					const gchar ** buf,
+					const gchar * end,
+					FttCellReadBufferFunc read,
+					gpointer data);
+
+static gboolean cell_read_binary_buffer (FttCell * cell, 
+					 const gchar ** buf,
+					 const gchar * end,
+					 FttCellReadBufferFunc read,
+					 gpointer data)
+{
+  guint flags;
+
+  if (end - *buf < sizeof (guint))
+    return FALSE;
+  memcpy (&flags, *buf, sizeof (guint));
+  *buf += sizeof (guint);
+  if (FTT_CELL_ID (cell) != (flags & FTT_FLAG_ID))
+    return FALSE;
+  cell->flags = flags;
+
+  if (read && !FTT_CELL_IS_DESTROYED (cell) && !(* read) (cell, buf, end, data))
+    return FALSE;
+
+  if (!FTT_CELL_IS_DESTROYED (cell) && !FTT_CELL_IS_FLAGGED_LEAF (cell))
+    return oct_read_binary_buffer (cell, buf, end, read, data);
+
+  cell->flags &= ~FTT_FLAG_LEAF;
+  return TRUE;
+}
+
+static gboolean oct_read_binary_buffer (FttCell * parent,
+					const gchar ** buf,
+					const gchar * end,
+					FttCellReadBufferFunc read,
+					gpointer data)
+{
+  FttOct * oct;
+  guint n;
+
+  oct = g_malloc0 (sizeof (FttOct));
+  oct->level = ftt_cell_level (parent);
+  oct->parent = parent;
+  parent->children = oct;
+  ftt_cell_pos (parent, &(oct->pos));
+  
+  for (n = 0; n < FTT_CELLS; n++) {
+    oct->cell[n].parent = oct;
+    oct->cell[n].flags = n;
+  }
+
+  for (n = 0; n < FTT_CELLS; n++)
+    if (!cell_read_binary_buffer (&(oct->cell[n]), buf, end, read, data))
+      return FALSE;
+  
+  return TRUE;
+}
+
+/**
+ * ftt_cell_read_binary_buffer:
+ * @buf: a pointer to the start of a buffer.
+ * @end: the end of the buffer.
+ * @read: a #FttCellReadBufferFunc function or %NULL.
+ * @data: user data to pass to @read.
+ *
+ * Reads the cell tree written in the buffer pointed to by @buf using
+ * ftt_cell_write_binary_buffer(). On return @buf points to the end
+ * of the data read. If not %NULL, the user-defined function @read is
+ * used to read the extra user data associated with each cell.
+ *
+ * If an error occurs (i.e. corrupted or truncated buffer), @buf is
+ * set to %NULL and a possibly incomplete tree is returned.
+ *
+ * Returns: the root cell of the tree contained in @buf.
+ */
+FttCell * ftt_cell_read_binary_buffer (const gchar ** buf,
+				       const gchar * end,
+				       FttCellReadBufferFunc read,
+				       gpointer data)
+{
+  FttCell * root;
+  guint l, depth;
+
+  g_return_val_if_fail (buf != NULL && *buf != NULL, NULL);
+  g_return_val_if_fail (end != NULL, NULL);
+
+  root = ftt_cell_new (NULL, NULL);
+  if (!cell_read_binary_buffer (root, buf, end, read, data))
+    *buf = NULL;
+
+  depth = ftt_cell_depth (root);
+  for (l = 0; l < depth; l++)
+    ftt_cell_traverse (root, FTT_PRE_ORDER, 
+		       FTT_TRAVERSE_LEVEL|FTT_TRAVERSE_NON_LEAFS, l, 
+		       (FttCellTraverseFunc) set_neighbors, NULL);
+
+  return root;
+}
+
 /**
  * ftt_refine_corner:
  * @cell: a #FttCell.
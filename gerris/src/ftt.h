@@ -767,6 +767,14 @@ void                 ftt_cell_write_binary           (const FttCell * root,
 						      FILE * fp,
 						      FttCellWriteFunc write,
 						      gpointer data);
+typedef void      (* FttCellWriteBufferFunc)         (const FttCell * cell,
+						      GArray * buf,
+						      gpointer data);
+void                 ftt_cell_write_binary_buffer    (const FttCell * root,
+						      gint max_depth,
+						      GArray * buf,
+						      FttCellWriteBufferFunc write,
+						      gpointer data);
 typedef void      (* FttCellReadFunc)                (FttCell * cell,
 						      GtsFile * fp,
 						      gpointer data);
@@ -776,6 +784,14 @@ FttCell *            ftt_cell_read                   (GtsFile * fp,
 FttCell *            ftt_cell_read_binary            (GtsFile * fp,
 						      FttCellReadFunc read,
 						      gpointer data);
+typedef gboolean  (* FttCellReadBufferFunc)          (FttCell * cell,
+						      const gchar ** buf,
+						      const gchar * end,
+						      gpointer data);
+FttCell *            ftt_cell_read_binary_buffer     (const gchar ** buf,
+						      const gchar * end,
+						      FttCellReadBufferFunc read,
+						      gpointer data);
 typedef void      (* FttCellCleanupFunc)             (FttCell * cell,
 						      gpointer data);
 void                 ftt_cell_destroy           (FttCell * cell,
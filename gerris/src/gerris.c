@@ -37,11 +37,24 @@
 #include "solid.h"
 #include "version.h"
 
+/* maximum imbalance and maximum average number of boxes per
+   partition of space-filling curve partitioning */
+#define SFC_IMBALANCE 0.1
+#define SFC_BOXES     64
+
 static void set_box_pid (GfsBox * box, gint * pid)
 {
   box->pid = *pid;
 }
 
+static void box_weight (GfsBox * box, gdouble * w)
+{
+  gdouble size = gts_gnode_weight (GTS_GNODE (box));
+  if (size > w[0])
+    w[0] = size;
+  w[1] += size;
+}
+
 static void setup_binary_IO (GfsDomain * domain)
 {
   /* make sure that all the variables are sent */
@@ -75,6 +88,7 @@ int main (int argc, char * argv[])
   guint split = 0;
   guint npart = 0;
   gboolean profile = FALSE, macros = FALSE, one_box_per_pe = TRUE, bubble = FALSE, verbose = FALSE;
+  gboolean curve = FALSE;
   gchar * m4_options = g_strdup (M4_OPTIONS);
   GPtrArray * events = g_ptr_array_new ();
   gint maxlevel = -2;
@@ -95,6 +109,7 @@ int main (int argc, char * argv[])
       {"data", no_argument, NULL, 'd'},
       {"event", required_argument, NULL, 'e'},
       {"bubble", required_argument, NULL, 'b'},
+      {"curve", required_argument, NULL, 'c'},
       {"debug", no_argument, NULL, 'B'},
       {"verbose", no_argument, NULL, 'v'},
       {"help", no_argument, NULL, 'h'},
@@ -102,10 +117,10 @@ int main (int argc, char * argv[])
       { NULL }
     };
     int option_index = 0;
-    switch ((c = getopt_long (argc, argv, "hVs:ip:PD:I:mde:b:vB",
+    switch ((c = getopt_long (argc, argv, "hVs:ip:PD:I:mde:b:c:vB",
 			      long_options, &option_index))) {
 #else /* not HAVE_GETOPT_LONG */
-    switch ((c = getopt (argc, argv, "hVs:ip:PD:I:mde:b:vB"))) {
+    switch ((c = getopt (argc, argv, "hVs:ip:PD:I:mde:b:c:vB"))) {
 #endif /* not HAVE_GETOPT_LONG */
     case 'P': /* profile */
       profile = TRUE;
@@ -117,6 +132,10 @@ int main (int argc, char * argv[])
       npart = atoi (optarg);
       bubble = TRUE;
       break;
+    case 'c': /* space-filling curve partition */
+      npart = atoi (optarg);
+      bubble = curve = TRUE;
+      break;
     case 's': /* split */
       split = atoi (optarg);
       break;
@@ -170,6 +189,9 @@ int main (int argc, char * argv[])
 	"                       the corresponding simulation\n"
 	"  -b N   --bubble=N    partition the domain in N subdomains and returns\n" 
 	"                       the corresponding simulation\n"
+	"  -c N   --curve=N     partition the domain in N subdomains along a Hilbert\n"
+	"                       space-filling curve, splitting the boxes if necessary,\n"
+	"                       and returns the corresponding simulation\n"
 	"  -d     --data        when splitting or partitioning, output all data\n"
 	"  -P     --profile     profiles calls to boundary conditions\n"
 #ifdef HAVE_M4
@@ -295,7 +317,8 @@ int main (int argc, char * argv[])
     return 1;
   }
 
-  fp = gts_file_new (fptr);
+  GMappedFile * mapped;
+  fp = gfs_file_new_mapped (fptr, &mapped);
   if (!(simulation = gfs_simulation_read (fp))) {
     gfs_error (-1, 
 	     "gerris: file `%s' is not a valid simulation file\n"
@@ -305,6 +328,8 @@ int main (int argc, char * argv[])
     return 1;
   }
   gts_file_destroy (fp);
+  if (mapped)
+    g_mapped_file_unref (mapped);
 
   if (macros)
     pclose (fptr);
@@ -324,9 +349,12 @@ int main (int argc, char * argv[])
 	return 1;
       }
       /* automatic bubble partitioning if the simulation is not
-	 partitioned correctly (or at all) */
+	 partitioned correctly (or at all), or space-filling curve
+	 partitioning if there are not enough boxes */
       npart = size;
       bubble = TRUE;
+      if (gts_container_size (GTS_CONTAINER (simulation)) < size)
+	curve = TRUE;
     }
   }
 #endif /* HAVE_MPI */
@@ -356,49 +384,85 @@ int main (int argc, char * argv[])
     gfloat imbalance = 0.0;
     GSList * partition, * i;
 
-    if (verbose && domain->pid <= 0)
-      gts_graph_print_stats (GTS_GRAPH (simulation), stderr);
-    if (gts_container_size (GTS_CONTAINER (simulation)) < np) {
-      gfs_error (0,
-		 "gerris: the number of boxes in the domain to partition should be >= %d\n"
-		 "Use option '-s' to split the domain first\n"
-		 "Try `gerris --help' for more information.\n",
-		 np);
-      return 1;
+    if (curve) {
+      /* space-filling curve partitioning, splitting the boxes until
+	 the imbalance is small enough */
+      gint pid = domain->pid;
+      guint nsplit = 0;
+      domain->pid = -1; /* force serial */
+      if (!split) {
+	gfs_clock_start (domain->timer);
+	gfs_simulation_refine (simulation);
+	gfs_clock_stop (domain->timer);
+      }
+      gdouble max = gfs_domain_sfc_partition (domain, np);
+      for (;;) {
+	/* w[0] is the size of the largest box, w[1] the total size */
+	gdouble w[2] = { 0., 0. };
+	gts_container_foreach (GTS_CONTAINER (simulation), (GtsFunc) box_weight, w);
+	/* each partition needs at least one box and splitting only
+	   improves the balance if some boxes are larger than the
+	   imbalance allowed */
+	guint nb = gts_container_size (GTS_CONTAINER (simulation));
+	if (nb >= np &&
+	    (max <= 1. + SFC_IMBALANCE || nb*FTT_CELLS > SFC_BOXES*np ||
+	     w[0] <= SFC_IMBALANCE*w[1]/np))
+	  break;
+	gfs_domain_split (domain, FALSE);
+	max = gfs_domain_sfc_partition (domain, np);
+	nsplit++;
+      }
+      domain->pid = pid;
+      if (verbose && domain->pid <= 0)
+	fprintf (stderr, 
+		 "gerris: %d boxes (%d splits) on %d processes: imbalance %.3f\n",
+		 gts_container_size (GTS_CONTAINER (simulation)), nsplit, np, max);
     }
-    if (bubble)
-      partition = gts_graph_bubble_partition (GTS_GRAPH (simulation), npart, 100, 
-					      verbose ? 
-					      (GtsFunc) gts_graph_partition_print_stats : NULL, 
-					      stderr);
-    else
-      partition = gts_graph_recursive_bisection (GTS_WGRAPH (simulation),
-						 npart, 
-						 ntry, mmax, nmin, imbalance);
-
-    gint pid = 0;
-    i = partition;
-    while (i) {
-      if (gts_container_size (GTS_CONTAINER (i->data)) == 0) {
-	fprintf (stderr, "gerris: partitioning failed: empty partition\n");
-	if (!bubble)
-	  fprintf (stderr, 
-		   "Try using the '-b' option\n"
-		   "Try `gerris --help' for more information.\n");
+    else {
+      if (verbose && domain->pid <= 0)
+	gts_graph_print_stats (GTS_GRAPH (simulation), stderr);
+      if (gts_container_size (GTS_CONTAINER (simulation)) < np) {
+	gfs_error (0,
+		   "gerris: the number of boxes in the domain to partition should be >= %d\n"
+		   "Use option '-s' to split the domain first\n"
+		   "Try `gerris --help' for more information.\n",
+		   np);
 	return 1;
       }
-      gts_container_foreach (GTS_CONTAINER (i->data), (GtsFunc) set_box_pid, &pid);
-      pid++;
-      i = i->next;
-    }
+      if (bubble)
+	partition = gts_graph_bubble_partition (GTS_GRAPH (simulation), npart, 100, 
+						verbose ? 
+						(GtsFunc) gts_graph_partition_print_stats : NULL, 
+						stderr);
+      else
+	partition = gts_graph_recursive_bisection (GTS_WGRAPH (simulation),
+						   npart, 
+						   ntry, mmax, nmin, imbalance);
 
-    if (pid != np)
-      fprintf (stderr, "gerris: warning: only %d partitions were created\n", pid);
+      gint pid = 0;
+      i = partition;
+      while (i) {
+	if (gts_container_size (GTS_CONTAINER (i->data)) == 0) {
+	  fprintf (stderr, "gerris: partitioning failed: empty partition\n");
+	  if (!bubble)
+	    fprintf (stderr, 
+		     "Try using the '-b' option\n"
+		     "Try `gerris --help' for more information.\n");
+	  return 1;
+	}
+	gts_container_foreach (GTS_CONTAINER (i->data), (GtsFunc) set_box_pid, &pid);
+	pid++;
+	i = i->next;
+      }
+
+      if (pid != np)
+	fprintf (stderr, "gerris: warning: only %d partitions were created\n", pid);
+
+      if (verbose && domain->pid <= 0)
+	gts_graph_partition_print_stats (partition, stderr);
+      gts_graph_partition_destroy (partition);
+    }
 
-    if (verbose && domain->pid <= 0)
-      gts_graph_partition_print_stats (partition, stderr);
-    gts_graph_partition_destroy (partition);
-      
     if (domain->pid >= 0) { /* we are running a parallel job */
       /* write partitioned simulation in a temporary file */
       gchar * partname = gfs_template ();
@@ -410,11 +474,13 @@ int main (int argc, char * argv[])
       gts_object_destroy (GTS_OBJECT (simulation));
       /* replace the simulation with its partitioned version */
       rewind (fptr);
-      fp = gts_file_new (fptr);
+      fp = gfs_file_new_mapped (fptr, &mapped);
       simulation = gfs_simulation_read (fp);
       domain = GFS_DOMAIN (simulation);
       /* cleanup */
       gts_file_destroy (fp);
+      if (mapped)
+	g_mapped_file_unref (mapped);
       fclose (fptr);
       close (fd);
       g_assert (simulation);
@@ -2354,4 +2354,71 @@ guint gfs_cut_cube_vertices (FttCell * cell, gint maxlevel,
   return 0;
 }
 
+/**
+ * gfs_cut_cube_isosurface:
+ * @cell: a #FttCell.
+ * @maxlevel: the maximum level to consider (or -1).
+ * @var: a #GfsVariable.
+ * @value: the isovalue.
+ * @v: where to return the vertices coordinates.
+ * @np: where to return the number of vertices of each polygon.
+ *
+ * Fills @v and @np with the polygons, intersections of @cell with the
+ * isosurface @value of @var. The values of @var at the corners of
+ * @cell are linearly interpolated along its edges.
+ *
+ * Several polygons may be defined. The vertices of polygon @i are
+ * stored consecutively in @v, after those of polygons 0 to @i -
+ * 1. The polygons are oriented consistently, with their normal
+ * pointing towards increasing values of @var.
+ *
+ * Returns: the number of polygons (0 if the isosurface does not cut the cell).
+ */
+guint gfs_cut_cube_isosurface (FttCell * cell, gint maxlevel,
+			       GfsVariable * var, gdouble value,
+			       FttVector v[12], guint np[4])
+{
+  FttVector a[12], o;
+  gdouble f[8], h;
+  gint orient[12];
+  guint i, nv = 0, npoly = 0;
+
+  g_return_val_if_fail (cell != NULL, 0);
+  g_return_val_if_fail (var != NULL, 0);
+
+  for (i = 0; i < 8; i++)
+    f[i] = gfs_cell_corner_value (cell, corner[i], var, maxlevel) - value;
+
+  h = ftt_cell_size (cell);
+  ftt_cell_pos (cell, &o);
+  o.x -= h/2.; o.y -= h/2.; o.z -= h/2.;
+  for (i = 0; i < 12; i++) {
+    guint j = edge1[i][0], k = edge1[i][1];
+    orient[i] = -1;
+    if ((f[j] > 0.) != (f[k] > 0.)) {
+      gdouble t = f[j]/(f[j] - f[k]);
+      a[i].x = o.x + h*(edge[i][0].x + t*(edge[i][1].x - edge[i][0].x));
+      a[i].y = o.y + h*(edge[i][0].y + t*(edge[i][1].y - edge[i][0].y));
+      a[i].z = o.z + h*(edge[i][0].z + t*(edge[i][1].z - edge[i][0].z));
+      orient[i] = (f[k] > 0.);
+    }
+  }
+
+  for (i = 0; i < 12; i++) {
+    guint n = 0, e = i;
+    while (orient[e] >= 0) {
+      guint m = 0, * ne = connect[e][orient[e]];
+      v[nv + n++] = a[e];
+      orient[e] = -1;
+      while (m < 3 && orient[e] < 0)
+	e = ne[m++];
+    }
+    if (n > 2) {
+      np[npoly++] = n;
+      nv += n;
+    }
+  }
+  return npoly;
+}
+
 #endif /* 3D */
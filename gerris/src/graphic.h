@@ -140,6 +140,12 @@ guint              gfs_cut_cube_vertices       (FttCell * cell,
 						FttVector v[12], FttDirection d[12],
 						GfsVariable * var,
 						gdouble val[12]);
+guint              gfs_cut_cube_isosurface     (FttCell * cell, 
+						gint maxlevel,
+						GfsVariable * var,
+						gdouble value,
+						FttVector v[12],
+						guint np[4]);
 
 #ifdef __cplusplus
 }
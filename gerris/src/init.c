@@ -260,6 +260,7 @@ GtsObjectClass ** gfs_classes (void)
       gfs_output_solid_stats_class (),
       gfs_output_adapt_stats_class (),
       gfs_output_timing_class (),
+      gfs_output_trace_class (),
       gfs_output_balance_class (),
       gfs_output_solid_force_class (),
       gfs_output_location_class (),
@@ -279,6 +280,10 @@ GtsObjectClass ** gfs_classes (void)
           gfs_output_correlation_class (),
 	gfs_output_squares_class (),
 	gfs_output_streamline_class (),
+#if !FTT_2D
+	gfs_output_slice_class (),
+	gfs_output_isosurface_class (),
+#endif /* 3D */
         gfs_output_ppm_class (),  
         gfs_output_grd_class (),  
 
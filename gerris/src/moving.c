@@ -1150,7 +1150,7 @@ static void simulation_moving_run (GfsSimulation * sim)
 	 sim->time.i < sim->time.iend) {
     gdouble tstart = gfs_clock_elapsed (domain->timer);
 
-    gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);
+    gfs_events_do (sim);
 
     move_solids (sim);
    
@@ -1207,7 +1207,7 @@ static void simulation_moving_run (GfsSimulation * sim)
     gts_range_add_value (&domain->size, gfs_domain_size (domain, FTT_TRAVERSE_LEAFS, -1));
     gts_range_update (&domain->size);
   }
-  gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);  
+  gfs_events_do (sim);
   gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gts_object_destroy, NULL);
 
   for (c = 0; c < FTT_DIMENSION; c++) {
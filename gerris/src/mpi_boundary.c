@@ -142,6 +142,7 @@ static void receive (GfsBoundary * bb,
   if (domain->pid < 0)
     return;
 
+  gfs_domain_timer_start_id (domain, GFS_TIMER_MPI_WAIT);
 #ifdef PROFILE_MPI
   gdouble start, end;
 
@@ -212,6 +213,7 @@ fflush (DEBUG);
   end = MPI_Wtime ();
   gts_range_add_value (&domain->mpi_wait, end - start);
 #endif /* PROFILE_MPI */
+  gfs_domain_timer_stop_id (domain, GFS_TIMER_MPI_WAIT);
 
   (* gfs_boundary_periodic_class ()->receive) (bb, flags, max_depth);
 }
@@ -219,18 +221,20 @@ fflush (DEBUG);
 static void synchronize (GfsBoundary * bb)
 {
   GfsBoundaryMpi * boundary = GFS_BOUNDARY_MPI (bb);
+  GfsDomain * domain = gfs_box_domain (bb->box);
   MPI_Status status;
   guint i;
 #ifdef PROFILE_MPI
-  GfsDomain * domain = gfs_box_domain (bb->box);
   gdouble start, end;
 
   start = MPI_Wtime ();
 #endif /* PROFILE_MPI */
 
   /* wait for completion of non-blocking send(s) */
+  gfs_domain_timer_start_id (domain, GFS_TIMER_MPI_WAIT);
   for (i = 0; i < boundary->nrequest; i++)
     MPI_Wait (&(boundary->request[i]), &status);
+  gfs_domain_timer_stop_id (domain, GFS_TIMER_MPI_WAIT);
 #ifdef PROFILE_MPI
   end = MPI_Wtime ();
   gts_range_add_value (&domain->mpi_wait, end - start);
@@ -298,7 +298,7 @@ static void ocean_run (GfsSimulation * sim)
     GfsVariable * g[2];
     gdouble tstart = gfs_clock_elapsed (domain->timer);
 
-    gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);
+    gfs_events_do (sim);
 
     gfs_simulation_set_timestep (sim);
 
@@ -349,7 +349,7 @@ static void ocean_run (GfsSimulation * sim)
     gts_range_add_value (&domain->size, gfs_domain_size (domain, FTT_TRAVERSE_LEAFS, -1));
     gts_range_update (&domain->size);
   }
-  gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);  
+  gfs_events_do (sim);
   gts_container_foreach (GTS_CONTAINER (sim->events),
 			 (GtsFunc) gts_object_destroy, NULL);
 
@@ -475,6 +475,8 @@ static void ocean_post_read (GfsDomain * domain, GtsFile * fp)
 {
   (* GFS_DOMAIN_CLASS (GTS_OBJECT_CLASS (gfs_ocean_class ())->parent_class)->post_read) 
     (domain, fp);
+  if (fp->type == GTS_ERROR)
+    return;
 
   gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) add_layer, domain);
   g_assert (GFS_OCEAN (domain)->layer->len > 0);
@@ -710,7 +712,7 @@ static void ocean_run (GfsSimulation * sim)
     gfs_domain_cell_traverse (domain,
 			      FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
 			      (FttCellTraverseFunc) gfs_cell_coarse_init, domain);
-    gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);
+    gfs_events_do (sim);
 
     gfs_simulation_set_timestep (sim);
 
@@ -798,7 +800,7 @@ static void ocean_run (GfsSimulation * sim)
     gts_range_add_value (&domain->size, gfs_domain_size (domain, FTT_TRAVERSE_LEAFS, -1));
     gts_range_update (&domain->size);
   }
-  gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);  
+  gfs_events_do (sim);
   gts_container_foreach (GTS_CONTAINER (sim->events),
 			 (GtsFunc) gts_object_destroy, NULL);
 
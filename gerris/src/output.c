@@ -34,6 +34,7 @@
 #include "ocean.h"
 #include "unstructured.h"
 #include "init.h"
+#include "map.h"
 
 /**
  * Writing simulation data.
@@ -214,6 +215,7 @@ static void gfs_output_read (GtsObject ** o, GtsFile * fp)
 static void gfs_output_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_event;
   GFS_EVENT_CLASS (klass)->post_event = gfs_output_post_event;
 
   GTS_OBJECT_CLASS (klass)->write = gfs_output_write;
@@ -271,6 +273,7 @@ void gfs_output_mute (GfsOutput * output)
 }
 
 static GHashTable * gfs_output_files = NULL;
+G_LOCK_DEFINE_STATIC (gfs_output_files);
 
 /**
  * gfs_output_file_new:
@@ -306,6 +309,7 @@ GfsOutputFile * gfs_output_file_open (const gchar * name, const gchar * mode)
 
   g_return_val_if_fail (name != NULL, NULL);
 
+  G_LOCK (gfs_output_files);
   if (gfs_output_files == NULL) {
     gfs_output_files = g_hash_table_new (g_str_hash, g_str_equal);
     file = g_malloc (sizeof (GfsOutputFile));
@@ -320,18 +324,14 @@ GfsOutputFile * gfs_output_file_open (const gchar * name, const gchar * mode)
     g_hash_table_insert (gfs_output_files, file->name, file);
   }
 
-  if ((file = g_hash_table_lookup (gfs_output_files, name))) {
+  if ((file = g_hash_table_lookup (gfs_output_files, name)))
     file->refcount++;
-    return file;
+  else if ((fp = fopen (name, mode))) {
+    file = gfs_output_file_new (fp);
+    file->name = g_strdup (name);
+    g_hash_table_insert (gfs_output_files, file->name, file);
   }
-
-  fp = fopen (name, mode);
-  if (fp == NULL)
-    return NULL;
-
-  file = gfs_output_file_new (fp);
-  file->name = g_strdup (name);
-  g_hash_table_insert (gfs_output_files, file->name, file);
+  G_UNLOCK (gfs_output_files);
 
   return file;  
 }
@@ -347,10 +347,12 @@ void gfs_output_file_close (GfsOutputFile * file)
 {
   g_return_if_fail (file);
 
-  file->refcount--;
-  if (file->refcount == 0) {
-    if (file->name)
-      g_hash_table_remove (gfs_output_files, file->name);
+  G_LOCK (gfs_output_files);
+  gboolean last = (--file->refcount == 0);
+  if (last && file->name)
+    g_hash_table_remove (gfs_output_files, file->name);
+  G_UNLOCK (gfs_output_files);
+  if (last) {
     if (file->is_pipe)
       pclose (file->fp);
     else
@@ -394,6 +396,7 @@ static gboolean time_event (GfsEvent * event, GfsSimulation * sim)
 static void gfs_output_time_class_init (GfsEventClass * klass)
 {
   klass->event = time_event;
+  klass->scheduled_event = time_event;
 }
 
 GfsOutputClass * gfs_output_time_class (void)
@@ -453,6 +456,7 @@ static gboolean progress_event (GfsEvent * event, GfsSimulation * sim)
 static void gfs_output_progress_class_init (GfsEventClass * klass)
 {
   klass->event = progress_event;
+  klass->scheduled_event = progress_event;
 }
 
 GfsOutputClass * gfs_output_progress_class (void)
@@ -502,6 +506,7 @@ static gboolean projection_stats_event (GfsEvent * event, GfsSimulation * sim)
 static void gfs_output_projection_stats_class_init (GfsEventClass * klass)
 {
   klass->event = projection_stats_event;
+  klass->scheduled_event = projection_stats_event;
 }
 
 GfsOutputClass * gfs_output_projection_stats_class (void)
@@ -568,6 +573,7 @@ static gboolean diffusion_stats_event (GfsEvent * event, GfsSimulation * sim)
 static void gfs_output_diffusion_stats_class_init (GfsEventClass * klass)
 {
   klass->event = diffusion_stats_event;
+  klass->scheduled_event = diffusion_stats_event;
 }
 
 GfsOutputClass * gfs_output_diffusion_stats_class (void)
@@ -627,6 +633,7 @@ static gboolean gfs_output_solid_stats_event (GfsEvent * event,
 static void gfs_output_solid_stats_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_solid_stats_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_solid_stats_event;
 }
 
 GfsOutputClass * gfs_output_solid_stats_class (void)
@@ -694,6 +701,7 @@ static gboolean gfs_output_adapt_stats_event (GfsEvent * event,
 static void gfs_output_adapt_stats_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_adapt_stats_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_adapt_stats_event;
 }
 
 GfsOutputClass * gfs_output_adapt_stats_class (void)
@@ -724,49 +732,120 @@ GfsOutputClass * gfs_output_adapt_stats_class (void)
  * \beginobject{GfsOutputTiming}
  */
 
-typedef struct {
-  GfsTimer * t;
-  gchar * name;
-} Timer;
-
 static int compare_timer (const void * a, const void * b)
 {
-  Timer * t1 = (Timer *) a;
-  Timer * t2 = (Timer *) b;
-  return (t1->t->r.sum < t2->t->r.sum) ? -1 : 1 ;
+  GfsTimer * t1 = *((GfsTimer **) a);
+  GfsTimer * t2 = *((GfsTimer **) b);
+  return (t1->ranks.sum > t2->ranks.sum) ? -1 : 1;
 }
 
-static void get_timer (gchar * name, GfsTimer * t, gpointer * data)
+/* Prints hardware counters @c accumulated over @n timesteps of total
+   duration @total */
+static void print_counters (gint64 * c, gdouble total, guint n, FILE * fp)
 {
-  Timer * timing = data[0];
-  gint * count = data[1];
-  timing[*count].t = t;
-  timing[*count].name = name;
-  (*count)++;
+  fprintf (fp, "%s: %9.3g %s: %9.3g IPC: %5.2f %s: %9.3g %s: %9.3g (%.3g GB/s)\n",
+	   gfs_counter_name (0), c[0]/(gdouble) n,
+	   gfs_counter_name (1), c[1]/(gdouble) n,
+	   c[0] > 0 ? c[1]/(gdouble) c[0] : 0.,
+	   gfs_counter_name (2), c[2]/(gdouble) n,
+	   gfs_counter_name (3), c[3]/(gdouble) n,
+	   total > 0. ? c[3]/total/1e9 : 0.);
 }
 
-static void print_timing (GHashTable * timers, GfsDomain * domain, FILE * fp)
+static void print_timer (GfsTimer * t, GfsDomain * domain, 
+			 gdouble parent, guint depth, FILE * fp)
 {
-  Timer * timing = g_malloc (sizeof (Timer)*g_hash_table_size (timers));
-  gint count = 0;
-  gpointer data[2];
+  gdouble total = gfs_timer_total (t, domain);
+  fprintf (fp, 
+	   "%*s%s:\n"
+	   "%*s    total: %9.3f (%4.1f%%) calls: %u",
+	   2*depth, "", gfs_timer_name (t->id),
+	   2*depth, "", total, parent > 0. ? 100.*total/parent : 0., t->r.n);
+  if (t->r.n > 0)
+    fprintf (fp, " min: %9.3g avg: %9.3g | %7.3g max: %9.3g\n",
+	     t->r.min, t->r.mean, t->r.stddev, t->r.max);
+  else
+    fputs (" (running)\n", fp);
+  if (domain->pid >= 0)
+    fprintf (fp, 
+	     "%*s    processes min: %9.3f avg: %9.3f | %7.3f max: %9.3f\n",
+	     2*depth, "", t->ranks.min, t->ranks.mean, t->ranks.stddev, t->ranks.max);
+  if (domain->counters) {
+    gint64 c[GFS_COUNTERS];
+    gfs_timer_counters (t, domain, c);
+    fprintf (fp, "%*s    ", 2*depth, "");
+    print_counters (c, total, 1, fp);
+  }
 
-  data[0] = timing;
-  data[1] = &count;  
-  g_hash_table_foreach (domain->timers, (GHFunc) get_timer, data);
-  qsort (timing, count, sizeof (Timer), compare_timer);
-  while (--count >= 0)
-    if (timing[count].t->r.sum > 0.)
-      fprintf (fp, 
-	       "  %s:\n"
-	       "      min: %9.3f avg: %9.3f (%4.1f%%) | %7.3f max: %9.3f\n",
-	       timing[count].name,
-	       timing[count].t->r.min,
-	       timing[count].t->r.mean, 
-	       domain->timestep.sum > 0. ? 100.*timing[count].t->r.sum/domain->timestep.sum : 0.,
-	       timing[count].t->r.stddev, 
-	       timing[count].t->r.max);
-  g_free (timing);
+  GfsTimer ** children = g_memdup (t->children->pdata, t->children->len*sizeof (GfsTimer *));
+  guint i;
+  qsort (children, t->children->len, sizeof (GfsTimer *), compare_timer);
+  for (i = 0; i < t->children->len; i++)
+    print_timer (children[i], domain, total, depth + 1, fp);
+  g_free (children);
+}
+
+/* Prints the tree of timers, each timer with the percentage of the
+   time of its parent (or of the elapsed time for top-level timers) */
+static void print_timing (GfsDomain * domain, FILE * fp)
+{
+  GfsTimer ** children = g_memdup (domain->timers->children->pdata, 
+				   domain->timers->children->len*sizeof (GfsTimer *));
+  gdouble elapsed = g_timer_elapsed (domain->clock, NULL);
+  guint i;
+
+  gfs_domain_timers_reduce (domain);
+  if (domain->counters && domain->timestep.n > 0) {
+    gint64 c[GFS_COUNTERS] = { 0 }, tc[GFS_COUNTERS];
+    gdouble total = 0.;
+    guint j;
+    for (i = 0; i < domain->timers->children->len; i++) {
+      gfs_timer_counters (children[i], domain, tc);
+      for (j = 0; j < GFS_COUNTERS; j++)
+	c[j] += tc[j];
+      total += gfs_timer_total (children[i], domain);
+    }
+    fputs ("  hardware counters per timestep:\n      ", fp);
+    print_counters (c, total, domain->timestep.n, fp);
+  }
+  qsort (children, domain->timers->children->len, sizeof (GfsTimer *), compare_timer);
+  for (i = 0; i < domain->timers->children->len; i++)
+    print_timer (children[i], domain, elapsed, 1, fp);
+  g_free (children);
+}
+
+static void gfs_output_timing_read (GtsObject ** o, GtsFile * fp)
+{
+  GfsOutputTiming * output = GFS_OUTPUT_TIMING (*o);
+
+  (* GTS_OBJECT_CLASS (gfs_output_timing_class ())->parent_class->read) (o, fp);
+  if (fp->type == GTS_ERROR)
+    return;
+
+  if (fp->type == '{') {
+    GtsFileVariable var[] = {
+      {GTS_INT, "counters", TRUE, &output->counters},
+      {GTS_NONE}
+    };
+    gts_file_assign_variables (fp, var);
+    if (fp->type == GTS_ERROR)
+      return;
+  }
+
+  if (output->counters) {
+    GfsDomain * domain = GFS_DOMAIN (gfs_object_simulation (*o));
+    if (domain->counters == NULL && 
+	(domain->counters = gfs_counters_new ()) == NULL)
+      g_warning ("hardware performance counters are not available: %s",
+		 strerror (errno));
+  }
+}
+
+static void gfs_output_timing_write (GtsObject * o, FILE * fp)
+{
+  (* GTS_OBJECT_CLASS (gfs_output_timing_class ())->parent_class->write) (o, fp);
+  if (GFS_OUTPUT_TIMING (o)->counters)
+    fputs (" { counters = 1 }", fp);
 }
 
 static gboolean timing_event (GfsEvent * event, GfsSimulation * sim)
@@ -794,13 +873,20 @@ static gboolean timing_event (GfsEvent * event, GfsSimulation * sim)
 	       domain->size.stddev, 
 	       domain->size.max,
 	       gfs_domain_variables_number (domain));
-      print_timing (domain->timers, domain, fp);
+      print_timing (domain, fp);
       if (domain->mpi_messages.n > 0)
 	fprintf (fp,
 		 "Message passing summary\n"
 		 "  n: %10d size: %10.0f bytes\n",
 		 domain->mpi_messages.n,
 		 domain->mpi_messages.sum);
+      if (sim->substeps) {
+	guint l;
+	fputs ("Subcycling summary\n", fp);
+	for (l = 0; l < sim->substeps->len; l++)
+	  fprintf (fp, "  level %2d: %10u substeps\n", 
+		   l, g_array_index (sim->substeps, guint, l));
+      }
     }
     return TRUE;
   }
@@ -809,7 +895,10 @@ static gboolean timing_event (GfsEvent * event, GfsSimulation * sim)
 
 static void gfs_output_timing_class_init (GfsEventClass * klass)
 {
+  GTS_OBJECT_CLASS (klass)->read = gfs_output_timing_read;
+  GTS_OBJECT_CLASS (klass)->write = gfs_output_timing_write;
   klass->event = timing_event;
+  klass->scheduled_event = timing_event;
 }
 
 GfsOutputClass * gfs_output_timing_class (void)
@@ -819,7 +908,7 @@ GfsOutputClass * gfs_output_timing_class (void)
   if (klass == NULL) {
     GtsObjectClassInfo gfs_output_timing_info = {
       "GfsOutputTiming",
-      sizeof (GfsOutput),
+      sizeof (GfsOutputTiming),
       sizeof (GfsOutputClass),
       (GtsObjectClassInitFunc) gfs_output_timing_class_init,
       (GtsObjectInitFunc) NULL,
@@ -835,6 +924,99 @@ GfsOutputClass * gfs_output_timing_class (void)
 
 /** \endobject{GfsOutputTiming} */
 
+/**
+ * Writing timer traces.
+ * \beginobject{GfsOutputTrace}
+ */
+
+static void gfs_output_trace_read (GtsObject ** o, GtsFile * fp)
+{
+  (* GTS_OBJECT_CLASS (gfs_output_trace_class ())->parent_class->read) (o, fp);
+  if (fp->type == GTS_ERROR)
+    return;
+
+  /* start recording the timer calls */
+  GfsDomain * domain = GFS_DOMAIN (gfs_object_simulation (*o));
+  if (domain->timer_calls == NULL)
+    domain->timer_calls = g_array_new (FALSE, FALSE, sizeof (GfsTimerCall));
+}
+
+/* Writes the timer calls recorded since the last call using the
+   (unterminated) JSON array format of Chrome traces, one process per
+   MPI rank. The calls are discarded once written. */
+static void write_trace (GfsOutput * output, GfsDomain * domain, FILE * fp)
+{
+  gint pid = MAX (domain->pid, 0);
+  guint i;
+
+  if (output->first_call) {
+    if (pid == 0 || output->parallel)
+      fputs ("[\n", fp);
+    fprintf (fp, 
+	     "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+	     "\"args\":{\"name\":\"process %d\"}},\n",
+	     pid, pid);
+  }
+  for (i = 0; i < domain->timer_calls->len; i++) {
+    GfsTimerCall * c = &g_array_index (domain->timer_calls, GfsTimerCall, i);
+    fprintf (fp, 
+	     "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":0},\n",
+	     gfs_timer_name (c->timer->id), 1e6*c->start, 1e6*(c->end - c->start), pid);
+  }
+  g_array_set_size (domain->timer_calls, 0);
+}
+
+static gboolean gfs_output_trace_event (GfsEvent * event, GfsSimulation * sim)
+{
+  if ((* GFS_EVENT_CLASS (GTS_OBJECT_CLASS (gfs_output_trace_class ())->parent_class)->event)
+      (event, sim)) {
+    GfsDomain * domain = GFS_DOMAIN (sim);
+    GfsOutput * output = GFS_OUTPUT (event);
+    FILE * fp = output->file->fp;
+
+    if (domain->pid < 0 || output->parallel)
+      write_trace (output, domain, fp);
+    else {
+      GfsUnionFile uf;
+      FILE * fpp = gfs_union_open (fp, domain->pid, &uf);
+      write_trace (output, domain, fpp);
+      gfs_union_close (fp, domain->pid, &uf);
+    }
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static void gfs_output_trace_class_init (GfsEventClass * klass)
+{
+  GTS_OBJECT_CLASS (klass)->read = gfs_output_trace_read;
+  klass->event = gfs_output_trace_event;
+  klass->scheduled_event = gfs_output_trace_event;
+}
+
+GfsOutputClass * gfs_output_trace_class (void)
+{
+  static GfsOutputClass * klass = NULL;
+
+  if (klass == NULL) {
+    GtsObjectClassInfo gfs_output_trace_info = {
+      "GfsOutputTrace",
+      sizeof (GfsOutput),
+      sizeof (GfsOutputClass),
+      (GtsObjectClassInitFunc) gfs_output_trace_class_init,
+      (GtsObjectInitFunc) NULL,
+      (GtsArgSetFunc) NULL,
+      (GtsArgGetFunc) NULL
+    };
+    klass = gts_object_class_new (GTS_OBJECT_CLASS (gfs_output_class ()),
+				  &gfs_output_trace_info);
+  }
+
+  return klass;
+}
+
+/** \endobject{GfsOutputTrace} */
+
 /**
  * Writing simulation size statistics.
  * \beginobject{GfsOutputBalance}
@@ -859,6 +1041,12 @@ static gboolean gfs_output_balance_event (GfsEvent * event,
       fprintf (fp, 
 	       "  boundary min: %9.0f avg: %9.0f         | %7.0f max: %9.0f\n",
 	       boundary.min, boundary.mean, boundary.stddev, boundary.max);
+    /* quality of the partition: maximum over average domain size (1
+       is perfect) and fraction of the cells on parallel boundaries */
+    if (size.n > 1 && size.mean > 0.)
+      fprintf (fp,
+	       "  partition imbalance: %.3f boundary/domain: %.3f\n",
+	       size.max/size.mean, boundary.n > 0 ? boundary.sum/size.sum : 0.);
     if (mpiwait.max > 0.)
       fprintf (fp,
 	       "  average timestep MPI wait time:\n"
@@ -872,6 +1060,7 @@ static gboolean gfs_output_balance_event (GfsEvent * event,
 static void gfs_output_balance_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_balance_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_balance_event;
 }
 
 GfsOutputClass * gfs_output_balance_class (void)
@@ -966,6 +1155,7 @@ static void gfs_output_solid_force_class_init (GfsOutputClass * klass)
   GTS_OBJECT_CLASS (klass)->write = gfs_output_solid_force_write;
   GTS_OBJECT_CLASS (klass)->destroy = gfs_output_solid_force_destroy;
   GFS_EVENT_CLASS (klass)->event = gfs_output_solid_force_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_solid_force_event;
 }
 
 GfsOutputClass * gfs_output_solid_force_class (void)
@@ -1002,6 +1192,8 @@ static void gfs_output_location_destroy (GtsObject * object)
 {
   GfsOutputLocation * l = GFS_OUTPUT_LOCATION (object);
   g_array_free (l->p, TRUE);
+  if (l->probes)
+    g_array_free (l->probes, TRUE);
   g_free (l->label);
   if (l->precision != default_precision)
     g_free (l->precision);
@@ -1100,6 +1292,7 @@ static void gfs_output_location_read (GtsObject ** o, GtsFile * fp)
       {GTS_STRING, "label", TRUE, &label},
       {GTS_STRING, "precision", TRUE, &precision},
       {GTS_INT,    "interpolate", TRUE, &l->interpolate},
+      {GTS_INT,    "binary", TRUE, &l->binary},
       {GTS_NONE}
     };
     gts_file_assign_variables (fp, var);
@@ -1138,7 +1331,7 @@ static void gfs_output_location_write (GtsObject * o, FILE * fp)
   g_free (format);
   fputc ('}', fp);
 
-  if (l->precision != default_precision || l->label) {
+  if (l->precision != default_precision || l->label || l->binary) {
     fputs (" {\n", fp);
     if (l->precision != default_precision)
       fprintf (fp, "  precision = %s\n", l->precision);
@@ -1146,10 +1339,80 @@ static void gfs_output_location_write (GtsObject * o, FILE * fp)
       fprintf (fp, "  label = \"%s\"\n", l->label);
     if (!l->interpolate)
       fputs ("  interpolate = 0\n", fp);
+    if (l->binary)
+      fputs ("  binary = 1\n", fp);
     fputc ('}', fp);
   }
 }
 
+/* The probes of a GfsOutputLocation are the locations of the points
+   in computational coordinates together with the leaf cells
+   containing them. Leaf cells are cached until the mesh changes. The
+   probes are sorted by box and Morton key, so that neighbouring
+   probes are interpolated one after the other. */
+
+typedef struct {
+  guint i;        /* index of the point in GfsOutputLocation->p */
+  FttVector p;    /* location in computational coordinates */
+  FttCell * cell; /* leaf cell containing p or NULL */
+  guint box;      /* id of the box containing cell */
+  guint64 key;    /* Morton key of p within this box */
+} LocationProbe;
+
+static guint64 morton_key (FttCell * root, FttVector * p)
+{
+  guint bits = 64/FTT_DIMENSION, c, b;
+  guint64 q[FTT_DIMENSION], key = 0;
+  gdouble h = ftt_cell_size (root);
+  FttVector o;
+
+  ftt_cell_pos (root, &o);
+  for (c = 0; c < FTT_DIMENSION; c++) {
+    gdouble x = ((&p->x)[c] - (&o.x)[c])/h + 0.5;
+    q[c] = CLAMP (x, 0., 1.)*((G_GUINT64_CONSTANT (1) << bits) - 1);
+  }
+  for (b = bits; b-- > 0;)
+    for (c = 0; c < FTT_DIMENSION; c++)
+      key = (key << 1) | ((q[c] >> b) & 1);
+  return key;
+}
+
+static gint compare_probes (const LocationProbe * a, const LocationProbe * b)
+{
+  if (a->box != b->box)
+    return a->box < b->box ? -1 : 1;
+  if (a->key != b->key)
+    return a->key < b->key ? -1 : 1;
+  return a->i < b->i ? -1 : a->i > b->i;
+}
+
+static void location_locate (GfsOutputLocation * location, GfsSimulation * sim)
+{
+  GfsDomain * domain = GFS_DOMAIN (sim);
+  guint i;
+
+  if (location->probes == NULL)
+    location->probes = g_array_new (FALSE, FALSE, sizeof (LocationProbe));
+  g_array_set_size (location->probes, location->p->len);
+  for (i = 0; i < location->p->len; i++) {
+    LocationProbe * probe = &g_array_index (location->probes, LocationProbe, i);
+    GfsBox * box = NULL;
+
+    probe->i = i;
+    probe->p = g_array_index (location->p, FttVector, i);
+    gfs_simulation_map (sim, &probe->p);
+    probe->cell = gfs_domain_locate (domain, probe->p, -1, &box);
+    if (probe->cell) {
+      probe->box = box->id;
+      probe->key = morton_key (box->root, &probe->p);
+    }
+    else
+      probe->box = probe->key = 0;
+  }
+  g_array_sort (location->probes, (GCompareFunc) compare_probes);
+  location->mesh_changes = domain->mesh_changes;
+}
+
 static gboolean gfs_output_location_event (GfsEvent * event, 
 					   GfsSimulation * sim)
 {
@@ -1161,48 +1424,87 @@ static gboolean gfs_output_location_event (GfsEvent * event,
     GfsUnionFile uf;
     FILE * fpp = ((domain->pid < 0 || GFS_OUTPUT (event)->parallel) ? fp:
 		  gfs_union_open (GFS_OUTPUT (event)->file->fp, domain->pid, &uf));
-    guint i;
+    guint i, j, nv = 0, n = 0;
 
-    if (GFS_OUTPUT (event)->first_call) {
-      GSList * i = domain->variables;
-      guint nv = 5;
+    GSList * l = domain->variables;
+    while (l) {
+      if (GFS_VARIABLE (l->data)->name)
+	nv++;
+      l = l->next;
+    }
+    GfsVariable ** v = g_malloc (MAX (nv, 1)*sizeof (GfsVariable *));
+    nv = 0;
+    for (l = domain->variables; l; l = l->next)
+      if (GFS_VARIABLE (l->data)->name)
+	v[nv++] = l->data;
 
+    if (GFS_OUTPUT (event)->first_call) {
       fputs ("# 1:t 2:x 3:y 4:z", fp);
-      while (i) {
-	if (GFS_VARIABLE (i->data)->name)
-	  fprintf (fp, " %d:%s", nv++, GFS_VARIABLE (i->data)->name);
-	i = i->next;
-      }
+      for (j = 0; j < nv; j++)
+	fprintf (fp, " %d:%s", j + 5, v[j]->name);
       fputc ('\n', fp);
     }
-    gchar * pformat = g_strdup_printf ("%s %s %s %s", 
-				       location->precision, location->precision, 
-				       location->precision, location->precision);
-    gchar * vformat = g_strdup_printf (" %s", location->precision);
-    for (i = 0; i < location->p->len; i++) {
-      FttVector p = g_array_index (location->p, FttVector, i), pm = p;
-      gfs_simulation_map (sim, &pm);
-      FttCell * cell = gfs_domain_locate (domain, pm, -1, NULL);
-      
-      if (cell != NULL) {
-	GSList * i = domain->variables;
-	
-	fprintf (fpp, pformat, sim->time.t, p.x, p.y, p.z);
-	while (i) {
-	  GfsVariable * v = i->data;
-	  if (v->name)
-	    fprintf (fpp, vformat, gfs_dimensional_value (v, 
-							  location->interpolate ? 
-							  gfs_interpolate (cell, pm, v) :
-							  GFS_VALUE (cell, v)));
-	  i = i->next;
-	}
-	fputc ('\n', fpp);
+
+    if (location->probes == NULL || location->mesh_changes != domain->mesh_changes)
+      location_locate (location, sim);
+
+    /* values of the variables, computed in the order of the probes */
+    gdouble * val = g_malloc (MAX (location->p->len*nv, 1)*sizeof (gdouble));
+    FttCell ** cell = g_malloc0 (MAX (location->p->len, 1)*sizeof (FttCell *));
+    for (i = 0; i < location->probes->len; i++) {
+      LocationProbe * probe = &g_array_index (location->probes, LocationProbe, i);
+      if (probe->cell) {
+	gdouble * pv = &val[probe->i*nv];
+	if (location->interpolate)
+	  gfs_interpolate_variables (probe->cell, probe->p, v, nv, pv);
+	else
+	  for (j = 0; j < nv; j++)
+	    pv[j] = GFS_VALUE (probe->cell, v[j]);
+	for (j = 0; j < nv; j++)
+	  pv[j] = gfs_dimensional_value (v[j], pv[j]);
+	cell[probe->i] = probe->cell;
+	n++;
+      }
+    }
+
+    if (location->binary) {
+      /* binary columns: t, number of points and of columns, followed
+	 by the columns (x, y, z and variables) of n values each */
+      guint nc = nv + 3;
+      fwrite (&sim->time.t, sizeof (gdouble), 1, fpp);
+      fwrite (&n, sizeof (guint), 1, fpp);
+      fwrite (&nc, sizeof (guint), 1, fpp);
+      gdouble * column = g_malloc (MAX (n, 1)*sizeof (gdouble));
+      for (j = 0; j < nc; j++) {
+	guint k = 0;
+	for (i = 0; i < location->p->len; i++)
+	  if (cell[i])
+	    column[k++] = j < 3 ? 
+	      (&g_array_index (location->p, FttVector, i).x)[j] : val[i*nv + j - 3];
+	fwrite (column, sizeof (gdouble), n, fpp);
       }
+      g_free (column);
+    }
+    else {
+      gchar * pformat = g_strdup_printf ("%s %s %s %s", 
+					 location->precision, location->precision, 
+					 location->precision, location->precision);
+      gchar * vformat = g_strdup_printf (" %s", location->precision);
+      for (i = 0; i < location->p->len; i++)
+	if (cell[i]) {
+	  FttVector p = g_array_index (location->p, FttVector, i);
+	  fprintf (fpp, pformat, sim->time.t, p.x, p.y, p.z);
+	  for (j = 0; j < nv; j++)
+	    fprintf (fpp, vformat, val[i*nv + j]);
+	  fputc ('\n', fpp);
+	}
+      g_free (pformat);
+      g_free (vformat);
     }
 
-    g_free (pformat);
-    g_free (vformat);
+    g_free (val);
+    g_free (cell);
+    g_free (v);
     fflush (fp);
     if (!(domain->pid < 0 || GFS_OUTPUT (event)->parallel))
       gfs_union_close (GFS_OUTPUT (event)->file->fp, domain->pid, &uf);
@@ -1214,6 +1516,7 @@ static gboolean gfs_output_location_event (GfsEvent * event,
 static void gfs_output_location_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_location_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_location_event;
   GTS_OBJECT_CLASS (klass)->destroy = gfs_output_location_destroy;
   GTS_OBJECT_CLASS (klass)->read = gfs_output_location_read;
   GTS_OBJECT_CLASS (klass)->write = gfs_output_location_write;
@@ -1316,6 +1619,120 @@ GfsOutputClass * gfs_output_particle_class (void)
  * \beginobject{GfsOutputSimulation}
  */
 
+/* Asynchronous snapshots: the snapshot is written into a memory
+   buffer by the event and a background thread copies the buffer into
+   the output file while the simulation proceeds */
+
+typedef struct {
+  GfsOutputFile * file;
+  char * buf;
+  size_t len;
+  gint64 offset; /* offset in the file at which buf is written or -1 */
+} AsyncSnapshot;
+
+static GAsyncQueue * async_todo = NULL, * async_done = NULL;
+static guint async_pending = 0;
+static GSList * async_snapshots = NULL;
+
+static gpointer async_writer (gpointer data)
+{
+  while (TRUE) {
+    AsyncSnapshot * s = g_async_queue_pop (async_todo);
+    if (fwrite (s->buf, 1, s->len, s->file->fp) < s->len)
+      g_warning ("could not write asynchronous snapshot:\n%s", strerror (errno));
+    fflush (s->file->fp);
+    g_async_queue_push (async_done, s);
+  }
+  return NULL;
+}
+
+/* Frees the snapshots already written until at most @max are still pending */
+static void async_reap (guint max)
+{
+  while (async_pending > 0) {
+    AsyncSnapshot * s = async_pending > max ? 
+      g_async_queue_pop (async_done) : 
+      g_async_queue_try_pop (async_done);
+    if (s == NULL)
+      break;
+    async_snapshots = g_slist_remove (async_snapshots, s);
+    gfs_output_file_close (s->file);
+    free (s->buf);
+    g_free (s);
+    async_pending--;
+  }
+}
+
+/* Returns the offset in @file at which the next asynchronous
+   snapshot will be written or -1 if @file is not seekable */
+static gint64 async_offset (GfsOutputFile * file)
+{
+  GSList * i;
+  for (i = async_snapshots; i; i = i->next) {
+    AsyncSnapshot * s = i->data;
+    if (s->file == file)
+      return s->offset < 0 ? -1 : s->offset + s->len;
+  }
+  return ftello (file->fp);
+}
+
+static void async_push (GfsOutputFile * file, char * buf, size_t len, gint64 offset,
+			guint max)
+{
+  if (async_todo == NULL) {
+    async_todo = g_async_queue_new ();
+    async_done = g_async_queue_new ();
+    g_thread_new ("GfsOutputSimulation", async_writer, NULL);
+  }
+  async_reap (max - 1);
+  AsyncSnapshot * s = g_malloc (sizeof (AsyncSnapshot));
+  s->file = file;
+  file->refcount++;
+  s->buf = buf;
+  s->len = len;
+  s->offset = offset;
+  async_pending++;
+  async_snapshots = g_slist_prepend (async_snapshots, s);
+  g_async_queue_push (async_todo, s);
+}
+
+/* Returns %TRUE if the file of @output can be written asynchronously
+   i.e. if it is not a standard stream and is not shared with other
+   outputs, whose writes would otherwise be interleaved out of order
+   with the pending snapshots. Files are opened by the first event of
+   each output, so outputs sharing a file are identified by name. */
+static gboolean async_writable (GfsOutput * output, GfsSimulation * sim)
+{
+  GfsOutputFile * file = output->file;
+  if (file->fp == stdout || file->fp == stderr)
+    return FALSE;
+
+  guint refcount = 1;
+  GSList * i;
+  for (i = async_snapshots; i; i = i->next)
+    if (((AsyncSnapshot *) i->data)->file == file)
+      refcount++;
+  if (file->refcount != refcount)
+    return FALSE;
+
+  for (i = sim->events->items; i; i = i->next)
+    if (i->data != output && GFS_IS_OUTPUT (i->data) && GFS_OUTPUT (i->data)->format &&
+	!strcmp (GFS_OUTPUT (i->data)->format, output->format))
+      return FALSE;
+  return TRUE;
+}
+
+/**
+ * gfs_output_simulation_flush:
+ *
+ * Waits until all the snapshots written asynchronously by
+ * #GfsOutputSimulation events have been written.
+ */
+void gfs_output_simulation_flush (void)
+{
+  async_reap (0);
+}
+
 static void output_simulation_destroy (GtsObject * object)
 {
   GfsOutputSimulation * output = GFS_OUTPUT_SIMULATION (object);
@@ -1323,6 +1740,9 @@ static void output_simulation_destroy (GtsObject * object)
   g_slist_free (output->var);
   if (output->precision != default_precision)
     g_free (output->precision);
+  g_free (output->compress);
+  if (output->tolerance)
+    g_hash_table_destroy (output->tolerance);
 
   (* GTS_OBJECT_CLASS (gfs_output_simulation_class ())->parent_class->destroy) (object);
 }
@@ -1371,23 +1791,43 @@ static gboolean output_simulation_event (GfsEvent * event, GfsSimulation * sim)
     }
 
     domain->binary =       output->binary;
+    domain->compress =     (output->tolerance != NULL && output->format == GFS);
+    domain->tolerance_io = output->tolerance;
     sim->output_solid   =  output->solid;
+
+    GfsOutputFile * file = GFS_OUTPUT (event)->file;
+    FILE * fp = file->fp;
+    char * buf = NULL;
+    size_t len = 0;
+    gboolean async = (output->async > 0 && async_writable (GFS_OUTPUT (event), sim));
+    if (async) {
+      fp = open_memstream (&buf, &len);
+      if (fp == NULL)
+	g_error ("GfsOutputSimulation: could not open_memstream:\n%s", strerror (errno));
+      /* the buffer is appended to the file after the pending snapshots */
+      domain->offset_io = async_offset (file);
+    }
+
     switch (output->format) {
 
     case GFS:
       if (GFS_OUTPUT (output)->parallel)
 	gfs_simulation_write (sim,
 			      output->max_depth,
-			      GFS_OUTPUT (event)->file->fp);
-      else
-	gfs_simulation_union_write (sim,
-				    output->max_depth,
-				    GFS_OUTPUT (event)->file->fp);
+			      fp);
+      else {
+	/* regular files are written collectively by all processes */
+	gboolean regular = (!async && file->name && !file->is_pipe &&
+			    strcmp (file->name, "stdout") && strcmp (file->name, "stderr"));
+	gfs_simulation_collective_write (sim,
+					 output->max_depth,
+					 fp,
+					 regular ? file->name : NULL);
+      }
       break;
 
     case GFS_TEXT: {
       if (GFS_OUTPUT (output)->parallel || domain->pid <= 0) {
-	FILE * fp = GFS_OUTPUT (event)->file->fp;
 	GSList * i = domain->variables_io;
 	guint nv = 4;
 
@@ -1402,36 +1842,69 @@ static gboolean output_simulation_event (GfsEvent * event, GfsSimulation * sim)
       gpointer data[2];
       data[0] = output;
       if (GFS_OUTPUT (output)->parallel) {
-	data[1] = GFS_OUTPUT (event)->file->fp;
+	data[1] = fp;
 	gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL|FTT_TRAVERSE_LEAFS,
 				  output->max_depth,
 				  (FttCellTraverseFunc) write_text, data);
       }
       else {
 	GfsUnionFile uf;
-	FILE * fpp = gfs_union_open (GFS_OUTPUT (event)->file->fp, domain->pid, &uf);
+	FILE * fpp = gfs_union_open (fp, domain->pid, &uf);
 	data[1] = fpp;
 	gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEVEL|FTT_TRAVERSE_LEAFS,
 				  output->max_depth,
 				  (FttCellTraverseFunc) write_text, data);
-	gfs_union_close (GFS_OUTPUT (event)->file->fp, domain->pid, &uf);
+	gfs_union_close (fp, domain->pid, &uf);
       }
       break;
     }
 
     case GFS_VTK: {
       gfs_domain_write_vtk (domain, output->max_depth, domain->variables_io, output->precision,
-			    GFS_OUTPUT (event)->file->fp);
+			    fp);
+      break;
+    }
+
+    case GFS_VTU: {
+      gboolean zlib = (output->compress != NULL);
+      if (domain->pid < 0 || GFS_OUTPUT (output)->parallel)
+	gfs_domain_write_vtu (domain, output->max_depth, domain->variables_io, zlib, fp);
+      else if (GFS_OUTPUT (output)->formats == NULL)
+	g_warning ("GfsOutputSimulation: parallel VTU output requires a file name");
+      else {
+	/* each process writes its own piece in name-pid.vtu and the
+	   master process writes the index of the pieces in the output
+	   file name.pvtu (see output_simulation_read()) */
+	gchar * fname = gfs_format_string (GFS_OUTPUT (output)->formats, domain->pid,
+					   sim->time.i, sim->time.t);
+	if (g_str_has_suffix (fname, ".pvtu"))
+	  fname[strlen (fname) - 5] = '\0';
+	gchar * piece = g_strdup_printf ("%s-%d.vtu", fname, domain->pid);
+	FILE * fpp = fopen (piece, "w");
+	if (fpp == NULL)
+	  g_warning ("could not open file `%s'", piece);
+	else {
+	  gfs_domain_write_vtu (domain, output->max_depth, domain->variables_io, zlib, fpp);
+	  fclose (fpp);
+	}
+	if (domain->pid == 0) {
+	  gchar * base = g_path_get_basename (fname);
+	  gfs_domain_write_pvtu (domain, domain->variables_io, base, fp);
+	  g_free (base);
+	}
+	g_free (piece);
+	g_free (fname);
+      }
       break;
     }
 
     case GFS_TECPLOT: {
       gfs_domain_write_tecplot (domain, output->max_depth, domain->variables_io, output->precision,
-				GFS_OUTPUT (event)->file->fp);
+				fp);
 #if !FTT_2D 
       gfs_domain_write_tecplot_surface (domain, output->max_depth, domain->variables_io, 
 					output->precision,
-					GFS_OUTPUT (event)->file->fp);
+					fp);
 #endif
       break;
     }
@@ -1439,10 +1912,17 @@ static gboolean output_simulation_event (GfsEvent * event, GfsSimulation * sim)
     default:
       g_assert_not_reached ();
     }
+    if (async) {
+      fclose (fp);
+      async_push (file, buf, len, domain->offset_io, output->async);
+    }
     if (!output->var)
       g_slist_free (domain->variables_io);
     domain->variables_io = NULL;
     domain->binary =       TRUE;
+    domain->compress =     FALSE;
+    domain->tolerance_io = NULL;
+    domain->offset_io =    0;
     sim->output_solid   =  TRUE;
     return TRUE;
   }
@@ -1475,13 +1955,56 @@ static void output_simulation_write (GtsObject * o, FILE * fp)
   case GFS_TEXT:    fputs (" format = text", fp);    break;
   case GFS_VTK:     fputs (" format = VTK", fp);     break;
   case GFS_TECPLOT: fputs (" format = Tecplot", fp); break;
+  case GFS_VTU:     fputs (" format = VTU", fp);     break;
   default: break;
   }
   if (output->precision != default_precision)
     fprintf (fp, " precision = %s", output->precision);
+  if (output->async > 0)
+    fprintf (fp, " async = %d", output->async);
+  if (output->compress)
+    fprintf (fp, " compress = %s", output->compress);
   fputs (" }", fp);
 }
 
+/* Returns a table of the compression tolerances of the variables in
+   @list, a comma-separated list of "name" (lossless compression) or
+   "name:tolerance" entries */
+static GHashTable * compression_tolerances (GfsDomain * domain, const gchar * list, 
+					    gchar ** error)
+{
+  GHashTable * tolerance = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  gchar ** entries = g_strsplit (list, ",", 0), ** i;
+
+  for (i = entries; *i; i++) {
+    gchar * s = strchr (*i, ':'), * end;
+    gdouble * tol = g_malloc (sizeof (gdouble));
+    *tol = 0.;
+    if (s) {
+      *s++ = '\0';
+      *tol = strtod (s, &end);
+      if (*end != '\0' || *tol < 0.) {
+	*error = g_strdup_printf ("invalid tolerance `%s' for variable `%s'", s, *i);
+	g_free (tol);
+	break;
+      }
+    }
+    GfsVariable * v = gfs_variable_from_name (domain->variables, *i);
+    if (v == NULL) {
+      *error = g_strdup_printf ("unknown variable `%s'", *i);
+      g_free (tol);
+      break;
+    }
+    g_hash_table_insert (tolerance, v, tol);
+  }
+  g_strfreev (entries);
+  if (*error) {
+    g_hash_table_destroy (tolerance);
+    return NULL;
+  }
+  return tolerance;
+}
+
 static void output_simulation_read (GtsObject ** o, GtsFile * fp)
 {
   (* GTS_OBJECT_CLASS (gfs_output_simulation_class ())->parent_class->read) (o, fp);
@@ -1498,9 +2021,11 @@ static void output_simulation_read (GtsObject ** o, GtsFile * fp)
       {GTS_INT,    "solid",     TRUE},
       {GTS_STRING, "format",    TRUE},
       {GTS_STRING, "precision", TRUE},
+      {GTS_UINT,   "async",     TRUE},
+      {GTS_STRING, "compress",  TRUE},
       {GTS_NONE}
     };
-    gchar * variables = NULL, * format = NULL, * precision = NULL;
+    gchar * variables = NULL, * format = NULL, * precision = NULL, * compress = NULL;
 
     var[0].data = &output->max_depth;
     var[1].data = &variables;
@@ -1508,30 +2033,17 @@ static void output_simulation_read (GtsObject ** o, GtsFile * fp)
     var[3].data = &output->solid;
     var[4].data = &format;
     var[5].data = &precision;
+    var[6].data = &output->async;
+    var[7].data = &compress;
     gts_file_assign_variables (fp, var);
     if (fp->type == GTS_ERROR) {
       g_free (variables);
       g_free (format);
       g_free (precision);
+      g_free (compress);
       return;
     }
 
-    if (variables != NULL) {
-      gchar * error = NULL;
-      GfsDomain * domain = GFS_DOMAIN (gfs_object_simulation (output));
-      GSList * vars = gfs_variables_from_list (domain->variables, variables, &error);
-
-      if (vars == NULL) {
-	gts_file_variable_error (fp, var, "variables",
-				 "unknown variable `%s'", error);
-	g_free (variables);
-	return;
-      }
-      g_slist_free (output->var);
-      output->var = vars;
-      g_free (variables);
-    }
-
     if (format != NULL) {
       if (!strcmp (format, "gfs"))
 	output->format = GFS;
@@ -1541,26 +2053,95 @@ static void output_simulation_read (GtsObject ** o, GtsFile * fp)
 	output->format = GFS_VTK;
       else if (!strcmp (format, "Tecplot"))
 	output->format = GFS_TECPLOT;
+      else if (!strcmp (format, "VTU"))
+	output->format = GFS_VTU;
       else {
 	gts_file_variable_error (fp, var, "format",
 				 "unknown format `%s'", format);
+	g_free (variables);
 	g_free (format);
+	g_free (precision);
+	g_free (compress);
 	return;
       }
       g_free (format);
     }
 
+    if (compress != NULL && output->format == GFS_VTU) {
+      if (strcmp (compress, "zlib")) {
+	gts_file_variable_error (fp, var, "compress",
+				 "unknown compression `%s' for VTU format", compress);
+	g_free (variables);
+	g_free (precision);
+	g_free (compress);
+	return;
+      }
+      g_free (output->compress);
+      output->compress = compress;
+      if (output->tolerance)
+	g_hash_table_destroy (output->tolerance);
+      output->tolerance = NULL;
+    }
+    else if (compress != NULL) {
+      gchar * error = NULL;
+      GHashTable * tolerance = 
+	compression_tolerances (GFS_DOMAIN (gfs_object_simulation (output)), compress, &error);
+      if (tolerance == NULL) {
+	gts_file_variable_error (fp, var, "compress", "%s", error);
+	g_free (error);
+	g_free (variables);
+	g_free (precision);
+	g_free (compress);
+	return;
+      }
+      g_free (output->compress);
+      output->compress = compress;
+      if (output->tolerance)
+	g_hash_table_destroy (output->tolerance);
+      output->tolerance = tolerance;
+    }
+
+    if (variables != NULL) {
+      gchar * error = NULL;
+      GfsDomain * domain = GFS_DOMAIN (gfs_object_simulation (output));
+      GSList * vars = gfs_variables_from_list (domain->variables, variables, &error);
+
+      if (vars == NULL) {
+	gts_file_variable_error (fp, var, "variables",
+				 "unknown variable `%s'", error);
+	g_free (variables);
+	return;
+      }
+      g_slist_free (output->var);
+      output->var = vars;
+      g_free (variables);
+    }
+
     if (precision != NULL) {
       if (output->precision != default_precision)
 	g_free (output->precision);
       output->precision = precision;
     }
   }
+
+  /* in parallel, the output file of the master process is the .pvtu
+     index of the pieces and must be named accordingly */
+  GfsOutput * out = GFS_OUTPUT (output);
+  if (output->format == GFS_VTU && !out->parallel && out->formats &&
+      GFS_DOMAIN (gfs_object_simulation (output))->pid >= 0 &&
+      g_str_has_suffix (out->format, ".vtu")) {
+    gchar * format = g_strdup_printf ("%.*s.pvtu", (int) strlen (out->format) - 4, out->format);
+    g_free (out->format);
+    out->format = format;
+    gfs_format_destroy (out->formats);
+    out->formats = gfs_format_new (out->format, NULL, NULL, NULL);
+  }
 }
 
 static void gfs_output_simulation_class_init (GfsEventClass * klass)
 {
   klass->event = output_simulation_event;
+  klass->scheduled_event = output_simulation_event;
   GTS_OBJECT_CLASS (klass)->destroy = output_simulation_destroy;
   GTS_OBJECT_CLASS (klass)->read = output_simulation_read;
   GTS_OBJECT_CLASS (klass)->write = output_simulation_write;
@@ -1574,6 +2155,9 @@ static void gfs_output_simulation_init (GfsOutputSimulation * object)
   object->solid = 1;
   object->format = GFS;
   object->precision = default_precision;
+  object->async = 0;
+  object->compress = NULL;
+  object->tolerance = NULL;
 }
 
 GfsOutputClass * gfs_output_simulation_class (void)
@@ -1621,6 +2205,7 @@ static gboolean output_boundaries_event (GfsEvent * event, GfsSimulation * sim)
 static void gfs_output_boundaries_class_init (GfsEventClass * klass)
 {
   klass->event = output_boundaries_event;
+  klass->scheduled_event = output_boundaries_event;
 }
 
 GfsOutputClass * gfs_output_boundaries_class (void)
@@ -1838,11 +2423,6 @@ static void gfs_output_scalar_write (GtsObject * o, FILE * fp)
     fputs (" }", fp);
 }
 
-static void update_v (FttCell * cell, GfsOutputScalar * output)
-{
-  GFS_VALUE (cell, output->v) = gfs_function_value (output->f, cell);
-}
-
 static gboolean cell_condition (FttCell * cell, gpointer condition)
 {
   return gfs_function_value (condition, cell);
@@ -1878,7 +2458,7 @@ static gboolean gfs_output_scalar_event (GfsEvent * event,
 	gfs_variable_is_dimensional (output->v)) {
       output->v = gfs_temporary_variable (domain);
       gfs_catch_floating_point_exceptions ();
-      gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) update_v, output);
+      gfs_function_fill (output->f, output->v, FTT_TRAVERSE_LEAFS, -1);
       gfs_restore_fpe_for_function (output->f);
       gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, output->v);
     }
@@ -1919,6 +2499,7 @@ static void gfs_output_scalar_post_event (GfsEvent * event,
 static void gfs_output_scalar_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_scalar_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_scalar_event;
   GFS_EVENT_CLASS (klass)->post_event = gfs_output_scalar_post_event;
   GTS_OBJECT_CLASS (klass)->read = gfs_output_scalar_read;
   GTS_OBJECT_CLASS (klass)->write = gfs_output_scalar_write;
@@ -1988,6 +2569,7 @@ static gboolean gfs_output_scalar_norm_event (GfsEvent * event,
 static void gfs_output_scalar_norm_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_scalar_norm_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_scalar_norm_event;
 }
 
 GfsOutputClass * gfs_output_scalar_norm_class (void)
@@ -2050,6 +2632,7 @@ static gboolean gfs_output_scalar_stats_event (GfsEvent * event,
 static void gfs_output_scalar_stats_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_scalar_stats_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_scalar_stats_event;
 }
 
 GfsOutputClass * gfs_output_scalar_stats_class (void)
@@ -2125,6 +2708,7 @@ static gboolean gfs_output_scalar_sum_event (GfsEvent * event,
 static void gfs_output_scalar_sum_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_scalar_sum_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_scalar_sum_event;
 }
 
 GfsOutputClass * gfs_output_scalar_sum_class (void)
@@ -2245,6 +2829,7 @@ static void gfs_output_scalar_maxima_class_init (GfsOutputClass * klass)
   GTS_OBJECT_CLASS (klass)->read = gfs_output_scalar_maxima_read;
   GTS_OBJECT_CLASS (klass)->write = gfs_output_scalar_maxima_write;
   GFS_EVENT_CLASS (klass)->event = gfs_output_scalar_maxima_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_scalar_maxima_event;
 }
 
 GfsOutputClass * gfs_output_scalar_maxima_class (void)
@@ -2465,6 +3050,7 @@ static gboolean gfs_output_scalar_histogram_event (GfsEvent * event,
 static void gfs_output_scalar_histogram_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_scalar_histogram_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_scalar_histogram_event;
   GTS_OBJECT_CLASS (klass)->read = gfs_output_scalar_histogram_read;
   GTS_OBJECT_CLASS (klass)->write = gfs_output_scalar_histogram_write;
   GTS_OBJECT_CLASS (klass)->destroy = gfs_output_scalar_histogram_destroy;
@@ -2570,11 +3156,6 @@ static void droplet_sums (FttCell * cell, DropSumsPar * p)
   }
 }
 
-static void compute_c (FttCell * cell, DropSumsPar * p)
-{
-  GFS_VALUE (cell, p->c) = gfs_function_value (p->fc, cell);
-}
-
 static int volume_sort (const void * p1, const void * p2)
 {
   VolumePair * a = (VolumePair *) p1;
@@ -2595,8 +3176,7 @@ static gboolean gfs_output_droplet_sums_event (GfsEvent * event, GfsSimulation *
       p.c = gfs_temporary_variable (domain);
       p.fc = d->c;
       gfs_catch_floating_point_exceptions ();
-      gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
-				(FttCellTraverseFunc) compute_c, &p);
+      gfs_function_fill (p.fc, p.c, FTT_TRAVERSE_ALL, -1);
       gfs_restore_fpe_for_function (p.fc);
     }
     p.tag = d->tag ? d->tag : gfs_temporary_variable (domain);
@@ -2638,6 +3218,7 @@ static gboolean gfs_output_droplet_sums_event (GfsEvent * event, GfsSimulation *
 static void gfs_output_droplet_sums_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_droplet_sums_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_droplet_sums_event;
   GTS_OBJECT_CLASS (klass)->read = gfs_output_droplet_sums_read;
   GTS_OBJECT_CLASS (klass)->write = gfs_output_droplet_sums_write;
   GTS_OBJECT_CLASS (klass)->destroy = gfs_output_droplet_sums_destroy;
@@ -2924,6 +3505,7 @@ static void gfs_output_error_norm_class_init (GfsOutputClass * klass)
   GTS_OBJECT_CLASS (klass)->read = output_error_norm_read;
   GTS_OBJECT_CLASS (klass)->write = output_error_norm_write;
   GFS_EVENT_CLASS (klass)->event = gfs_output_error_norm_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_error_norm_event;
 }
 
 static void output_error_norm_init (GfsOutputErrorNorm * e)
@@ -3034,6 +3616,7 @@ static gboolean gfs_output_correlation_event (GfsEvent * event,
 static void gfs_output_correlation_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_correlation_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_correlation_event;
 }
 
 GfsOutputClass * gfs_output_correlation_class (void)
@@ -3083,6 +3666,7 @@ static gboolean gfs_output_squares_event (GfsEvent * event, GfsSimulation * sim)
 static void gfs_output_squares_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_squares_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_squares_event;
 }
 
 GfsOutputClass * gfs_output_squares_class (void)
@@ -3180,6 +3764,7 @@ static gboolean gfs_output_streamline_event (GfsEvent * event,
 static void gfs_output_streamline_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_streamline_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_streamline_event;
   GTS_OBJECT_CLASS (klass)->read = gfs_output_streamline_read;
   GTS_OBJECT_CLASS (klass)->write = gfs_output_streamline_write;
 }
@@ -3207,6 +3792,423 @@ GfsOutputClass * gfs_output_streamline_class (void)
 
 /** \endobject{GfsOutputStreamline} */
 
+#if !FTT_2D
+
+/* PolygonMesh: polygonal meshes written by GfsOutputSlice and
+   GfsOutputIsosurface */
+
+typedef struct {
+  float p[3], val;
+} MeshVertex;
+
+typedef struct {
+  GArray * v;         /* MeshVertex */
+  GArray * np;        /* number of vertices of each polygon */
+  GArray * index;     /* vertex indices of each polygon */
+  guint * hash, size; /* open-addressing table of vertex indices + 1 */
+} PolygonMesh;
+
+static void polygon_mesh_init (PolygonMesh * mesh, gboolean weld)
+{
+  mesh->v = g_array_new (FALSE, FALSE, sizeof (MeshVertex));
+  mesh->np = g_array_new (FALSE, FALSE, sizeof (guint));
+  mesh->index = g_array_new (FALSE, FALSE, sizeof (guint));
+  mesh->size = weld ? 1024 : 0;
+  mesh->hash = weld ? g_malloc0 (mesh->size*sizeof (guint)) : NULL;
+}
+
+static void polygon_mesh_free (PolygonMesh * mesh)
+{
+  g_array_free (mesh->v, TRUE);
+  g_array_free (mesh->np, TRUE);
+  g_array_free (mesh->index, TRUE);
+  g_free (mesh->hash);
+}
+
+static guint mesh_vertex_hash (const MeshVertex * v)
+{
+  guint32 k[3];
+  memcpy (k, v->p, 3*sizeof (guint32));
+  return (k[0]*73856093) ^ (k[1]*19349663) ^ (k[2]*83492791);
+}
+
+static guint * polygon_mesh_lookup (PolygonMesh * mesh, const MeshVertex * v)
+{
+  guint i = mesh_vertex_hash (v) & (mesh->size - 1);
+  while (mesh->hash[i] && 
+	 memcmp (g_array_index (mesh->v, MeshVertex, mesh->hash[i] - 1).p, v->p,
+		 3*sizeof (float)))
+    i = (i + 1) & (mesh->size - 1);
+  return &mesh->hash[i];
+}
+
+static void polygon_mesh_grow (PolygonMesh * mesh)
+{
+  guint i;
+  g_free (mesh->hash);
+  mesh->size *= 2;
+  mesh->hash = g_malloc0 (mesh->size*sizeof (guint));
+  for (i = 0; i < mesh->v->len; i++)
+    *polygon_mesh_lookup (mesh, &g_array_index (mesh->v, MeshVertex, i)) = i + 1;
+}
+
+/* Adds a polygon of @n vertices @v (in computational coordinates),
+   with values @val (or NULL) */
+static void polygon_mesh_add (PolygonMesh * mesh, GfsSimulation * sim,
+			      FttVector * v, gdouble * val, guint n)
+{
+  guint i;
+
+  g_array_append_val (mesh->np, n);
+  for (i = 0; i < n; i++) {
+    FttVector p = v[i];
+    MeshVertex vertex;
+    guint index = mesh->v->len;
+
+    gfs_simulation_map_inverse (sim, &p);
+    vertex.p[0] = p.x; vertex.p[1] = p.y; vertex.p[2] = p.z;
+    vertex.val = val ? val[i] : 0.;
+    if (mesh->hash) {
+      guint * h = polygon_mesh_lookup (mesh, &vertex);
+      if (*h)
+	index = *h - 1;
+      else {
+	*h = index + 1;
+	g_array_append_val (mesh->v, vertex);
+	if (2*mesh->v->len > mesh->size)
+	  polygon_mesh_grow (mesh);
+      }
+    }
+    else
+      g_array_append_val (mesh->v, vertex);
+    g_array_append_val (mesh->index, index);
+  }
+}
+
+/* Binary mesh: t, number of vertices, of polygons and of value
+   columns, followed by the x, y, z (and value) columns of the
+   vertices (as floats), the number of vertices of each polygon and
+   the vertex indices of each polygon */
+static void polygon_mesh_write (PolygonMesh * mesh, gdouble t, guint nc, FILE * fp)
+{
+  guint i, j, nv = mesh->v->len, np = mesh->np->len;
+  float * column = g_malloc (MAX (nv, 1)*sizeof (float));
+
+  fwrite (&t, sizeof (gdouble), 1, fp);
+  fwrite (&nv, sizeof (guint), 1, fp);
+  fwrite (&np, sizeof (guint), 1, fp);
+  fwrite (&nc, sizeof (guint), 1, fp);
+  for (j = 0; j < 3 + nc; j++) {
+    for (i = 0; i < nv; i++)
+      column[i] = g_array_index (mesh->v, MeshVertex, i).p[j];
+    fwrite (column, sizeof (float), nv, fp);
+  }
+  g_free (column);
+  fwrite (mesh->np->data, sizeof (guint), np, fp);
+  fwrite (mesh->index->data, sizeof (guint), mesh->index->len, fp);
+}
+
+/* Writes @mesh either directly into the file of @output or, for
+   non-parallel outputs of parallel simulations, as one block per
+   process in the union file */
+static void output_polygon_mesh (GfsOutput * output, GfsDomain * domain, 
+				 PolygonMesh * mesh, guint nc)
+{
+  FILE * fp = output->file->fp;
+  if (domain->pid < 0 || output->parallel)
+    polygon_mesh_write (mesh, GFS_SIMULATION (domain)->time.t, nc, fp);
+  else {
+    GfsUnionFile uf;
+    FILE * fpp = gfs_union_open (fp, domain->pid, &uf);
+    polygon_mesh_write (mesh, GFS_SIMULATION (domain)->time.t, nc, fpp);
+    gfs_union_close (fp, domain->pid, &uf);
+  }
+  fflush (fp);
+}
+
+/**
+ * Planar slices.
+ * \beginobject{GfsOutputSlice}
+ */
+
+static void gfs_output_slice_read (GtsObject ** o, GtsFile * fp)
+{
+  GfsOutputSlice * s = GFS_OUTPUT_SLICE (*o);
+
+  if (GTS_OBJECT_CLASS (gfs_output_slice_class ())->parent_class->read)
+    (* GTS_OBJECT_CLASS (gfs_output_slice_class ())->parent_class->read) 
+      (o, fp);
+  if (fp->type == GTS_ERROR)
+    return;
+
+  if (fp->type == '{') {
+    GtsFileVariable var[] = {
+      {GTS_DOUBLE, "x",  TRUE},
+      {GTS_DOUBLE, "y",  TRUE},
+      {GTS_DOUBLE, "z",  TRUE},
+      {GTS_DOUBLE, "nx", TRUE},
+      {GTS_DOUBLE, "ny", TRUE},
+      {GTS_DOUBLE, "nz", TRUE},
+      {GTS_NONE}
+    };
+    var[0].data = &s->p.x;
+    var[1].data = &s->p.y;
+    var[2].data = &s->p.z;
+    var[3].data = &s->n.x;
+    var[4].data = &s->n.y;
+    var[5].data = &s->n.z;
+    gts_file_assign_variables (fp, var);
+    if (fp->type == GTS_ERROR)
+      return;
+    if (s->n.x == 0. && s->n.y == 0. && s->n.z == 0.) {
+      gts_file_error (fp, "the normal to the plane must be non-zero");
+      return;
+    }
+  }
+
+  /* the slice is only planar for linear mappings */
+  GfsDomain * domain = GFS_DOMAIN (gfs_object_simulation (*o));
+  if (domain->metric_data || domain->face_metric || domain->cell_metric) {
+    gts_file_error (fp, "GfsOutputSlice cannot be used with a metric");
+    return;
+  }
+  GSList * i = GFS_SIMULATION (domain)->maps->items;
+  while (i) {
+    if (GFS_IS_MAP_FUNCTION (i->data)) {
+      gts_file_error (fp, "GfsOutputSlice cannot be used with GfsMapFunction");
+      return;
+    }
+    i = i->next;
+  }
+}
+
+static void gfs_output_slice_write (GtsObject * o, FILE * fp)
+{
+  GfsOutputSlice * s = GFS_OUTPUT_SLICE (o);
+
+  if (GTS_OBJECT_CLASS (gfs_output_slice_class ())->parent_class->write)
+    (* GTS_OBJECT_CLASS (gfs_output_slice_class ())->parent_class->write) 
+      (o, fp);
+  fprintf (fp, " { x = %g y = %g z = %g nx = %g ny = %g nz = %g }",
+	   s->p.x, s->p.y, s->p.z, s->n.x, s->n.y, s->n.z);
+}
+
+static gboolean slice_cuts_cell (FttCell * cell, GfsOutputSlice * s)
+{
+  return gfs_plane_cuts_cell (s->plane, cell);
+}
+
+static void slice_polygon (FttCell * cell, gpointer * data)
+{
+  GfsOutputScalar * output = data[0];
+  FttVector * p = data[2];
+  FttVector v[12];
+  FttDirection d[12];
+  gdouble val[12];
+  guint n;
+
+  if ((!FTT_CELL_IS_LEAF (cell) && ftt_cell_level (cell) != output->maxlevel) ||
+      (output->condition && !gfs_function_value (output->condition, cell)))
+    return;
+  /* output->v is dimensional (see gfs_output_scalar_event()) */
+  if ((n = gfs_cut_cube_vertices (cell, output->maxlevel, p, data[3],
+				  v, d, output->v, val)))
+    polygon_mesh_add (data[1], gfs_object_simulation (output), v, val, n);
+}
+
+static gboolean gfs_output_slice_event (GfsEvent * event, GfsSimulation * sim)
+{
+  if ((* GFS_EVENT_CLASS (GTS_OBJECT_CLASS (gfs_output_slice_class ())->parent_class)->event)
+      (event, sim)) {
+    GfsOutputSlice * s = GFS_OUTPUT_SLICE (event);
+    FttVector p = s->p, t1, t2, * n = &s->n, mn;
+    PolygonMesh mesh;
+    gpointer data[4];
+    FttComponent c;
+
+    /* three points of the plane, for gfs_plane_cuts_cell() */
+    if (fabs (n->x) <= fabs (n->y) && fabs (n->x) <= fabs (n->z)) {
+      t1.x = 0.; t1.y = n->z; t1.z = - n->y;
+    }
+    else if (fabs (n->y) <= fabs (n->z)) {
+      t1.x = - n->z; t1.y = 0.; t1.z = n->x;
+    }
+    else {
+      t1.x = n->y; t1.y = - n->x; t1.z = 0.;
+    }
+    t2.x = n->y*t1.z - n->z*t1.y;
+    t2.y = n->z*t1.x - n->x*t1.z;
+    t2.z = n->x*t1.y - n->y*t1.x;
+    s->plane[0] = p;
+    s->plane[1].x = p.x + t1.x; s->plane[1].y = p.y + t1.y; s->plane[1].z = p.z + t1.z;
+    s->plane[2].x = p.x + t2.x; s->plane[2].y = p.y + t2.y; s->plane[2].z = p.z + t2.z;
+
+    /* the (linear) mapping transforms the plane into a plane: its
+       normal is obtained from the mapped points */
+    for (c = 0; c < 3; c++)
+      gfs_simulation_map (sim, &s->plane[c]);
+    p = s->plane[0];
+    for (c = 0; c < 3; c++) {
+      (&t1.x)[c] = (&s->plane[1].x)[c] - (&p.x)[c];
+      (&t2.x)[c] = (&s->plane[2].x)[c] - (&p.x)[c];
+    }
+    mn.x = t1.y*t2.z - t1.z*t2.y;
+    mn.y = t1.z*t2.x - t1.x*t2.z;
+    mn.z = t1.x*t2.y - t1.y*t2.x;
+
+    polygon_mesh_init (&mesh, FALSE);
+    data[0] = s;
+    data[1] = &mesh;
+    data[2] = &p;
+    data[3] = &mn;
+    gfs_domain_cell_traverse_condition (GFS_DOMAIN (sim), 
+					FTT_PRE_ORDER, FTT_TRAVERSE_ALL, 
+					GFS_OUTPUT_SCALAR (s)->maxlevel,
+					(FttCellTraverseFunc) slice_polygon, data,
+					(gboolean (*) (FttCell *, gpointer)) slice_cuts_cell, s);
+    output_polygon_mesh (GFS_OUTPUT (event), GFS_DOMAIN (sim), &mesh, 1);
+    polygon_mesh_free (&mesh);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static void gfs_output_slice_class_init (GfsOutputClass * klass)
+{
+  GFS_EVENT_CLASS (klass)->event = gfs_output_slice_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_slice_event;
+  GTS_OBJECT_CLASS (klass)->read = gfs_output_slice_read;
+  GTS_OBJECT_CLASS (klass)->write = gfs_output_slice_write;
+}
+
+static void gfs_output_slice_init (GfsOutputSlice * s)
+{
+  s->n.z = 1.;
+}
+
+GfsOutputClass * gfs_output_slice_class (void)
+{
+  static GfsOutputClass * klass = NULL;
+
+  if (klass == NULL) {
+    GtsObjectClassInfo gfs_output_slice_info = {
+      "GfsOutputSlice",
+      sizeof (GfsOutputSlice),
+      sizeof (GfsOutputClass),
+      (GtsObjectClassInitFunc) gfs_output_slice_class_init,
+      (GtsObjectInitFunc) gfs_output_slice_init,
+      (GtsArgSetFunc) NULL,
+      (GtsArgGetFunc) NULL
+    };
+    klass = gts_object_class_new (GTS_OBJECT_CLASS (gfs_output_scalar_class ()),
+				  &gfs_output_slice_info);
+  }
+
+  return klass;
+}
+
+/** \endobject{GfsOutputSlice} */
+
+/**
+ * Isosurfaces.
+ * \beginobject{GfsOutputIsosurface}
+ */
+
+static void gfs_output_isosurface_read (GtsObject ** o, GtsFile * fp)
+{
+  if (GTS_OBJECT_CLASS (gfs_output_isosurface_class ())->parent_class->read)
+    (* GTS_OBJECT_CLASS (gfs_output_isosurface_class ())->parent_class->read) 
+      (o, fp);
+  if (fp->type == GTS_ERROR)
+    return;
+
+  if (fp->type == '{') {
+    GtsFileVariable var[] = {
+      {GTS_DOUBLE, "value", TRUE},
+      {GTS_NONE}
+    };
+    var[0].data = &GFS_OUTPUT_ISOSURFACE (*o)->value;
+    gts_file_assign_variables (fp, var);
+  }
+}
+
+static void gfs_output_isosurface_write (GtsObject * o, FILE * fp)
+{
+  if (GTS_OBJECT_CLASS (gfs_output_isosurface_class ())->parent_class->write)
+    (* GTS_OBJECT_CLASS (gfs_output_isosurface_class ())->parent_class->write) 
+      (o, fp);
+  fprintf (fp, " { value = %g }", GFS_OUTPUT_ISOSURFACE (o)->value);
+}
+
+static void isosurface_polygons (FttCell * cell, gpointer * data)
+{
+  GfsOutputScalar * output = data[0];
+  FttVector v[12];
+  guint i, np[4], n = gfs_cut_cube_isosurface (cell, output->maxlevel, output->v,
+					       GFS_OUTPUT_ISOSURFACE (output)->value,
+					       v, np);
+  FttVector * p = v;
+
+  for (i = 0; i < n; i++) {
+    polygon_mesh_add (data[1], gfs_object_simulation (output), p, NULL, np[i]);
+    p += np[i];
+  }
+}
+
+static gboolean gfs_output_isosurface_event (GfsEvent * event, GfsSimulation * sim)
+{
+  if ((* GFS_EVENT_CLASS (GTS_OBJECT_CLASS (gfs_output_isosurface_class ())->parent_class)->event)
+      (event, sim)) {
+    PolygonMesh mesh;
+    gpointer data[2];
+
+    polygon_mesh_init (&mesh, TRUE);
+    data[0] = event;
+    data[1] = &mesh;
+    output_scalar_traverse (GFS_OUTPUT_SCALAR (event), 
+			    FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS|FTT_TRAVERSE_LEVEL,
+			    GFS_OUTPUT_SCALAR (event)->maxlevel,
+			    (FttCellTraverseFunc) isosurface_polygons, data);
+    output_polygon_mesh (GFS_OUTPUT (event), GFS_DOMAIN (sim), &mesh, 0);
+    polygon_mesh_free (&mesh);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static void gfs_output_isosurface_class_init (GfsOutputClass * klass)
+{
+  GFS_EVENT_CLASS (klass)->event = gfs_output_isosurface_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_isosurface_event;
+  GTS_OBJECT_CLASS (klass)->read = gfs_output_isosurface_read;
+  GTS_OBJECT_CLASS (klass)->write = gfs_output_isosurface_write;
+}
+
+GfsOutputClass * gfs_output_isosurface_class (void)
+{
+  static GfsOutputClass * klass = NULL;
+
+  if (klass == NULL) {
+    GtsObjectClassInfo gfs_output_isosurface_info = {
+      "GfsOutputIsosurface",
+      sizeof (GfsOutputIsosurface),
+      sizeof (GfsOutputClass),
+      (GtsObjectClassInitFunc) gfs_output_isosurface_class_init,
+      (GtsObjectInitFunc) NULL,
+      (GtsArgSetFunc) NULL,
+      (GtsArgGetFunc) NULL
+    };
+    klass = gts_object_class_new (GTS_OBJECT_CLASS (gfs_output_scalar_class ()),
+				  &gfs_output_isosurface_info);
+  }
+
+  return klass;
+}
+
+/** \endobject{GfsOutputIsosurface} */
+
+#endif /* 3D */
+
 /**
  * Writing 2D images.
  * \beginobject{GfsOutputPPM}
@@ -3255,6 +4257,7 @@ static void gfs_output_ppm_class_init (GfsOutputClass * klass)
 {
   GTS_OBJECT_CLASS (klass)->read = gfs_output_ppm_read;
   GFS_EVENT_CLASS (klass)->event = gfs_output_ppm_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_ppm_event;
 }
 
 GfsOutputClass * gfs_output_ppm_class (void)
@@ -3305,6 +4308,7 @@ static gboolean gfs_output_grd_event (GfsEvent * event, GfsSimulation * sim)
 static void gfs_output_grd_class_init (GfsOutputClass * klass)
 {
   GFS_EVENT_CLASS (klass)->event = gfs_output_grd_event;
+  GFS_EVENT_CLASS (klass)->scheduled_event = gfs_output_grd_event;
 }
 
 GfsOutputClass * gfs_output_grd_class (void)
@@ -3381,6 +4385,7 @@ static void gfs_output_object_class_init (GfsOutputClass * klass)
   GTS_OBJECT_CLASS (klass)->read = output_object_read;
   GTS_OBJECT_CLASS (klass)->write = output_object_write;
   GFS_EVENT_CLASS(klass)->event = output_object_event;
+  GFS_EVENT_CLASS(klass)->scheduled_event = output_object_event;
 }
 
 GfsOutputClass * gfs_output_object_class (void)
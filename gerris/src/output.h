@@ -95,8 +95,26 @@ GfsOutputClass * gfs_output_adapt_stats_class  (void);
 
 /* GfsOutputTiming: Header */
 
+typedef struct _GfsOutputTiming         GfsOutputTiming;
+
+struct _GfsOutputTiming {
+  /*< private >*/
+  GfsOutput parent;
+
+  /*< public >*/
+  gboolean counters;
+};
+
+#define GFS_OUTPUT_TIMING(obj)            GTS_OBJECT_CAST (obj,\
+					         GfsOutputTiming,\
+					         gfs_output_timing_class ())
+
 GfsOutputClass * gfs_output_timing_class (void);
 
+/* GfsOutputTrace: Header */
+
+GfsOutputClass * gfs_output_trace_class (void);
+
 /* GfsOutputBalance: Header */
 
 GfsOutputClass * gfs_output_balance_class  (void);
@@ -130,7 +148,11 @@ struct _GfsOutputLocation {
   /*< public >*/
   GArray * p;
   gchar * precision, * label;
-  gboolean interpolate;
+  gboolean interpolate, binary;
+
+  /*< private >*/
+  GArray * probes;
+  guint mesh_changes;
 };
 
 #define GFS_OUTPUT_LOCATION(obj)            GTS_OBJECT_CAST (obj,\
@@ -147,7 +169,8 @@ typedef struct _GfsOutputSimulation         GfsOutputSimulation;
 typedef enum   { GFS, 
 		 GFS_TEXT, 
 		 GFS_VTK, 
-		 GFS_TECPLOT }              GfsOutputSimulationFormat;
+		 GFS_TECPLOT,
+		 GFS_VTU }                  GfsOutputSimulationFormat;
 
 struct _GfsOutputSimulation {
   GfsOutput parent;
@@ -157,6 +180,9 @@ struct _GfsOutputSimulation {
   gboolean binary, solid;
   gchar * precision;
   GfsOutputSimulationFormat format;
+  guint async;
+  gchar * compress;
+  GHashTable * tolerance;
 };
 
 #define GFS_OUTPUT_SIMULATION(obj)            GTS_OBJECT_CAST (obj,\
@@ -169,6 +195,7 @@ struct _GfsOutputSimulation {
 					     gfs_output_simulation_class ()))
      
 GfsOutputClass * gfs_output_simulation_class  (void);
+void             gfs_output_simulation_flush  (void);
 
 /* GfsOutputBoundaries: Header */
 
@@ -332,6 +359,51 @@ struct _GfsOutputStreamline {
 
 GfsOutputClass * gfs_output_streamline_class  (void);
 
+#if !FTT_2D
+
+/* GfsOutputSlice: Header */
+
+typedef struct _GfsOutputSlice         GfsOutputSlice;
+
+struct _GfsOutputSlice {
+  /*< private >*/
+  GfsOutputScalar parent;
+  FttVector plane[3];
+
+  /*< public >*/
+  FttVector p, n;
+};
+
+#define GFS_OUTPUT_SLICE(obj)            GTS_OBJECT_CAST (obj,\
+					         GfsOutputSlice,\
+					         gfs_output_slice_class ())
+#define GFS_IS_OUTPUT_SLICE(obj)         (gts_object_is_from_class (obj,\
+						 gfs_output_slice_class ()))
+
+GfsOutputClass * gfs_output_slice_class  (void);
+
+/* GfsOutputIsosurface: Header */
+
+typedef struct _GfsOutputIsosurface         GfsOutputIsosurface;
+
+struct _GfsOutputIsosurface {
+  /*< private >*/
+  GfsOutputScalar parent;
+
+  /*< public >*/
+  gdouble value;
+};
+
+#define GFS_OUTPUT_ISOSURFACE(obj)            GTS_OBJECT_CAST (obj,\
+					         GfsOutputIsosurface,\
+					         gfs_output_isosurface_class ())
+#define GFS_IS_OUTPUT_ISOSURFACE(obj)         (gts_object_is_from_class (obj,\
+						 gfs_output_isosurface_class ()))
+
+GfsOutputClass * gfs_output_isosurface_class  (void);
+
+#endif /* 3D */
+
 /* GfsOutputParticle: Header */
 
 #define GFS_IS_OUTPUT_PARTICLE(obj)     (gts_object_is_from_class (obj,\
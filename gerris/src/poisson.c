@@ -1234,7 +1234,7 @@ void gfs_poisson_solve (GfsDomain * domain,
   g_return_if_fail (res != NULL);
   g_return_if_fail (dia != NULL);
 
-  gfs_domain_timer_start (domain, "poisson_solve");
+  gfs_domain_timer_start_id (domain, GFS_TIMER_POISSON_SOLVE);
 
   guint minlevel = par->minlevel;
   par->depth = gfs_domain_depth (domain);
@@ -1251,7 +1251,9 @@ void gfs_poisson_solve (GfsDomain * domain,
 	 (par->residual.infty > par->tolerance && par->niter < par->nitermax)) {
 
     /* Does one iteration */
+    gfs_domain_timer_start_id (domain, GFS_TIMER_POISSON_CYCLE);
     gfs_poisson_cycle (domain, par, lhs, rhs, dia, res);
+    gfs_domain_timer_stop_id (domain, GFS_TIMER_POISSON_CYCLE);
     
     par->residual = gfs_domain_norm_residual (domain, FTT_TRAVERSE_LEAFS, -1, dt, res);
 
@@ -1265,7 +1267,7 @@ void gfs_poisson_solve (GfsDomain * domain,
 
   par->minlevel = minlevel;
 
-  gfs_domain_timer_stop (domain, "poisson_solve");
+  gfs_domain_timer_stop_id (domain, GFS_TIMER_POISSON_SOLVE);
 }
 
 typedef struct {
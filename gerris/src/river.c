@@ -1026,7 +1026,7 @@ static void river_run (GfsSimulation * sim)
     gdouble tstart = gfs_clock_elapsed (domain->timer);
 
     /* events */
-    gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);
+    gfs_events_do (sim);
 
     /* update H */
     domain_traverse_all_leaves (domain, (FttCellTraverseFunc) cell_H, r);
@@ -1075,7 +1075,7 @@ static void river_run (GfsSimulation * sim)
     gts_range_add_value (&domain->size, gfs_domain_size (domain, FTT_TRAVERSE_LEAFS, -1));
     gts_range_update (&domain->size);
   }
-  gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);  
+  gfs_events_do (sim);
   gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gts_object_destroy, NULL);
 }
 
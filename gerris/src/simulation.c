@@ -69,6 +69,9 @@ static void simulation_destroy (GtsObject * object)
   g_slist_free (sim->globals);
   g_slist_foreach (sim->preloaded_modules, (GFunc) module_close, NULL);
   g_slist_free (sim->preloaded_modules);
+  if (sim->substeps)
+    g_array_free (sim->substeps, TRUE);
+  g_free (sim->levels_cfl);
 
   (* GTS_OBJECT_CLASS (gfs_simulation_class ())->parent_class->destroy) (object);
 }
@@ -310,6 +313,11 @@ static void simulation_read (GtsObject ** object, GtsFile * fp)
       gfs_advection_params_read (&sim->advection_params, fp);
       if (fp->type == GTS_ERROR)
 	return;
+      if (sim->advection_params.subcycle &&
+	  !gts_object_is_from_class (sim, gfs_advection_class ())) {
+	gts_file_error (fp, "subcycling is only implemented for GfsAdvection");
+	return;
+      }
       if (sim->advection_params.linear) {
 	sim->u0[0] = gfs_domain_get_or_add_variable (domain, 
 						     "U0", "x-component of the base velocity");
@@ -394,23 +402,50 @@ static void simulation_read (GtsObject ** object, GtsFile * fp)
   }
 }
 
+static void tracers_fine_coarse (FttCell * cell, GSList * tracers)
+{
+  while (tracers) {
+    GfsAdvectionParams * par = tracers->data;
+    (* par->v->fine_coarse) (cell, par->v);
+    tracers = tracers->next;
+  }
+}
+
+/* advects the list of passive tracers accumulated in @passive */
+static void advance_passive_tracers (GfsDomain * domain, GSList ** passive)
+{
+  if (*passive) {
+    *passive = g_slist_reverse (*passive);
+    gfs_tracers_advection (domain, *passive);
+    gfs_domain_cell_traverse (domain,
+			      FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
+			      (FttCellTraverseFunc) tracers_fine_coarse, *passive);
+    g_slist_free (*passive);
+    *passive = NULL;
+  }
+}
+
 /**
  * gfs_advance_tracers:
  * @sim: a #GfsSimulation.
  * @dt: the timestep.
  *
  * Performs advection/difussion of tracers associated with @sim.
+ *
+ * Consecutive passive tracers (see gfs_tracer_is_passive()) are
+ * advected together using gfs_tracers_advection().
  */
 void gfs_advance_tracers (GfsSimulation * sim, gdouble dt)
 {
   g_return_if_fail (sim != NULL);
 
   GfsDomain * domain = GFS_DOMAIN (sim);
-  GSList * i = sim->events->items;
+  GSList * i = sim->events->items, * passive = NULL;
   while (i) {
     if (GFS_IS_VARIABLE_TRACER_VOF (i->data)) {
       GfsVariableTracer * t = i->data;
       
+      advance_passive_tracers (domain, &passive);
       t->advection.dt = dt;
       gfs_tracer_vof_advection (domain, &t->advection);
       gfs_domain_variable_centered_sources (domain, i->data, i->data, t->advection.dt);
@@ -419,13 +454,19 @@ void gfs_advance_tracers (GfsSimulation * sim, gdouble dt)
       GfsVariableTracer * t = i->data;
       
       t->advection.dt = dt;
-      gfs_tracer_advection_diffusion (domain, &t->advection, sim->physical_params.alpha);
-      gfs_domain_cell_traverse (domain,
-				FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
-				(FttCellTraverseFunc) GFS_VARIABLE (t)->fine_coarse, t);
+      if (gfs_tracer_is_passive (&t->advection))
+	passive = g_slist_prepend (passive, &t->advection);
+      else {
+	advance_passive_tracers (domain, &passive);
+	gfs_tracer_advection_diffusion (domain, &t->advection, sim->physical_params.alpha);
+	gfs_domain_cell_traverse (domain,
+				  FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
+				  (FttCellTraverseFunc) GFS_VARIABLE (t)->fine_coarse, t);
+      }
     }
     i = i->next;
-  }  
+  }
+  advance_passive_tracers (domain, &passive);
 }
 
 static void simulation_run (GfsSimulation * sim)
@@ -478,7 +519,7 @@ static void simulation_run (GfsSimulation * sim)
 	 sim->time.i < sim->time.iend) {
     gdouble tstart = gfs_clock_elapsed (domain->timer);
 
-    gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);
+    gfs_events_do (sim);
 
     if (sim->advection_params.linear) {
       /* linearised advection */
@@ -540,7 +581,7 @@ static void simulation_run (GfsSimulation * sim)
     gts_range_add_value (&domain->size, gfs_domain_size (domain, FTT_TRAVERSE_LEAFS, -1));
     gts_range_update (&domain->size);
   }
-  gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);  
+  gfs_events_do (sim);
   gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gts_object_destroy, NULL);
 
   for (c = 0; c < FTT_DIMENSION; c++) {
@@ -553,7 +594,12 @@ static void simulation_run (GfsSimulation * sim)
 static gdouble simulation_cfl (GfsSimulation * sim)
 {
   GSList * i = GFS_DOMAIN (sim)->variables;
-  gdouble cflmin = G_MAXDOUBLE;
+  gdouble cflmin = G_MAXDOUBLE, local = GFS_DOMAIN (sim)->cfl;
+
+  /* the local velocity CFL timestep computed by
+     gfs_approximate_projection() can only be used once, it is reduced
+     by gfs_simulation_set_timestep() */
+  GFS_DOMAIN (sim)->cfl = -1.;
   
   while (i) {
     GfsVariable * v = i->data;
@@ -569,7 +615,13 @@ static gdouble simulation_cfl (GfsSimulation * sim)
     }
     i = i->next;
   }
-  return cflmin < G_MAXDOUBLE ? cflmin : gfs_domain_cfl (GFS_DOMAIN (sim), FTT_TRAVERSE_LEAFS, -1);
+  if (cflmin < G_MAXDOUBLE)
+    return cflmin;
+  if (local >= 0.) {
+    gfs_domain_sources_cfl (GFS_DOMAIN (sim), &local);
+    return sqrt (local);
+  }
+  return gfs_domain_cfl (GFS_DOMAIN (sim), FTT_TRAVERSE_LEAFS, -1);
 }
 
 static void gfs_simulation_class_init (GfsSimulationClass * klass)
@@ -1006,6 +1058,8 @@ static void simulation_init (GfsSimulation * object)
   object->modules = object->preloaded_modules = NULL;
   
   object->tnext = 0.;
+  object->substeps = NULL;
+  object->levels_cfl = NULL;
 }
 
 GfsSimulationClass * gfs_simulation_class (void)
@@ -1258,22 +1312,11 @@ void gfs_simulation_refine (GfsSimulation * sim)
   }
 }
 
-/**
- * gfs_simulation_read:
- * @fp: a #GtsFile.
- *
- * Reads a simulation file from @fp.
- *
- * Returns: the #GfsSimulation or %NULL if an error occured, in which
- * case the @pos and @error fields of @fp are set.
- */
-GfsSimulation * gfs_simulation_read (GtsFile * fp)
+static GfsSimulation * read_simulation (GtsFile * fp, GfsReadSelection * selection)
 {
   GfsDomain * d;
   GSList * ml = NULL; /* list of preloaded modules */
 
-  g_return_val_if_fail (fp != NULL, NULL);
-
   while (fp->type == '\n')
      gts_file_next_token (fp);
 
@@ -1286,7 +1329,7 @@ GfsSimulation * gfs_simulation_read (GtsFile * fp)
       gts_file_next_token (fp);
   }
       
-  d = gfs_domain_read (fp);
+  d = gfs_domain_read_selection (fp, selection);
   if (d != NULL && !GFS_IS_SIMULATION (d)) {
     gts_file_error (fp, "parent graph is not a GfsSimulation");
     gts_object_destroy (GTS_OBJECT (d));
@@ -1308,6 +1351,94 @@ GfsSimulation * gfs_simulation_read (GtsFile * fp)
   return GFS_SIMULATION (d);
 }
 
+/**
+ * gfs_simulation_read:
+ * @fp: a #GtsFile.
+ *
+ * Reads a simulation file from @fp.
+ *
+ * Returns: the #GfsSimulation or %NULL if an error occured, in which
+ * case the @pos and @error fields of @fp are set.
+ */
+GfsSimulation * gfs_simulation_read (GtsFile * fp)
+{
+  g_return_val_if_fail (fp != NULL, NULL);
+
+  return read_simulation (fp, NULL);
+}
+
+/* Length of the last line of files containing a box index */
+#define INDEX_OFFSET_LENGTH 41
+
+/* Reads the box index at the end of @fp (if any) and restores the
+   position of @fp. Returns a hash table of the (start, end) offsets
+   of the boxes indexed by box id, or %NULL. */
+static GHashTable * read_box_index (FILE * fp)
+{
+  off_t pos = ftello (fp);
+  if (pos < 0)
+    return NULL;
+
+  GHashTable * index = NULL;
+  gchar line[128];
+  if (!fseeko (fp, - INDEX_OFFSET_LENGTH, SEEK_END) &&
+      fgets (line, sizeof (line), fp) &&
+      !strncmp (line, "# GfsBoxIndexOffset ", 20) &&
+      !fseeko (fp, g_ascii_strtoll (&line[20], NULL, 10), SEEK_SET) &&
+      fgets (line, sizeof (line), fp) &&
+      !strncmp (line, "# GfsBoxIndex ", 14)) {
+    guint n = strtol (&line[14], NULL, 10), i;
+    index = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+    for (i = 0; i < n && index; i++) {
+      gchar * s = line + 1, * end;
+      gint64 * offset = g_malloc (2*sizeof (gint64)), id;
+      if (fgets (line, sizeof (line), fp) == NULL || line[0] != '#' ||
+	  (id = g_ascii_strtoll (s, &end, 10)) <= 0 || end == s ||
+	  (offset[0] = g_ascii_strtoll (s = end, &end, 10)) < 0 || end == s ||
+	  (offset[1] = g_ascii_strtoll (s = end, &end, 10)) <= offset[0] || end == s) {
+	g_free (offset);
+	g_hash_table_destroy (index);
+	index = NULL;
+      }
+      else
+	g_hash_table_insert (index, GUINT_TO_POINTER ((guint) id), offset);
+    }
+  }
+  fseeko (fp, pos, SEEK_SET);
+  return index;
+}
+
+/**
+ * gfs_simulation_read_selection:
+ * @fp: a #GtsFile.
+ * @selection: a #GfsReadSelection.
+ *
+ * Reads the subset of the simulation file @fp defined by @selection
+ * (see gfs_domain_read_selection()).
+ *
+ * If @fp is a seekable file containing a box index (as written by
+ * gfs_simulation_write() for binary files), the cell data of the
+ * boxes outside the selected region is skipped without being read
+ * and the @indexed field of @selection is set to %TRUE.
+ *
+ * Returns: the #GfsSimulation or %NULL if an error occured, in which
+ * case the @pos and @error fields of @fp are set.
+ */
+GfsSimulation * gfs_simulation_read_selection (GtsFile * fp, GfsReadSelection * selection)
+{
+  g_return_val_if_fail (fp != NULL, NULL);
+  g_return_val_if_fail (selection != NULL, NULL);
+
+  selection->index = fp->fp ? read_box_index (fp->fp) : NULL;
+  selection->indexed = (selection->index != NULL);
+  GfsSimulation * sim = read_simulation (fp, selection);
+  if (selection->index) {
+    g_hash_table_destroy (selection->index);
+    selection->index = NULL;
+  }
+  return sim;
+}
+
 static void write_preloaded_modules (GfsSimulation * sim, FILE * fp)
 {
   GSList * i = sim->preloaded_modules;
@@ -1324,50 +1455,35 @@ static void write_preloaded_modules (GfsSimulation * sim, FILE * fp)
   }
 }
 
-/**
- * gfs_simulation_write:
- * @sim: a #GfsSimulation.
- * @max_depth: the maximum depth at which to stop writing cell tree
- * data (-1 means no limit).
- * @fp: a file pointer.
- *
- * Writes in @fp a text representation of @sim. If @max_depth is
- * smaller or equal to -2, no cell tree data is written.  
- */
-void gfs_simulation_write (GfsSimulation * sim,
-			   gint max_depth,		  
-			   FILE * fp)
-{
-  gint depth;
-  GfsDomain * domain;
-
-  g_return_if_fail (sim != NULL);
-  g_return_if_fail (fp != NULL);
-
-  fprintf (fp, "# Gerris Flow Solver %dD version %s (%s)\n",
-	   FTT_DIMENSION, GFS_VERSION, GFS_BUILD_VERSION);
-  write_preloaded_modules (sim, fp);
-  domain = GFS_DOMAIN (sim);
-  depth = domain->max_depth_write;
-  domain->max_depth_write = max_depth;
-  gts_graph_write (GTS_GRAPH (sim), fp);
-  domain->max_depth_write = depth;
-}
-
-#ifdef HAVE_MPI
 static void count_edges (GtsGEdge * e, guint * nedge)
 {
   (*nedge)++;
 }
 
+/* Offsets in a simulation file of the description of a box and of
+   the closing brace of its cell data */
+typedef struct {
+  gint64 id, start, end;
+} BoxOffset;
+
 static void write_node (GtsObject * node, gpointer * data)
 {
   FILE * fp = data[0];
   guint * nnode = data[1];
+  GArray * index = data[2];
+  BoxOffset o;
 
   node->reserved = GUINT_TO_POINTER ((*nnode)++);
+  if (index) {
+    o.id = GFS_BOX (node)->id;
+    o.start = ftello (fp);
+  }
   if (node->klass->write)
     (* node->klass->write) (node, fp);
+  if (index) {
+    o.end = ftello (fp) - 1;
+    g_array_append_val (index, o);
+  }
   fputc ('\n', fp);
 }
 
@@ -1380,28 +1496,123 @@ static void write_edge (GtsGEdge * edge, FILE * fp)
     (* GTS_OBJECT (edge)->klass->write) (GTS_OBJECT (edge), fp);
   fputc ('\n', fp);
 }
-#endif /* HAVE_MPI */
+
+/* Writes the index of the boxes as a trailing comment block (which
+   is ignored when reading the file), followed by a line of fixed
+   length (INDEX_OFFSET_LENGTH) containing the offset of the block.
+   @offset is the offset in the file of the start of @fp */
+static void write_box_index (BoxOffset * index, guint n, gint64 offset, FILE * fp)
+{
+  gint64 start = ftello (fp) + offset;
+  guint i;
+
+  fprintf (fp, "# GfsBoxIndex %u\n", n);
+  for (i = 0; i < n; i++)
+    fprintf (fp, "# %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n",
+	     index[i].id, index[i].start + offset, index[i].end + offset);
+  fprintf (fp, "# GfsBoxIndexOffset %20" G_GINT64_FORMAT "\n", start);
+}
 
 /**
- * gfs_simulation_union_write:
+ * gfs_simulation_write:
  * @sim: a #GfsSimulation.
  * @max_depth: the maximum depth at which to stop writing cell tree
  * data (-1 means no limit).
  * @fp: a file pointer.
  *
- * Identical to gfs_simulation_write() for serial simulations. For
- * parallel simulations writes the union of the simulations on all
- * processes to @fp.
+ * Writes in @fp a text representation of @sim. If @max_depth is
+ * smaller or equal to -2, no cell tree data is written.  
+ *
+ * Binary cell data written to a seekable @fp is followed by an index
+ * of the boxes used by gfs_simulation_read_selection(). The offsets
+ * of the index are relative to the start of @fp plus the
+ * @offset_io field of the domain (no index is written if it is
+ * negative).
  */
-void gfs_simulation_union_write (GfsSimulation * sim,
-				 gint max_depth,		  
-				 FILE * fp)
+void gfs_simulation_write (GfsSimulation * sim,
+			   gint max_depth,		  
+			   FILE * fp)
 {
-  GfsDomain * domain = GFS_DOMAIN (sim);
+  gint depth;
+  GfsDomain * domain;
 
   g_return_if_fail (sim != NULL);
   g_return_if_fail (fp != NULL);
 
+  fprintf (fp, "# Gerris Flow Solver %dD version %s (%s)\n",
+	   FTT_DIMENSION, GFS_VERSION, GFS_BUILD_VERSION);
+  write_preloaded_modules (sim, fp);
+  domain = GFS_DOMAIN (sim);
+  depth = domain->max_depth_write;
+  domain->max_depth_write = max_depth;
+
+  /* see gts/src/graph.c:gts_graph_write() for the original implementation */
+  GtsGraph * g = GTS_GRAPH (sim);
+  guint nnode = 1, nedge = 0;
+  gpointer data[3];
+  gts_graph_foreach_edge (g, (GtsFunc) count_edges, &nedge);
+  fprintf (fp, "%u %u", gts_container_size (GTS_CONTAINER (g)), nedge);
+  if (GTS_OBJECT (g)->klass->write)
+    (* GTS_OBJECT (g)->klass->write) (GTS_OBJECT (g), fp);
+  fputc ('\n', fp);
+  data[0] = fp;
+  data[1] = &nnode;
+  data[2] = domain->binary && max_depth > -2 && domain->offset_io >= 0 && ftello (fp) >= 0 ?
+    g_array_new (FALSE, FALSE, sizeof (BoxOffset)) : NULL;
+  gts_container_foreach (GTS_CONTAINER (g), (GtsFunc) write_node, data);
+  gts_graph_foreach_edge (g, (GtsFunc) write_edge, fp);
+  gts_container_foreach (GTS_CONTAINER (g), (GtsFunc) gts_object_reset_reserved, NULL);
+  if (data[2]) {
+    GArray * index = data[2];
+    write_box_index ((BoxOffset *) index->data, index->len, domain->offset_io, fp);
+    g_array_free (index, TRUE);
+  }
+
+  domain->max_depth_write = depth;
+}
+
+#ifdef HAVE_MPI
+/* Gathers the index of the boxes written collectively on PE 0 */
+static void gather_box_index (GfsDomain * domain, GArray * index, gint64 offset,
+			      guint * nbox, int gsize, FILE * fp)
+{
+  guint i;
+  for (i = 0; i < index->len; i++) {
+    g_array_index (index, BoxOffset, i).start += offset;
+    g_array_index (index, BoxOffset, i).end += offset;
+  }
+
+  int * count = NULL, * displ = NULL;
+  BoxOffset * all = NULL;
+  guint nboxes = 0;
+  if (domain->pid == 0) {
+    count = g_malloc (gsize*sizeof (int));
+    displ = g_malloc (gsize*sizeof (int));
+    for (i = 0; i < gsize; i++) {
+      count[i] = 3*nbox[i];
+      displ[i] = 3*nboxes;
+      nboxes += nbox[i];
+    }
+    all = g_malloc (nboxes*sizeof (BoxOffset));
+  }
+  MPI_Gatherv (index->data, 3*index->len, MPI_LONG_LONG, 
+	       all, count, displ, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+  if (domain->pid == 0) {
+    write_box_index (all, nboxes, 0, fp);
+    g_free (count);
+    g_free (displ);
+    g_free (all);
+  }
+}
+#endif /* HAVE_MPI */
+
+static void union_write (GfsSimulation * sim,
+			 gint max_depth,
+			 FILE * fp,
+			 const gchar * name)
+{
+  GfsDomain * domain = GFS_DOMAIN (sim);
+
   if (domain->pid < 0)
     gfs_simulation_write (sim, max_depth, fp);
   else {
@@ -1436,30 +1647,106 @@ void gfs_simulation_union_write (GfsSimulation * sim,
 
     gint depth = domain->max_depth_write;
     guint i, nnode = 1;
-    gpointer data[2];
+    gpointer data[3];
 
     for (i = 0; i < domain->pid; i++)
       nnode += nbox[i];
-    g_free (nbox);
 
     GfsUnionFile uf;
-    FILE * fpp = gfs_union_open (fp, domain->pid, &uf);
+    FILE * fpp = name ? 
+      gfs_union_open_collective (fp, name, domain->pid, &uf) :
+      gfs_union_open (fp, domain->pid, &uf);
     data[0] = fpp;
     data[1] = &nnode;
+    data[2] = name ? g_array_new (FALSE, FALSE, sizeof (BoxOffset)) : NULL;
     domain->max_depth_write = max_depth;
     gts_container_foreach (GTS_CONTAINER (g), (GtsFunc) write_node, data);
     domain->max_depth_write = depth;
     gfs_union_close (fp, domain->pid, &uf);
+    gint64 offset = uf.offset;
 
     fpp = gfs_union_open (fp, domain->pid, &uf);
     gts_graph_foreach_edge (g, (GtsFunc) write_edge, fpp);
     gfs_union_close (fp, domain->pid, &uf);
 
+    if (data[2]) {
+      gather_box_index (domain, data[2], offset, nbox, gsize, fp);
+      g_array_free (data[2], TRUE);
+    }
+    g_free (nbox);
+
     gts_container_foreach (GTS_CONTAINER (g), (GtsFunc) gts_object_reset_reserved, NULL);
 #endif /* HAVE_MPI */
   }
 }
 
+/**
+ * gfs_simulation_union_write:
+ * @sim: a #GfsSimulation.
+ * @max_depth: the maximum depth at which to stop writing cell tree
+ * data (-1 means no limit).
+ * @fp: a file pointer.
+ *
+ * Identical to gfs_simulation_write() for serial simulations. For
+ * parallel simulations writes the union of the simulations on all
+ * processes to @fp.
+ */
+void gfs_simulation_union_write (GfsSimulation * sim,
+				 gint max_depth,		  
+				 FILE * fp)
+{
+  g_return_if_fail (sim != NULL);
+  g_return_if_fail (fp != NULL);
+
+  union_write (sim, max_depth, fp, NULL);
+}
+
+/**
+ * gfs_simulation_collective_write:
+ * @sim: a #GfsSimulation.
+ * @max_depth: the maximum depth at which to stop writing cell tree
+ * data (-1 means no limit).
+ * @fp: a file pointer.
+ * @name: the name of the (regular) file pointed to by @fp on process
+ * zero, or %NULL.
+ *
+ * Identical to gfs_simulation_union_write() but the boxes of each
+ * process are written directly into @name using collective MPI-IO
+ * (see gfs_union_open_collective()) rather than being funnelled
+ * through process zero. The file offset of each box is appended to
+ * the file as a trailing "# GfsBoxIndex" comment block.
+ *
+ * Only the values of @fp and @name on process zero are used. If
+ * @name is %NULL (on process zero), this function is identical to
+ * gfs_simulation_union_write().
+ */
+void gfs_simulation_collective_write (GfsSimulation * sim,
+				      gint max_depth,
+				      FILE * fp,
+				      const gchar * name)
+{
+  g_return_if_fail (sim != NULL);
+  g_return_if_fail (fp != NULL);
+
+#ifdef HAVE_MPI
+  GfsDomain * domain = GFS_DOMAIN (sim);
+  if (domain->pid >= 0) {
+    int len = domain->pid == 0 && name ? strlen (name) + 1 : 0;
+    MPI_Bcast (&len, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (len > 0) {
+      gchar * shared = g_malloc (len);
+      if (domain->pid == 0)
+	strcpy (shared, name);
+      MPI_Bcast (shared, len, MPI_CHAR, 0, MPI_COMM_WORLD);
+      union_write (sim, max_depth, fp, shared);
+      g_free (shared);
+      return;
+    }
+  }
+#endif /* HAVE_MPI */
+  union_write (sim, max_depth, fp, NULL);
+}
+
 static gdouble min_cfl (GfsSimulation * sim)
 {
   gdouble cfl = (sim->advection_params.scheme == GFS_NONE ?
@@ -1488,6 +1775,11 @@ static gdouble min_cfl (GfsSimulation * sim)
  * source terms and taking into account the timings of the various
  * #GfsEvent associated to @sim.
  *
+ * If gfs_approximate_projection() has just been called, the CFL
+ * computed as a by-product of the velocity correction is used
+ * instead of traversing the domain again. All the constraints are
+ * then combined locally and reduced in a single global operation.
+ *
  * More precisely, the time step is adjusted (if necessary) so that
  * the time of the closest event is exactly reached after the
  * iteration.  
@@ -1767,6 +2059,8 @@ static void error_handler (const gchar *log_domain,
 			   gpointer user_data)
 {
   GfsDomain * domain = user_data;
+  /* do not lose the snapshots still being written */
+  gfs_output_simulation_flush ();
   g_slist_free (domain->variables_io);
   domain->variables_io = NULL;
   GSList * i = domain->variables;
@@ -1803,7 +2097,10 @@ void gfs_simulation_run (GfsSimulation * sim)
   g_timer_start (domain->clock);
   gfs_clock_start (domain->timer);
   gts_range_init (&domain->mpi_wait);
+  gfs_domain_timer_start_id (domain, GFS_TIMER_SIMULATION_RUN);
   (* GFS_SIMULATION_CLASS (GTS_OBJECT (sim)->klass)->run) (sim);
+  gfs_output_simulation_flush ();
+  gfs_domain_timer_stop_id (domain, GFS_TIMER_SIMULATION_RUN);
   gfs_clock_stop (domain->timer);
   g_timer_stop (domain->clock);
   g_log_remove_handler ("Gfs", id);
@@ -1984,10 +2281,61 @@ static void event_do_not_adapt (GfsEvent * event, GfsSimulation * sim)
     gfs_event_do (event, sim);
 }
 
+/* returns the list of the advection parameters of the tracers of
+   @sim or %NULL if some of them are not passive */
+static GSList * passive_tracers (GfsSimulation * sim)
+{
+  GSList * i = sim->events->items, * tracers = NULL;
+
+  while (i) {
+    if (GFS_IS_VARIABLE_TRACER (i->data)) {
+      GfsVariableTracer * t = i->data;
+
+      if (GFS_IS_VARIABLE_TRACER_VOF (t) || !gfs_tracer_is_passive (&t->advection)) {
+	g_slist_free (tracers);
+	return NULL;
+      }
+      tracers = g_slist_prepend (tracers, &t->advection);
+    }
+    i = i->next;
+  }
+  return g_slist_reverse (tracers);
+}
+
+/* returns the number of substeps of each level for the timestep of @sim */
+static guint * levels_substeps (GfsSimulation * sim)
+{
+  GfsDomain * domain = GFS_DOMAIN (sim);
+  guint l, depth = gfs_domain_depth (domain);
+  gdouble * cfl = sim->levels_cfl, c = min_cfl (sim);
+  guint * n = g_malloc ((depth + 1)*sizeof (guint));
+
+  /* the per-level CFL has been computed by advection_cfl() for this
+     timestep (unless the timestep is not limited by the CFL) */
+  for (l = 0; l <= depth; l++) {
+    n[l] = l > 0 ? n[l - 1] : 1;
+    if (cfl && cfl[l] < G_MAXDOUBLE)
+      while (sim->advection_params.dt > n[l]*(c*cfl[l]))
+	n[l] *= 2;
+  }
+  g_free (cfl);
+  sim->levels_cfl = NULL;
+
+  if (sim->substeps == NULL)
+    sim->substeps = g_array_new (FALSE, TRUE, sizeof (guint));
+  if (sim->substeps->len < depth + 1)
+    g_array_set_size (sim->substeps, depth + 1);
+  for (l = 0; l <= depth; l++)
+    g_array_index (sim->substeps, guint, l) += n[l];
+
+  return n;
+}
+
 static void advection_run (GfsSimulation * sim)
 {
   GfsDomain * domain = GFS_DOMAIN (sim);
   gboolean streamfunction = FALSE;
+  GSList * tracers = NULL;
 
 #if FTT_2D
   GSList * i = domain->variables;
@@ -2002,6 +2350,10 @@ static void advection_run (GfsSimulation * sim)
 
   /* ignore default advection scheme (use per tracer parameters only) */
   sim->advection_params.scheme = GFS_NONE;
+  if (sim->advection_params.subcycle && !(tracers = passive_tracers (sim))) {
+    g_warning ("subcycling requires passive tracers: using a single timestep");
+    sim->advection_params.subcycle = FALSE;
+  }
   while (sim->time.t < sim->time.end &&
 	 sim->time.i < sim->time.iend) {
     gdouble tstart = gfs_clock_elapsed (domain->timer);
@@ -2027,7 +2379,19 @@ static void advection_run (GfsSimulation * sim)
 
     gfs_simulation_set_timestep (sim);
 
-    gfs_advance_tracers (sim, sim->advection_params.dt);
+    if (tracers) {
+      guint * n = levels_substeps (sim);
+      GSList * j;
+      for (j = tracers; j; j = j->next)
+	((GfsAdvectionParams *) j->data)->dt = sim->advection_params.dt;
+      gfs_tracers_subcycled_advection (domain, tracers, n);
+      gfs_domain_cell_traverse (domain,
+				FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
+				(FttCellTraverseFunc) tracers_fine_coarse, tracers);
+      g_free (n);
+    }
+    else
+      gfs_advance_tracers (sim, sim->advection_params.dt);
 
     sim->time.t = sim->tnext;
     sim->time.i++;
@@ -2037,13 +2401,41 @@ static void advection_run (GfsSimulation * sim)
     gts_range_add_value (&domain->size, gfs_domain_size (domain, FTT_TRAVERSE_LEAFS, -1));
     gts_range_update (&domain->size);
   }
-  gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);  
+  gfs_events_do (sim);
   gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gts_object_destroy, NULL);
+  g_slist_free (tracers);
+}
+
+static gdouble advection_cfl (GfsSimulation * sim)
+{
+  if (!sim->advection_params.subcycle)
+    return (* GFS_SIMULATION_CLASS (GTS_OBJECT_CLASS (gfs_advection_class ())->parent_class)->cfl)
+      (sim);
+
+  /* the coarsest level lmin takes a single step, level l takes at
+     most 2^(l - lmin) steps */
+  GfsDomain * domain = GFS_DOMAIN (sim);
+  guint l, lmin = G_MAXINT, depth = gfs_domain_depth (domain);
+  gdouble * cfl, cflmin = G_MAXDOUBLE;
+
+  /* kept for levels_substeps() */
+  g_free (sim->levels_cfl);
+  cfl = sim->levels_cfl = g_malloc ((depth + 1)*sizeof (gdouble));
+  gfs_domain_levels_cfl (domain, cfl);
+  for (l = 0; l <= depth; l++)
+    if (cfl[l] < G_MAXDOUBLE) {
+      if (lmin > l)
+	lmin = l;
+      if (cfl[l]*(1 << (l - lmin)) < cflmin)
+	cflmin = cfl[l]*(1 << (l - lmin));
+    }
+  return cflmin < G_MAXDOUBLE ? cflmin : sqrt (G_MAXDOUBLE);
 }
 
 static void gfs_advection_class_init (GfsSimulationClass * klass)
 {
   klass->run = advection_run;
+  klass->cfl = advection_cfl;
 }
 
 GfsSimulationClass * gfs_advection_class (void)
@@ -2200,7 +2592,7 @@ static void poisson_run (GfsSimulation * sim)
     gts_range_add_value (&domain->size, gfs_domain_size (domain, FTT_TRAVERSE_LEAFS, -1));
     gts_range_update (&domain->size);
 
-    gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);
+    gfs_events_do (sim);
   }
   gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gts_object_destroy, NULL);
 
@@ -77,6 +77,8 @@ struct _GfsSimulation {
   gboolean output_solid;
 
   gdouble tnext;
+  GArray * substeps;
+  gdouble * levels_cfl;
 
   GfsVariable * u0[FTT_DIMENSION];
 };
@@ -108,7 +110,13 @@ void                 gfs_simulation_write        (GfsSimulation * sim,
 void                 gfs_simulation_union_write  (GfsSimulation * sim,
 						  gint max_depth,  
 						  FILE * fp);
+void                 gfs_simulation_collective_write (GfsSimulation * sim,
+						      gint max_depth,
+						      FILE * fp,
+						      const gchar * name);
 GfsSimulation *      gfs_simulation_read         (GtsFile * fp);
+GfsSimulation *      gfs_simulation_read_selection (GtsFile * fp,
+						    GfsReadSelection * selection);
 GSList *             gfs_simulation_get_solids   (GfsSimulation * sim);
 guint                gfs_check_solid_fractions   (GfsDomain * domain);
 void                 gfs_simulation_refine       (GfsSimulation * sim);
@@ -903,11 +903,6 @@ static void diffusion_write (GtsObject * o, FILE * fp)
   gfs_multilevel_params_write (&GFS_DIFFUSION (o)->par, fp);
 }
 
-static void update_mu (FttCell * cell, GfsDiffusion * d)
-{
-  GFS_VALUE (cell, d->mu) = gfs_function_value (d->val, cell);
-}
-
 static gboolean diffusion_event (GfsEvent * event, GfsSimulation * sim)
 {
   GfsDiffusion * d = GFS_DIFFUSION (event);
@@ -917,8 +912,7 @@ static gboolean diffusion_event (GfsEvent * event, GfsSimulation * sim)
       d->mu = gfs_domain_add_variable (GFS_DOMAIN (sim), NULL, NULL);
     if (d->mu != gfs_function_get_variable (d->val)) {
       gfs_catch_floating_point_exceptions ();
-      gfs_domain_cell_traverse (GFS_DOMAIN (sim), FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
-				(FttCellTraverseFunc) update_mu, event);
+      gfs_function_fill (d->val, d->mu, FTT_TRAVERSE_LEAFS, -1);
       gfs_restore_fpe_for_function (d->val);
     }
     gfs_domain_cell_traverse (GFS_DOMAIN (sim),
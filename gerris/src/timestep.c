@@ -111,8 +111,8 @@ void gfs_scale_gradients (GfsDomain * domain, guint dimension, GfsVariable ** g)
 }
 
 typedef struct {
-  GfsVariable * p, ** gv;
-  gdouble dt;
+  GfsVariable * p, ** gv, ** v;
+  gdouble dt, * cfl;
 } CorrectPar;
 
 static void correct_normal_velocity (FttCellFace * face,
@@ -143,6 +143,34 @@ static void correct_normal_velocity (FttCellFace * face,
     GFS_VALUE (face->neighbor, par->gv[face->d/2]) += dp*GFS_FACE_FRACTION_RIGHT (face);
 }
 
+static void correct_normal_velocity_cfl (FttCellFace * face,
+					 CorrectPar * par)
+{
+  correct_normal_velocity (face, par);
+  gfs_face_cfl (face, par->v, par->cfl);
+}
+
+static void correct_normal_velocities (GfsDomain * domain,
+				       guint dimension,
+				       GfsVariable * p,
+				       GfsVariable ** g,
+				       gdouble dt,
+				       gdouble * cfl)
+{
+  CorrectPar par;
+
+  par.p = p;
+  par.gv = g;
+  par.dt = dt;
+  par.v = gfs_domain_velocity (domain);
+  par.cfl = cfl;
+  gfs_domain_face_traverse (domain, dimension == 2 ? FTT_XY : FTT_XYZ,
+			    FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			    (FttFaceTraverseFunc) (cfl ? 
+						   correct_normal_velocity_cfl :
+						   correct_normal_velocity), &par);
+}
+
 /**
  * gfs_correct_normal_velocities:
  * @domain: a #GfsDomain.
@@ -165,17 +193,10 @@ void gfs_correct_normal_velocities (GfsDomain * domain,
 				    GfsVariable ** g,
 				    gdouble dt)
 {
-  CorrectPar par;
-
   g_return_if_fail (domain != NULL);
   g_return_if_fail (p != NULL);
 
-  par.p = p;
-  par.gv = g;
-  par.dt = dt;
-  gfs_domain_face_traverse (domain, dimension == 2 ? FTT_XY : FTT_XYZ,
-			    FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
-			    (FttFaceTraverseFunc) correct_normal_velocity, &par);
+  correct_normal_velocities (domain, dimension, p, g, dt, NULL);
 }
 
 static void scale_divergence (FttCell * cell, gpointer * data)
@@ -362,8 +383,8 @@ static void mac_projection (GfsDomain * domain,
 			    GfsVariable ** g,
 			    void (* divergence_hook) (GfsDomain * domain, 
 						      gdouble dt,
-						      GfsVariable * div)
-			    )
+						      GfsVariable * div),
+			    gdouble * cfl)
 {
   /* Add face sources */
   gfs_reset_gradients (domain, FTT_DIMENSION, g);
@@ -427,7 +448,7 @@ static void mac_projection (GfsDomain * domain,
   if (!res)
     gts_object_destroy (GTS_OBJECT (res1));
 
-  gfs_correct_normal_velocities (domain, FTT_DIMENSION, p, g, dt);
+  correct_normal_velocities (domain, FTT_DIMENSION, p, g, dt, cfl);
   gfs_scale_gradients (domain, FTT_DIMENSION, g);
 }
 
@@ -473,11 +494,11 @@ void gfs_mac_projection (GfsDomain * domain,
   g_return_if_fail (p != NULL);
   g_return_if_fail (g != NULL);
 
-  gfs_domain_timer_start (domain, "mac_projection");
+  gfs_domain_timer_start_id (domain, GFS_TIMER_MAC_PROJECTION);
 
-  mac_projection (domain, par, dt, p, alpha, NULL, g, divergence_hook);
+  mac_projection (domain, par, dt, p, alpha, NULL, g, divergence_hook, NULL);
 
-  gfs_domain_timer_stop (domain, "mac_projection");
+  gfs_domain_timer_stop_id (domain, GFS_TIMER_MAC_PROJECTION);
 
   if (par->residual.infty > par->tolerance)
     g_warning ("MAC projection: max residual %g > %g", par->residual.infty, par->tolerance);
@@ -495,6 +516,33 @@ static void correct (FttCell * cell, gpointer * data)
     GFS_VALUE (cell, v[c]) -= GFS_VALUE (cell, g[c])*(*dt);
 }
 
+static void correct_cfl (FttCell * cell, gpointer * data)
+{
+  correct (cell, data);
+  gfs_cell_cfl (cell, data[0], data[4]);
+}
+
+static void correct_centered_velocities (GfsDomain * domain,
+					 guint dimension,
+					 GfsVariable ** g,
+					 gdouble dt,
+					 gdouble * cfl)
+{
+  GfsVariable ** v;
+  FttComponent c;
+  gpointer data[5];
+
+  data[0] = v = gfs_domain_velocity (domain);
+  data[1] = g;
+  data[2] = &dt;
+  data[3] = &dimension;
+  data[4] = cfl;
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			    (FttCellTraverseFunc) (cfl ? correct_cfl : correct), data);
+  for (c = 0; c < dimension; c++)
+    gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, v[c]);
+}
+
 /**
  * gfs_correct_centered_velocities:
  * @domain: a #GfsDomain.
@@ -512,21 +560,10 @@ void gfs_correct_centered_velocities (GfsDomain * domain,
 				      GfsVariable ** g,
 				      gdouble dt)
 {
-  GfsVariable ** v;
-  FttComponent c;
-  gpointer data[4];
-
   g_return_if_fail (domain != NULL);
   g_return_if_fail (g != NULL);
 
-  data[0] = v = gfs_domain_velocity (domain);
-  data[1] = g;
-  data[2] = &dt;
-  data[3] = &dimension;
-  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
-			    (FttCellTraverseFunc) correct, data);
-  for (c = 0; c < dimension; c++)
-    gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, v[c]);
+  correct_centered_velocities (domain, dimension, g, dt, NULL);
 }
 
 /**
@@ -574,7 +611,7 @@ void gfs_approximate_projection (GfsDomain * domain,
   g_return_if_fail (p != NULL);
   g_return_if_fail (g != NULL);
 
-  gfs_domain_timer_start (domain, "approximate_projection");
+  gfs_domain_timer_start_id (domain, GFS_TIMER_APPROXIMATE_PROJECTION);
   
   /* compute MAC velocities from centered velocities */
   gfs_domain_face_traverse (domain, FTT_XYZ,
@@ -585,11 +622,14 @@ void gfs_approximate_projection (GfsDomain * domain,
 			    (FttFaceTraverseFunc) gfs_face_interpolated_normal_velocity, 
 			    gfs_domain_velocity (domain));
   
-  mac_projection (domain, par, dt, p, alpha, res, g, divergence_hook);
+  /* the (local) CFL timestep of the corrected velocity field is
+     computed as a by-product (see gfs_simulation_set_timestep()) */
+  domain->cfl = G_MAXDOUBLE;
+  mac_projection (domain, par, dt, p, alpha, res, g, divergence_hook, &domain->cfl);
 
-  gfs_correct_centered_velocities (domain, FTT_DIMENSION, g, dt);
+  correct_centered_velocities (domain, FTT_DIMENSION, g, dt, &domain->cfl);
 
-  gfs_domain_timer_stop (domain, "approximate_projection");
+  gfs_domain_timer_stop_id (domain, GFS_TIMER_APPROXIMATE_PROJECTION);
 
   if (par->residual.infty > par->tolerance)
     g_warning ("approx projection: max residual %g > %g", par->residual.infty, par->tolerance);
@@ -1044,6 +1084,423 @@ void gfs_tracer_advection_diffusion (GfsDomain * domain,
   gfs_domain_timer_stop (domain, "tracer_advection_diffusion");
 }
 
+/**
+ * gfs_tracer_is_passive:
+ * @par: the advection parameters of a tracer.
+ *
+ * Returns: %TRUE if the tracer advected using @par is a passive
+ * scalar (Godunov advection, no source terms and no sinking
+ * velocity) which can be advected using gfs_tracers_advection().
+ */
+gboolean gfs_tracer_is_passive (const GfsAdvectionParams * par)
+{
+  g_return_val_if_fail (par != NULL, FALSE);
+
+  return (par->scheme == GFS_GODUNOV &&
+	  par->flux == gfs_face_advection_flux &&
+	  par->sink[0] == NULL &&
+	  !(par->v->component < FTT_DIMENSION && par->v->domain->has_rotated_bc) &&
+	  (par->v->sources == NULL || GTS_SLIST_CONTAINER (par->v->sources)->items == NULL));
+}
+
+/* maximum number of tracers advected simultaneously */
+#define TRACERS_BATCH 8
+
+/* Face values are computed on the fly while traversing the faces
+   except in the ghost cells and in the leaf cells touching a
+   boundary, where they depend on the boundary conditions. These are
+   stored in @boundary (FTT_NEIGHBORS*TRACERS_BATCH values per cell). */
+typedef struct {
+  GfsAdvectionParams ** par;
+  guint n;
+  GHashTable * boundary;
+} TracersBatch;
+
+typedef struct {
+  TracersBatch * b;
+  guint i;
+} BoundaryFaceValues;
+
+static void store_face_values (FttCell * cell, BoundaryFaceValues * p)
+{
+  gdouble * v = g_hash_table_lookup (p->b->boundary, cell);
+  FttDirection d;
+
+  if (v == NULL) {
+    v = g_malloc (FTT_NEIGHBORS*TRACERS_BATCH*sizeof (gdouble));
+    g_hash_table_insert (p->b->boundary, cell, v);
+  }
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    v[d*TRACERS_BATCH + p->i] = GFS_STATE (cell)->f[d].v;
+  if (GFS_CELL_IS_BOUNDARY (cell))
+    GFS_VALUE (cell, p->b->par[p->i]->fv) = 0.;
+  else
+    cell->flags |= GFS_FLAG_USED;
+}
+
+static void box_boundary_face_values (GfsBox * box, GfsAdvectionParams * par)
+{
+  FttDirection d;
+
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (GFS_IS_BOUNDARY (box->neighbor[d]))
+      ftt_cell_traverse_boundary (box->root, d, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+				  (FttCellTraverseFunc) gfs_cell_advected_face_values, par);
+}
+
+static void box_store_face_values (GfsBox * box, BoundaryFaceValues * p)
+{
+  FttDirection d;
+
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (GFS_IS_BOUNDARY (box->neighbor[d])) {
+      ftt_cell_traverse_boundary (box->root, d, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+				  (FttCellTraverseFunc) store_face_values, p);
+      ftt_cell_traverse (GFS_BOUNDARY (box->neighbor[d])->root,
+			 FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
+			 (FttCellTraverseFunc) store_face_values, p);
+    }
+}
+
+static gdouble batch_face_value (FttCell * cell, FttDirection d, guint i, TracersBatch * b)
+{
+  if (GFS_CELL_IS_BOUNDARY (cell) || (cell->flags & GFS_FLAG_USED)) {
+    gdouble * v = g_hash_table_lookup (b->boundary, cell);
+    g_assert (v);
+    return v[d*TRACERS_BATCH + i];
+  }
+  return gfs_cell_advected_face_value (cell, d, b->par[i]);
+}
+
+static void batch_reset (FttCell * cell, TracersBatch * b)
+{
+  guint i;
+  for (i = 0; i < b->n; i++)
+    GFS_VALUE (cell, b->par[i]->fv) = 0.;
+}
+
+static void batch_advection_flux (FttCellFace * face, TracersBatch * b)
+{
+  gfs_face_advection_flux_batch (face, b->par, b->n, 
+				 (GfsFaceValueFunc) batch_face_value, b);
+}
+
+static void batch_advection_update (GSList * merged, TracersBatch * b)
+{
+  guint i;
+  for (i = 0; i < b->n; i++)
+    (* b->par[i]->update) (merged, b->par[i]);
+}
+
+static void clear_used_flag (FttCell * cell, gpointer v, gpointer data)
+{
+  cell->flags &= ~GFS_FLAG_USED;
+}
+
+static void tracers_advection (GfsDomain * domain, TracersBatch * b)
+{
+  BoundaryFaceValues p = { b, 0 };
+
+  b->boundary = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  for (p.i = 0; p.i < b->n; p.i++) {
+    GfsAdvectionParams * par = b->par[p.i];
+
+    par->u = gfs_domain_velocity (domain);
+    par->g = NULL;
+    par->fv = gfs_temporary_variable (domain);
+    par->upwinding = GFS_FACE_UPWINDING;
+    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_boundary_face_values, par);
+    gfs_domain_face_bc (domain, FTT_XYZ, par->v);
+    gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) box_store_face_values, &p);
+  }
+  gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) batch_reset, b);
+
+  gfs_domain_face_traverse (domain, FTT_XYZ, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			    (FttFaceTraverseFunc) batch_advection_flux, b);
+  g_hash_table_foreach (b->boundary, (GHFunc) clear_used_flag, NULL);
+  g_hash_table_destroy (b->boundary);
+  gfs_domain_traverse_merged (domain, (GfsMergedTraverseFunc) batch_advection_update, b);
+
+  for (p.i = 0; p.i < b->n; p.i++) {
+    GfsAdvectionParams * par = b->par[p.i];
+
+    gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, par->v);
+    par->u = par->g = NULL;
+    gts_object_destroy (GTS_OBJECT (par->fv));
+    par->fv = NULL;
+  }
+}
+
+/**
+ * gfs_tracers_advection:
+ * @domain: a #GfsDomain.
+ * @tracers: a list of #GfsAdvectionParams.
+ *
+ * Advects the @v fields of @tracers using the current face-centered
+ * (MAC) velocity field. This gives the same result as calling
+ * gfs_tracer_advection_diffusion() for each tracer but the faces and
+ * merged cells are traversed only once for several tracers.
+ *
+ * All the tracers must be passive (see gfs_tracer_is_passive()).
+ */
+void gfs_tracers_advection (GfsDomain * domain, GSList * tracers)
+{
+  GfsAdvectionParams * par[TRACERS_BATCH];
+  TracersBatch b = { par, 0, NULL };
+
+  g_return_if_fail (domain != NULL);
+
+  if (tracers && !tracers->next) {
+    gfs_tracer_advection_diffusion (domain, tracers->data, NULL);
+    return;
+  }
+
+  gfs_domain_timer_start (domain, "tracer_advection_diffusion");
+
+  while (tracers) {
+    g_assert (gfs_tracer_is_passive (tracers->data));
+    par[b.n++] = tracers->data;
+    if (b.n == TRACERS_BATCH || !tracers->next) {
+      tracers_advection (domain, &b);
+      b.n = 0;
+    }
+    tracers = tracers->next;
+  }
+
+  gfs_domain_timer_stop (domain, "tracer_advection_diffusion");
+}
+
+/* Level-wise subcycling */
+
+typedef struct {
+  guint * n, depth, kmax;
+  GfsVariable * ns;
+  GArray ** faces;
+  GPtrArray ** cells, ** singles, ** merged;
+} Subcycle;
+
+static guint substeps_index (guint n)
+{
+  guint k = 0;
+  while (n > 1) {
+    n >>= 1;
+    k++;
+  }
+  return k;
+}
+
+static void cell_substeps (FttCell * cell, Subcycle * p)
+{
+  GFS_VALUE (cell, p->ns) = p->n[MIN (ftt_cell_level (cell), p->depth)];
+}
+
+static void collect_cell (FttCell * cell, Subcycle * p)
+{
+  guint k = substeps_index (GFS_VALUE (cell, p->ns));
+
+  g_ptr_array_add (p->cells[k], cell);
+  if (cell->flags & GFS_FLAG_USED)
+    cell->flags &= ~GFS_FLAG_USED;
+  else
+    g_ptr_array_add (p->singles[k], cell);
+}
+
+static void collect_face (FttCellFace * face, Subcycle * p)
+{
+  gdouble n = GFS_VALUE (face->cell, p->ns);
+
+  if (face->neighbor)
+    n = MAX (n, GFS_VALUE (face->neighbor, p->ns));
+  g_array_append_val (p->faces[substeps_index (n)], *face);
+}
+
+static void subcycle_init (GfsDomain * domain, Subcycle * p, guint * n)
+{
+  GPtrArray * merged;
+  guint k;
+
+  p->n = n;
+  p->depth = gfs_domain_depth (domain);
+  p->kmax = substeps_index (n[p->depth]);
+  p->faces = g_malloc ((p->kmax + 1)*sizeof (GArray *));
+  p->cells = g_malloc ((p->kmax + 1)*sizeof (GPtrArray *));
+  p->singles = g_malloc ((p->kmax + 1)*sizeof (GPtrArray *));
+  p->merged = g_malloc ((p->kmax + 1)*sizeof (GPtrArray *));
+  for (k = 0; k <= p->kmax; k++) {
+    p->faces[k] = g_array_new (FALSE, FALSE, sizeof (FttCellFace));
+    p->cells[k] = g_ptr_array_new ();
+    p->singles[k] = g_ptr_array_new ();
+    p->merged[k] = g_ptr_array_new ();
+  }
+
+  /* ns: number of substeps of each cell */
+  p->ns = gfs_temporary_variable (domain);
+  gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) cell_substeps, p);
+
+  /* merged cells are updated together, using the smallest substep */
+  merged = gfs_domain_merged (domain);
+  for (k = 0; k < merged->len; k++) {
+    GSList * i = merged->pdata[k];
+    gdouble ns = 0.;
+    while (i) {
+      ns = MAX (ns, GFS_VALUE ((FttCell *) i->data, p->ns));
+      i = i->next;
+    }
+    for (i = merged->pdata[k]; i; i = i->next) {
+      FttCell * cell = i->data;
+      GFS_VALUE (cell, p->ns) = ns;
+      cell->flags |= GFS_FLAG_USED;
+    }
+    g_ptr_array_add (p->merged[substeps_index (ns)], merged->pdata[k]);
+  }
+  gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, p->ns);
+
+  gfs_domain_traverse_leaves (domain, (FttCellTraverseFunc) collect_cell, p);
+  gfs_domain_face_traverse (domain, FTT_XYZ, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			    (FttFaceTraverseFunc) collect_face, p);
+}
+
+static void subcycle_free (Subcycle * p)
+{
+  guint k;
+
+  for (k = 0; k <= p->kmax; k++) {
+    g_array_free (p->faces[k], TRUE);
+    g_ptr_array_free (p->cells[k], TRUE);
+    g_ptr_array_free (p->singles[k], TRUE);
+    g_ptr_array_free (p->merged[k], TRUE);
+  }
+  g_free (p->faces);
+  g_free (p->cells);
+  g_free (p->singles);
+  g_free (p->merged);
+  gts_object_destroy (GTS_OBJECT (p->ns));
+}
+
+/* the cells with at least 2^j substeps start a substep at substep
+   @s, j = 0 for the first (and the last + 1) substep */
+static guint substep_level (Subcycle * p, guint s)
+{
+  guint j = p->kmax;
+
+  if (s == 0)
+    return 0;
+  while (!(s & 1)) {
+    s >>= 1;
+    j--;
+  }
+  return j;
+}
+
+/* Performs substep @s. The cells starting a substep compute their
+   face values, which are then kept until the end of their own
+   substep: the flux through a face is computed at each substep of
+   the finest cell but the face value of a coarser upwind cell is
+   always centered on the substep of this coarser cell. The cells
+   ending their substep are updated using the fluxes accumulated
+   during their whole substep. */
+static void subcycle_step (GfsDomain * domain, Subcycle * p,
+			   GfsAdvectionParams * par, gdouble dt, guint s)
+{
+  guint j = substep_level (p, s), jend = substep_level (p, s + 1), k, i;
+
+  for (k = j; k <= p->kmax; k++)
+    for (i = 0; i < p->cells[k]->len; i++) {
+      FttCell * cell = p->cells[k]->pdata[i];
+      par->dt = dt/GFS_VALUE (cell, p->ns);
+      gfs_cell_advected_face_values (cell, par);
+    }
+  gfs_domain_face_bc (domain, FTT_XYZ, par->v);
+
+  for (k = j; k <= p->kmax; k++) {
+    par->dt = dt/(1 << k);
+    for (i = 0; i < p->faces[k]->len; i++)
+      (* par->flux) (&g_array_index (p->faces[k], FttCellFace, i), par);
+  }
+
+  for (k = jend; k <= p->kmax; k++) {
+    for (i = 0; i < p->singles[k]->len; i++) {
+      GSList merged;
+      merged.data = p->singles[k]->pdata[i];
+      merged.next = NULL;
+      (* par->update) (&merged, par);
+    }
+    for (i = 0; i < p->merged[k]->len; i++)
+      (* par->update) (p->merged[k]->pdata[i], par);
+    for (i = 0; i < p->cells[k]->len; i++)
+      GFS_VALUE ((FttCell *) p->cells[k]->pdata[i], par->fv) = 0.;
+  }
+  gfs_domain_bc (domain, FTT_TRAVERSE_LEAFS, -1, par->v);
+}
+
+static void face_reset (FttCellFace * face, GfsVariable * fv)
+{
+  GFS_VALUE (face->cell, fv) = GFS_VALUE (face->neighbor, fv) = 0.;
+}
+
+/**
+ * gfs_tracers_subcycled_advection:
+ * @domain: a #GfsDomain.
+ * @tracers: a list of #GfsAdvectionParams.
+ * @n: the number of substeps of each level of @domain.
+ *
+ * Advects the @v fields of @tracers using the current face-centered
+ * (MAC) velocity field and the timestep @dt of the first tracer. The
+ * leaf cells of level l are advanced using @n[l] substeps of length
+ * @dt/@n[l]. @n[l] must be a power of two and must not decrease with
+ * l.
+ *
+ * The flux through a face is computed using the smallest substep of
+ * the cells on either side and is applied to both cells, so that the
+ * scheme is conservative. A cell is updated only at the end of each
+ * of its own substeps, so that its face values and its fluxes are
+ * consistent in time.
+ *
+ * All the tracers must be passive (see gfs_tracer_is_passive()).
+ */
+void gfs_tracers_subcycled_advection (GfsDomain * domain, GSList * tracers, guint * n)
+{
+  Subcycle p;
+  GSList * i;
+  gdouble dt;
+
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (n != NULL);
+
+  if (tracers == NULL)
+    return;
+
+  gfs_domain_timer_start (domain, "tracer_advection_diffusion");
+
+  subcycle_init (domain, &p, n);
+  dt = ((GfsAdvectionParams *) tracers->data)->dt;
+  /* the face values of a tracer are kept over several substeps:
+     the tracers are advected one after the other */
+  for (i = tracers; i; i = i->next) {
+    GfsAdvectionParams * par = i->data;
+    guint s;
+
+    g_assert (gfs_tracer_is_passive (par));
+    par->u = gfs_domain_velocity (domain);
+    par->g = NULL;
+    par->fv = gfs_temporary_variable (domain);
+    par->upwinding = GFS_FACE_UPWINDING;
+    gfs_domain_face_traverse (domain, FTT_XYZ, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			      (FttFaceTraverseFunc) face_reset, par->fv);
+
+    for (s = 0; s < n[p.depth]; s++)
+      subcycle_step (domain, &p, par, dt, s);
+
+    par->dt = dt;
+    par->u = par->g = NULL;
+    gts_object_destroy (GTS_OBJECT (par->fv));
+    par->fv = NULL;
+  }
+  subcycle_free (&p);
+
+  gfs_domain_timer_stop (domain, "tracer_advection_diffusion");
+}
+
 /**
  * Generic Surface boundary condition.
  * \beginobject{GfsSurfaceGenericBc}
@@ -91,6 +91,12 @@ void          gfs_remove_sinking_velocity     (GfsDomain * domain,
 void          gfs_tracer_advection_diffusion  (GfsDomain * domain,
 					       GfsAdvectionParams * par,
 					       GfsFunction * alpha);
+gboolean      gfs_tracer_is_passive           (const GfsAdvectionParams * par);
+void          gfs_tracers_advection           (GfsDomain * domain,
+					       GSList * tracers);
+void          gfs_tracers_subcycled_advection (GfsDomain * domain,
+					       GSList * tracers,
+					       guint * n);
 void          gfs_velocity_face_sources       (GfsDomain * domain,
                                                GfsVariable ** u,
                                                gdouble dt,
@@ -21,6 +21,7 @@
  * \brief Conversion to unstructured mesh formats.
  */
 
+#include <string.h>
 #include "unstructured.h"
 #include "variable.h"
 #include "config.h"
@@ -28,6 +29,10 @@
 #include "graphic.h"
 #include "solid.h"
 
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif /* HAVE_ZLIB */
+
 #define NV (4*(FTT_DIMENSION - 1))
 
 static void reset_pointers (FttCell * cell, GfsVariable ** v)
@@ -305,6 +310,384 @@ void gfs_domain_write_vtk (GfsDomain * domain, gint max_depth, GSList * variable
     gts_object_destroy (GTS_OBJECT (v[i]));
 }
 
+/* Binary VTK XML output */
+
+/* Hash table of the corners of the cells of a box, indexed by their
+   integer coordinates on the finest level of the box */
+typedef struct {
+  guint64 * key;  /* key + 1 (zero for empty slots) */
+  guint * index;
+  guint * used;   /* the n slots in use */
+  guint size, n;
+} CornerIndex;
+
+static void corner_index_init (CornerIndex * h, guint size)
+{
+  h->size = 16;
+  while (h->size < 2*size)
+    h->size *= 2;
+  h->key = g_malloc0 (h->size*sizeof (guint64));
+  h->index = g_malloc (h->size*sizeof (guint));
+  h->used = g_malloc (h->size*sizeof (guint));
+  h->n = 0;
+}
+
+static void corner_index_free (CornerIndex * h)
+{
+  g_free (h->key);
+  g_free (h->index);
+  g_free (h->used);
+}
+
+/* Empties @h in a time proportional to the number of slots in use */
+static void corner_index_clear (CornerIndex * h)
+{
+  guint i;
+  for (i = 0; i < h->n; i++)
+    h->key[h->used[i]] = 0;
+  h->n = 0;
+}
+
+static guint * corner_index_lookup (CornerIndex * h, guint64 key, gboolean * found)
+{
+  guint i = (key*G_GUINT64_CONSTANT (0x9e3779b97f4a7c15)) >> 32 & (h->size - 1);
+  key++;
+  while (h->key[i] && h->key[i] != key)
+    i = (i + 1) & (h->size - 1);
+  *found = (h->key[i] != 0);
+  if (!*found) {
+    h->key[i] = key;
+    h->used[h->n++] = i;
+  }
+  return &h->index[i];
+}
+
+static void corner_index_grow (CornerIndex * h)
+{
+  CornerIndex g;
+  guint i;
+
+  corner_index_init (&g, h->size);
+  for (i = 0; i < h->n; i++) {
+    guint j = h->used[i];
+    gboolean found;
+    *corner_index_lookup (&g, h->key[j] - 1, &found) = h->index[j];
+  }
+  corner_index_free (h);
+  *h = g;
+}
+
+typedef struct {
+  GArray * vertices, * connectivity;
+  CornerIndex corners;
+  FttVector origin;
+  gdouble h;
+  gint max_depth;
+} VtuParams;
+
+static void vtu_cell (FttCell * cell, VtuParams * p)
+{
+  static gint dx[NV][FTT_DIMENSION] = {
+#if FTT_2D
+    {-1,-1}, {1,-1}, {-1,1}, {1,1},
+#else /* 3D */
+    {-1,-1,-1}, {1,-1,-1}, {-1,1,-1}, {1,1,-1},
+    {-1,-1,1},  {1,-1,1},  {-1,1,1},  {1,1,1}
+#endif /* 3D */
+  };
+  guint bits = 64/FTT_DIMENSION, i;
+  gdouble size = ftt_cell_size (cell)/2.;
+  FttVector o;
+
+  ftt_cell_pos (cell, &o);
+  for (i = 0; i < NV; i++) {
+    guint64 key = 0;
+    FttComponent c;
+    for (c = 0; c < FTT_DIMENSION; c++)
+      key = (key << bits) | 
+	(guint64) floor (((&o.x)[c] + dx[i][c]*size - (&p->origin.x)[c])/p->h + 0.5);
+
+    gboolean found;
+    guint * index = corner_index_lookup (&p->corners, key, &found);
+    gint32 n;
+    if (found)
+      n = *index;
+    else {
+      Vertex v;
+      v.cell = cell;
+      v.i = i;
+      v.index = n = *index = p->vertices->len;
+      g_array_append_val (p->vertices, v);
+      if (2*p->corners.n > p->corners.size)
+	corner_index_grow (&p->corners);
+    }
+    g_array_append_val (p->connectivity, n);
+  }
+}
+
+static void vtu_box (GfsBox * box, VtuParams * p)
+{
+  guint depth = ftt_cell_depth (box->root);
+  if (p->max_depth >= 0 && depth > p->max_depth)
+    depth = p->max_depth;
+  g_assert (depth < 64/FTT_DIMENSION);
+
+  gdouble size = ftt_cell_size (box->root);
+  FttComponent c;
+  ftt_cell_pos (box->root, &p->origin);
+  for (c = 0; c < FTT_DIMENSION; c++)
+    (&p->origin.x)[c] -= size/2.;
+  p->h = size/(1 << depth);
+
+  /* corners are not shared between boxes */
+  corner_index_clear (&p->corners);
+  ftt_cell_traverse (box->root, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, p->max_depth,
+		     (FttCellTraverseFunc) vtu_cell, p);
+}
+
+/* Appends to @data the array @a of @n bytes, either raw or compressed
+   as defined by vtkZLibDataCompressor, and returns the offset of the
+   array in @data */
+#define VTU_BLOCK_SIZE 32768
+
+static guint64 vtu_append (GArray * data, gconstpointer a, guint64 n, gboolean compress)
+{
+  guint64 offset = data->len;
+#ifdef HAVE_ZLIB
+  if (compress) {
+    guint64 nb = (n + VTU_BLOCK_SIZE - 1)/VTU_BLOCK_SIZE, i;
+    guint64 header[3] = { nb, VTU_BLOCK_SIZE, n % VTU_BLOCK_SIZE };
+    if (nb > 0 && header[2] == 0)
+      header[2] = VTU_BLOCK_SIZE;
+    g_array_append_vals (data, header, sizeof (header));
+    guint64 sizes = data->len;
+    g_array_set_size (data, data->len + nb*sizeof (guint64));
+    for (i = 0; i < nb; i++) {
+      uLong len = (i < nb - 1 ? VTU_BLOCK_SIZE : header[2]);
+      uLongf clen = compressBound (len);
+      guint64 start = data->len;
+      g_array_set_size (data, start + clen);
+      if (compress2 ((Bytef *) data->data + start, &clen,
+		     (const Bytef *) a + i*VTU_BLOCK_SIZE, len, Z_DEFAULT_COMPRESSION) != Z_OK)
+	g_error ("vtu_append(): compression failed");
+      g_array_set_size (data, start + clen);
+      guint64 s = clen;
+      memcpy (data->data + sizes + i*sizeof (guint64), &s, sizeof (guint64));
+    }
+    return offset;
+  }
+#endif /* HAVE_ZLIB */
+  g_array_append_vals (data, &n, sizeof (guint64));
+  g_array_append_vals (data, a, n);
+  return offset;
+}
+
+static void vertex_values (Vertex * vertex, GfsVariable ** v, guint nv, gint max_depth, 
+			   float * val)
+{
+  GfsInterpolator inter[2];
+  gboolean computed[2] = { FALSE, FALSE };
+  guint i, j;
+
+  for (i = 0; i < nv; i++) {
+    guint c = v[i]->centered ? 1 : 0;
+    if (!computed[c]) {
+      gfs_cell_corner_interpolator (vertex->cell, d[vertex->i], max_depth, c, &inter[c]);
+      computed[c] = TRUE;
+    }
+    gdouble value = 0.;
+    for (j = 0; j < inter[c].n; j++) {
+      gdouble v1 = GFS_VALUE (inter[c].c[j], v[i]);
+      if (v1 == GFS_NODATA) {
+	value = GFS_VALUE (vertex->cell, v[i]);
+	break;
+      }
+      value += inter[c].w[j]*v1;
+    }
+    val[i] = gfs_dimensional_value (v[i], value);
+  }
+}
+
+static const gchar * vtu_byte_order (void)
+{
+  return G_BYTE_ORDER == G_LITTLE_ENDIAN ? "LittleEndian" : "BigEndian";
+}
+
+/**
+ * gfs_domain_write_vtu:
+ * @domain: a #GfsDomain.
+ * @max_depth: the maximum depth to consider.
+ * @variables: a list of #GfsVariable to output.
+ * @compress: whether to compress the data (requires zlib).
+ * @fp: a file pointer.
+ *
+ * Writes in @fp a binary VTK XML unstructured grid (.vtu)
+ * representation of the local part of @domain and of the
+ * corresponding variables in the given list. The data is stored in
+ * appended (raw or zlib-compressed) form.
+ *
+ * The vertices are shared only between cells of the same box.
+ */
+void gfs_domain_write_vtu (GfsDomain * domain, gint max_depth, GSList * variables, 
+			   gboolean compress, FILE * fp)
+{
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (fp != NULL);
+
+#ifndef HAVE_ZLIB
+  if (compress) {
+    g_warning ("gfs_domain_write_vtu(): zlib compression is not available");
+    compress = FALSE;
+  }
+#endif /* not HAVE_ZLIB */
+
+  VtuParams p;
+  p.vertices = g_array_new (FALSE, FALSE, sizeof (Vertex));
+  p.connectivity = g_array_new (FALSE, FALSE, sizeof (gint32));
+  p.max_depth = max_depth;
+  corner_index_init (&p.corners, 1024);
+  gts_container_foreach (GTS_CONTAINER (domain), (GtsFunc) vtu_box, &p);
+  corner_index_free (&p.corners);
+
+  guint nv = p.vertices->len, n_cells = p.connectivity->len/NV, i;
+  GArray * data = g_array_new (FALSE, FALSE, 1);
+
+  /* point data */
+  guint nvar = g_slist_length (variables);
+  GfsVariable ** v = g_malloc (MAX (nvar, 1)*sizeof (GfsVariable *));
+  GSList * j = variables;
+  for (i = 0; i < nvar; i++, j = j->next)
+    v[i] = j->data;
+  float * values = g_malloc (MAX (nv*nvar, 1)*sizeof (float));
+  for (i = 0; i < nv; i++)
+    vertex_values (&g_array_index (p.vertices, Vertex, i), v, nvar, max_depth, 
+		   &values[i*nvar]);
+  guint64 * offset = g_malloc ((nvar + 4)*sizeof (guint64));
+  float * a = g_malloc (MAX (nv, 1)*3*sizeof (float));
+  for (i = 0; i < nvar; i++) {
+    guint k;
+    for (k = 0; k < nv; k++)
+      a[k] = values[k*nvar + i];
+    offset[i] = vtu_append (data, a, nv*sizeof (float), compress);
+  }
+  g_free (values);
+
+  /* points */
+  for (i = 0; i < nv; i++) {
+    FttVector pos;
+    vertex_pos (&g_array_index (p.vertices, Vertex, i), &pos, GFS_SIMULATION (domain));
+    a[3*i] = pos.x; a[3*i + 1] = pos.y; a[3*i + 2] = pos.z;
+  }
+  offset[nvar] = vtu_append (data, a, 3*nv*sizeof (float), compress);
+  g_free (a);
+  g_array_free (p.vertices, TRUE);
+
+  /* cells */
+  offset[nvar + 1] = vtu_append (data, p.connectivity->data, 
+				 p.connectivity->len*sizeof (gint32), compress);
+  g_array_set_size (p.connectivity, n_cells);
+  for (i = 0; i < n_cells; i++)
+    g_array_index (p.connectivity, gint32, i) = (i + 1)*NV;
+  offset[nvar + 2] = vtu_append (data, p.connectivity->data, n_cells*sizeof (gint32), compress);
+  g_array_free (p.connectivity, TRUE);
+  guint8 * types = g_malloc (MAX (n_cells, 1));
+  memset (types, FTT_DIMENSION == 2 ? 8 : 11, n_cells);
+  offset[nvar + 3] = vtu_append (data, types, n_cells, compress);
+  g_free (types);
+
+  /* header */
+  fprintf (fp,
+	   "<?xml version=\"1.0\"?>\n"
+	   "<!-- Gerris simulation version %s (%s) -->\n"
+	   "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"%s\""
+	   " header_type=\"UInt64\"%s>\n"
+	   "  <UnstructuredGrid>\n"
+	   "    <FieldData>\n"
+	   "      <DataArray type=\"Float64\" Name=\"TimeValue\" NumberOfTuples=\"1\""
+	   " format=\"ascii\">%.16g</DataArray>\n"
+	   "    </FieldData>\n"
+	   "    <Piece NumberOfPoints=\"%u\" NumberOfCells=\"%u\">\n"
+	   "      <PointData>\n",
+	   GFS_VERSION, GFS_BUILD_VERSION, vtu_byte_order (),
+	   compress ? " compressor=\"vtkZLibDataCompressor\"" : "",
+	   GFS_SIMULATION (domain)->time.t,
+	   nv, n_cells);
+  for (i = 0; i < nvar; i++)
+    fprintf (fp, 
+	     "        <DataArray type=\"Float32\" Name=\"%s\" format=\"appended\""
+	     " offset=\"%" G_GUINT64_FORMAT "\"/>\n",
+	     v[i]->name, offset[i]);
+  fprintf (fp,
+	   "      </PointData>\n"
+	   "      <Points>\n"
+	   "        <DataArray type=\"Float32\" NumberOfComponents=\"3\" format=\"appended\""
+	   " offset=\"%" G_GUINT64_FORMAT "\"/>\n"
+	   "      </Points>\n"
+	   "      <Cells>\n"
+	   "        <DataArray type=\"Int32\" Name=\"connectivity\" format=\"appended\""
+	   " offset=\"%" G_GUINT64_FORMAT "\"/>\n"
+	   "        <DataArray type=\"Int32\" Name=\"offsets\" format=\"appended\""
+	   " offset=\"%" G_GUINT64_FORMAT "\"/>\n"
+	   "        <DataArray type=\"UInt8\" Name=\"types\" format=\"appended\""
+	   " offset=\"%" G_GUINT64_FORMAT "\"/>\n"
+	   "      </Cells>\n"
+	   "    </Piece>\n"
+	   "  </UnstructuredGrid>\n"
+	   "  <AppendedData encoding=\"raw\">\n"
+	   "   _",
+	   offset[nvar], offset[nvar + 1], offset[nvar + 2], offset[nvar + 3]);
+  fwrite (data->data, 1, data->len, fp);
+  fputs ("\n  </AppendedData>\n"
+	 "</VTKFile>\n", fp);
+
+  g_array_free (data, TRUE);
+  g_free (offset);
+  g_free (v);
+}
+
+/**
+ * gfs_domain_write_pvtu:
+ * @domain: a #GfsDomain.
+ * @variables: a list of #GfsVariable to output.
+ * @base: the base name of the pieces.
+ * @fp: a file pointer.
+ *
+ * Writes in @fp a parallel VTK XML unstructured grid (.pvtu) file
+ * referring to the pieces written by each process using
+ * gfs_domain_write_vtu(). The piece of process @i is the file
+ * @base-@i.vtu.
+ */
+void gfs_domain_write_pvtu (GfsDomain * domain, GSList * variables, const gchar * base, 
+			    FILE * fp)
+{
+  g_return_if_fail (domain != NULL);
+  g_return_if_fail (base != NULL);
+  g_return_if_fail (fp != NULL);
+
+  fprintf (fp,
+	   "<?xml version=\"1.0\"?>\n"
+	   "<!-- Gerris simulation version %s (%s) -->\n"
+	   "<VTKFile type=\"PUnstructuredGrid\" version=\"1.0\" byte_order=\"%s\""
+	   " header_type=\"UInt64\">\n"
+	   "  <PUnstructuredGrid GhostLevel=\"0\">\n"
+	   "    <PPointData>\n",
+	   GFS_VERSION, GFS_BUILD_VERSION, vtu_byte_order ());
+  while (variables) {
+    fprintf (fp, "      <PDataArray type=\"Float32\" Name=\"%s\"/>\n",
+	     GFS_VARIABLE (variables->data)->name);
+    variables = variables->next;
+  }
+  fputs ("    </PPointData>\n"
+	 "    <PPoints>\n"
+	 "      <PDataArray type=\"Float32\" NumberOfComponents=\"3\"/>\n"
+	 "    </PPoints>\n", fp);
+  int i;
+  for (i = 0; i < MAX (domain->np, 1); i++)
+    fprintf (fp, "    <Piece Source=\"%s-%d.vtu\"/>\n", base, i);
+  fputs ("  </PUnstructuredGrid>\n"
+	 "</VTKFile>\n", fp);
+}
+
 static void write_tecplot_element (FttCell * cell, WriteParams * par)
 {
   static guint tecplot_index[NV] = {
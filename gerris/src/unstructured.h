@@ -32,6 +32,15 @@ void gfs_domain_write_vtk     (GfsDomain * domain,
 			       GSList * variables, 
 			       const gchar * precision,
 			       FILE * fp);
+void gfs_domain_write_vtu     (GfsDomain * domain, 
+			       gint max_depth, 
+			       GSList * variables, 
+			       gboolean compress,
+			       FILE * fp);
+void gfs_domain_write_pvtu    (GfsDomain * domain, 
+			       GSList * variables, 
+			       const gchar * base,
+			       FILE * fp);
 void gfs_domain_write_tecplot (GfsDomain * domain, 
 			       gint max_depth, 
 			       GSList * variables, 
@@ -30,12 +30,20 @@
 #include <sys/times.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <time.h>
 #include <math.h>
 #include "config.h"
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <linux/perf_event.h>
+#endif /* HAVE_LINUX_PERF_EVENT_H */
 #include "solid.h"
 #include "simulation.h"
 #include "cartesian.h"
+#include "version.h"
 
 /*
  * get_tmp_file based on the mkstemp implementation from the GNU C library.
@@ -249,6 +257,12 @@ typedef gdouble (* GfsFunctionFunc) (const FttCell * cell,
 				     GfsSimulation * sim,
 				     GfsVariable ** var,
 				     GfsDerivedVariable ** dvar);
+typedef void    (* GfsFunctionBatchFunc)   (FttCell ** cells,
+					    guint n,
+					    GfsSimulation * sim,
+					    GfsVariable ** var,
+					    GfsDerivedVariable ** dvar,
+					    gdouble * values);
 typedef gdouble (* GfsFunctionDerivedFunc) (const FttCell * cell,
 					    const FttCellFace * face,
 					    GfsSimulation * sim,
@@ -362,6 +376,7 @@ struct _GfsFunction {
   gboolean isexpr;
   GfsModule * module;
   GfsFunctionFunc f;
+  GfsFunctionBatchFunc batch;
   gchar * sname;
   GtsSurface * s;
   GfsCartesianGrid * g;
@@ -373,6 +388,11 @@ struct _GfsFunction {
   gdouble units;
   GfsVariable ** var;
   GfsDerivedVariable ** dvar;
+  /* dependency of compiled functions and time at which their folded
+     value (stored in val) was computed */
+  GfsFunctionDependency dependency;
+  gboolean folded;
+  gdouble t, dt;
 };
 
 /** \endobject{GfsGlobal} */
@@ -415,6 +435,26 @@ static gchar * find_identifier (const gchar * s, const gchar * i)
 /* source code for functions pending compilation */
 static GString * pending_functions = NULL;
 static guint n_pending_functions = 0;
+/* protects the pending functions and the function cache, so that
+   simulation files can be read concurrently by several threads */
+G_LOCK_DEFINE_STATIC (pending_functions);
+
+/* append the body of @f to pending compilations */
+static void append_function_body (const GfsFunction * f, guint line)
+{
+  g_string_append_printf (pending_functions, "#line %d \"GfsFunction\"\n", line);
+
+  if (f->isexpr)
+    g_string_append_printf (pending_functions, "return %s;\n}\n", f->expr->str);
+  else {
+    gchar * s = f->expr->str;
+    guint len = strlen (s);
+    g_assert (s[0] == '{' && s[len-1] == '}');
+    s[len-1] = '\0';
+    g_string_append_printf (pending_functions, "%s\n}\n", &s[1]);
+    s[len-1] = '}';
+  }
+}
 
 /* append source code for @f to pending compilations */
 static void append_pending_function (const GfsFunction * f, guint line, guint id)
@@ -445,12 +485,16 @@ static void append_pending_function (const GfsFunction * f, guint line, guint id
     }
   }
     
-  if (f->spatial)
+  if (f->spatial) {
     g_string_append_printf (pending_functions, 
 			    "\ndouble f%u (double x, double y, double z, double t) {\n"
 			    "  _x = x; _y = y; _z = z;\n", id);
-  else if (f->constant)
+    append_function_body (f, line);
+  }
+  else if (f->constant) {
     g_string_append_printf (pending_functions, "\ndouble f%u (void) {\n", id);
+    append_function_body (f, line);
+  }
   else {
     g_string_append_printf (pending_functions, "char * variables%u[] = {", id);
     i = domain->variables;
@@ -478,6 +522,27 @@ static void append_pending_function (const GfsFunction * f, guint line, guint id
     g_string_append (pending_functions, "NULL};\n");
     ldv = g_slist_reverse (ldv);
 
+    /* the body of the function is defined only once, as a static
+       inline function of the values of the variables it uses, so
+       that compilation errors are reported only once */
+    GString * args = g_string_new ("");
+    g_string_append_printf (pending_functions,
+			    "\nstatic inline double e%u (FttCell * cell, FttCellFace * face,\n"
+			    "            GfsSimulation * sim, GfsVariable ** var,\n"
+			    "            GfsDerivedVariable ** dvar",
+			    id);
+    for (i = lv; i; i = i->next) {
+      g_string_append_printf (pending_functions, ", double %s", GFS_VARIABLE (i->data)->name);
+      g_string_append_printf (args, ", %s", GFS_VARIABLE (i->data)->name);
+    }
+    for (i = ldv; i; i = i->next) {
+      g_string_append_printf (pending_functions, ", double %s",
+			      GFS_DERIVED_VARIABLE (i->data)->name);
+      g_string_append_printf (args, ", %s", GFS_DERIVED_VARIABLE (i->data)->name);
+    }
+    g_string_append (pending_functions, ") {\n");
+    append_function_body (f, line);
+
     g_string_append_printf (pending_functions,
 			    "\ndouble f%u (FttCell * cell, FttCellFace * face,\n"
 			    "            GfsSimulation * sim, GfsVariable ** var,\n"
@@ -520,7 +585,6 @@ static void append_pending_function (const GfsFunction * f, guint line, guint id
 	  i = i->next; index++;
 	}
 	g_string_append (pending_functions, "  }\n");
-	g_slist_free (lv);
       }
       if (ldv) {
 	i = ldv; int index = 0;
@@ -531,21 +595,58 @@ static void append_pending_function (const GfsFunction * f, guint line, guint id
 		   v->name, index, index);
 	  i = i->next; index++;
 	}
-	g_slist_free (ldv);
       }
     }
-  }
-  g_string_append_printf (pending_functions, "#line %d \"GfsFunction\"\n", line);
+    g_string_append_printf (pending_functions,
+			    "  return e%u (cell, face, sim, var, dvar%s);\n}\n",
+			    id, args->str);
 
-  if (f->isexpr)
-    g_string_append_printf (pending_functions, "return %s;\n}\n", f->expr->str);
-  else {
-    gchar * s = f->expr->str;
-    guint len = strlen (s);
-    g_assert (s[0] == '{' && s[len-1] == '}');
-    s[len-1] = '\0';
-    g_string_append_printf (pending_functions, "%s\n}\n", &s[1]);
-    s[len-1] = '}';
+    /* batch entry point: the values of the variables are first
+       gathered for all the cells, then the function is evaluated in
+       a separate loop, with a single call per batch */
+    g_string_append_printf (pending_functions,
+			    "\nvoid f%u_batch (FttCell ** cells, unsigned int n,\n"
+			    "            GfsSimulation * sim, GfsVariable ** var,\n"
+			    "            GfsDerivedVariable ** dvar, double * values) {\n"
+			    "  unsigned int _i;\n"
+			    "  _sim = sim;\n",
+			    id);
+    g_string_truncate (args, 0);
+    gint index;
+    for (i = lv; i; i = i->next) {
+      g_string_append_printf (pending_functions, "  double _b_%s[GFS_FUNCTION_BATCH];\n",
+			      GFS_VARIABLE (i->data)->name);
+      g_string_append_printf (args, ", _b_%s[_i]", GFS_VARIABLE (i->data)->name);
+    }
+    for (i = ldv; i; i = i->next) {
+      g_string_append_printf (pending_functions, "  double _b_%s[GFS_FUNCTION_BATCH];\n",
+			      GFS_DERIVED_VARIABLE (i->data)->name);
+      g_string_append_printf (args, ", _b_%s[_i]", GFS_DERIVED_VARIABLE (i->data)->name);
+    }
+    if (lv || ldv) {
+      g_string_append (pending_functions, "  for (_i = 0; _i < n; _i++) {\n");
+      for (i = lv, index = 0; i; i = i->next, index++)
+	g_string_append_printf (pending_functions,
+				"    _b_%s[_i] = gfs_dimensional_value (var[%d], "
+				"GFS_VALUE (cells[_i], var[%d]));\n",
+				GFS_VARIABLE (i->data)->name, index, index);
+      for (i = ldv, index = 0; i; i = i->next, index++)
+	g_string_append_printf (pending_functions,
+				"    _b_%s[_i] = (* (Func) dvar[%d]->func) "
+				"(cells[_i], NULL, sim, dvar[%d]->data);\n",
+				GFS_DERIVED_VARIABLE (i->data)->name, index, index);
+      g_string_append (pending_functions, "  }\n");
+    }
+    g_string_append_printf (pending_functions,
+			    "  for (_i = 0; _i < n; _i++) {\n"
+			    "    _cell = cells[_i];\n"
+			    "    values[_i] = e%u (cells[_i], NULL, sim, var, dvar%s);\n"
+			    "  }\n"
+			    "}\n",
+			    id, args->str);
+    g_string_free (args, TRUE);
+    g_slist_free (lv);
+    g_slist_free (ldv);
   }
 }
 
@@ -573,6 +674,10 @@ static void link_module (GfsFunction * f)
     f->expr = NULL;
   }
   else if (!f->spatial) {
+    name = g_strdup_printf ("f%u_batch", id);
+    if (!g_module_symbol (module, name, (gpointer) &f->batch))
+      f->batch = NULL;
+    g_free (name);
     char ** variables;
     name = g_strdup_printf ("variables%u", id);
     g_assert (g_module_symbol (module, name, (gpointer) &variables));
@@ -618,7 +723,9 @@ static void gfs_module_ref (GfsModule * m, GfsFunction * f)
 
 static void gfs_module_unref (GfsModule * m, GfsFunction * f)
 {
+  G_LOCK (pending_functions);
   m->l = g_slist_remove (m->l, f);
+  G_UNLOCK (pending_functions);
   /* modules are kept "forever" in case they come up again e.g. during
      dynamic load-balancing */
 }
@@ -638,6 +745,7 @@ static gboolean lookup_function (GfsFunction * f)
 
 static void gfs_module_new (GfsFunction * f, guint line)
 {
+  G_LOCK (pending_functions);
   if (!lookup_function (f)) {
     GfsModule * m = g_malloc0 (sizeof (GfsModule));
     m->key = function_key (f);
@@ -646,6 +754,7 @@ static void gfs_module_new (GfsFunction * f, guint line)
     append_pending_function (f, line, m->id);
     gfs_module_ref (m, f);
   }
+  G_UNLOCK (pending_functions);
 }
 
 static double current_time (void)
@@ -655,7 +764,241 @@ static double current_time (void)
   return r.tv_sec + 1e-6*r.tv_usec;
 }
 
-static GModule * compile (GtsFile * fp, const gchar * dirname, const gchar * finname)
+/* maximum age (in seconds) of the lock of a module being compiled
+   by another process, after which the lock is considered stale */
+#define MODULE_LOCK_TIMEOUT 600.
+
+/* maximum depth of nested headers included in the hash of a module */
+#define MODULE_INCLUDE_DEPTH 16
+
+static void module_key_append_dependencies (GString * key, const gchar * source,
+					    const gchar * dir, const gchar * wdir,
+					    guint depth);
+
+/* Appends the contents of @path (if the file exists) to @key. If
+   @include is %TRUE, the headers included by @path are also
+   appended. */
+static gboolean module_key_append_file (GString * key, const gchar * path,
+					const gchar * wdir, gboolean include,
+					guint depth)
+{
+  gchar * contents;
+  gsize length;
+  if (!g_file_get_contents (path, &contents, &length, NULL))
+    return FALSE;
+  g_string_append_printf (key, "\n%" G_GSIZE_FORMAT "\n", length);
+  g_string_append_len (key, contents, length);
+  if (include && depth < MODULE_INCLUDE_DEPTH) {
+    gchar * dir = g_path_get_dirname (path);
+    module_key_append_dependencies (key, contents, dir, wdir, depth + 1);
+    g_free (dir);
+  }
+  g_free (contents);
+  return TRUE;
+}
+
+/* Appends the library @name linked with "-l@name" if it is found
+   in one of the @ldirs given with "-L" */
+static void module_key_append_library (GString * key, const gchar * name, GSList * ldirs)
+{
+  static gchar * suffix[] = { ".so", ".a", NULL };
+  for (; ldirs; ldirs = ldirs->next) {
+    gchar ** s;
+    for (s = suffix; *s; s++) {
+      gchar * lib = g_strconcat ("lib", name, *s, NULL);
+      gchar * path = g_build_filename (ldirs->data, lib, NULL);
+      gboolean found = module_key_append_file (key, path, NULL, FALSE, 0);
+      g_free (path);
+      g_free (lib);
+      if (found)
+	return;
+    }
+  }
+}
+
+/*
+ * Appends to @key the contents of the files the module compiled from
+ * @source depends on, as found by build_function: headers included
+ * with quotes (searched for in @dir, then in @wdir), headers included
+ * with angle brackets and found in @wdir (the simulation directory,
+ * which is in the include path) and the files and libraries given to
+ * "#link" (libraries are searched for in the "-L" directories).
+ * System headers and libraries are only identified by their names.
+ */
+static void module_key_append_dependencies (GString * key, const gchar * source,
+					    const gchar * dir, const gchar * wdir,
+					    guint depth)
+{
+  gchar ** lines = g_strsplit (source, "\n", 0), ** l;
+  for (l = lines; *l; l++) {
+    gchar * s = *l;
+    while (isspace (*s)) s++;
+    if (*s != '#' && *s != '@')
+      continue;
+    s++;
+    while (isspace (*s)) s++;
+    if (!strncmp (s, "include", 7)) {
+      gchar * end;
+      s += 7;
+      while (isspace (*s)) s++;
+      if ((*s == '"' || *s == '<') && (end = strchr (s + 1, *s == '"' ? '"' : '>'))) {
+	gchar * name = g_strndup (s + 1, end - s - 1);
+	if (g_path_is_absolute (name))
+	  module_key_append_file (key, name, wdir, TRUE, depth);
+	else {
+	  gboolean found = FALSE;
+	  if (*s == '"') {
+	    gchar * path = g_build_filename (dir, name, NULL);
+	    found = module_key_append_file (key, path, wdir, TRUE, depth);
+	    g_free (path);
+	  }
+	  if (!found) {
+	    gchar * path = g_build_filename (wdir, name, NULL);
+	    module_key_append_file (key, path, wdir, TRUE, depth);
+	    g_free (path);
+	  }
+	}
+	g_free (name);
+      }
+    }
+    else if (!strncmp (s, "link", 4) && isspace (s[4])) {
+      gchar ** args = g_strsplit_set (s + 4, " \t", 0), ** a;
+      GSList * ldirs = NULL;
+      for (a = args; *a; a++)
+	if (!strncmp (*a, "-L", 2) && (*a)[2] != '\0')
+	  ldirs = g_slist_append (ldirs, *a + 2);
+      for (a = args; *a; a++)
+	if (!strncmp (*a, "-l", 2))
+	  module_key_append_library (key, *a + 2, ldirs);
+	else if (**a != '-' && **a != '\0')
+	  module_key_append_file (key, *a, NULL, FALSE, 0);
+      g_slist_free (ldirs);
+      g_strfreev (args);
+    }
+  }
+  g_strfreev (lines);
+}
+
+/*
+ * Returns the path of the module compiled from @source in the on-disk
+ * cache or %NULL if the cache is not used. The name of the module is
+ * a hash of the source code, of the dimension, of the version of
+ * Gerris, of the build script (which contains the compiler and its
+ * flags) and of the contents of the headers and libraries the module
+ * depends on (see module_key_append_dependencies()).
+ */
+static gchar * module_cache_path (const gchar * source)
+{
+  const gchar * dir = getenv ("GFS_FUNCTION_CACHE");
+  if (dir == NULL || *dir == '\0')
+    return NULL;
+  if (g_mkdir_with_parents (dir, 0755)) {
+    g_warning ("cannot create function cache directory %s: %s", dir, strerror (errno));
+    return NULL;
+  }
+
+  GString * key = g_string_new (source);
+  g_string_append_printf (key, "\n%dD %s\n", FTT_DIMENSION, GFS_BUILD_VERSION);
+#ifdef HAVE_MPI
+  g_string_append (key, "MPI\n");
+#endif /* HAVE_MPI */
+  gchar * script = g_build_filename (GFS_DATA_DIR, "build_function", NULL), * contents;
+  gsize length;
+  if (g_file_get_contents (script, &contents, &length, NULL)) {
+    g_string_append_len (key, contents, length);
+    g_free (contents);
+  }
+  g_free (script);
+  char pwd[512];
+  g_assert (getcwd (pwd, 512));
+  module_key_append_dependencies (key, source, pwd, pwd, 0);
+  gchar * sum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key->str, key->len);
+  g_string_free (key, TRUE);
+  gchar * name = g_strconcat (sum, ".so", NULL);
+  gchar * path = g_build_filename (dir, name, NULL);
+  g_free (name);
+  g_free (sum);
+  return path;
+}
+
+/*
+ * Looks up the module @path in the on-disk cache. If another process
+ * is compiling the same module, waits for it to complete.
+ *
+ * Returns the module if it is in the cache. Otherwise returns %NULL
+ * and sets @lock to the descriptor of the lock file which guarantees
+ * that this process is the only one compiling the module (or to -1 if
+ * the lock could not be obtained).
+ */
+static GModule * module_cache_lookup (const gchar * path, gint * lock)
+{
+  gchar * lockname = g_strconcat (path, ".lock", NULL);
+  GModule * module = NULL;
+
+  *lock = -1;
+  while (TRUE) {
+    if (g_file_test (path, G_FILE_TEST_EXISTS)) {
+      if (*lock >= 0) {
+	close (*lock);
+	g_unlink (lockname);
+	*lock = -1;
+      }
+      if ((module = g_module_open (path, 0))) {
+	gfs_debug ("using cached module %s", path);
+	break;
+      }
+      /* the cached module is invalid: compile it again */
+      g_warning ("cannot load cached module %s: %s", path, g_module_error ());
+      g_unlink (path);
+      continue;
+    }
+    if (*lock >= 0) /* nobody else compiled the module in the meantime */
+      break;
+    if ((*lock = open (lockname, O_CREAT | O_EXCL | O_WRONLY, 0644)) >= 0)
+      continue; /* check again whether the module has been installed */
+    struct stat sb;
+    if (errno != EEXIST)
+      break;
+    if (stat (lockname, &sb) == 0 && 
+	difftime (time (NULL), sb.st_mtime) > MODULE_LOCK_TIMEOUT) {
+      g_warning ("removing stale lock %s", lockname);
+      g_unlink (lockname);
+    }
+    else
+      g_usleep (100000);
+  }
+  g_free (lockname);
+  return module;
+}
+
+/* Copies the module compiled in @dirname into the cache as @path */
+static void module_cache_install (const gchar * dirname, const gchar * path)
+{
+  gchar * mname = g_build_filename (dirname, "module.so", NULL), * contents;
+  gsize length;
+  GError * error = NULL;
+  /* g_file_set_contents() replaces the file atomically so that other
+     processes never see a partially written module */
+  if (!g_file_get_contents (mname, &contents, &length, &error) ||
+      !g_file_set_contents (path, contents, length, &error)) {
+    g_warning ("cannot install module in function cache: %s", error->message);
+    g_error_free (error);
+  }
+  else
+    g_free (contents);
+  g_free (mname);
+}
+
+/* Releases the @lock on the compilation of the cached module @path */
+static void module_cache_unlock (const gchar * path, gint lock)
+{
+  gchar * lockname = g_strconcat (path, ".lock", NULL);
+  close (lock);
+  g_unlink (lockname);
+  g_free (lockname);
+}
+
+static GModule * compile (GtsFile * fp, const gchar * dirname, const gchar * cached)
 {
   GModule * module = NULL;
   gfs_debug ("starting compilation");
@@ -703,6 +1046,8 @@ static GModule * compile (GtsFile * fp, const gchar * dirname, const gchar * fin
       module = g_module_open (mname, 0);
     if (module == NULL)
       gts_file_error (fp, "cannot load module: %s", g_module_error ());
+    else if (cached)
+      module_cache_install (dirname, cached);
     g_free (mname);
   }
 #if 1
@@ -732,24 +1077,43 @@ static void update_module (gchar * key, GfsModule * m, GModule * module)
  *
  * Compiles and links pending #GfsFunction definitions.
  *
+ * If the environment variable GFS_FUNCTION_CACHE is set, it is the
+ * name of a directory where compiled modules are cached. Identical
+ * definitions are then compiled only once and are shared between
+ * runs and between the processes of parallel runs.
+ *
  * Compilation errors are reported in @fp.
  */
 void gfs_pending_functions_compilation (GtsFile * fp)
 {
   g_return_if_fail (fp != NULL);
 
+  G_LOCK (pending_functions);
   if (pending_functions && fp->type != GTS_ERROR) {
-    gchar * dirname = gfs_template ();
-    if (g_mkdtemp (dirname) == NULL) {
-      gts_file_error (fp, "cannot create temporary directory\n%s", strerror (errno));
+    gint lock = -1;
+    gchar * cached = module_cache_path (pending_functions->str);
+    GModule * module = cached ? module_cache_lookup (cached, &lock) : NULL;
+    if (module == NULL) {
+      gchar * dirname = gfs_template ();
+      if (g_mkdtemp (dirname) == NULL) {
+	gts_file_error (fp, "cannot create temporary directory\n%s", strerror (errno));
+	g_free (dirname);
+	if (lock >= 0)
+	  module_cache_unlock (cached, lock);
+	g_free (cached);
+	G_UNLOCK (pending_functions);
+	return;
+      }
+      gchar * finname = g_strdup_printf ("%s/function.c", dirname);
+      FILE * fin = fopen (finname, "w");
+      fputs (pending_functions->str, fin);
+      fclose (fin);
+      module = compile (fp, dirname, lock >= 0 ? cached : NULL);
+      if (lock >= 0)
+	module_cache_unlock (cached, lock);
       g_free (dirname);
-      return;
+      g_free (finname);
     }
-    gchar * finname = g_strdup_printf ("%s/function.c", dirname);
-    FILE * fin = fopen (finname, "w");
-    fputs (pending_functions->str, fin);
-    fclose (fin);
-    GModule * module = compile (fp, dirname, finname);
     if (module)
       g_hash_table_foreach (get_function_cache (), (GHFunc) update_module, module);
     /* note that if there is an error in some pending functions
@@ -758,9 +1122,9 @@ void gfs_pending_functions_compilation (GtsFile * fp)
     g_string_free (pending_functions, TRUE);
     pending_functions = NULL;
     n_pending_functions = 0;
-    g_free (dirname);
-    g_free (finname);
+    g_free (cached);
   }
+  G_UNLOCK (pending_functions);
 }
 
 /**
@@ -982,6 +1346,271 @@ GString * gfs_function_expression (GtsFile * fp, gboolean * is_expression)
   }
 }
 
+/* identifiers which make a function depend on the cell or face in
+   which it is evaluated (see function.h and spatial.h) */
+static gchar * cell_identifiers[] = {
+  "cell", "face", "_cell", "var", "dvar", "X", "Y", "Z", "_x", "_y", "_z",
+  "dd", "dd2", "dx", "dy", "dz", "dx2", "dy2", "dz2", "dsd", "dsx", "dsy", "dsz",
+  "area", "correctness", "distance", "flux", "overlaps", "mapv", "mapvx", "mapvy",
+  NULL
+};
+
+/* identifiers which make a function depend on more than its
+   arguments i.e. whose value may change between two calls */
+static gchar * impure_identifiers[] = {
+  "sim", "_sim", "rand", "random", "drand48", "lrand48", "mrand48",
+  NULL
+};
+
+/* derived variables which depend only on time */
+static gchar * time_identifiers[] = {
+  "t", "dt",
+  NULL
+};
+
+/* derived variables which depend only on the geometry of the cell */
+static gchar * space_identifiers[] = {
+  "x", "y", "z", "ax", "ay", "az", "cx", "cy", "cz", "rx", "ry", "rz",
+  "dV", "dL", "Level", "A", "S", "Sr", "Sl", "St", "Sb", "Sf", "Sk",
+  "Pid", "Id", "Orthogonality",
+  NULL
+};
+
+static gboolean find_any_identifier (const gchar * s, gchar ** identifiers)
+{
+  while (*identifiers)
+    if (find_identifier (s, *(identifiers++)))
+      return TRUE;
+  return FALSE;
+}
+
+static gboolean is_identifier (const gchar * s, gchar ** identifiers)
+{
+  while (*identifiers)
+    if (!strcmp (s, *(identifiers++)))
+      return TRUE;
+  return FALSE;
+}
+
+/* Returns the last identifier of the string between @start and
+   @end or %NULL */
+static gchar * last_identifier (const gchar * start, const gchar * end)
+{
+  while (end > start && !(isalnum (end[-1]) || end[-1] == '_'))
+    end--;
+  const gchar * begin = end;
+  while (begin > start && (isalnum (begin[-1]) || begin[-1] == '_'))
+    begin--;
+  return begin < end && !isdigit (*begin) ? g_strndup (begin, end - begin) : NULL;
+}
+
+/* Adds to @variables the names of the variables declared by the
+   file-scope declaration @decl, unless they are constant */
+static void global_declaration (const gchar * decl, GSList ** variables)
+{
+  if (find_identifier (decl, "typedef") || find_identifier (decl, "const"))
+    return;
+  const gchar * c = decl, * start = decl, * end = NULL;
+  gint depth = 0;
+  while (TRUE) {
+    if (*c == '\0' || (*c == ',' && depth == 0)) {
+      /* end of a declarator: the name is before the dimensions and
+	 the initializer */
+      const gchar * b = start;
+      if (end == NULL)
+	end = c;
+      while (b < end && *b != '[')
+	b++;
+      gchar * name = last_identifier (start, b);
+      if (name)
+	*variables = g_slist_prepend (*variables, name);
+      if (*c == '\0')
+	break;
+      start = c + 1;
+      end = NULL;
+    }
+    else if (*c == '(' && depth == 0 && end == NULL)
+      return; /* function prototype */
+    else if (*c == '=' && depth == 0 && end == NULL)
+      end = c;
+    else if (*c == '(' || *c == '[' || *c == '{')
+      depth++;
+    else if (*c == ')' || *c == ']' || *c == '}')
+      depth--;
+    c++;
+  }
+}
+
+typedef struct {
+  gchar * name, * body;
+  gboolean impure;
+} GlobalFunction;
+
+/* Adds to @variables the non-constant variables and to @functions
+   the functions defined at file scope by the C code @s of a
+   GfsGlobal. This is not a C parser: only simple declarations are
+   recognised. */
+static void global_symbols (const gchar * s, GSList ** variables, GSList ** functions)
+{
+  GString * decl = g_string_new (""), * body = g_string_new ("");
+  gboolean function = FALSE, newline = TRUE;
+  gint depth = 0;
+  const gchar * c = s;
+
+  while (*c) {
+    if (c[0] == '/' && c[1] == '*') {
+      if (!(c = strstr (c + 2, "*/")))
+	break;
+      c += 2;
+      continue;
+    }
+    if ((c[0] == '/' && c[1] == '/') || (newline && (*c == '#' || *c == '@'))) {
+      /* comment or preprocessor directive */
+      while (*c && (*c != '\n' || c[-1] == '\\'))
+	c++;
+      continue;
+    }
+    if (*c == '"' || *c == '\'') {
+      gchar quote = *(c++);
+      while (*c && *c != quote)
+	if (*(c++) == '\\' && *c)
+	  c++;
+      if (*c)
+	c++;
+      g_string_append_c (depth > 0 ? body : decl, '0');
+      continue;
+    }
+    if (*c == '\n')
+      newline = TRUE;
+    else if (!isspace (*c))
+      newline = FALSE;
+    if (depth > 0) {
+      if (*c == '{')
+	depth++;
+      else if (*c == '}' && --depth == 0 && function) {
+	gchar * p = strchr (decl->str, '(');
+	gchar * name = last_identifier (decl->str, p);
+	if (name) {
+	  GlobalFunction * f = g_malloc0 (sizeof (GlobalFunction));
+	  f->name = name;
+	  f->body = g_strdup (body->str);
+	  *functions = g_slist_prepend (*functions, f);
+	}
+	g_string_truncate (decl, 0);
+	function = FALSE;
+      }
+      g_string_append_c (body, *c);
+    }
+    else if (*c == '{') {
+      depth++;
+      /* a function definition has parameters and no initializer */
+      function = strchr (decl->str, '(') && !strchr (decl->str, '=');
+      if (!function)
+	g_string_append (decl, "{}");
+      g_string_truncate (body, 0);
+    }
+    else if (*c == ';') {
+      global_declaration (decl->str, variables);
+      g_string_truncate (decl, 0);
+    }
+    else
+      g_string_append_c (decl, *c);
+    c++;
+  }
+  g_string_free (decl, TRUE);
+  g_string_free (body, TRUE);
+}
+
+static gboolean find_any_variable (const gchar * s, GSList * variables)
+{
+  for (; variables; variables = variables->next)
+    if (find_identifier (s, variables->data))
+      return TRUE;
+  return FALSE;
+}
+
+static void global_function_destroy (GlobalFunction * f)
+{
+  g_free (f->name);
+  g_free (f->body);
+  g_free (f);
+}
+
+/* Returns %TRUE if @expr uses the state defined by the GfsGlobal
+   objects of @sim i.e. reads or assigns a non-constant variable or
+   calls a function which does or which has static variables. Such
+   state can change between two evaluations of @expr. */
+static gboolean uses_global_state (const gchar * expr, GfsSimulation * sim)
+{
+  GSList * variables = NULL, * functions = NULL, * i, * j;
+  for (i = sim->globals; i; i = i->next)
+    global_symbols (GFS_GLOBAL (i->data)->s, &variables, &functions);
+
+  for (i = functions; i; i = i->next) {
+    GlobalFunction * f = i->data;
+    f->impure = find_identifier (f->body, "static") || find_any_variable (f->body, variables);
+  }
+  /* functions calling impure functions are impure */
+  gboolean changed = TRUE;
+  while (changed) {
+    changed = FALSE;
+    for (i = functions; i; i = i->next) {
+      GlobalFunction * f = i->data;
+      for (j = functions; j && !f->impure; j = j->next) {
+	GlobalFunction * g = j->data;
+	if (g->impure && find_identifier (f->body, g->name))
+	  f->impure = changed = TRUE;
+      }
+    }
+  }
+
+  gboolean uses = find_any_variable (expr, variables);
+  for (i = functions; i && !uses; i = i->next) {
+    GlobalFunction * f = i->data;
+    if (f->impure && find_identifier (expr, f->name))
+      uses = TRUE;
+  }
+  g_slist_foreach (variables, (GFunc) g_free, NULL);
+  g_slist_free (variables);
+  g_slist_foreach (functions, (GFunc) global_function_destroy, NULL);
+  g_slist_free (functions);
+  return uses;
+}
+
+static GfsFunctionDependency expression_dependency (const gchar * expr, GfsSimulation * sim)
+{
+  GfsDomain * domain = GFS_DOMAIN (sim);
+  gboolean time = FALSE, space = FALSE;
+  GSList * i;
+
+  if (find_any_identifier (expr, impure_identifiers) || find_identifier (expr, "static"))
+    return GFS_DEPENDENCY_FIELD;
+  for (i = sim->globals; i; i = i->next) {
+    gchar * s = GFS_GLOBAL (i->data)->s;
+    if (find_any_identifier (s, impure_identifiers) || find_any_identifier (s, cell_identifiers))
+      return GFS_DEPENDENCY_FIELD;
+  }
+  if (uses_global_state (expr, sim))
+    return GFS_DEPENDENCY_FIELD;
+  for (i = domain->variables; i; i = i->next)
+    if (GFS_VARIABLE (i->data)->name && find_identifier (expr, GFS_VARIABLE (i->data)->name))
+      return GFS_DEPENDENCY_FIELD;
+  for (i = domain->derived_variables; i; i = i->next) {
+    GfsDerivedVariable * v = i->data;
+    if (find_identifier (expr, v->name)) {
+      if (is_identifier (v->name, time_identifiers))
+	time = TRUE;
+      else if (is_identifier (v->name, space_identifiers))
+	space = TRUE;
+      else
+	return GFS_DEPENDENCY_FIELD;
+    }
+  }
+  if (space || find_any_identifier (expr, cell_identifiers))
+    return GFS_DEPENDENCY_SPACE;
+  return time ? GFS_DEPENDENCY_TIME : GFS_DEPENDENCY_CONSTANT;
+}
+
 static void function_read (GtsObject ** o, GtsFile * fp)
 {
   GfsFunction * f = GFS_FUNCTION (*o);
@@ -1022,6 +1651,9 @@ static void function_read (GtsObject ** o, GtsFile * fp)
 
   if ((f->expr = gfs_function_expression (fp, &f->isexpr)) == NULL)
     return;
+  f->folded = FALSE;
+  f->dependency = f->spatial ? GFS_DEPENDENCY_SPACE :
+    f->constant ? GFS_DEPENDENCY_CONSTANT : expression_dependency (f->expr->str, sim);
 
   if (f->isexpr) {
     if (fp->type == GTS_INT || fp->type == GTS_FLOAT) {
@@ -1221,6 +1853,24 @@ static gdouble adimensional_value (GfsFunction * f, gdouble v)
   return v*pow (L, - f->units);
 }
 
+/* value of compiled function @f, computed only once if @f is
+   constant or once per timestep if @f depends only on time */
+static gdouble compiled_value (GfsFunction * f, FttCell * cell, FttCellFace * face)
+{
+  GfsSimulation * sim = gfs_object_simulation (f);
+
+  if (f->dependency > GFS_DEPENDENCY_TIME)
+    return (* f->f) (cell, face, sim, f->var, f->dvar);
+  if (!f->folded || (f->dependency == GFS_DEPENDENCY_TIME &&
+		     (f->t != sim->time.t || f->dt != sim->advection_params.dt))) {
+    f->val = (* f->f) (NULL, NULL, sim, f->var, f->dvar);
+    f->t = sim->time.t;
+    f->dt = sim->advection_params.dt;
+    f->folded = TRUE;
+  }
+  return f->val;
+}
+
 /**
  * gfs_function_value:
  * @f: a #GfsFunction.
@@ -1231,7 +1881,7 @@ static gdouble adimensional_value (GfsFunction * f, gdouble v)
 gdouble gfs_function_value (GfsFunction * f, FttCell * cell)
 {
   g_return_val_if_fail (f != NULL, 0.);
-  g_assert (!pending_functions);
+  g_assert (!f->module || f->module->module);
 
   gdouble dimensional;
   if (f->s) {
@@ -1252,12 +1902,127 @@ gdouble gfs_function_value (GfsFunction * f, FttCell * cell)
 							    gfs_object_simulation (f),
 							    f->dv->data);
   else if (f->f)
-    dimensional = (* f->f) (cell, NULL, gfs_object_simulation (f), f->var, f->dvar);
+    dimensional = compiled_value (f, cell, NULL);
   else
     dimensional = f->val;
   return adimensional_value (f, dimensional);
 }
 
+/**
+ * gfs_function_values:
+ * @f: a #GfsFunction.
+ * @cells: an array of #FttCell.
+ * @n: the number of cells in @cells (at most %GFS_FUNCTION_BATCH).
+ * @values: an array of at least @n values.
+ *
+ * Fills @values with the values of function @f in each of
+ * @cells. This is equivalent to calling gfs_function_value() for
+ * each cell but compiled functions are evaluated using a single call
+ * to their batch entry point.
+ */
+void gfs_function_values (GfsFunction * f, FttCell ** cells, guint n, gdouble * values)
+{
+  guint i;
+
+  g_return_if_fail (f != NULL);
+  g_return_if_fail (cells != NULL);
+  g_return_if_fail (n <= GFS_FUNCTION_BATCH);
+  g_return_if_fail (values != NULL);
+  g_assert (!f->module || f->module->module);
+
+  if (f->s || f->g || f->dv || (f->f && !f->batch && f->dependency > GFS_DEPENDENCY_TIME)) {
+    for (i = 0; i < n; i++)
+      values[i] = gfs_function_value (f, cells[i]);
+    return;
+  }
+  else if (f->v)
+    for (i = 0; i < n; i++)
+      values[i] = gfs_dimensional_value (f->v, GFS_VALUE (cells[i], f->v));
+  else if (f->f && f->dependency <= GFS_DEPENDENCY_TIME) {
+    gdouble val = compiled_value (f, NULL, NULL);
+    for (i = 0; i < n; i++)
+      values[i] = val;
+  }
+  else if (f->batch)
+    (* f->batch) (cells, n, gfs_object_simulation (f), f->var, f->dvar, values);
+  else
+    for (i = 0; i < n; i++)
+      values[i] = f->val;
+
+  gdouble L;
+  if (f->units != 0. && (L = gfs_object_simulation (f)->physical_params.L) != 1.) {
+    gdouble factor = pow (L, - f->units);
+    for (i = 0; i < n; i++)
+      if (values[i] != GFS_NODATA)
+	values[i] *= factor;
+  }
+}
+
+typedef struct {
+  GfsFunction * f;
+  GfsVariable * v;
+  FttCell * cells[GFS_FUNCTION_BATCH];
+  guint n;
+} FunctionBatch;
+
+static void function_batch_flush (FunctionBatch * b)
+{
+  gdouble values[GFS_FUNCTION_BATCH];
+  guint i;
+
+  gfs_function_values (b->f, b->cells, b->n, values);
+  for (i = 0; i < b->n; i++)
+    GFS_VALUE (b->cells[i], b->v) = values[i];
+  b->n = 0;
+}
+
+static void function_batch_add (FttCell * cell, FunctionBatch * b)
+{
+  b->cells[b->n++] = cell;
+  if (b->n == GFS_FUNCTION_BATCH)
+    function_batch_flush (b);
+}
+
+static void function_value (FttCell * cell, FunctionBatch * b)
+{
+  GFS_VALUE (cell, b->v) = gfs_function_value (b->f, cell);
+}
+
+/**
+ * gfs_function_fill:
+ * @f: a #GfsFunction.
+ * @v: a #GfsVariable.
+ * @flags: the traversal flags.
+ * @max_depth: the maximum depth of the traversal.
+ *
+ * Sets @v to the value of @f in the cells of the domain of @v, using
+ * batch evaluation (see gfs_function_values()).
+ *
+ * If @f depends on @v, the function is evaluated cell by cell, in
+ * traversal order.
+ */
+void gfs_function_fill (GfsFunction * f, GfsVariable * v, 
+			FttTraverseFlags flags, gint max_depth)
+{
+  FunctionBatch b;
+
+  g_return_if_fail (f != NULL);
+  g_return_if_fail (v != NULL);
+
+  b.f = f;
+  b.v = v;
+  b.n = 0;
+  if (f->expr && v->name && find_identifier (f->expr->str, v->name))
+    gfs_domain_cell_traverse (v->domain, FTT_PRE_ORDER, flags, max_depth,
+			      (FttCellTraverseFunc) function_value, &b);
+  else {
+    gfs_domain_cell_traverse (v->domain, FTT_PRE_ORDER, flags, max_depth,
+			      (FttCellTraverseFunc) function_batch_add, &b);
+    if (b.n > 0)
+      function_batch_flush (&b);
+  }
+}
+
 /**
  * gfs_function_face_value:
  * @f: a #GfsFunction.
@@ -1269,7 +2034,7 @@ gdouble gfs_function_face_value (GfsFunction * f, FttCellFace * fa)
 {
   g_return_val_if_fail (f != NULL, 0.);
   g_return_val_if_fail (fa != NULL, 0.);
-  g_assert (!pending_functions);
+  g_assert (!f->module || f->module->module);
 
   gdouble dimensional;
   if (f->s) {
@@ -1290,7 +2055,7 @@ gdouble gfs_function_face_value (GfsFunction * f, FttCellFace * fa)
 							    gfs_object_simulation (f),
 							    f->dv->data);
   else if (f->f)
-    dimensional = (* f->f) (NULL, fa, gfs_object_simulation (f), f->var, f->dvar);
+    dimensional = compiled_value (f, NULL, fa);
   else
     dimensional = f->val;
   return adimensional_value (f, dimensional);
@@ -1322,7 +2087,7 @@ void gfs_function_set_constant_value (GfsFunction * f, gdouble val)
 gdouble gfs_function_get_constant_value (GfsFunction * f)
 {
   g_return_val_if_fail (f != NULL, G_MAXDOUBLE);
-  g_assert (!pending_functions);
+  g_assert (!f->module || f->module->module);
 
   if (f->f || f->s || f->v || f->dv)
     return G_MAXDOUBLE;
@@ -1343,6 +2108,34 @@ gboolean gfs_function_is_constant (const GfsFunction * f)
   return f->constant;
 }
 
+/**
+ * gfs_function_dependency:
+ * @f: a #GfsFunction.
+ *
+ * The dependency of functions defined by an expression is determined
+ * when they are read. Functions which are constant or depend only on
+ * time are evaluated only once (per timestep) rather than in each
+ * cell.
+ *
+ * Returns: what the value of @f depends on.
+ */
+GfsFunctionDependency gfs_function_dependency (const GfsFunction * f)
+{
+  g_return_val_if_fail (f != NULL, GFS_DEPENDENCY_FIELD);
+
+  if (f->s || f->g || f->spatial)
+    return GFS_DEPENDENCY_SPACE;
+  if (f->v)
+    return GFS_DEPENDENCY_FIELD;
+  if (f->dv)
+    return is_identifier (f->dv->name, time_identifiers) ? GFS_DEPENDENCY_TIME :
+      is_identifier (f->dv->name, space_identifiers) ? GFS_DEPENDENCY_SPACE :
+      GFS_DEPENDENCY_FIELD;
+  if (f->expr)
+    return f->dependency;
+  return GFS_DEPENDENCY_CONSTANT;
+}
+
 /**
  * gfs_function_get_variable:
  * @f: a #GfsFunction.
@@ -1437,7 +2230,7 @@ gdouble gfs_function_spatial_value (GfsFunction * f, const FttVector * p)
   g_return_val_if_fail (f != NULL, 0.);
   g_return_val_if_fail (GFS_IS_FUNCTION_SPATIAL (f), 0.);
   g_return_val_if_fail (p != NULL, 0.);
-  g_assert (!pending_functions);
+  g_assert (!f->module || f->module->module);
 
   gdouble dimensional;  
   if (f->f) {
@@ -1907,6 +2700,128 @@ void gfs_clock_destroy (GfsClock * t)
   g_free (t);
 }
 
+struct _GfsCounters {
+  int fd[GFS_COUNTERS];
+};
+
+/* size of the cache lines transferred on last-level cache misses */
+#define CACHE_LINE 64
+
+/**
+ * gfs_counters_new:
+ *
+ * Opens a group of hardware performance counters (using
+ * perf_event_open()) counting the user-space events of the calling
+ * thread.
+ *
+ * Returns: a new #GfsCounters or %NULL if hardware counters are not
+ * available, in which case errno is set.
+ */
+GfsCounters * gfs_counters_new (void)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  static const struct { guint32 type; guint64 config; } event[GFS_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HW_CACHE, (PERF_COUNT_HW_CACHE_LL |
+			   PERF_COUNT_HW_CACHE_OP_READ << 8 |
+			   PERF_COUNT_HW_CACHE_RESULT_MISS << 16) }
+  };
+  GfsCounters * c = g_malloc (sizeof (GfsCounters));
+  guint i;
+
+  for (i = 0; i < GFS_COUNTERS; i++) {
+    struct perf_event_attr attr;
+
+    memset (&attr, 0, sizeof (attr));
+    attr.size = sizeof (attr);
+    attr.type = event[i].type;
+    attr.config = event[i].config;
+    attr.disabled = (i == 0); /* the group is enabled by its leader */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    c->fd[i] = syscall (__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : c->fd[0], 0);
+    if (c->fd[i] < 0) {
+      int error = errno;
+      while (i > 0)
+	close (c->fd[--i]);
+      g_free (c);
+      errno = error;
+      return NULL;
+    }
+  }
+  ioctl (c->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return c;
+#else /* not HAVE_LINUX_PERF_EVENT_H */
+  errno = ENOSYS;
+  return NULL;
+#endif /* not HAVE_LINUX_PERF_EVENT_H */
+}
+
+/**
+ * gfs_counters_read:
+ * @c: a #GfsCounters.
+ * @values: an array of size %GFS_COUNTERS.
+ *
+ * Fills @values with the current values of the counters of @c (see
+ * gfs_counter_name()). The number of bytes read from memory is
+ * estimated from the number of last-level cache read misses.
+ *
+ * Returns: %FALSE if the counters could not be read.
+ */
+gboolean gfs_counters_read (GfsCounters * c, gint64 * values)
+{
+  guint64 buf[1 + GFS_COUNTERS];
+  guint i;
+
+  g_return_val_if_fail (c != NULL, FALSE);
+  g_return_val_if_fail (values != NULL, FALSE);
+
+  /* PERF_FORMAT_GROUP: the number of counters followed by their values */
+  if (read (c->fd[0], buf, sizeof (buf)) != sizeof (buf))
+    return FALSE;
+  for (i = 0; i < GFS_COUNTERS; i++)
+    values[i] = buf[i + 1];
+  values[GFS_COUNTERS - 1] *= CACHE_LINE;
+  return TRUE;
+}
+
+/**
+ * gfs_counter_name:
+ * @i: the index of a counter.
+ *
+ * Returns: the name of counter @i.
+ */
+const gchar * gfs_counter_name (guint i)
+{
+  static const gchar * name[GFS_COUNTERS] = { 
+    "cycles", "instructions", "LLC misses", "bytes read"
+  };
+
+  g_return_val_if_fail (i < GFS_COUNTERS, NULL);
+
+  return name[i];
+}
+
+/**
+ * gfs_counters_destroy:
+ * @c: a #GfsCounters.
+ *
+ * Closes the counters of @c and frees the memory allocated for it.
+ */
+void gfs_counters_destroy (GfsCounters * c)
+{
+  guint i;
+
+  g_return_if_fail (c != NULL);
+
+  for (i = 0; i < GFS_COUNTERS; i++)
+    close (c->fd[i]);
+  g_free (c);
+}
+
 /**
  * gfs_union_open:
  * @fp: a file pointer.
@@ -1925,6 +2840,8 @@ FILE * gfs_union_open (FILE * fp, int rank, GfsUnionFile * file)
   g_return_val_if_fail (fp != NULL, NULL);
   g_return_val_if_fail (file != NULL, NULL);
 
+  file->name = NULL;
+  file->offset = 0;
   if (rank <= 0) /* master */
     return fp;
   else { /* slaves */
@@ -1941,20 +2858,108 @@ FILE * gfs_union_open (FILE * fp, int rank, GfsUnionFile * file)
   }
 }
 
+/**
+ * gfs_union_open_collective:
+ * @fp: a file pointer.
+ * @name: the name of the file pointed to by @fp on process zero.
+ * @rank: the rank of the current parallel process.
+ * @file: a #GfsUnionFile.
+ *
+ * Opens a "parallel" file which serialises multiple parallel (write)
+ * accesses to the file pointed to by @fp.
+ *
+ * Contrary to gfs_union_open(), the data written by each process is
+ * not sent to process zero. When the file is closed, each process
+ * computes its offset in the file (using a parallel prefix-sum of
+ * the sizes of the data written on each process) and writes its
+ * data directly into @name using collective MPI-IO.
+ *
+ * This file must be closed with gfs_union_close().
+ *
+ * Returns: a "parallel" file pointer associated with @fp.
+ */
+FILE * gfs_union_open_collective (FILE * fp, const gchar * name, int rank, GfsUnionFile * file)
+{
+  g_return_val_if_fail (fp != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+  g_return_val_if_fail (file != NULL, NULL);
+
+  if (rank < 0) /* serial */
+    return gfs_union_open (fp, rank, file);
+
+  file->name = g_strdup (name);
+  file->offset = 0;
+  file->fp = open_memstream (&file->buf, &file->len);
+  if (file->fp == NULL)
+    g_error ("gfs_union_open_collective(): could not open_memstream:\n%s", strerror (errno));
+  return file->fp;
+}
+
+/* maximum number of bytes written in a single MPI-IO call */
+#define UNION_CHUNK (1 << 30)
+
+static void union_close_collective (FILE * fp, int rank, GfsUnionFile * file)
+{
+  fclose (file->fp);
+#ifdef HAVE_MPI
+  MPI_Offset start = 0, offset = 0, length = file->len, total = 0;
+  if (rank == 0) {
+    fflush (fp);
+    start = ftello (fp);
+  }
+  MPI_Bcast (&start, 1, MPI_OFFSET, 0, MPI_COMM_WORLD);
+  MPI_Exscan (&length, &offset, 1, MPI_OFFSET, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0)
+    offset = 0;
+  file->offset = start + offset;
+
+  /* all the processes must take part in each collective write */
+  long nchunk = (length + UNION_CHUNK - 1)/UNION_CHUNK, nmax;
+  MPI_Allreduce (&nchunk, &nmax, 1, MPI_LONG, MPI_MAX, MPI_COMM_WORLD);
+  MPI_File fh;
+  if (MPI_File_open (MPI_COMM_WORLD, file->name, MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) 
+      != MPI_SUCCESS)
+    g_error ("gfs_union_close(): could not open `%s' for MPI-IO", file->name);
+  long i;
+  MPI_Offset written = 0;
+  for (i = 0; i < nmax; i++) {
+    int count = MIN (length - written, UNION_CHUNK);
+    MPI_Status status;
+    MPI_File_write_at_all (fh, file->offset + written, file->buf + written, count, 
+			   MPI_BYTE, &status);
+    written += count;
+  }
+  MPI_File_close (&fh);
+
+  /* process zero carries on writing after the data of all processes */
+  MPI_Reduce (&length, &total, 1, MPI_OFFSET, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (rank == 0)
+    fseeko (fp, start + total, SEEK_SET);
+#endif /* HAVE_MPI */
+  if (file->len > 0)
+    g_free (file->buf);
+  g_free (file->name);
+  file->name = NULL;
+}
+
 /**
  * gfs_union_close:
  * @fp: a file pointer.
  * @rank: the rank of the current parallel process.
- * @file: a #GfsUnionFile returned by a call to gfs_union_open().
+ * @file: a #GfsUnionFile returned by a call to gfs_union_open() or
+ * gfs_union_open_collective().
  *
- * Closes a "parallel" file previously opened using gfs_union_open().
+ * Closes a "parallel" file previously opened using gfs_union_open()
+ * or gfs_union_open_collective().
  */
 void gfs_union_close (FILE * fp, int rank, GfsUnionFile * file)
 {
   g_return_if_fail (fp != NULL);
   g_return_if_fail (file != NULL);
 
-  if (rank == 0) { /* master */
+  if (file->name)
+    union_close_collective (fp, rank, file);
+  else if (rank == 0) { /* master */
 #ifdef HAVE_MPI
     int pe, npe;
     MPI_Comm_size (MPI_COMM_WORLD, &npe);
@@ -1988,6 +2993,436 @@ void gfs_union_close (FILE * fp, int rank, GfsUnionFile * file)
   }
 }
 
+/* Compression of binary data: a simple LZ77 coder (with the same
+   token layout as LZ4) and column coders for arrays of doubles */
+
+#define LZ_HASH_LOG   14
+#define LZ_MIN_MATCH  4
+#define LZ_MAX_OFFSET 65535
+
+static void lz_length (GArray * out, gsize len)
+{
+  guint8 b = 255;
+  while (len >= 255) {
+    g_array_append_val (out, b);
+    len -= 255;
+  }
+  b = len;
+  g_array_append_val (out, b);
+}
+
+static void lz_sequence (GArray * out, const guint8 * lit, gsize nlit, 
+			 gsize offset, gsize match)
+{
+  guint8 token = (MIN (nlit, 15) << 4) | (match > 0 ? MIN (match - LZ_MIN_MATCH, 15) : 0);
+  g_array_append_val (out, token);
+  if (nlit >= 15)
+    lz_length (out, nlit - 15);
+  g_array_append_vals (out, lit, nlit);
+  if (match > 0) {
+    guint8 o[2] = { offset & 0xff, offset >> 8 };
+    g_array_append_vals (out, o, 2);
+    if (match - LZ_MIN_MATCH >= 15)
+      lz_length (out, match - LZ_MIN_MATCH - 15);
+  }
+}
+
+/* The hash table of gfs_compress_bytes() is allocated once per
+   thread. Its entries are positions offset by @base: the entries not
+   larger than @base come from previous calls and are ignored, so that
+   the table does not need to be cleared. */
+typedef struct {
+  gsize * table, base;
+} LzTable;
+
+static void lz_table_free (LzTable * t)
+{
+  g_free (t->table);
+  g_free (t);
+}
+
+static GPrivate lz_table = G_PRIVATE_INIT ((GDestroyNotify) lz_table_free);
+
+/**
+ * gfs_compress_bytes:
+ * @src: the data to compress.
+ * @n: the size of @src.
+ * @out: a #GArray of bytes.
+ *
+ * Appends to @out the (lossless) compressed representation of @src.
+ */
+void gfs_compress_bytes (const gchar * src, gsize n, GArray * out)
+{
+  g_return_if_fail (src != NULL || n == 0);
+  g_return_if_fail (out != NULL);
+
+  const guint8 * s = (const guint8 *) src;
+  LzTable * t = g_private_get (&lz_table);
+  if (t == NULL) {
+    t = g_malloc (sizeof (LzTable));
+    t->table = g_malloc0 (sizeof (gsize) << LZ_HASH_LOG);
+    t->base = 0;
+    g_private_set (&lz_table, t);
+  }
+  else if (t->base > G_MAXSIZE - n) {
+    memset (t->table, 0, sizeof (gsize) << LZ_HASH_LOG);
+    t->base = 0;
+  }
+
+  gsize * table = t->table, base = t->base;
+  gsize i = 0, anchor = 0;
+
+  while (i + LZ_MIN_MATCH <= n) {
+    guint32 seq;
+    memcpy (&seq, &s[i], sizeof (guint32));
+    guint h = (seq*2654435761U) >> (32 - LZ_HASH_LOG);
+    gsize ref = table[h];
+    table[h] = base + i + 1;
+    if (ref > base && i - (ref - base - 1) <= LZ_MAX_OFFSET &&
+	!memcmp (&s[ref - base - 1], &s[i], LZ_MIN_MATCH)) {
+      gsize len = LZ_MIN_MATCH;
+      ref -= base + 1;
+      while (i + len < n && s[ref + len] == s[i + len])
+	len++;
+      lz_sequence (out, &s[anchor], i - anchor, i - ref, len);
+      i += len;
+      anchor = i;
+    }
+    else
+      i++;
+  }
+  /* the last sequence only contains literals */
+  lz_sequence (out, &s[anchor], n - anchor, 0, 0);
+  t->base += n;
+}
+
+static gboolean lz_read_length (const guint8 ** s, const guint8 * end, gsize * len)
+{
+  guint8 b;
+  do {
+    if (*s >= end)
+      return FALSE;
+    b = *(*s)++;
+    *len += b;
+  } while (b == 255);
+  return TRUE;
+}
+
+/**
+ * gfs_uncompress_bytes:
+ * @src: the data compressed with gfs_compress_bytes().
+ * @len: the size of @src.
+ * @dst: the destination buffer.
+ * @n: the size of the uncompressed data.
+ *
+ * Returns: %TRUE if @src was successfully uncompressed into @dst,
+ * %FALSE if @src is corrupted or its uncompressed size is not @n.
+ */
+gboolean gfs_uncompress_bytes (const gchar * src, gsize len, gchar * dst, gsize n)
+{
+  g_return_val_if_fail (src != NULL, FALSE);
+  g_return_val_if_fail (dst != NULL || n == 0, FALSE);
+
+  const guint8 * s = (const guint8 *) src, * end = s + len;
+  guint8 * d = (guint8 *) dst;
+  gsize o = 0;
+
+  while (s < end) {
+    guint token = *s++;
+    gsize nlit = token >> 4;
+    if (nlit == 15 && !lz_read_length (&s, end, &nlit))
+      return FALSE;
+    if (nlit > n - o || nlit > end - s)
+      return FALSE;
+    memcpy (&d[o], s, nlit);
+    s += nlit;
+    o += nlit;
+    if (o == n)
+      return s == end;
+
+    if (end - s < 2)
+      return FALSE;
+    gsize offset = s[0] | (s[1] << 8), match = token & 15, k;
+    s += 2;
+    if (match == 15 && !lz_read_length (&s, end, &match))
+      return FALSE;
+    match += LZ_MIN_MATCH;
+    if (offset == 0 || offset > o || match > n - o)
+      return FALSE;
+    for (k = 0; k < match; k++, o++) /* matches can overlap */
+      d[o] = d[o - offset];
+  }
+  return o == n;
+}
+
+enum {
+  COLUMN_RAW, COLUMN_LOSSLESS, COLUMN_QUANTISED
+};
+
+static void column_header (GArray * out, guint8 method, guint64 size)
+{
+  g_array_append_val (out, method);
+  g_array_append_vals (out, &size, sizeof (guint64));
+}
+
+/* Byte-shuffles and compresses @v */
+static void column_lossless (const gdouble * v, guint n, GArray * out)
+{
+  gchar * shuffled = g_malloc (n*sizeof (gdouble));
+  const gchar * s = (const gchar *) v;
+  guint i, b;
+  for (i = 0; i < n; i++)
+    for (b = 0; b < sizeof (gdouble); b++)
+      shuffled[b*n + i] = s[i*sizeof (gdouble) + b];
+  gsize start = out->len;
+  column_header (out, COLUMN_LOSSLESS, 0);
+  gfs_compress_bytes (shuffled, n*sizeof (gdouble), out);
+  guint64 size = out->len - start - 1 - sizeof (guint64);
+  memcpy (&out->data[start + 1], &size, sizeof (guint64));
+  g_free (shuffled);
+}
+
+static void varint (GArray * out, guint64 u)
+{
+  while (u >= 0x80) {
+    guint8 b = (u & 0x7f) | 0x80;
+    g_array_append_val (out, b);
+    u >>= 7;
+  }
+  guint8 b = u;
+  g_array_append_val (out, b);
+}
+
+/* Values which are not quantised (i.e. undefined values) */
+#define IS_EXCEPTION(v) (!isfinite (v) || fabs (v) == G_MAXDOUBLE)
+/* Maximum number of quantisation steps */
+#define QUANTISED_MAX 4503599627370496. /* 2^52 */
+
+/* Quantises @v with an absolute error smaller than @tolerance and
+   compresses the differences between consecutive values */
+/* The step is slightly smaller than twice the tolerance, so that the
+   rounding errors of the quantisation do not make the error larger
+   than @tolerance. This is checked for each value and the column is
+   stored losslessly if the check fails (i.e. if @tolerance is too
+   small compared to the values). */
+static gboolean column_quantised (const gdouble * v, guint n, gdouble tolerance, GArray * out)
+{
+  gdouble vmin = G_MAXDOUBLE, vmax = - G_MAXDOUBLE, step = 2.*tolerance*(1. - 1e-6);
+  guint32 nexc = 0;
+  guint i;
+
+  for (i = 0; i < n; i++)
+    if (IS_EXCEPTION (v[i]))
+      nexc++;
+    else {
+      if (v[i] < vmin) vmin = v[i];
+      if (v[i] > vmax) vmax = v[i];
+    }
+  if (nexc == n)
+    vmin = vmax = 0.;
+  if ((vmax - vmin)/step >= QUANTISED_MAX)
+    return FALSE;
+
+  GArray * q = g_array_sized_new (FALSE, FALSE, 1, n);
+  gsize start = out->len;
+  column_header (out, COLUMN_QUANTISED, 0);
+  g_array_append_vals (out, &vmin, sizeof (gdouble));
+  g_array_append_vals (out, &step, sizeof (gdouble));
+  g_array_append_vals (out, &nexc, sizeof (guint32));
+  gint64 prev = 0;
+  for (i = 0; i < n; i++)
+    if (IS_EXCEPTION (v[i])) {
+      guint32 index = i;
+      g_array_append_vals (out, &index, sizeof (guint32));
+      g_array_append_vals (out, &v[i], sizeof (gdouble));
+      varint (q, 0);
+    }
+    else {
+      gint64 qi = floor ((v[i] - vmin)/step + 0.5), d = qi - prev;
+      /* same reconstruction as gfs_uncompress_column() */
+      if (fabs (vmin + qi*step - v[i]) > tolerance) {
+	g_array_set_size (out, start);
+	g_array_free (q, TRUE);
+	return FALSE;
+      }
+      varint (q, d >= 0 ? 2*(guint64) d : 2*(guint64) (- d) - 1); /* zigzag encoding */
+      prev = qi;
+    }
+  guint64 qlen = q->len;
+  g_array_append_vals (out, &qlen, sizeof (guint64));
+  gfs_compress_bytes (q->data, q->len, out);
+  guint64 size = out->len - start - 1 - sizeof (guint64);
+  memcpy (&out->data[start + 1], &size, sizeof (guint64));
+  g_array_free (q, TRUE);
+  return TRUE;
+}
+
+/**
+ * gfs_compress_column:
+ * @v: an array of values.
+ * @n: the size of @v.
+ * @tolerance: the absolute error tolerance.
+ * @out: a #GArray of bytes.
+ *
+ * Appends to @out a compressed representation of @v. If @tolerance is
+ * negative, @v is stored uncompressed. If @tolerance is zero, @v is
+ * compressed losslessly (byte-shuffling followed by
+ * gfs_compress_bytes()). Otherwise the values are quantised so that
+ * the (absolute) error on each value is not larger than @tolerance.
+ *
+ * The compressed column starts with a one-byte compression method
+ * followed by the (64 bits) size of the compressed data.
+ */
+void gfs_compress_column (const gdouble * v, guint n, gdouble tolerance, GArray * out)
+{
+  g_return_if_fail (v != NULL || n == 0);
+  g_return_if_fail (out != NULL);
+
+  if (tolerance < 0.) {
+    column_header (out, COLUMN_RAW, n*sizeof (gdouble));
+    g_array_append_vals (out, v, n*sizeof (gdouble));
+  }
+  else if (tolerance == 0. || !column_quantised (v, n, tolerance, out))
+    column_lossless (v, n, out);
+}
+
+/**
+ * gfs_uncompress_column:
+ * @buf: a pointer to a column compressed with gfs_compress_column().
+ * @end: the end of the buffer.
+ * @v: an array of values.
+ * @n: the size of @v.
+ *
+ * Uncompresses into @v the column pointed to by @buf and updates
+ * @buf to point to the end of the column.
+ *
+ * Returns: %TRUE if the column was successfully uncompressed, %FALSE
+ * if the column is corrupted or does not contain @n values.
+ */
+gboolean gfs_uncompress_column (const gchar ** buf, const gchar * end, gdouble * v, guint n)
+{
+  g_return_val_if_fail (buf != NULL && *buf != NULL, FALSE);
+  g_return_val_if_fail (end != NULL, FALSE);
+  g_return_val_if_fail (v != NULL || n == 0, FALSE);
+
+  const gchar * s = *buf;
+  guint64 size;
+  if (end - s < 1 + sizeof (guint64))
+    return FALSE;
+  guint8 method = *s++;
+  memcpy (&size, s, sizeof (guint64));
+  s += sizeof (guint64);
+  if (size > end - s)
+    return FALSE;
+  *buf = s + size;
+
+  switch (method) {
+  case COLUMN_RAW:
+    if (size != n*sizeof (gdouble))
+      return FALSE;
+    memcpy (v, s, size);
+    return TRUE;
+
+  case COLUMN_LOSSLESS: {
+    gchar * shuffled = g_malloc (n*sizeof (gdouble)), * d = (gchar *) v;
+    gboolean status = gfs_uncompress_bytes (s, size, shuffled, n*sizeof (gdouble));
+    if (status) {
+      guint i, b;
+      for (i = 0; i < n; i++)
+	for (b = 0; b < sizeof (gdouble); b++)
+	  d[i*sizeof (gdouble) + b] = shuffled[b*n + i];
+    }
+    g_free (shuffled);
+    return status;
+  }
+
+  case COLUMN_QUANTISED: {
+    const gchar * e = s + size;
+    gdouble vmin, step;
+    guint32 nexc, i;
+    guint64 qlen;
+    if (e - s < 2*sizeof (gdouble) + sizeof (guint32))
+      return FALSE;
+    memcpy (&vmin, s, sizeof (gdouble)); s += sizeof (gdouble);
+    memcpy (&step, s, sizeof (gdouble)); s += sizeof (gdouble);
+    memcpy (&nexc, s, sizeof (guint32)); s += sizeof (guint32);
+    const gchar * exceptions = s;
+    if (nexc > n || e - s < nexc*(sizeof (guint32) + sizeof (gdouble)) + sizeof (guint64))
+      return FALSE;
+    s += nexc*(sizeof (guint32) + sizeof (gdouble));
+    memcpy (&qlen, s, sizeof (guint64)); s += sizeof (guint64);
+    if (qlen > 10*(guint64) n)
+      return FALSE;
+    guint8 * q = g_malloc (qlen), * p = q, * qend = q + qlen;
+    if (!gfs_uncompress_bytes (s, e - s, (gchar *) q, qlen)) {
+      g_free (q);
+      return FALSE;
+    }
+    gint64 prev = 0;
+    for (i = 0; i < n; i++) {
+      guint64 u = 0;
+      guint shift = 0;
+      do {
+	if (p == qend || shift > 63) {
+	  g_free (q);
+	  return FALSE;
+	}
+	u |= (guint64) (*p & 0x7f) << shift;
+	shift += 7;
+      } while (*p++ & 0x80);
+      prev += u & 1 ? - (gint64) ((u + 1)/2) : (gint64) (u/2);
+      v[i] = vmin + prev*step;
+    }
+    g_free (q);
+    for (i = 0; i < nexc; i++) {
+      guint32 index;
+      memcpy (&index, exceptions, sizeof (guint32)); exceptions += sizeof (guint32);
+      if (index >= n)
+	return FALSE;
+      memcpy (&v[index], exceptions, sizeof (gdouble)); exceptions += sizeof (gdouble);
+    }
+    return TRUE;
+  }
+
+  default:
+    return FALSE;
+  }
+}
+
+/**
+ * gfs_file_new_mapped:
+ * @fptr: a file pointer.
+ * @mapped: a pointer to a #GMappedFile.
+ *
+ * If @fptr is a regular file which has not been read yet, maps its
+ * content in memory (read-only) and returns a #GtsFile reading from
+ * the mapping. The mapping is returned in @mapped and must be freed
+ * with g_mapped_file_unref() once the #GtsFile has been destroyed.
+ *
+ * Binary cell data of simulation files read from the mapping is
+ * parsed directly from memory (see ftt_cell_read_binary_buffer()).
+ *
+ * Otherwise (pipes, terminals etc...) returns gts_file_new (@fptr)
+ * and sets @mapped to %NULL.
+ *
+ * Returns: a new #GtsFile.
+ */
+GtsFile * gfs_file_new_mapped (FILE * fptr, GMappedFile ** mapped)
+{
+  struct stat sb;
+
+  g_return_val_if_fail (fptr != NULL, NULL);
+  g_return_val_if_fail (mapped != NULL, NULL);
+
+  *mapped = NULL;
+  if (!fstat (fileno (fptr), &sb) && S_ISREG (sb.st_mode) && sb.st_size > 0 &&
+      ftello (fptr) == 0 &&
+      (*mapped = g_mapped_file_new_from_fd (fileno (fptr), FALSE, NULL)))
+    return gts_file_new_from_buffer (g_mapped_file_get_contents (*mapped),
+				     g_mapped_file_get_length (*mapped));
+  return gts_file_new (fptr);
+}
+
 static GfsFormat * format_new (const gchar * s, 
 			       guint len, 
 			       GfsFormatType t)
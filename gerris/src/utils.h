@@ -33,10 +33,13 @@ extern "C" {
 #  ifdef HAVE_MPI
 #    include <mpi.h>
 
+/* the time spent in the reduction is counted as MPI wait time */
 # define gfs_all_reduce(domain, p, type, op) {			        \
     if ((domain)->pid >= 0) {						\
       union { int a; float b; double c;} global;			\
+      gfs_domain_timer_start_id (domain, GFS_TIMER_MPI_WAIT);		\
       MPI_Allreduce (&(p), &global, 1, type, op, MPI_COMM_WORLD);	\
+      gfs_domain_timer_stop_id (domain, GFS_TIMER_MPI_WAIT);		\
       memcpy (&(p), &global, sizeof (p));				\
     }									\
   }
@@ -103,8 +106,18 @@ GtsObjectClass * gfs_global_class  (void);
   
 /* GfsFunction: Header */
 
+/* maximum number of cells evaluated by gfs_function_values() */
+#define GFS_FUNCTION_BATCH 128
+
 typedef struct _GfsFunction         GfsFunction;
 
+typedef enum {
+  GFS_DEPENDENCY_CONSTANT,
+  GFS_DEPENDENCY_TIME,
+  GFS_DEPENDENCY_SPACE,
+  GFS_DEPENDENCY_FIELD
+} GfsFunctionDependency;
+
 typedef struct _GfsFunctionClass    GfsFunctionClass;
 
 struct _GfsFunctionClass {
@@ -133,10 +146,19 @@ gdouble            gfs_function_face_value  (GfsFunction * f,
 					     FttCellFace * fa);
 gdouble            gfs_function_value       (GfsFunction * f,
 					     FttCell * cell);
+void               gfs_function_values      (GfsFunction * f,
+					     FttCell ** cells,
+					     guint n,
+					     gdouble * values);
+void               gfs_function_fill        (GfsFunction * f,
+					     GfsVariable * v,
+					     FttTraverseFlags flags,
+					     gint max_depth);
 void               gfs_function_set_constant_value (GfsFunction * f, 
 						    gdouble val);
 gdouble            gfs_function_get_constant_value (GfsFunction * f);
 gboolean           gfs_function_is_constant  (const GfsFunction * f);
+GfsFunctionDependency gfs_function_dependency (const GfsFunction * f);
 GfsVariable *      gfs_function_get_variable (GfsFunction * f);
 void               gfs_function_read        (GfsFunction * f, 
 					     gpointer domain,
@@ -199,19 +221,55 @@ void               gfs_clock_stop           (GfsClock * t);
 gdouble            gfs_clock_elapsed        (GfsClock * t);
 void               gfs_clock_destroy        (GfsClock * t);
 
+/* hardware performance counters: cycles, instructions, last-level
+   cache misses and bytes read from memory */
+#define GFS_COUNTERS 4
+
+typedef struct _GfsCounters GfsCounters;
+
+GfsCounters *      gfs_counters_new         (void);
+gboolean           gfs_counters_read        (GfsCounters * c,
+					     gint64 * values);
+const gchar *      gfs_counter_name         (guint i);
+void               gfs_counters_destroy     (GfsCounters * c);
+
 typedef struct {
   FILE * fp;
   char * buf;
   size_t len;
+  gchar * name;  /**< name of the shared file (collective mode) or %NULL */
+  gint64 offset; /**< offset in the shared file of the data of this process */
 } GfsUnionFile;
 
 FILE *             gfs_union_open           (FILE * fp, 
 					     int rank,
 					     GfsUnionFile * file);
+FILE *             gfs_union_open_collective (FILE * fp,
+					      const gchar * name,
+					      int rank,
+					      GfsUnionFile * file);
 void               gfs_union_close          (FILE * fp, 
 					     int rank, 
 					     GfsUnionFile * file);
 
+void               gfs_compress_bytes       (const gchar * src,
+					     gsize n,
+					     GArray * out);
+gboolean           gfs_uncompress_bytes     (const gchar * src,
+					     gsize len,
+					     gchar * dst,
+					     gsize n);
+void               gfs_compress_column      (const gdouble * v,
+					     guint n,
+					     gdouble tolerance,
+					     GArray * out);
+gboolean           gfs_uncompress_column    (const gchar ** buf,
+					     const gchar * end,
+					     gdouble * v,
+					     guint n);
+GtsFile *          gfs_file_new_mapped      (FILE * fptr,
+					     GMappedFile ** mapped);
+
 /* GfsFormat: Header */
 
 typedef struct _GfsFormat GfsFormat;
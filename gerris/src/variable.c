@@ -67,6 +67,8 @@ static void gfs_variable_read (GtsObject ** o, GtsFile * fp)
     GSList * i;
     if ((i = g_slist_find (domain->variables_io, old)))
       i->data = v;
+    if (domain->selection && (i = g_slist_find (domain->selection->read, old)))
+      i->data = v;
     domain->variables = g_slist_remove (domain->variables, old);
     gts_object_destroy (GTS_OBJECT (old));
   }
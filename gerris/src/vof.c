@@ -118,6 +118,83 @@ gdouble gfs_line_alpha (const FttVector * m, gdouble c)
   return alpha;
 }
 
+/* The batch versions below evaluate all the cases of the scalar
+   functions and select the result, so that the loops do not contain
+   any branches and can be vectorised by the compiler. All the
+   denominators and the arguments of sqrt() etc... are protected, even
+   for cases which are not selected, so that the floating-point
+   exceptions enabled by gfs_init() are never raised. This is also
+   what makes it safe to tell GCC that these operations do not trap,
+   which it needs to if-convert (and vectorise) the selects. */
+
+#if defined (__GNUC__) && !defined (__clang__) && !defined (__INTEL_COMPILER)
+# define VECTORIZE __attribute__ ((optimize ("tree-vectorize", "no-trapping-math", "no-math-errno")))
+#else
+# define VECTORIZE
+#endif
+
+#define NONZERO(x) MAX (x, 1e-50)
+
+/**
+ * gfs_line_area_batch:
+ * @m: an array of @n normals.
+ * @alpha: an array of @n line constants.
+ * @area: an array of size @n.
+ * @n: the number of lines.
+ *
+ * Fills @area with the areas of the fractions of a cell lying under
+ * each of the lines (@m,@alpha). This is equivalent to (but faster
+ * than) calling gfs_line_area() @n times.
+ */
+VECTORIZE
+void gfs_line_area_batch (const FttVector * m, const gdouble * alpha, gdouble * area, guint n)
+{
+  guint i;
+
+  g_return_if_fail (n == 0 || (m != NULL && alpha != NULL && area != NULL));
+
+  for (i = 0; i < n; i++) {
+    gdouble nx = fabs (m[i].x), ny = fabs (m[i].y);
+    gdouble a = alpha[i] + MAX (0., - m[i].x) + MAX (0., - m[i].y);
+    gdouble amax = nx + ny;
+    gdouble a1 = MIN (MAX (a, 0.), amax);
+    gdouble bx = MAX (a1 - nx, 0.), by = MAX (a1 - ny, 0.);
+    gdouble nxy = 2.*nx*ny;
+    gdouble v = nxy > 0. ? (a1*a1 - bx*bx - by*by)/NONZERO (nxy) : a1/NONZERO (amax);
+    area[i] = a <= 0. ? 0. : a >= amax ? 1. : CLAMP (v, 0., 1.);
+  }
+}
+
+/**
+ * gfs_line_alpha_batch:
+ * @m: an array of @n normals.
+ * @c: an array of @n volume fractions.
+ * @alpha: an array of size @n.
+ * @n: the number of lines.
+ *
+ * Fills @alpha with the line constants such that the area of a
+ * square cell lying under each line (@m,@alpha) is equal to @c. This
+ * is equivalent to (but faster than) calling gfs_line_alpha() @n
+ * times.
+ */
+VECTORIZE
+void gfs_line_alpha_batch (const FttVector * m, const gdouble * c, gdouble * alpha, guint n)
+{
+  guint i;
+
+  g_return_if_fail (n == 0 || (m != NULL && c != NULL && alpha != NULL));
+
+  for (i = 0; i < n; i++) {
+    gdouble m1 = MIN (fabs (m[i].x), fabs (m[i].y));
+    gdouble m2 = MAX (fabs (m[i].x), fabs (m[i].y));
+    gdouble ch = MIN (c[i], 1. - c[i]), v1 = m1/2.;
+    gdouble a1 = sqrt (MAX (2.*ch*m1*m2, 0.)), a2 = ch*m2 + v1;
+    gdouble a = ch*m2 <= v1 ? a1 : a2;
+    a = c[i] > 0.5 ? m1 + m2 - a : a;
+    alpha[i] = a + MIN (m[i].x, 0.) + MIN (m[i].y, 0.);
+  }
+}
+
 #define EPS 1e-4
 
 /**
@@ -414,6 +491,111 @@ gdouble gfs_plane_alpha (const FttVector * m, gdouble c)
   return alpha;
 }
 
+/**
+ * gfs_plane_volume_batch:
+ * @m: an array of @n normals.
+ * @alpha: an array of @n plane constants.
+ * @volume: an array of size @n.
+ * @n: the number of planes.
+ *
+ * Fills @volume with the volumes of a cell lying under each of the
+ * planes (@m,@alpha). This is equivalent to (but faster than) calling
+ * gfs_plane_volume() @n times.
+ */
+VECTORIZE
+void gfs_plane_volume_batch (const FttVector * m, const gdouble * alpha, gdouble * volume, guint n)
+{
+  guint i;
+
+  g_return_if_fail (n == 0 || (m != NULL && alpha != NULL && volume != NULL));
+
+  for (i = 0; i < n; i++) {
+    gdouble nx = fabs (m[i].x), ny = fabs (m[i].y), nz = fabs (m[i].z);
+    gdouble al = alpha[i] + MAX (0., - m[i].x) + MAX (0., - m[i].y) + MAX (0., - m[i].z);
+    gdouble amax = nx + ny + nz, s = NONZERO (amax);
+    gdouble n1 = nx/s, n2 = ny/s, n3 = nz/s;
+    gdouble a = MAX (0., MIN (1., al/s));
+    gdouble a0 = MIN (a, 1. - a);
+    /* sorting network: b1 <= b2 <= b3 */
+    gdouble b1 = MIN (MIN (n1, n2), n3);
+    gdouble b2 = MAX (MIN (n1, n2), MIN (MAX (n1, n2), n3));
+    gdouble b3 = MAX (MAX (n1, n2), n3);
+    gdouble b12 = b1 + b2, bm = MIN (b12, b3);
+    gdouble pr = MAX (6.*b1*b2*b3, 1e-50);
+    gdouble v1 = a0*a0*a0/pr;
+    gdouble v2 = 0.5*a0*(a0 - b1)/NONZERO (b2*b3) + b1*b1*b1/pr;
+    gdouble v3 = (a0*a0*(3.*b12 - a0) + b1*b1*(b1 - 3.*a0) + b2*b2*(b2 - 3.*a0))/pr;
+    gdouble v4 = (a0 - 0.5*bm)/NONZERO (b3);
+    gdouble v5 = (a0*a0*(3. - 2.*a0) + b1*b1*(b1 - 3.*a0) +
+		  b2*b2*(b2 - 3.*a0) + b3*b3*(b3 - 3.*a0))/pr;
+    gdouble v = b12 < b3 ? v4 : v5;
+    v = a0 < bm ? v3 : v;
+    v = a0 < b2 ? v2 : v;
+    v = a0 < b1 ? v1 : v;
+    v = a <= 0.5 ? v : 1. - v;
+    v = CLAMP (v, 0., 1.);
+    v = al >= amax ? 1. : v;
+    volume[i] = al <= 0. ? 0. : v;
+  }
+}
+
+/**
+ * gfs_plane_alpha_batch:
+ * @m: an array of @n normals.
+ * @c: an array of @n volume fractions.
+ * @alpha: an array of size @n.
+ * @n: the number of planes.
+ *
+ * Fills @alpha with the plane constants such that the volume of a
+ * cubic cell lying under each plane (@m,@alpha) is equal to @c. This
+ * is equivalent to calling gfs_plane_alpha() @n times.
+ *
+ * Unlike the other batch functions, the cost is dominated by calls to
+ * cbrt(), acos() and cos() which cannot be vectorised with standard
+ * libm implementations, so only the case relevant for each plane is
+ * evaluated.
+ */
+void gfs_plane_alpha_batch (const FttVector * m, const gdouble * c, gdouble * alpha, guint n)
+{
+  guint i;
+
+  g_return_if_fail (n == 0 || (m != NULL && c != NULL && alpha != NULL));
+
+  for (i = 0; i < n; i++) {
+    gdouble nx = fabs (m[i].x), ny = fabs (m[i].y), nz = fabs (m[i].z);
+    /* sorting network: m1 <= m2 <= m3 */
+    gdouble m1 = MIN (MIN (nx, ny), nz);
+    gdouble m2 = MAX (MIN (nx, ny), MIN (MAX (nx, ny), nz));
+    gdouble m3 = MAX (MAX (nx, ny), nz);
+    gdouble m12 = m1 + m2, mm = MIN (m3, m12);
+    gdouble pr = MAX (6.*m1*m2*m3, 1e-50);
+    gdouble V1 = m1*m1*m1/pr;
+    gdouble V2 = V1 + (m2 - m1)/(2.*m3);
+    gdouble V3 = m3 < m12 ?
+      (m3*m3*(3.*m12 - m3) + m1*m1*(m1 - 3.*m3) + m2*m2*(m2 - 3.*m3))/pr :
+      mm/(2.*m3);
+    gdouble ch = MIN (c[i], 1. - c[i]), a;
+
+    if (ch < V1)
+      a = cbrt (pr*ch);
+    else if (ch < V2)
+      a = (m1 + sqrt (m1*m1 + 8.*m2*m3*(ch - V1)))/2.;
+    else if (ch >= V3 && m12 < m3)
+      a = m3*ch + mm/2.;
+    else {
+      /* the two "cubic" cases only differ by their coefficients */
+      gboolean upper = ch >= V3;
+      gdouble p = upper ? m1*(m2 + m3) + m2*m3 - 1./4. : 2.*m1*m2;
+      gdouble q = upper ? 3.*m1*m2*m3*(1./2. - ch)/2. : 3.*m1*m2*(m12 - 2.*m3*ch)/2.;
+      gdouble p12 = sqrt (p);
+      gdouble cs = cos (acos (q/(p*p12))/3.);
+      a = p12*(sqrt (3.*(1. - cs*cs)) - cs) + (upper ? 1./2. : m12);
+    }
+    a = c[i] > 1./2. ? 1. - a : a;
+    alpha[i] = a + MIN (m[i].x, 0.) + MIN (m[i].y, 0.) + MIN (m[i].z, 0.);
+  }
+}
+
 /**
  * gfs_plane_center:
  * @m: normal to the plane.
@@ -1063,7 +1245,9 @@ static void vof_coarse_fine (FttCell * parent, GfsVariable * v)
   else {
     /* interfacial cell */
     gdouble alpha = GFS_VALUE (parent, t->alpha);
-    FttVector m;
+    FttVector m, mc[FTT_CELLS];
+    gdouble alphac[FTT_CELLS], fc[FTT_CELLS];
+    guint n = 0;
     
     for (i = 0; i < FTT_DIMENSION; i++)
       (&m.x)[i] = GFS_VALUE (parent, t->m[i]);
@@ -1078,9 +1262,14 @@ static void vof_coarse_fine (FttCell * parent, GfsVariable * v)
 	  alpha1 -= (&m.x)[c]*(0.25 + (&p.x)[c]);
 	  GFS_VALUE (child.c[i], t->m[c]) = (&m.x)[c];
 	}
-	GFS_VALUE (child.c[i], v) = gfs_plane_volume (&m, 2.*alpha1);
 	GFS_VALUE (child.c[i], t->alpha) = 2.*alpha1;
+	mc[n] = m;
+	alphac[n++] = 2.*alpha1;
       }
+    gfs_plane_volume_batch (mc, alphac, fc, n);
+    for (i = 0, n = 0; i < FTT_CELLS; i++)
+      if (child.c[i])
+	GFS_VALUE (child.c[i], v) = fc[n++];
 
     /* firs-order interpolation for concentrations in interfacial cells */
     GSList * j = t->concentrations->items;
@@ -1201,57 +1390,69 @@ typedef struct {
   guint depth, too_coarse;
 } VofParms;
 
-static gdouble plane_volume_shifted (FttVector m, gdouble alpha, FttVector p[2])
+static void plane_shift (FttVector * m, gdouble * alpha, FttVector p[2])
 {
   FttComponent c;
 
   for (c = 0; c < FTT_DIMENSION; c++) {
-    alpha -= (&m.x)[c]*(&p[0].x)[c];
-    (&m.x)[c] *= (&p[1].x)[c] - (&p[0].x)[c];
+    *alpha -= (&m->x)[c]*(&p[0].x)[c];
+    (&m->x)[c] *= (&p[1].x)[c] - (&p[0].x)[c];
   }
-  return gfs_plane_volume (&m, alpha);
 }
 
-static gdouble fine_fraction (FttCellFace * face, GfsVariable * v, gdouble un, FttVector q[2])
+/* Returns the fraction if the fine cell is full, -1 otherwise, in
+   which case the fraction is the volume under the plane (@m,@alpha) */
+static gdouble fine_plane (FttCellFace * face, GfsVariable * v, gdouble un, FttVector q[2],
+			   FttVector * m, gdouble * alpha)
 {
   gdouble f = GFS_VALUE (face->cell, v);
   if (f == 0. || f == 1.)
     return f;
   else {
     FttComponent c;
-    FttVector m, q1[2];
-    gdouble alpha = GFS_VALUE (face->cell, GFS_VARIABLE_TRACER_VOF (v)->alpha);
+    FttVector q1[2];
 
+    *alpha = GFS_VALUE (face->cell, GFS_VARIABLE_TRACER_VOF (v)->alpha);
     for (c = 0; c < FTT_DIMENSION; c++)
-      (&m.x)[c] = GFS_VALUE (face->cell, GFS_VARIABLE_TRACER_VOF (v)->m[c]);
+      (&m->x)[c] = GFS_VALUE (face->cell, GFS_VARIABLE_TRACER_VOF (v)->m[c]);
     c = face->d/2;
     if (face->d % 2 != 0) {
-      (&m.x)[c] = - (&m.x)[c];
-      alpha += (&m.x)[c];
+      (&m->x)[c] = - (&m->x)[c];
+      *alpha += (&m->x)[c];
     }
 
     q1[0] = q[0]; q1[1] = q[1];
     (&q1[0].x)[c] = 1. - un;
-    return plane_volume_shifted (m, alpha, q1);
+    plane_shift (m, alpha, q1);
+    return -1.;
   }
 }
 
-static gdouble coarse_fraction (FttCellFace * face, GfsVariable * v, gdouble un, FttVector q[2])
+static gdouble fine_fraction (FttCellFace * face, GfsVariable * v, gdouble un, FttVector q[2])
+{
+  FttVector m;
+  gdouble alpha, f = fine_plane (face, v, un, q, &m, &alpha);
+  return f < 0. ? gfs_plane_volume (&m, alpha) : f;
+}
+
+/* Same as fine_plane() but for the coarse neighbor of @face */
+static gdouble coarse_plane (FttCellFace * face, GfsVariable * v, gdouble un, FttVector q[2],
+			     FttVector * m, gdouble * alpha)
 {
   gdouble f = GFS_VALUE (face->neighbor, v);
   if (f == 0. || f == 1.)
     return f;
   else {
     FttComponent c;
-    FttVector m, o, q1[2];
-    gdouble alpha = GFS_VALUE (face->neighbor, GFS_VARIABLE_TRACER_VOF (v)->alpha);
-    
+    FttVector o, q1[2];
+
+    *alpha = GFS_VALUE (face->neighbor, GFS_VARIABLE_TRACER_VOF (v)->alpha);
     for (c = 0; c < FTT_DIMENSION; c++)
-      (&m.x)[c] = GFS_VALUE (face->neighbor, GFS_VARIABLE_TRACER_VOF (v)->m[c]);
+      (&m->x)[c] = GFS_VALUE (face->neighbor, GFS_VARIABLE_TRACER_VOF (v)->m[c]);
     
     if (!FTT_FACE_DIRECT (face)) {
-      (&m.x)[face->d/2] = - (&m.x)[face->d/2];
-      alpha += (&m.x)[face->d/2];
+      (&m->x)[face->d/2] = - (&m->x)[face->d/2];
+      *alpha += (&m->x)[face->d/2];
     }
     
     /* shift interface perpendicularly */
@@ -1263,7 +1464,8 @@ static gdouble coarse_fraction (FttCellFace * face, GfsVariable * v, gdouble un,
 	(&q1[1].x)[c] = (&o.x)[c] + 1./4. + (&q1[1].x)[c]/2.;
       }
     (&q1[1].x)[face->d/2] = un;
-    return plane_volume_shifted (m, alpha, q1);
+    plane_shift (m, alpha, q1);
+    return -1.;
   }
 }
 
@@ -1478,6 +1680,20 @@ static void concentration_face_values (FttCell * cell, VofParms * p)
   GFS_VALUE (cell, p->par->fv) = 0.;
 }
 
+/* maximum number of bands used by vof_flux() */
+#if FTT_2D
+# define VOF_BANDS 4
+#else
+# define VOF_BANDS 16
+#endif
+
+typedef struct {
+  FttCell * cell, * neighbor; /* upwind and downwind cells */
+  FttDirection d;
+  gdouble un, f;
+  gint i;                     /* index of the plane or -1 if full */
+} VofBand;
+
 static void vof_flux (FttCellFace * face, VofParms * p)
 {
   gdouble size = ftt_cell_size (face->cell);
@@ -1511,8 +1727,13 @@ static void vof_flux (FttCellFace * face, VofParms * p)
   }
 
   FttVector q[2] = {{0., 0., 0.},{1., 1., 1.}};
-  gdouble flux = 0., unj = un;
+  gdouble unj = un;
   FttComponent ci = FTT_ORTHOGONAL_COMPONENT (p->c);
+  FttFaceType type = ftt_face_type (face);
+  VofBand band[VOF_BANDS];
+  FttVector m[VOF_BANDS];
+  gdouble alpha[VOF_BANDS], volume[VOF_BANDS];
+  guint nb = 0, nm = 0;
 
 #if FTT_2D
   gdouble f = gfs_domain_face_fraction (p->vof->domain, face)/n;
@@ -1533,8 +1754,9 @@ static void vof_flux (FttCellFace * face, VofParms * p)
     (&q[1].x)[ci] = (i + 1)/(gdouble) n;  /* top of the band */
     /* linear interpolation of the velocity at the center of the band */
     gdouble uni = unj + (1 - n + 2*i)*dun[0]/(gdouble) (2*n);
+    VofBand * b = &band[nb++];
     
-    switch (ftt_face_type (face)) {
+    switch (type) {
     case FTT_FINE_FINE: {
       if (uni < 0.) {
 	FttCell * tmp = face->cell;
@@ -1547,38 +1769,58 @@ static void vof_flux (FttCellFace * face, VofParms * p)
 	for (c = 0; c < FTT_DIMENSION - 1; c++)
 	  dun[c] = - dun[c];
       }
-      flux = fine_fraction (face, p->vof, uni, q)*uni*f;
-      if (p->par->v == p->vof)
-	GFS_VALUE (face->neighbor, p->vpar.fv) += uni*f;
-      else
-	flux *= GFS_STATE (face->cell)->f[face->d].v;
-      GFS_VALUE (face->neighbor, p->par->fv) += flux;	
+      b->f = fine_plane (face, p->vof, uni, q, &m[nm], &alpha[nm]);
       break;
     }
     case FTT_FINE_COARSE: {
-      flux = uni > 0. ? 
-	fine_fraction (face, p->vof, uni, q)*uni*f : 
-	coarse_fraction (face, p->vof, -uni/2., q)*uni*f;
-      if (p->par->v == p->vof)
-	GFS_VALUE (face->neighbor, p->vpar.fv) += uni*f/FTT_CELLS;
-      else
-	flux *= uni > 0. ?
-	  GFS_STATE (face->cell)->f[face->d].v :
-	  GFS_STATE (face->neighbor)->f[FTT_OPPOSITE_DIRECTION (face->d)].v;
-      GFS_VALUE (face->neighbor, p->par->fv) += flux/FTT_CELLS;
+      b->f = uni > 0. ? 
+	fine_plane (face, p->vof, uni, q, &m[nm], &alpha[nm]) :
+	coarse_plane (face, p->vof, -uni/2., q, &m[nm], &alpha[nm]);
       break;
     }
     default:
       g_assert_not_reached ();
     }
-    if (p->par->v == p->vof)
-      GFS_VALUE (face->cell, p->vpar.fv) -= uni*f;
-    GFS_VALUE (face->cell, p->par->fv) -= flux;
+    b->cell = face->cell;
+    b->neighbor = face->neighbor;
+    b->d = face->d;
+    b->un = uni;
+    b->i = b->f < 0. ? nm++ : -1;
   }
 
 #if !FTT_2D
   }
 #endif
+
+  /* interfacial fractions for all the bands */
+  gfs_plane_volume_batch (m, alpha, volume, nm);
+
+  guint k;
+  for (k = 0; k < nb; k++) {
+    VofBand * b = &band[k];
+    gdouble uni = b->un;
+    gdouble flux = (b->i < 0 ? b->f : volume[b->i])*uni*f;
+
+    if (type == FTT_FINE_FINE) {
+      if (p->par->v == p->vof)
+	GFS_VALUE (b->neighbor, p->vpar.fv) += uni*f;
+      else
+	flux *= GFS_STATE (b->cell)->f[b->d].v;
+      GFS_VALUE (b->neighbor, p->par->fv) += flux;	
+    }
+    else {
+      if (p->par->v == p->vof)
+	GFS_VALUE (b->neighbor, p->vpar.fv) += uni*f/FTT_CELLS;
+      else
+	flux *= uni > 0. ?
+	  GFS_STATE (b->cell)->f[b->d].v :
+	  GFS_STATE (b->neighbor)->f[FTT_OPPOSITE_DIRECTION (b->d)].v;
+      GFS_VALUE (b->neighbor, p->par->fv) += flux/FTT_CELLS;
+    }
+    if (p->par->v == p->vof)
+      GFS_VALUE (b->cell, p->vpar.fv) -= uni*f;
+    GFS_VALUE (b->cell, p->par->fv) -= flux;
+  }
 }
 
 static void initialize_dV (FttCell * cell, GfsVariable * dV)
@@ -40,9 +40,19 @@ gdouble gfs_line_area_center       (const FttVector * m,
 				    FttVector * p);
 gdouble gfs_line_alpha             (const FttVector * m, 
 				    gdouble c);
+void    gfs_line_area_batch        (const FttVector * m,
+				    const gdouble * alpha,
+				    gdouble * area,
+				    guint n);
+void    gfs_line_alpha_batch       (const FttVector * m,
+				    const gdouble * c,
+				    gdouble * alpha,
+				    guint n);
 #if FTT_2D
 #  define gfs_plane_volume         gfs_line_area
 #  define gfs_plane_alpha          gfs_line_alpha
+#  define gfs_plane_volume_batch   gfs_line_area_batch
+#  define gfs_plane_alpha_batch    gfs_line_alpha_batch
 #  define gfs_plane_center         gfs_line_center
 #  define gfs_plane_area_center     gfs_line_area_center
 #else /* 3D */
@@ -50,6 +60,14 @@ gdouble gfs_plane_volume           (const FttVector * m,
 				    gdouble alpha);
 gdouble gfs_plane_alpha            (const FttVector * m, 
 				    gdouble c);
+void    gfs_plane_volume_batch     (const FttVector * m,
+				    const gdouble * alpha,
+				    gdouble * volume,
+				    guint n);
+void    gfs_plane_alpha_batch      (const FttVector * m,
+				    const gdouble * c,
+				    gdouble * alpha,
+				    guint n);
 void    gfs_plane_center           (const FttVector * m, 
 				    gdouble alpha, 
 				    gdouble a,
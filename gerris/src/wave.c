@@ -186,7 +186,7 @@ static void wave_run (GfsSimulation * sim)
 	 sim->time.i < sim->time.iend) {
     gdouble tstart = gfs_clock_elapsed (domain->timer);
 
-    gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);
+    gfs_events_do (sim);
 
     /* get global timestep */
     gfs_domain_face_traverse (domain, FTT_XYZ,
@@ -260,7 +260,7 @@ static void wave_run (GfsSimulation * sim)
     gts_range_add_value (&domain->size, gfs_domain_size (domain, FTT_TRAVERSE_LEAFS, -1));
     gts_range_update (&domain->size);
   }
-  gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gfs_event_do, sim);  
+  gfs_events_do (sim);
   gts_container_foreach (GTS_CONTAINER (sim->events), (GtsFunc) gts_object_destroy, NULL);
   gts_object_destroy (GTS_OBJECT (par.fv));
 }
@@ -0,0 +1,28 @@
+if gerris2D $1 > ref.gfs 2> /dev/null; then :
+else
+    exit 1
+fi
+
+for np in 2 3 4; do
+    if mpirun -np $np gerris2D $1 > run-$np.gfs 2> log-$np; then :
+    else
+	echo "  FAIL: mpirun -np $np gerris2D $1"
+	exit 1
+    fi
+    if gfscompare2D -v run-$np.gfs ref.gfs T 2> log; then :
+    else
+	exit 1
+    fi
+    if awk '{ if ($1 == "total" && $8 > 1e-4) exit 1; }' < log; then :
+    else
+	cat log
+	echo "  FAIL: T with $np processes"
+	exit 1
+    fi
+done
+
+# the imbalance is less than 10% on two processes
+if awk '/imbalance/{ if ($3 > 1.1) exit (1); }' < log-2; then :
+else
+    exit 1
+fi
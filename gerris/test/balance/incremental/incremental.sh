@@ -0,0 +1,24 @@
+# reference: the whole domain is reshaped after each migration
+sed 's/{ incremental = 1 }//' < $1 > full.gfs
+
+if mpirun -np 3 gerris2D full.gfs > ref.gfs 2> log; then :
+else
+    echo "  FAIL: mpirun -np 3 gerris2D full.gfs"
+    exit 1
+fi
+
+if mpirun -np 3 gerris2D $1 > run.gfs 2> log; then :
+else
+    echo "  FAIL: mpirun -np 3 gerris2D $1"
+    exit 1
+fi
+
+if gfscompare2D -v run.gfs ref.gfs T 2> log; then :
+else
+    exit 1
+fi
+if awk '{ if ($1 == "total" && $8 > 1e-10) exit 1; }' < log; then :
+else
+    cat log
+    exit 1
+fi
@@ -0,0 +1,11 @@
+if mpirun -np 2 gerris2D $1 2> log; then :
+else
+    echo "  FAIL: mpirun -np 2 gerris2D $1"
+    exit 1
+fi
+
+if awk '/imbalance/{ if ($3 > 1.2) exit (1); }' < log; then :
+else
+    cat log
+    exit 1
+fi
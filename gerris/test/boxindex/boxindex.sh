@@ -0,0 +1,22 @@
+rm -f sync.gfs async.gfs
+if gerris2D $1; then :
+else
+    exit 1
+fi
+
+if cmp sync.gfs async.gfs; then :
+else
+    exit 1
+fi
+
+# each box starts at the indexed offset and ends with a closing brace
+if tail -n 5 async.gfs | head -n 4 | while read hash id start end; do
+    if test "`tail -c +\`expr $start + 1\` async.gfs | head -c 6`" = "GfsBox" &&
+	test "`tail -c +\`expr $end + 1\` async.gfs | head -c 1`" = "}"; then :
+    else
+	exit 1
+    fi
+done; then :
+else
+    exit 1
+fi
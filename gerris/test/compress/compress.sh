@@ -0,0 +1,25 @@
+if gerris2D $1; then :
+else
+    exit 1
+fi
+
+for v in T U P; do
+    if gfscompare2D -v uncompressed.gfs compressed.gfs $v 2> error-$v; then :
+    else
+	exit 1
+    fi
+done
+
+# lossless variables are identical
+for v in U P; do
+    if awk '{ if ($1 == "total" && $8 != 0.) exit (1); }' < error-$v; then :
+    else
+	exit 1
+    fi
+done
+
+# the maximum error on T is not larger than the tolerance
+if awk '{ if ($1 == "total" && $8 > 1e-3) exit (1); }' < error-T; then :
+else
+    exit 1
+fi
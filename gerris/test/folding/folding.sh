@@ -0,0 +1,15 @@
+if gerris2D $1 > stats; then :
+else
+    exit 1
+fi
+# constant, time-dependent and spatial functions have the expected values
+if awk '/^(C|T|X)/{ if ($5 != 0. || $NF != 0.) exit (1); }' < stats; then :
+else
+    exit 1
+fi
+# G is different in each cell and R is the last value of G
+if awk '/^G/{ if ($5 == $NF) exit (1); g = $NF; }
+        /^R/{ if ($5 != g || $NF != g) exit (1); }' < stats; then :
+else
+    exit 1
+fi
@@ -0,0 +1,15 @@
+for np in 2 4 7 16 100; do
+    if gerris2D -v -c $np $1 > partition-$np 2> log; then :
+    else
+	exit 1
+    fi
+    # each subdomain contains at least one box
+    if test `grep -o "pid = [0-9]*" partition-$np | sort -u | wc -l` -ne $np; then
+	exit 1
+    fi
+    # the imbalance is less than 10%
+    if awk '/imbalance/{ if ($NF > 1.1) exit (1); }' < log; then :
+    else
+	exit 1
+    fi
+done
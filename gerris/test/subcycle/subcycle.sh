@@ -0,0 +1,30 @@
+for subcycle in 0 1; do
+    if sed "s/SUBCYCLE/$subcycle/g" < $1 | gerris2D - > stats-$subcycle; then :
+    else
+	exit 1
+    fi
+done
+
+# the total amount of tracer is conserved
+if awk 'BEGIN { n = 0 }
+        /sum:/{ s[n++] = $NF; }
+        END { if (n != 2 || (s[1] - s[0])/s[0] > 1e-10 || (s[0] - s[1])/s[0] > 1e-10) exit (1); }' \
+    < stats-1; then :
+else
+    exit 1
+fi
+
+# the extrema are close to those obtained without subcycling
+if awk 'BEGIN { n = 0 }
+        /min:/{ min[n] = $5; max[n++] = $NF; }
+        END { if (min[1] < min[0] - 0.01 || max[1] > max[0] + 0.01) exit (1); }' \
+    stats-0 stats-1; then :
+else
+    exit 1
+fi
+
+# subcycling is rejected for Navier-Stokes
+if sed -e "s/SUBCYCLE/1/g" -e "s/GfsAdvection/GfsSimulation/" < $1 | \
+    gerris2D - > /dev/null 2>&1; then
+    exit 1
+fi
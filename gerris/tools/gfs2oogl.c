@@ -718,6 +718,9 @@ int main (int argc, char * argv[])
   gboolean closed = FALSE;
   gint level = -1;
   gdouble iso = G_MAXDOUBLE;
+  GfsReadSelection selection = { FALSE };
+
+  selection.max_depth = -1;
 
   FILE * profile = NULL;
 
@@ -754,15 +757,17 @@ int main (int argc, char * argv[])
       {"vector", required_argument, NULL, 'V'},
       {"help", no_argument, NULL, 'h'},
       {"verbose", no_argument, NULL, 'v'},
+      {"region", required_argument, NULL, 'B'},
+      {"depth", required_argument, NULL, 'D'},
       { NULL }
     };
     int option_index = 0;
     switch ((c = getopt_long (argc, argv, 
-			      "hvs:rV:C:R:c:x:y:z:Sm:M:eiop:f:I:O:b:jl:L:u:g",
+			      "hvs:rV:C:R:c:x:y:z:Sm:M:eiop:f:I:O:b:jl:L:u:gB:D:",
 			      long_options, &option_index))) {
 #else /* not HAVE_GETOPT_LONG */
     switch ((c = getopt (argc, argv, 
-			 "hvs:rV:C:R:c:x:y:z:Sm:M:geiop:f:I:O:b:jl:L:u:g"))) {
+			 "hvs:rV:C:R:c:x:y:z:Sm:M:geiop:f:I:O:b:jl:L:u:gB:D:"))) {
 #endif /* not HAVE_GETOPT_LONG */
     case 'u': /* isosurface */
       iso = atof (optarg);
@@ -799,6 +804,29 @@ int main (int argc, char * argv[])
       }
       break;
     }
+    case 'B': { /* region */
+      gchar * s = strtok (optarg, ",");
+      guint i = 0;
+
+      while (i < 3 && s != NULL) {
+	(&selection.min.x)[i++] = atof (s);
+	s = strtok (NULL, ",");
+      }
+      while (i < 6 && s != NULL) {
+	(&selection.max.x)[i++ - 3] = atof (s);
+	s = strtok (NULL, ",");
+      }
+      if (i != 6) {
+	fprintf (stderr, "gfs2oogl: expecting six numbers for option `--region'\n");
+	fprintf (stderr, "Try `gfs2oogl --help' for more information.\n");
+	return 1;
+      }
+      selection.region = TRUE;
+      break;
+    }
+    case 'D': /* depth */
+      selection.max_depth = atoi (optarg);
+      break;
     case 'f': /* stream */
       even_stream = atof (optarg);
       break;
@@ -925,6 +953,9 @@ int main (int argc, char * argv[])
      "  -p F    --profile=F   output list of values for coordinates defined in F\n"
      "  -o      --mixed       output text values in mixed cells only\n"
      "  -L L    --level=L     use cells at level L only\n"
+     "  -B x,.. --region=x0,y0,z0,x1,y1,z1 only read the boxes intersecting\n"
+     "                        the given region\n"
+     "  -D L    --depth=L     only read cells up to level L\n"
      "  -i      --reinit      reinitializes refinement and solid fractions\n"
      "  -e      --merged      draw boundaries of merged cells\n"
      "  -S      --squares     draw (colored) squares\n"
@@ -970,7 +1001,7 @@ int main (int argc, char * argv[])
     GfsDomain * domain;
     GtsRange stats;
       
-    if (!(simulation = gfs_simulation_read (fp))) {
+    if (!(simulation = gfs_simulation_read_selection (fp, &selection))) {
       fprintf (stderr, 
 	       "gfs2oogl: file on standard input is not a valid simulation file\n"
 	       "<stdin>:%d:%d: %s\n",
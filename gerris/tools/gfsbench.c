@@ -0,0 +1,582 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif /* HAVE_GETOPT_H */
+#ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include "init.h"
+#include "vof.h"
+#include "simulation.h"
+
+/* Random normals (normalised as in vof_plane()) and random plane
+   constants/volume fractions, including the special cases of
+   full/empty cells and normals aligned with the axes */
+static void random_planes (FttVector * m, gdouble * alpha, gdouble * c, guint n)
+{
+  guint i;
+
+  for (i = 0; i < n; i++) {
+    FttComponent j;
+    gdouble norm = 0.;
+
+    for (j = 0; j < FTT_DIMENSION; j++) {
+      (&m[i].x)[j] = i % (7 + 2*j) ? g_random_double_range (-1., 1.) : 0.;
+      norm += fabs ((&m[i].x)[j]);
+    }
+    if (norm == 0.) {
+      m[i].x = 1.;
+      norm = 1.;
+    }
+    for (j = 0; j < FTT_DIMENSION; j++)
+      (&m[i].x)[j] /= norm;
+#if FTT_2D
+    m[i].z = 0.;
+#endif
+    alpha[i] = g_random_double_range (-1., 1.);
+    c[i] = i % 17 ? g_random_double () : i % 2;
+  }
+}
+
+typedef gdouble (* ScalarFunc) (const FttVector *, gdouble);
+typedef void    (* BatchFunc)  (const FttVector *, const gdouble *, gdouble *, guint);
+
+static void plane_kernel (const gchar * name,
+			  ScalarFunc scalar, BatchFunc batch,
+			  FttVector * m, gdouble * x, guint n, guint repeat)
+{
+  gdouble * ys = g_malloc (n*sizeof (gdouble)), * yb = g_malloc (n*sizeof (gdouble));
+  GTimer * timer = g_timer_new ();
+  gdouble error = 0., ts, tb;
+  guint i, r;
+
+  g_timer_start (timer);
+  for (r = 0; r < repeat; r++)
+    for (i = 0; i < n; i++)
+      ys[i] = (* scalar) (&m[i], x[i]);
+  ts = g_timer_elapsed (timer, NULL);
+
+  g_timer_start (timer);
+  for (r = 0; r < repeat; r++)
+    (* batch) (m, x, yb, n);
+  tb = g_timer_elapsed (timer, NULL);
+
+  for (i = 0; i < n; i++)
+    if (fabs (ys[i] - yb[i]) > error)
+      error = fabs (ys[i] - yb[i]);
+
+  printf ("%-14s %10u %12.4g %12.4g %8.3f %12.4g\n", name, n,
+	  n*repeat/ts/1e6, n*repeat/tb/1e6, ts/tb, error);
+
+  g_timer_destroy (timer);
+  g_free (ys);
+  g_free (yb);
+}
+
+/* Restart benchmark: simulations with (approximately) n cells, uniformly
+   refined at level - 1 and refined at level on part of the domain */
+
+typedef struct {
+  guint level;
+  gdouble xmax;
+} RestartRefine;
+
+static gboolean restart_refine (FttCell * cell, RestartRefine * r)
+{
+  guint level = ftt_cell_level (cell);
+  if (level + 1 < r->level)
+    return TRUE;
+  if (level + 1 == r->level) {
+    FttVector p;
+    ftt_cell_pos (cell, &p);
+    return p.x < r->xmax;
+  }
+  return FALSE;
+}
+
+static void restart_init (FttCell * cell, GfsVariable * v)
+{
+  FttVector p;
+  ftt_cell_pos (cell, &p);
+  GFS_VALUE (cell, v) = sin (10.*p.x)*cos (10.*p.y);
+}
+
+static void restart_count (FttCell * cell, guint * n)
+{
+  (*n)++;
+}
+
+static void restart_box_refine (GfsBox * box, RestartRefine * r)
+{
+  ftt_cell_refine (box->root, (FttCellRefineFunc) restart_refine, r,
+		   (FttCellInitFunc) gfs_cell_init, gfs_box_domain (box));
+}
+
+static GfsSimulation * restart_read (const gchar * fname, gboolean mapped, gdouble * t)
+{
+  FILE * fptr = fopen (fname, "r");
+  GMappedFile * map = NULL;
+  GTimer * timer = g_timer_new ();
+
+  g_timer_start (timer);
+  GtsFile * fp = mapped ? gfs_file_new_mapped (fptr, &map) : gts_file_new (fptr);
+  GfsSimulation * sim = gfs_simulation_read (fp);
+  gts_file_destroy (fp);
+  if (map)
+    g_mapped_file_unref (map);
+  *t = g_timer_elapsed (timer, NULL);
+
+  if (sim == NULL) {
+    fprintf (stderr, "gfsbench: could not read `%s'\n", fname);
+    exit (1);
+  }
+  fclose (fptr);
+  g_timer_destroy (timer);
+  return sim;
+}
+
+/* Returns a new simulation of (approximately) @n cells (see
+   restart_refine()), the actual number of cells is returned in @size */
+static GfsSimulation * mesh_new (guint n, guint * size)
+{
+  GtsFile * fp = gts_file_new_from_string ("1 0 GfsSimulation GfsBox GfsGEdge {} {\n"
+					   "  VariableTracer T\n"
+					   "}\n"
+					   "GfsBox { id = 1 }\n");
+  GfsSimulation * sim = gfs_simulation_read (fp);
+  g_assert (sim);
+  gts_file_destroy (fp);
+  GfsDomain * domain = GFS_DOMAIN (sim);
+
+  guint nc = 1 << FTT_DIMENSION, n0 = 1;
+  RestartRefine r = { 1, 0. };
+  while (n0*nc <= n) {
+    n0 *= nc;
+    r.level++;
+  }
+  r.xmax = - 0.5 + (n/(gdouble) n0 - 1.)/(nc - 1);
+  gts_container_foreach (GTS_CONTAINER (sim), (GtsFunc) restart_box_refine, &r);
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
+			    (FttCellTraverseFunc) restart_init, 
+			    gfs_variable_from_name (domain->variables, "T"));
+  *size = 0;
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			    (FttCellTraverseFunc) restart_count, size);
+  return sim;
+}
+
+static void restart (guint n)
+{
+  guint size;
+  GfsSimulation * sim = mesh_new (n, &size);
+  GfsDomain * domain = GFS_DOMAIN (sim);
+
+  gchar * fname = gfs_template ();
+  gint fd = g_mkstemp (fname);
+  FILE * fptr = fdopen (fd, "w");
+  domain->binary = TRUE;
+  gfs_simulation_write (sim, -1, fptr);
+  gdouble mb = ftello (fptr)/1048576.;
+  fclose (fptr);
+  gts_object_destroy (GTS_OBJECT (sim));
+
+  gdouble ts, tm;
+  sim = restart_read (fname, FALSE, &ts);
+  gts_object_destroy (GTS_OBJECT (sim));
+  sim = restart_read (fname, TRUE, &tm);
+  guint msize = 0;
+  gfs_domain_cell_traverse (GFS_DOMAIN (sim), FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			    (FttCellTraverseFunc) restart_count, &msize);
+  gts_object_destroy (GTS_OBJECT (sim));
+  remove (fname);
+  g_free (fname);
+
+  if (msize != size) {
+    fprintf (stderr, "gfsbench: restart read %u cells instead of %u\n", msize, size);
+    exit (1);
+  }
+  printf ("%-14s %10u %12.1f %12.4g %12.4g %8.3f\n", "restart", size, mb, ts, tm, ts/tm);
+}
+
+/* Kernel suite: each kernel is timed on a mesh of (approximately) n
+   cells and reported as one line "kernel cells operations time rate" */
+
+static void kernel_print (const gchar * name, guint size, gdouble ops, gdouble t)
+{
+  printf ("%-14s %2d %10u %12.0f %12.4g %12.4g\n", name, FTT_DIMENSION, size, ops, t,
+	  t > 0. ? ops/t : 0.);
+  fflush (stdout);
+}
+
+static void neighbors_count (FttCell * cell, guint * n)
+{
+  FttCellNeighbors neighbor;
+  FttDirection d;
+
+  ftt_cell_neighbors (cell, &neighbor);
+  for (d = 0; d < FTT_NEIGHBORS; d++)
+    if (neighbor.c[d])
+      (*n)++;
+}
+
+typedef struct {
+  GPtrArray * leaves;
+  guint max;
+} LeafCollect;
+
+static void leaf_collect (FttCell * cell, LeafCollect * c)
+{
+  if (c->leaves->len < c->max)
+    g_ptr_array_add (c->leaves, cell);
+}
+
+static void function_value (FttCell * cell, gpointer * data)
+{
+  GFS_VALUE (cell, GFS_VARIABLE (data[1])) = gfs_function_value (data[0], cell);
+}
+
+/* Returns a new function of @sim defined by @expr, compiled if needed */
+static GfsFunction * function_new (GfsSimulation * sim, gchar * expr)
+{
+  GtsFile * fp = gts_file_new_from_string (expr);
+  GfsFunction * f = gfs_function_new (gfs_function_class (), 0.);
+  gfs_function_read (f, sim, fp);
+  gfs_pending_functions_compilation (fp);
+  if (fp->type == GTS_ERROR) {
+    fprintf (stderr, "gfsbench: %s: %s\n", expr, fp->error);
+    exit (1);
+  }
+  gts_file_destroy (fp);
+  return f;
+}
+
+/* Times the evaluation of @expr in each leaf cell of @sim, first cell
+   by cell (as @name) then in batches using gfs_function_fill() (as
+   @name_fill) */
+static void function_kernel (GfsSimulation * sim, const gchar * name, gchar * expr,
+			     guint size, guint repeat)
+{
+  GfsDomain * domain = GFS_DOMAIN (sim);
+  GTimer * timer = g_timer_new ();
+  gpointer data[2];
+  guint r;
+
+  data[0] = function_new (sim, expr);
+  data[1] = gfs_temporary_variable (domain);
+  g_timer_start (timer);
+  for (r = 0; r < repeat; r++)
+    gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			      (FttCellTraverseFunc) function_value, data);
+  kernel_print (name, size, size*(gdouble) repeat, g_timer_elapsed (timer, NULL));
+
+  gchar * fill = g_strconcat (name, "_fill", NULL);
+  g_timer_start (timer);
+  for (r = 0; r < repeat; r++)
+    gfs_function_fill (data[0], data[1], FTT_TRAVERSE_LEAFS, -1);
+  kernel_print (fill, size, size*(gdouble) repeat, g_timer_elapsed (timer, NULL));
+  g_free (fill);
+
+  gts_object_destroy (data[1]);
+  gts_object_destroy (data[0]);
+  g_timer_destroy (timer);
+}
+
+static void kernels (guint n, guint repeat)
+{
+  guint size, count, i, r;
+  GfsSimulation * sim = mesh_new (n, &size);
+  GfsDomain * domain = GFS_DOMAIN (sim);
+  GTimer * timer = g_timer_new ();
+
+  /* traversal */
+  g_timer_start (timer);
+  for (r = 0; r < repeat; r++) {
+    count = 0;
+    gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			      (FttCellTraverseFunc) restart_count, &count);
+  }
+  kernel_print ("traverse", size, size*(gdouble) repeat, g_timer_elapsed (timer, NULL));
+
+  /* neighbors */
+  g_timer_start (timer);
+  for (r = 0; r < repeat; r++) {
+    count = 0;
+    gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			      (FttCellTraverseFunc) neighbors_count, &count);
+  }
+  kernel_print ("neighbors", size, size*(gdouble) repeat, g_timer_elapsed (timer, NULL));
+
+  /* Jacobi relaxation */
+  GfsVariable * u = gfs_variable_from_name (domain->variables, "T");
+  GfsVariable * rhs = gfs_temporary_variable (domain);
+  GfsVariable * dia = gfs_temporary_variable (domain);
+  gfs_poisson_coefficients (domain, NULL, TRUE, TRUE, TRUE);
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
+			    (FttCellTraverseFunc) gfs_cell_reset, rhs);
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_ALL, -1,
+			    (FttCellTraverseFunc) gfs_cell_reset, dia);
+  gint depth = gfs_domain_depth (domain);
+  g_timer_start (timer);
+  for (r = 0; r < repeat; r++)
+    gfs_relax (domain, FTT_DIMENSION, depth, 1., u, rhs, dia);
+  kernel_print ("relax", size, size*(gdouble) repeat, g_timer_elapsed (timer, NULL));
+  gts_object_destroy (GTS_OBJECT (rhs));
+  gts_object_destroy (GTS_OBJECT (dia));
+
+  /* function evaluation, without and with the position of the cell */
+  function_kernel (sim, "eval", "T*T + 1.", size, repeat);
+  function_kernel (sim, "eval_xy", "T*sin (x) + exp (-y*y)", size, repeat);
+
+  /* point location */
+  FttVector * p = g_malloc (size*sizeof (FttVector));
+  g_random_set_seed (1);
+  for (i = 0; i < size; i++) {
+    p[i].x = g_random_double_range (-0.5, 0.5);
+    p[i].y = g_random_double_range (-0.5, 0.5);
+    p[i].z = FTT_DIMENSION > 2 ? g_random_double_range (-0.5, 0.5) : 0.;
+  }
+  g_timer_start (timer);
+  for (r = 0; r < repeat; r++)
+    for (i = 0, count = 0; i < size; i++)
+      if (gfs_domain_locate (domain, p[i], -1, NULL))
+	count++;
+  kernel_print ("locate", size, size*(gdouble) repeat, g_timer_elapsed (timer, NULL));
+  g_free (p);
+
+  /* plane constant of VOF interfaces (one per cell) */
+  FttVector * m = g_malloc (size*sizeof (FttVector));
+  gdouble * alpha = g_malloc (size*sizeof (gdouble)), * f = g_malloc (size*sizeof (gdouble));
+  random_planes (m, alpha, f, size);
+  g_timer_start (timer);
+  for (r = 0; r < repeat; r++)
+    for (i = 0; i < size; i++)
+      alpha[i] = gfs_plane_alpha (&m[i], f[i]);
+  kernel_print ("plane_alpha", size, size*(gdouble) repeat, g_timer_elapsed (timer, NULL));
+  g_free (m);
+  g_free (alpha);
+  g_free (f);
+
+  /* binary write and read */
+  gchar * fname = gfs_template ();
+  gint fd = g_mkstemp (fname);
+  FILE * fptr = fdopen (fd, "w");
+  domain->binary = TRUE;
+  g_timer_start (timer);
+  gfs_simulation_write (sim, -1, fptr);
+  fflush (fptr);
+  kernel_print ("write", size, size, g_timer_elapsed (timer, NULL));
+  fclose (fptr);
+
+  gdouble t;
+  GfsSimulation * rsim = restart_read (fname, FALSE, &t);
+  kernel_print ("read", size, size, t);
+  gts_object_destroy (GTS_OBJECT (rsim));
+  rsim = restart_read (fname, TRUE, &t);
+  kernel_print ("read_mapped", size, size, t);
+  gts_object_destroy (GTS_OBJECT (rsim));
+  remove (fname);
+  g_free (fname);
+
+  /* refinement of (at most) size/2^FTT_DIMENSION leaf cells */
+  LeafCollect c = { g_ptr_array_new (), MAX (1, size >> FTT_DIMENSION) };
+  GPtrArray * leaves = c.leaves;
+  gfs_domain_cell_traverse (domain, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			    (FttCellTraverseFunc) leaf_collect, &c);
+  g_timer_start (timer);
+  for (i = 0; i < leaves->len; i++)
+    ftt_cell_refine_single (leaves->pdata[i], (FttCellInitFunc) gfs_cell_init, domain);
+  kernel_print ("refine_single", size, leaves->len, g_timer_elapsed (timer, NULL));
+  g_ptr_array_free (leaves, TRUE);
+
+  g_timer_destroy (timer);
+  gts_object_destroy (GTS_OBJECT (sim));
+}
+
+/* End-to-end benchmark: time @steps timesteps of the simulation in
+   @fname (or the standard input if @fname is "-"), excluding the
+   initialisation */
+static void simulation (const gchar * fname, const gchar * label, guint steps)
+{
+  FILE * fptr = strcmp (fname, "-") ? fopen (fname, "r") : stdin;
+  if (fptr == NULL) {
+    fprintf (stderr, "gfsbench: cannot open file `%s'\n", fname);
+    exit (1);
+  }
+  GtsFile * fp = gts_file_new (fptr);
+  GfsSimulation * sim = gfs_simulation_read (fp);
+  if (sim == NULL) {
+    fprintf (stderr, 
+	     "gfsbench: file `%s' is not a valid simulation file\n"
+	     "%s:%d:%d: %s\n",
+	     fname, fname, fp->line, fp->pos, fp->error);
+    exit (1);
+  }
+  gts_file_destroy (fp);
+  if (fptr != stdin)
+    fclose (fptr);
+
+  GfsDomain * domain = GFS_DOMAIN (sim);
+  sim->time.iend = sim->time.i + steps;
+  gfs_simulation_run (sim);
+  /* the timestep statistics do not include the initialisation */
+  kernel_print (label, domain->size.mean, domain->size.sum, domain->timestep.sum);
+
+  gts_object_destroy (GTS_OBJECT (sim));
+}
+
+int main (int argc, char * argv[])
+{
+  int c = 0;
+  guint n = 1000000, repeat = 10, steps = 10;
+  gchar * cells = NULL, * kcells = NULL, * fname = NULL, * label = NULL;
+
+  gfs_init (&argc, &argv);
+
+  /* parse options using getopt */
+  while (c != EOF) {
+#ifdef HAVE_GETOPT_LONG
+    static struct option long_options[] = {
+      {"size", required_argument, NULL, 'n'},
+      {"repeat", required_argument, NULL, 'r'},
+      {"restart", required_argument, NULL, 'R'},
+      {"kernels", required_argument, NULL, 'k'},
+      {"simulation", required_argument, NULL, 'S'},
+      {"timesteps", required_argument, NULL, 't'},
+      {"label", required_argument, NULL, 'l'},
+      {"help", no_argument, NULL, 'h'},
+      { NULL }
+    };
+    int option_index = 0;
+    switch ((c = getopt_long (argc, argv, "n:r:R:k:S:t:l:h",
+			      long_options, &option_index))) {
+#else /* not HAVE_GETOPT_LONG */
+    switch ((c = getopt (argc, argv, "n:r:R:k:S:t:l:h"))) {
+#endif /* not HAVE_GETOPT_LONG */
+    case 'n': /* size */
+      n = strtol (optarg, NULL, 0);
+      break;
+    case 'r': /* repeat */
+      repeat = strtol (optarg, NULL, 0);
+      break;
+    case 'R': /* restart */
+      cells = optarg;
+      break;
+    case 'k': /* kernels */
+      kcells = optarg;
+      break;
+    case 'S': /* simulation */
+      fname = optarg;
+      break;
+    case 't': /* timesteps */
+      steps = strtol (optarg, NULL, 0);
+      break;
+    case 'l': /* label */
+      label = optarg;
+      break;
+    case 'h': /* help */
+      fprintf (stderr,
+     "Usage: gfsbench [OPTION]\n"
+     "Times the scalar and batch versions of the VOF geometric kernels\n"
+     "and reports their throughput (in millions of evaluations per second)\n"
+     "and the maximum difference between the two.\n"
+     "The core kernel and simulation benchmarks write one line per benchmark:\n"
+     "name, dimension, cells, operations, time (in seconds) and operations\n"
+     "per second.\n"
+     "\n"
+     "  -n N  --size=N      number of evaluations (default is 1000000)\n"
+     "  -r R  --repeat=R    number of repetitions (default is 10)\n"
+     "  -R N,.. --restart=N1,N2,...\n"
+     "                      instead of the kernels, time the restart from binary\n"
+     "                      simulation files of N1, N2, ... cells, using standard\n"
+     "                      and memory-mapped reading (in seconds)\n"
+     "  -k N,.. --kernels=N1,N2,...\n"
+     "                      instead of the VOF kernels, time the core kernels\n"
+     "                      (traversal, neighbors, relaxation, function\n"
+     "                      evaluation, point location, plane constant, binary\n"
+     "                      write/read, refinement) on meshes of N1, N2, ...\n"
+     "                      cells\n"
+     "  -S FILE --simulation=FILE\n"
+     "                      instead of the kernels, time the timesteps of the\n"
+     "                      simulation in FILE (or standard input if FILE is -)\n"
+     "  -t N  --timesteps=N number of timesteps timed (default is 10)\n"
+     "  -l L  --label=L     label of the simulation benchmark (default is FILE)\n"
+     "  -h    --help        display this help and exit\n"
+     "\n"
+     "Reports bugs to %s\n",
+	       FTT_MAINTAINER);
+      return 0; /* success */
+      break;
+    case '?': /* wrong options */
+      fprintf (stderr, "Try `gfsbench --help' for more information.\n");
+      return 1; /* failure */
+    }
+  }
+
+  if (n == 0 || repeat == 0 || steps == 0) {
+    fprintf (stderr,
+	     "gfsbench: size, repeat and timesteps must be strictly positive\n"
+	     "Try `gfsbench --help' for more information.\n");
+    return 1; /* failure */
+  }
+
+  if (kcells || fname)
+    printf ("# benchmark     D      cells   operations      time(s)  rate(ops/s)\n");
+  if (fname)
+    simulation (fname, label ? label : fname, steps);
+  if (kcells) {
+    gchar * s = kcells;
+    while (*s != '\0') {
+      guint size = strtol (s, &s, 0);
+      if (size == 0 || (*s != '\0' && *s++ != ',')) {
+	fprintf (stderr,
+		 "gfsbench: invalid argument for option `kernels'\n"
+		 "Try `gfsbench --help' for more information.\n");
+	return 1; /* failure */
+      }
+      kernels (size, repeat);
+    }
+  }
+  if (kcells || fname)
+    return 0;
+
+  if (cells) {
+    gchar * s = cells;
+    printf ("# %dD benchmark        cells    size(MB)     stdio(s)    mapped(s)  speedup\n",
+	    FTT_DIMENSION);
+    while (*s != '\0') {
+      guint size = strtol (s, &s, 0);
+      if (size == 0 || (*s != '\0' && *s++ != ',')) {
+	fprintf (stderr,
+		 "gfsbench: invalid argument for option `restart'\n"
+		 "Try `gfsbench --help' for more information.\n");
+	return 1; /* failure */
+      }
+      restart (size);
+    }
+    return 0;
+  }
+
+  FttVector * m = g_malloc (n*sizeof (FttVector));
+  gdouble * alpha = g_malloc (n*sizeof (gdouble)), * f = g_malloc (n*sizeof (gdouble));
+  g_random_set_seed (1);
+  random_planes (m, alpha, f, n);
+
+  printf ("# %dD kernel          n   scalar(M/s)   batch(M/s)  speedup    max error\n",
+	  FTT_DIMENSION);
+  plane_kernel ("plane_volume",
+		(ScalarFunc) gfs_plane_volume, (BatchFunc) gfs_plane_volume_batch,
+		m, alpha, n, repeat);
+  plane_kernel ("plane_alpha",
+		(ScalarFunc) gfs_plane_alpha, (BatchFunc) gfs_plane_alpha_batch,
+		m, f, n, repeat);
+
+  g_free (m);
+  g_free (alpha);
+  g_free (f);
+
+  return 0;
+}
@@ -45,17 +45,273 @@ static void combine (FttCell * cell, CombineData * p)
   }
 }
 
+/* Combines variable @v2 of @s2 into @v1 of @s1, only for the cells
+   of @s1 overlapping @bbox (if not %NULL) */
+static void combine_simulations (GfsSimulation * s1, GfsVariable * v1,
+				 GfsSimulation * s2, GfsVariable * v2,
+				 GtsBBox * bbox)
+{
+  CombineData p = { s1, s2, v1, v2 };
+  if (bbox) {
+    gfs_domain_cell_traverse_box (GFS_DOMAIN (s1), bbox, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+				  (FttCellTraverseFunc) refine, &p);
+    gfs_domain_cell_traverse_box (GFS_DOMAIN (s1), bbox, FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+				  (FttCellTraverseFunc) combine, &p);
+  }
+  else {
+    gfs_domain_traverse_leaves (GFS_DOMAIN (s1), (FttCellTraverseFunc) refine, &p);
+    gfs_domain_traverse_leaves (GFS_DOMAIN (s1), (FttCellTraverseFunc) combine, &p);
+  }
+}
+
+static GfsSimulation * read_simulation (const gchar * fname, GfsReadSelection * selection)
+{
+  FILE * f = fopen (fname, "rt");
+  if (f == NULL) {
+    fprintf (stderr, "gfscombine: cannot open file `%s'\n", fname);
+    exit (1);
+  }
+  GtsFile * fp = gts_file_new (f);
+  GfsSimulation * sim = selection ? 
+    gfs_simulation_read_selection (fp, selection) : 
+    gfs_simulation_read (fp);
+  if (sim == NULL) {
+    fprintf (stderr, 
+	     "gfscombine: file `%s' is not a valid simulation file\n"
+	     "%s:%d:%d: %s\n",
+	     fname, fname, fp->line, fp->pos, fp->error);
+    exit (1);
+  }
+  gts_file_destroy (fp);
+  fclose (f);
+  gfs_simulation_init (sim);
+  return sim;
+}
+
+static GfsVariable * simulation_variable (GfsSimulation * sim, const gchar * name,
+					  const gchar * fname)
+{
+  GfsVariable * v = gfs_variable_from_name (GFS_DOMAIN (sim)->variables, name);
+  if (v == NULL) {
+    fprintf (stderr, 
+	     "gfscombine: unknown variable `%s' for `%s'\n"
+	     "Try `gfscombine --help' for more information.\n",
+	     name, fname);
+    exit (1);
+  }
+  return v;
+}
+
+static void print_stats (const gchar * fname, GfsNorm * norm, GtsRange * s, gdouble f)
+{
+  fprintf (stderr, 
+	   "%s:\n"
+	   "  first: %g second: %g infty: %g w: %g\n"
+	   "  min: %g avg: %g | %g max: %g\n",
+	   fname, 
+	   norm->first*f, norm->second*f, norm->infty*f, norm->w,
+	   s->min*f, s->mean*f, s->stddev*f, s->max*f);
+}
+
+static void print_simulation_stats (const gchar * fname, GfsSimulation * sim, GfsVariable * v)
+{
+  GfsNorm norm = gfs_domain_norm_variable (GFS_DOMAIN (sim),
+					   v, NULL, FTT_TRAVERSE_LEAFS, -1,
+					   NULL, NULL);
+  GtsRange s = gfs_domain_stats_variable (GFS_DOMAIN (sim),
+					  v, FTT_TRAVERSE_LEAFS, -1,
+					  NULL, NULL);
+  print_stats (fname, &norm, &s, pow (sim->physical_params.L, v->units));
+}
+
+/* Streaming combination (--threads): the boxes of FILE2, FILE3,
+   ... are read one at a time by the worker threads and combined in
+   order, by the main thread, with the simulation of FILE1 */
+
+typedef struct {
+  const gchar * fname;
+  guint box;
+  GfsSimulation * sim;
+  GfsVariable * v;
+  GfsNorm norm;
+  GtsRange s;
+} Tile;
+
+typedef struct {
+  const gchar * name;
+  Tile * tiles;
+  guint ntiles, next, applied, window;
+  GMutex mutex;
+  GCond cond;
+} Stream;
+
+static void tile_stats (FttCell * cell, Tile * t)
+{
+  gdouble val = GFS_VALUE (cell, t->v);
+  gfs_norm_add (&t->norm, val, gfs_cell_volume (cell, t->v->domain));
+  if (val != GFS_NODATA)
+    gts_range_add_value (&t->s, val);
+}
+
+static void tile_read (Tile * t, const gchar * name, guint * nboxes)
+{
+  GfsReadSelection selection = { FALSE };
+
+  selection.variables = (gchar *) name;
+  selection.max_depth = -1;
+  selection.single_box = TRUE;
+  selection.box = t->box;
+  t->sim = read_simulation (t->fname, &selection);
+  if (nboxes)
+    *nboxes = selection.nboxes;
+  t->v = simulation_variable (t->sim, name, t->fname);
+  gfs_norm_init (&t->norm);
+  gts_range_init (&t->s);
+  gfs_domain_traverse_leaves (GFS_DOMAIN (t->sim), (FttCellTraverseFunc) tile_stats, t);
+}
+
+static gpointer stream_worker (Stream * s)
+{
+  g_mutex_lock (&s->mutex);
+  while (s->next < s->ntiles) {
+    Tile * t = &s->tiles[s->next];
+    if (s->next >= s->applied + s->window)
+      /* wait for the main thread to catch up */
+      g_cond_wait (&s->cond, &s->mutex);
+    else if (t->sim) /* already read */
+      s->next++;
+    else {
+      s->next++;
+      g_mutex_unlock (&s->mutex);
+      Tile tile = *t;
+      tile_read (&tile, s->name, NULL);
+      g_mutex_lock (&s->mutex);
+      *t = tile;
+      g_cond_broadcast (&s->cond);
+    }
+  }
+  g_mutex_unlock (&s->mutex);
+  return NULL;
+}
+
+static void first_box (GfsBox * box, GfsBox ** first)
+{
+  if (*first == NULL)
+    *first = box;
+}
+
+/* Returns: the number of leaf cells combined */
+static guint stream_combine (GfsSimulation * s1, GfsVariable * var1,
+			     gchar ** fnames, guint nfiles, const gchar * name,
+			     guint nthreads, gboolean verbose)
+{
+  Stream s = { name };
+  guint i, j, k, size = 0;
+
+  /* the first box of each file is read on its own so that the
+     functions defined in the files are compiled only once */
+  Tile * first = g_malloc (nfiles*sizeof (Tile));
+  guint * nboxes = g_malloc (nfiles*sizeof (guint));
+  for (j = 0; j < nfiles; j++) {
+    first[j].fname = fnames[j];
+    first[j].box = 0;
+    tile_read (&first[j], name, &nboxes[j]);
+    s.ntiles += MAX (nboxes[j], 1);
+  }
+  s.tiles = g_malloc0 (s.ntiles*sizeof (Tile));
+  for (j = 0, i = 0; j < nfiles; j++) {
+    s.tiles[i++] = first[j];
+    for (k = 1; k < nboxes[j]; k++, i++) {
+      s.tiles[i].fname = fnames[j];
+      s.tiles[i].box = k;
+    }
+  }
+  g_free (first);
+  
+  s.window = 2*nthreads;
+  g_mutex_init (&s.mutex);
+  g_cond_init (&s.cond);
+  GThread ** threads = g_malloc (nthreads*sizeof (GThread *));
+  for (i = 0; i < nthreads; i++)
+    threads[i] = g_thread_new ("gfscombine", (GThreadFunc) stream_worker, &s);
+
+  GfsNorm norm;
+  GtsRange stats;
+  for (i = 0, j = 0, k = 0; i < s.ntiles; i++) {
+    g_mutex_lock (&s.mutex);
+    while (s.tiles[i].sim == NULL)
+      g_cond_wait (&s.cond, &s.mutex);
+    g_mutex_unlock (&s.mutex);
+
+    Tile * t = &s.tiles[i];
+    GfsBox * box = NULL;
+    gts_container_foreach (GTS_CONTAINER (t->sim), (GtsFunc) first_box, &box);
+    if (box) {
+      /* the bounding box of the tile in the coordinates of FILE1 */
+      GtsBBox bbox;
+      ftt_cell_bbox (box->root, &bbox);
+      FttVector p1 = { bbox.x1, bbox.y1, bbox.z1 }, p2 = { bbox.x2, bbox.y2, bbox.z2 };
+      gfs_simulation_map_inverse (t->sim, &p1);
+      gfs_simulation_map_inverse (t->sim, &p2);
+      gfs_simulation_map (s1, &p1);
+      gfs_simulation_map (s1, &p2);
+      gts_bbox_set (&bbox, NULL,
+		    MIN (p1.x, p2.x), MIN (p1.y, p2.y), MIN (p1.z, p2.z),
+		    MAX (p1.x, p2.x), MAX (p1.y, p2.y), MAX (p1.z, p2.z));
+      combine_simulations (s1, var1, t->sim, t->v, &bbox);
+    }
+
+    if (t->box == 0) {
+      gfs_norm_init (&norm);
+      gts_range_init (&stats);
+    }
+    norm.bias += t->norm.bias;
+    norm.first += t->norm.first;
+    norm.second += t->norm.second;
+    norm.w += t->norm.w;
+    norm.infty = MAX (norm.infty, t->norm.infty);
+    stats.min = MIN (stats.min, t->s.min);
+    stats.max = MAX (stats.max, t->s.max);
+    stats.sum += t->s.sum;
+    stats.sum2 += t->s.sum2;
+    stats.n += t->s.n;
+    if (verbose && t->box + 1 >= nboxes[j]) { /* last box of file j */
+      gfs_norm_update (&norm);
+      gts_range_update (&stats);
+      print_stats (fnames[j], &norm, &stats, pow (s1->physical_params.L, var1->units));
+    }
+    if (t->box + 1 >= nboxes[j])
+      j++;
+    size += t->s.n;
+
+    gts_object_destroy (GTS_OBJECT (t->sim));
+    g_mutex_lock (&s.mutex);
+    s.applied = i + 1;
+    g_cond_broadcast (&s.cond);
+    g_mutex_unlock (&s.mutex);
+  }
+
+  for (i = 0; i < nthreads; i++)
+    g_thread_join (threads[i]);
+  g_free (threads);
+  g_mutex_clear (&s.mutex);
+  g_cond_clear (&s.cond);
+  g_free (s.tiles);
+  g_free (nboxes);
+  return size;
+}
+
 int main (int argc, char * argv[])
 {
-  GtsFile * fp;
-  FILE * f;
   int c = 0;
   gchar * name;
-  GfsVariable * var1, * var2;
-  GfsSimulation * s1, * s2;
+  GfsVariable * var1;
+  GfsSimulation * s1;
   
   gboolean verbose = FALSE;
-  gchar * fname1, * fname2;
+  guint nthreads = 0;
+  gchar * fname1, ** fnames;
+  guint i, nfiles;
 
   gfs_init (&argc, &argv);
 
@@ -63,25 +319,37 @@ int main (int argc, char * argv[])
   while (c != EOF) {
 #ifdef HAVE_GETOPT_LONG
     static struct option long_options[] = {
+      {"threads", required_argument, NULL, 'j'},
       {"help", no_argument, NULL, 'h'},
       {"verbose", no_argument, NULL, 'v'},
       { NULL }
     };
     int option_index = 0;
-    switch ((c = getopt_long (argc, argv, "hv",
+    switch ((c = getopt_long (argc, argv, "hvj:",
 			      long_options, &option_index))) {
 #else /* not HAVE_GETOPT_LONG */
-    switch ((c = getopt (argc, argv, "hv"))) {
+    switch ((c = getopt (argc, argv, "hvj:"))) {
 #endif /* not HAVE_GETOPT_LONG */
+    case 'j': /* threads */
+      if (atoi (optarg) < 1) {
+	fprintf (stderr, 
+		 "gfscombine: invalid argument for option `threads'.\n"
+		 "Try `gfscombine --help' for more information.\n");
+	return 1; /* failure */
+      }
+      nthreads = atoi (optarg);
+      break;
     case 'v': /* verbose */
       verbose = TRUE;
       break;
     case 'h': /* help */
       fprintf (stderr,
-     "Usage: gfscombine [OPTION] FILE1 FILE2 VAR\n"
-     "Computes the maximum of VAR between the solutions in FILE1 and FILE2\n"
+     "Usage: gfscombine [OPTION] FILE1 FILE2 [FILE3 ...] VAR\n"
+     "Computes the maximum of VAR between the solutions in FILE1, FILE2, ...\n"
      "and outputs the corresponding simulation.\n"
      "\n"
+     "  -j N  --threads=N   read FILE2, FILE3, ... box by box using N threads,\n"
+     "                      only keeping in memory FILE1 and the boxes being combined\n"
      "  -v    --verbose     display statistics and other info\n"
      "  -h    --help        display this help and exit\n"
      "\n"
@@ -109,123 +377,57 @@ int main (int argc, char * argv[])
 	     "Try `gfscombine --help' for more information.\n");
     return 1; /* failure */
   }
-  fname2 = argv[optind++];
+  fnames = &argv[optind];
 
-  if (optind >= argc) { /* missing VAR */  
+  if (optind + 1 >= argc) { /* missing VAR */  
     fprintf (stderr, 
 	     "gfscombine: missing VAR\n"
 	     "Try `gfscombine --help' for more information.\n");
     return 1; /* failure */
   }
-  name = argv[optind++];
-
-  f = fopen (fname1, "rt");
-  if (f == NULL) {
-    fprintf (stderr, "gfscombine: cannot open file `%s'\n", fname1);
-    return 1;
-  }
-  fp = gts_file_new (f);
-  if (!(s1 = gfs_simulation_read (fp))) {
-    fprintf (stderr, 
-	     "gfscombine: file `%s' is not a valid simulation file\n"
-	     "%s:%d:%d: %s\n",
-	     fname1, fname1, fp->line, fp->pos, fp->error);
-    return 1;
-  }
-  gts_file_destroy (fp);
-  fclose (f);
-  gfs_simulation_init (s1);
-
-  f = fopen (fname2, "rt");
-  if (f == NULL) {
-    fprintf (stderr, "gfscombine: cannot open file `%s'\n", fname2);
-    return 1;
-  }
-  fp = gts_file_new (f);
-  if (!(s2 = gfs_simulation_read (fp))) {
-    fprintf (stderr, 
-	     "gfscombine: file `%s' is not a valid simulation file\n"
-	     "%s:%d:%d: %s\n",
-	     fname2, fname2, fp->line, fp->pos, fp->error);
-    return 1;
-  }
-  gts_file_destroy (fp);
-  fclose (f);
-  gfs_simulation_init (s2);
-
-  var1 = gfs_variable_from_name (GFS_DOMAIN (s1)->variables, name);
-  if (var1 == NULL) {
-    fprintf (stderr, 
-	     "gfscombine: unknown variable `%s' for `%s'\n"
-	     "Try `gfscombine --help' for more information.\n",
-	     name, fname1);
-    return 1; /* failure */
-  }
+  nfiles = argc - optind - 1;
+  name = argv[argc - 1];
 
-  var2 = gfs_variable_from_name (GFS_DOMAIN (s2)->variables, name);
-  if (var2 == NULL) {
-    fprintf (stderr, 
-	     "gfscombine: unknown variable `%s' for `%s'\n"
-	     "Try `gfscombine --help' for more information.\n",
-	     name, fname2);
-    return 1; /* failure */
-  }
+  GTimer * timer = g_timer_new ();
+  g_timer_start (timer);
+  s1 = read_simulation (fname1, NULL);
+  var1 = simulation_variable (s1, name, fname1);
+  if (verbose)
+    print_simulation_stats (fname1, s1, var1);
 
-  if (verbose) {
-    GfsNorm norm = gfs_domain_norm_variable (GFS_DOMAIN (s1),
-					     var1, NULL, FTT_TRAVERSE_LEAFS, -1,
-					     NULL, NULL);
-    GtsRange s = gfs_domain_stats_variable (GFS_DOMAIN (s1),
-					    var1, FTT_TRAVERSE_LEAFS, -1,
-					    NULL, NULL);
-    gdouble f = pow (s1->physical_params.L, var1->units);
-    fprintf (stderr, 
-	     "%s:\n"
-	     "  first: %g second: %g infty: %g w: %g\n"
-	     "  min: %g avg: %g | %g max: %g\n",
-	     fname1, 
-	     norm.first*f, norm.second*f, norm.infty*f, norm.w,
-	     s.min*f, s.mean*f, s.stddev*f, s.max*f);
-    norm = gfs_domain_norm_variable (GFS_DOMAIN (s2),
-				     var2, NULL, FTT_TRAVERSE_LEAFS, -1,
-				     NULL, NULL);
-    s = gfs_domain_stats_variable (GFS_DOMAIN (s2),
-				   var2, FTT_TRAVERSE_LEAFS, -1,
-				   NULL, NULL);
-    fprintf (stderr, 
-	     "%s:\n"
-	     "  first: %g second: %g infty: %g w: %g\n"
-	     "  min: %g avg: %g | %g max: %g\n",
-	     fname2, 
-	     norm.first*f, norm.second*f, norm.infty*f, norm.w,
-	     s.min*f, s.mean*f, s.stddev*f, s.max*f);
-  }
-
-  CombineData p = { s1, s2, var1, var2 };
-  gfs_domain_traverse_leaves (GFS_DOMAIN (s1), (FttCellTraverseFunc) refine, &p);
-  gfs_domain_traverse_leaves (GFS_DOMAIN (s1), (FttCellTraverseFunc) combine, &p);
+  guint size = 0;
+  if (nthreads > 0)
+    size = stream_combine (s1, var1, fnames, nfiles, name, nthreads, verbose);
+  else
+    for (i = 0; i < nfiles; i++) {
+      GfsSimulation * s2 = read_simulation (fnames[i], NULL);
+      GfsVariable * var2 = simulation_variable (s2, name, fnames[i]);
+      if (verbose) {
+	print_simulation_stats (fnames[i], s2, var2);
+	size += gfs_domain_stats_variable (GFS_DOMAIN (s2), var2, FTT_TRAVERSE_LEAFS, -1,
+					   NULL, NULL).n;
+      }
+      combine_simulations (s1, var1, s2, var2, NULL);
+      gts_object_destroy (GTS_OBJECT (s2));
+    }
 
   if (verbose) {
-    GfsNorm norm = gfs_domain_norm_variable (GFS_DOMAIN (s1),
-					     var1, NULL, FTT_TRAVERSE_LEAFS, -1,
-					     NULL, NULL);
-    GtsRange s = gfs_domain_stats_variable (GFS_DOMAIN (s1),
-					    var1, FTT_TRAVERSE_LEAFS, -1,
-					    NULL, NULL);
-    gdouble f = pow (s1->physical_params.L, var1->units);
-    fprintf (stderr, 
-	     "max(%s,%s):\n"
-	     "  first: %g second: %g infty: %g w: %g\n"
-	     "  min: %g avg: %g | %g max: %g\n",
-	     fname1, fname2,
-	     norm.first*f, norm.second*f, norm.infty*f, norm.w,
-	     s.min*f, s.mean*f, s.stddev*f, s.max*f);
+    gdouble elapsed = g_timer_elapsed (timer, NULL);
+    GString * result = g_string_new ("max(");
+    g_string_append (result, fname1);
+    for (i = 0; i < nfiles; i++)
+      g_string_append_printf (result, ",%s", fnames[i]);
+    g_string_append_c (result, ')');
+    print_simulation_stats (result->str, s1, var1);
+    g_string_free (result, TRUE);
+    fprintf (stderr, "%u cells combined in %g seconds: %g cells/s\n",
+	     size, elapsed, elapsed > 0. ? size/elapsed : 0.);
   }
 
   gfs_simulation_write (s1, -1, stdout);
 
   gts_object_destroy (GTS_OBJECT (s1));
-  gts_object_destroy (GTS_OBJECT (s2));
+  g_timer_destroy (timer);
 
   return 0;
 }
@@ -305,6 +305,338 @@ static void difference_centered (FttCell * cell, gpointer * data)
   GFS_VALUE (cell, e) = GFS_VALUE (cell, v1) - gfs_interpolate (locate, p, v2);
 }
 
+/* Streaming comparison (--threads): the boxes of FILE1 are compared
+   one at a time with the boxes of FILE2 they overlap */
+
+typedef struct {
+  FttVector min, max; /* physical extent of the box of FILE1 */
+  GfsNorm n1, n2, error;
+  GtsRange s1, s2;
+  guint size;
+} TileStats;
+
+typedef struct {
+  gchar * fname1, * fname2, * name;
+  GfsReadSelection selection;
+  gint full;
+  gboolean weighted, mixed;
+  gdouble f;
+  TileStats * tiles;
+  guint ntiles;
+  gint next;
+} Stream;
+
+static GfsSimulation * stream_read (const gchar * fname, GfsReadSelection * selection)
+{
+  FILE * f = fopen (fname, "rt");
+  if (f == NULL) {
+    fprintf (stderr, "gfscompare: cannot open file `%s'\n", fname);
+    exit (1);
+  }
+  GtsFile * fp = gts_file_new (f);
+  GfsSimulation * sim = gfs_simulation_read_selection (fp, selection);
+  if (sim == NULL) {
+    fprintf (stderr, 
+	     "gfscompare: file `%s' is not a valid simulation file\n"
+	     "%s:%d:%d: %s\n",
+	     fname, fname, fp->line, fp->pos, fp->error);
+    exit (1);
+  }
+  gts_file_destroy (fp);
+  fclose (f);
+  if (!selection->indexed) {
+    fprintf (stderr, 
+	     "gfscompare: file `%s' does not contain a box index\n"
+	     "option `threads' requires binary files written with a box index\n",
+	     fname);
+    exit (1);
+  }
+  gfs_simulation_init (sim);
+  return sim;
+}
+
+static GfsVariable * stream_variable (GfsSimulation * sim, const gchar * name,
+				      const gchar * fname)
+{
+  GfsVariable * v = gfs_variable_from_name (GFS_DOMAIN (sim)->variables, name);
+  if (v == NULL) {
+    fprintf (stderr, 
+	     "gfscompare: unknown variable `%s' for `%s'\n"
+	     "Try `gfscompare --help' for more information.\n",
+	     name, fname);
+    exit (1);
+  }
+  return v;
+}
+
+static void first_box (GfsBox * box, GfsBox ** first)
+{
+  if (*first == NULL)
+    *first = box;
+}
+
+static void tile_extent (GfsBox * box, Stream * s)
+{
+  TileStats * t = &s->tiles[s->ntiles++];
+  gdouble h = ftt_cell_size (box->root)/2.;
+  GfsSimulation * sim = GFS_SIMULATION (gfs_box_domain (box));
+  FttComponent c;
+
+  ftt_cell_pos (box->root, &t->min);
+  t->max = t->min;
+  for (c = 0; c < FTT_DIMENSION; c++) {
+    (&t->min.x)[c] -= h;
+    (&t->max.x)[c] += h;
+  }
+  gfs_simulation_map_inverse (sim, &t->min);
+  gfs_simulation_map_inverse (sim, &t->max);
+  for (c = 0; c < FTT_DIMENSION; c++)
+    if ((&t->min.x)[c] > (&t->max.x)[c]) {
+      gdouble a = (&t->min.x)[c];
+      (&t->min.x)[c] = (&t->max.x)[c];
+      (&t->max.x)[c] = a;
+    }
+}
+
+static int tile_compare (const void * a, const void * b)
+{
+  const FttVector * p1 = &((const TileStats *) a)->min;
+  const FttVector * p2 = &((const TileStats *) b)->min;
+  FttComponent c;
+
+  for (c = 0; c < FTT_DIMENSION; c++)
+    if ((&p1->x)[c] != (&p2->x)[c])
+      return (&p1->x)[c] < (&p2->x)[c] ? -1 : 1;
+  return 0;
+}
+
+/* Defines the tiles as the extents of the selected boxes of FILE1.
+   This reads FILE1 once, coarsened to the root cells of its boxes,
+   and also compiles the functions defined in FILE1 and FILE2 before
+   the worker threads start. */
+static void stream_tiles (Stream * s)
+{
+  GfsReadSelection selection = s->selection;
+  selection.max_depth = 0;
+  GfsSimulation * sim = stream_read (s->fname1, &selection);
+  GfsVariable * v = stream_variable (sim, s->name, s->fname1);
+  s->f = pow (sim->physical_params.L, v->units);
+  s->tiles = g_malloc0 (gts_container_size (GTS_CONTAINER (sim))*sizeof (TileStats));
+  s->ntiles = 0;
+  gts_container_foreach (GTS_CONTAINER (sim), (GtsFunc) tile_extent, s);
+  gts_object_destroy (GTS_OBJECT (sim));
+  /* the tiles are sorted so that the result does not depend on the
+     order of the boxes in memory */
+  qsort (s->tiles, s->ntiles, sizeof (TileStats), tile_compare);
+
+  selection = s->selection;
+  selection.region = FALSE;
+  selection.single_box = TRUE;
+  selection.box = 0;
+  selection.max_depth = 0;
+  sim = stream_read (s->fname2, &selection);
+  stream_variable (sim, s->name, s->fname2);
+  gts_object_destroy (GTS_OBJECT (sim));
+}
+
+static void tile_stats (FttCell * cell, gpointer * data)
+{
+  GfsVariable * v = data[0];
+  GfsNorm * n = data[1];
+  GtsRange * s = data[2];
+  FttVector * min = data[3], * max = data[4];
+
+  if (min) {
+    /* only count the cells whose center is within the tile */
+    FttVector p;
+    FttComponent c;
+
+    ftt_cell_pos (cell, &p);
+    gfs_simulation_map_inverse (GFS_SIMULATION (v->domain), &p);
+    for (c = 0; c < FTT_DIMENSION; c++)
+      if ((&p.x)[c] < (&min->x)[c] || (&p.x)[c] >= (&max->x)[c])
+	return;
+  }
+  gdouble val = GFS_VALUE (cell, v);
+  gfs_norm_add (n, val, gfs_cell_volume (cell, v->domain));
+  if (val != GFS_NODATA)
+    gts_range_add_value (s, val);
+}
+
+static void stream_tile (Stream * s, guint k)
+{
+  TileStats * t = &s->tiles[k];
+  GfsReadSelection selection = s->selection;
+  FttComponent c;
+
+  gfs_norm_init (&t->n1);
+  gfs_norm_init (&t->n2);
+  gfs_norm_init (&t->error);
+  gts_range_init (&t->s1);
+  gts_range_init (&t->s2);
+  t->size = 0;
+
+  /* the box of FILE1 is the only one intersecting the central part
+     of the tile */
+  selection.region = TRUE;
+  for (c = 0; c < FTT_DIMENSION; c++) {
+    gdouble q = ((&t->max.x)[c] - (&t->min.x)[c])/4.;
+    (&selection.min.x)[c] = (&t->min.x)[c] + q;
+    (&selection.max.x)[c] = (&t->max.x)[c] - q;
+  }
+  GfsSimulation * s1 = stream_read (s->fname1, &selection);
+  GfsVariable * var1 = stream_variable (s1, s->name, s->fname1);
+  GfsBox * box = NULL;
+  gts_container_foreach (GTS_CONTAINER (s1), (GtsFunc) first_box, &box);
+  g_assert (box != NULL && gts_container_size (GTS_CONTAINER (s1)) == 1);
+
+  /* only read the boxes of FILE2 overlapping the tile (i.e. not the
+     boxes only touching it) */
+  selection = s->selection;
+  selection.region = TRUE;
+  for (c = 0; c < FTT_DIMENSION; c++) {
+    gdouble eps = 1e-6*((&t->max.x)[c] - (&t->min.x)[c]);
+    (&selection.min.x)[c] = (&t->min.x)[c] + eps;
+    (&selection.max.x)[c] = (&t->max.x)[c] - eps;
+  }
+  GfsSimulation * s2 = stream_read (s->fname2, &selection);
+  GfsVariable * var2 = stream_variable (s2, s->name, s->fname2);
+
+  gpointer data[8];
+  data[0] = var1;
+  data[1] = &t->n1;
+  data[2] = &t->s1;
+  data[3] = data[4] = NULL;
+  gfs_domain_traverse_leaves (GFS_DOMAIN (s1), (FttCellTraverseFunc) tile_stats, data);
+  data[0] = var2;
+  data[1] = &t->n2;
+  data[2] = &t->s2;
+  data[3] = &t->min;
+  data[4] = &t->max;
+  gfs_domain_traverse_leaves (GFS_DOMAIN (s2), (FttCellTraverseFunc) tile_stats, data);
+  t->size = t->s1.n;
+
+  gfs_domain_cell_traverse (GFS_DOMAIN (s1), 
+			    FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
+			    (FttCellTraverseFunc) gfs_get_from_below_intensive, var1);
+  gfs_domain_cell_traverse (GFS_DOMAIN (s2), 
+			    FTT_POST_ORDER, FTT_TRAVERSE_NON_LEAFS, -1,
+			    (FttCellTraverseFunc) gfs_get_from_below_intensive, var2);
+  GfsVariable * e = gfs_temporary_variable (GFS_DOMAIN (s1));
+  difference_tree (box->root, GFS_DOMAIN (s2), var1, var2, e, 0.);
+
+  gboolean no = FALSE;
+  gdouble constant = 0.;
+  data[0] = &s->full;
+  data[1] = &t->error;
+  data[2] = &no;
+  data[3] = &no;
+  data[4] = &s->weighted;
+  data[5] = &constant;
+  data[6] = &s->mixed;
+  data[7] = e;
+  gfs_domain_cell_traverse (GFS_DOMAIN (s1), 
+			    FTT_PRE_ORDER, FTT_TRAVERSE_LEAFS, -1,
+			    (FttCellTraverseFunc) difference, data);
+
+  gts_object_destroy (GTS_OBJECT (s1));
+  gts_object_destroy (GTS_OBJECT (s2));
+}
+
+static gpointer stream_worker (Stream * s)
+{
+  gint k;
+  while ((k = g_atomic_int_add (&s->next, 1)) < (gint) s->ntiles)
+    stream_tile (s, k);
+  return NULL;
+}
+
+static void norm_merge (GfsNorm * n, const GfsNorm * m)
+{
+  n->bias += m->bias;
+  n->first += m->first;
+  n->second += m->second;
+  n->w += m->w;
+  if (m->infty > n->infty)
+    n->infty = m->infty;
+}
+
+static void range_merge (GtsRange * r, const GtsRange * s)
+{
+  if (s->min < r->min) r->min = s->min;
+  if (s->max > r->max) r->max = s->max;
+  r->sum += s->sum;
+  r->sum2 += s->sum2;
+  r->n += s->n;
+}
+
+static void print_stats (const gchar * fname, GfsNorm * norm, GtsRange * s, gdouble f)
+{
+  gfs_norm_update (norm);
+  gts_range_update (s);
+  fprintf (stderr, 
+	   "%s:\n"
+	   "  first: %g second: %g infty: %g w: %g\n"
+	   "  min: %g avg: %g | %g max: %g\n",
+	   fname, 
+	   norm->first*f, norm->second*f, norm->infty*f, norm->w,
+	   s->min*f, s->mean*f, s->stddev*f, s->max*f);
+}
+
+/* Compares FILE1 and FILE2 box by box using @nthreads threads */
+static void stream_compare (Stream * s, guint nthreads, gboolean verbose)
+{
+  GTimer * timer = g_timer_new ();
+  GThread ** threads = g_malloc (nthreads*sizeof (GThread *));
+  guint i;
+
+  g_timer_start (timer);
+  stream_tiles (s);
+  s->next = 0;
+  for (i = 0; i < nthreads; i++)
+    threads[i] = g_thread_new ("gfscompare", (GThreadFunc) stream_worker, s);
+  for (i = 0; i < nthreads; i++)
+    g_thread_join (threads[i]);
+  gdouble elapsed = g_timer_elapsed (timer, NULL);
+
+  /* the partial norms are combined in the order of the boxes so that
+     the result does not depend on the number of threads */
+  TileStats total;
+  gfs_norm_init (&total.n1);
+  gfs_norm_init (&total.n2);
+  gfs_norm_init (&total.error);
+  gts_range_init (&total.s1);
+  gts_range_init (&total.s2);
+  total.size = 0;
+  for (i = 0; i < s->ntiles; i++) {
+    TileStats * t = &s->tiles[i];
+    norm_merge (&total.n1, &t->n1);
+    norm_merge (&total.n2, &t->n2);
+    norm_merge (&total.error, &t->error);
+    range_merge (&total.s1, &t->s1);
+    range_merge (&total.s2, &t->s2);
+    total.size += t->size;
+  }
+  gfs_norm_update (&total.error);
+
+  if (verbose) {
+    print_stats (s->fname1, &total.n1, &total.s1, s->f);
+    print_stats (s->fname2, &total.n2, &total.s2, s->f);
+    fprintf (stderr, 
+	     "total err first: %10.3e second: %10.3e infty: %10.3e w: %g\n",
+	     total.error.first*s->f, total.error.second*s->f, total.error.infty*s->f,
+	     total.error.w);
+    fprintf (stderr,
+	     "%u boxes, %u cells in %g seconds using %u threads: %g cells/s\n",
+	     s->ntiles, total.size, elapsed, nthreads, 
+	     elapsed > 0. ? total.size/elapsed : 0.);
+  }
+
+  g_free (s->tiles);
+  g_free (threads);
+  g_timer_destroy (timer);
+}
+
 int main (int argc, char * argv[])
 {
   GtsFile * fp;
@@ -340,6 +672,10 @@ int main (int argc, char * argv[])
 #endif /* FTT_2D */
   gdouble min = G_MAXDOUBLE, max = - G_MAXDOUBLE;
   gboolean mixed = FALSE;
+  GfsReadSelection selection = { FALSE };
+  guint nthreads = 0;
+
+  selection.max_depth = -1;
 
   gfs_init (&argc, &argv);
 
@@ -369,13 +705,16 @@ int main (int argc, char * argv[])
       {"centered", no_argument, NULL, 'c'},
       {"not-weighted", no_argument, NULL, 'w'},
       {"constant", no_argument, NULL, 'C'},
+      {"region", required_argument, NULL, 'B'},
+      {"depth", required_argument, NULL, 'D'},
+      {"threads", required_argument, NULL, 'j'},
       { NULL }
     };
     int option_index = 0;
-    switch ((c = getopt_long (argc, argv, "hvnog:f:lSrHp:cwCeaGm:M:xt",
+    switch ((c = getopt_long (argc, argv, "hvnog:f:lSrHp:cwCeaGm:M:xtB:D:j:",
 			      long_options, &option_index))) {
 #else /* not HAVE_GETOPT_LONG */
-    switch ((c = getopt (argc, argv, "hvnog:f:lSrHp:cwCeaGm:M:xt"))) {
+    switch ((c = getopt (argc, argv, "hvnog:f:lSrHp:cwCeaGm:M:xtB:D:j:"))) {
 #endif /* not HAVE_GETOPT_LONG */
 #if FTT_2D
     case 'G': /* gnuplot */
@@ -388,6 +727,39 @@ int main (int argc, char * argv[])
     case 'x': /* mixed */
       mixed = TRUE;
       break;
+    case 'B': { /* region */
+      gchar * s = strtok (optarg, ",");
+      guint i = 0;
+
+      while (i < 3 && s != NULL) {
+	(&selection.min.x)[i++] = atof (s);
+	s = strtok (NULL, ",");
+      }
+      while (i < 6 && s != NULL) {
+	(&selection.max.x)[i++ - 3] = atof (s);
+	s = strtok (NULL, ",");
+      }
+      if (i != 6) {
+	fprintf (stderr, 
+		 "gfscompare: expecting six numbers for option `--region'\n"
+		 "Try `gfscompare --help' for more information.\n");
+	return 1; /* failure */
+      }
+      selection.region = TRUE;
+      break;
+    }
+    case 'D': /* depth */
+      selection.max_depth = atoi (optarg);
+      break;
+    case 'j': /* threads */
+      if (atoi (optarg) < 1) {
+	fprintf (stderr, 
+		 "gfscompare: invalid argument for option `threads'.\n"
+		 "Try `gfscompare --help' for more information.\n");
+	return 1; /* failure */
+      }
+      nthreads = atoi (optarg);
+      break;
     case 'm': /* min */
       min = atof (optarg);
       break;
@@ -471,6 +843,13 @@ int main (int argc, char * argv[])
      "  -r    --refined     display error norm on the finest grid\n"
      "  -n    --nocheck     do not check solid fractions\n"
      "  -g C  --gradient=C  use the C component of the gradient of VAR\n"
+     "  -B x,.. --region=x0,y0,z0,x1,y1,z1 only read the boxes of FILE1 and FILE2\n"
+     "                      intersecting the given region\n"
+     "  -D L  --depth=L     only read cells up to level L of FILE1 and FILE2\n"
+     "  -j N  --threads=N   compare the files box by box using N threads, only\n"
+     "                      keeping in memory the boxes being compared (the files\n"
+     "                      must contain a box index, cannot be used with -C, -c,\n"
+     "                      -p, -H, -o, -S, -r, -g, -G or -t)\n"
      "  -v    --verbose     display difference statistics and other info\n"
      "  -h    --help        display this help and exit\n"
      "\n"
@@ -507,6 +886,26 @@ int main (int argc, char * argv[])
     return 1; /* failure */
   }
   name = argv[optind++];
+  /* only VAR is needed (for compressed files) */
+  selection.variables = name;
+
+  if (nthreads > 0) {
+    if (constant || centered || period != 0. || histogram || output || squares ||
+	refined_error || gradient < FTT_DIMENSION
+#if FTT_2D
+	|| gnuplot || triangulate
+#endif /* FTT_2D */
+	) {
+      fprintf (stderr, 
+	       "gfscompare: option `threads' cannot be used with the options\n"
+	       "modifying or outputting the error field\n"
+	       "Try `gfscompare --help' for more information.\n");
+      return 1; /* failure */
+    }
+    Stream s = { fname1, fname2, name, selection, full, weighted, mixed };
+    stream_compare (&s, nthreads, verbose);
+    return 0;
+  }
 
   f = fopen (fname1, "rt");
   if (f == NULL) {
@@ -514,7 +913,7 @@ int main (int argc, char * argv[])
     return 1;
   }
   fp = gts_file_new (f);
-  if (!(s1 = gfs_simulation_read (fp))) {
+  if (!(s1 = gfs_simulation_read_selection (fp, &selection))) {
     fprintf (stderr, 
 	     "gfscompare: file `%s' is not a valid simulation file\n"
 	     "%s:%d:%d: %s\n",
@@ -531,7 +930,7 @@ int main (int argc, char * argv[])
     return 1;
   }
   fp = gts_file_new (f);
-  if (!(s2 = gfs_simulation_read (fp))) {
+  if (!(s2 = gfs_simulation_read_selection (fp, &selection))) {
     fprintf (stderr, 
 	     "gfscompare: file `%s' is not a valid simulation file\n"
 	     "%s:%d:%d: %s\n",